@@ -29,6 +29,10 @@
 #include "bitreader.h"
 #include "jpegparser.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define READ_UINT8(reader, val) {                           \
     if (!byte_reader_get_uint8 ((reader), &(val))) {        \
       WARNING ("failed to read uint8_t");                 \
@@ -210,6 +214,27 @@ jpeg_scan_for_marker_code (const uint8_t * data, size_t size, uint32_t offset)
   RETURN_VAL_IF_FAIL (data != NULL, -1);
 
   i = offset + 1;
+#if defined(__SSE2__)
+  /* entropy coded data is mostly free of 0xff, skip 16 bytes at a time */
+  {
+    const __m128i ff = _mm_set1_epi8 ((char) 0xff);
+    while (i + 15 <= size) {
+      int mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((const
+                      __m128i *) (data + i - 1)), ff));
+      if (!mask) {
+        i += 16;
+        continue;
+      }
+      /* i is the byte after the first 0xff */
+      i += __builtin_ctz (mask);
+      if (i >= size)
+        return -1;
+      if (data[i] >= 0xc0 && data[i] < 0xff)
+        return i - 1;
+      i++;
+    }
+  }
+#endif
   while (i < size) {
     const uint8_t v = data[i];
     if (v < 0xc0)
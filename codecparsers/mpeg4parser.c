@@ -198,29 +198,43 @@ failed:
   return FALSE;
 }
 
+/* dmv_code of 7.8.4, the msb being 0 means a negative value */
 static BOOL
-parse_sprite_trajectory (BitReader * br,
-    Mpeg4SpriteTrajectory * sprite_traj, uint32_t no_of_sprite_warping_points)
+parse_sprite_dmv (BitReader * br, int16_t * dmv)
 {
-  uint32_t i, length;
+  uint32_t length;
+  uint16_t code;
 
-  for (i = 0; i < no_of_sprite_warping_points; i++) {
+  if (!decode_vlc (br, &length, mpeg4_dmv_size_vlc_table,
+        ARRAY_N_ELEMENT(mpeg4_dmv_size_vlc_table)))
+    goto failed;
 
-    if (!decode_vlc (br, &length, mpeg4_dmv_size_vlc_table,
-          ARRAY_N_ELEMENT(mpeg4_dmv_size_vlc_table)))
-      goto failed;
+  *dmv = 0;
+  if (length) {
+    READ_UINT16 (br, code, length);
+    if (code >> (length - 1))
+      *dmv = code;
+    else
+      *dmv = (int16_t) code - (1 << length) + 1;
+  }
+  CHECK_MARKER (br);
+  return TRUE;
 
-    if (length)
-      READ_UINT16 (br, sprite_traj->vop_ref_points[i], length);
-    CHECK_MARKER (br);
+failed:
+  return FALSE;
+}
 
-    if (!decode_vlc (br, &length, mpeg4_dmv_size_vlc_table,
-          ARRAY_N_ELEMENT(mpeg4_dmv_size_vlc_table)))
-     goto failed;
+static BOOL
+parse_sprite_trajectory (BitReader * br,
+    Mpeg4SpriteTrajectory * sprite_traj, uint32_t no_of_sprite_warping_points)
+{
+  uint32_t i;
 
-    if (length)
-      READ_UINT16 (br, sprite_traj->sprite_ref_points[i], length);
-    CHECK_MARKER (br);
+  for (i = 0; i < no_of_sprite_warping_points; i++) {
+    if (!parse_sprite_dmv (br, &sprite_traj->vop_ref_points[i]))
+      goto failed;
+    if (!parse_sprite_dmv (br, &sprite_traj->sprite_ref_points[i]))
+      goto failed;
   }
 
   return TRUE;
@@ -1314,12 +1328,15 @@ mpeg4_parse_video_object_plane (Mpeg4VideoObjectPlane * vop,
   MARKER_UNCHECKED (&br);
 
   vop->coded = bit_reader_get_bits_uint8_unchecked (&br, 1);
-  if (!vop->coded)
+  if (!vop->coded) {
+    vop->size = bit_reader_get_pos (&br);
     return MPEG4_PARSER_OK;
+  }
 
   if (vol->newpred_enable) {
     uint16_t nbbits =
-        vop->time_increment + 3 < 15 ? vop->time_increment + 3 : 15;
+        vol->vop_time_increment_bits + 3 < 15 ?
+        vol->vop_time_increment_bits + 3 : 15;
 
     READ_UINT16 (&br, vop->id, nbbits);
     READ_UINT8 (&br, vop->id_for_prediction_indication, 1);
@@ -1337,8 +1354,8 @@ mpeg4_parse_video_object_plane (Mpeg4VideoObjectPlane * vop,
     READ_UINT8 (&br, vop->rounding_type, 1);
 
   if ((vol->reduced_resolution_vop_enable) &&
-      (vol->shape == MPEG4_RECTANGULAR ||
-          (vop->coding_type = MPEG4_P_VOP ||
+      (vol->shape == MPEG4_RECTANGULAR &&
+          (vop->coding_type == MPEG4_P_VOP ||
               vop->coding_type == MPEG4_I_VOP)))
     READ_UINT8 (&br, vop->reduced_resolution, 1);
 
@@ -1644,18 +1661,15 @@ mpeg4_parse_video_packet_header (Mpeg4VideoPacketHdr * videopackethdr,
     READ_UINT8 (&br, videopackethdr->header_extension_code, 1);
 
   if (videopackethdr->header_extension_code) {
-    uint32_t timeincr = 0;
     uint8_t bit = 0, coding_type;
 
+    /* modulo_time_base, the vop header already gave it */
     do {
       READ_UINT8 (&br, bit, 1);
-      timeincr++;
     } while (bit);
 
-    vol->vop_time_increment_bits = timeincr;
-
     CHECK_MARKER (&br);
-    READ_UINT16 (&br, vop->time_increment, timeincr);
+    READ_UINT16 (&br, vop->time_increment, vol->vop_time_increment_bits);
     CHECK_MARKER (&br);
     READ_UINT8 (&br, coding_type, 2);
     vop->coding_type = coding_type;
@@ -1697,7 +1711,8 @@ mpeg4_parse_video_packet_header (Mpeg4VideoPacketHdr * videopackethdr,
 
   if (vol->newpred_enable) {
     uint16_t nbbits =
-        vol->vop_time_increment_bits + 3 < 15 ? vop->time_increment + 3 : 15;
+        vol->vop_time_increment_bits + 3 < 15 ?
+        vol->vop_time_increment_bits + 3 : 15;
 
     READ_UINT16 (&br, vop->id, nbbits);
     READ_UINT8 (&br, vop->id_for_prediction_indication, 1);
@@ -1710,6 +1725,8 @@ mpeg4_parse_video_packet_header (Mpeg4VideoPacketHdr * videopackethdr,
 
   videopackethdr->size = bit_reader_get_pos (&br);
 
+  return MPEG4_PARSER_OK;
+
 failed:
   DEBUG ("Failed to parse video packet header \n");
 
@@ -426,8 +426,8 @@ struct _Mpeg4VideoObjectLayer {
  * 6.2.5.4 Sprite coding
  */
 struct _Mpeg4SpriteTrajectory {
-  uint16_t vop_ref_points[63]; /* Defined as "du" in 6.2.5.4 */
-  uint16_t sprite_ref_points[63]; /* Defined as "dv" in 6.2.5.4 */
+  int16_t vop_ref_points[63]; /* Defined as "du" in 6.2.5.4 */
+  int16_t sprite_ref_points[63]; /* Defined as "dv" in 6.2.5.4 */
 };
 
 /**
@@ -535,49 +535,49 @@ struct _Mpeg4Packet
   Mpeg4StartCode type;
 };
 
-Mpeg4ParseResult gst_h263_parse       (Mpeg4Packet * packet,
+Mpeg4ParseResult h263_parse           (Mpeg4Packet * packet,
                                        const uint8_t * data, uint32_t offset,
                                        size_t size);
 
 
-Mpeg4ParseResult gst_mpeg4_parse      (Mpeg4Packet * packet,
+Mpeg4ParseResult mpeg4_parse          (Mpeg4Packet * packet,
                                        BOOL skip_user_data,
                                        Mpeg4VideoObjectPlane *vop,
                                        const uint8_t * data, uint32_t offset,
                                        size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_video_object_plane       (Mpeg4VideoObjectPlane *vop,
-                                          Mpeg4SpriteTrajectory *sprite_trajectory,
-                                          Mpeg4VideoObjectLayer *vol,
-                                          const uint8_t * data,
-                                          size_t size);
+mpeg4_parse_video_object_plane       (Mpeg4VideoObjectPlane *vop,
+                                      Mpeg4SpriteTrajectory *sprite_trajectory,
+                                      Mpeg4VideoObjectLayer *vol,
+                                      const uint8_t * data,
+                                      size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_group_of_vop             (Mpeg4GroupOfVOP *gov,
-                                          const uint8_t * data, size_t size);
+mpeg4_parse_group_of_vop             (Mpeg4GroupOfVOP *gov,
+                                      const uint8_t * data, size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_video_object_layer       (Mpeg4VideoObjectLayer *vol,
-                                          Mpeg4VisualObject *vo,
-                                          const uint8_t * data, size_t size);
+mpeg4_parse_video_object_layer       (Mpeg4VideoObjectLayer *vol,
+                                      Mpeg4VisualObject *vo,
+                                      const uint8_t * data, size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_visual_object            (Mpeg4VisualObject *vo,
-                                          Mpeg4VideoSignalType *signal_type,
-                                          const uint8_t * data, size_t size);
+mpeg4_parse_visual_object            (Mpeg4VisualObject *vo,
+                                      Mpeg4VideoSignalType *signal_type,
+                                      const uint8_t * data, size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_visual_object_sequence   (Mpeg4VisualObjectSequence *vos,
-                                          const uint8_t * data, size_t size);
+mpeg4_parse_visual_object_sequence   (Mpeg4VisualObjectSequence *vos,
+                                      const uint8_t * data, size_t size);
 Mpeg4ParseResult
-gst_mpeg4_parse_video_plane_short_header (Mpeg4VideoPlaneShortHdr * shorthdr,
-                                          const uint8_t * data, size_t size);
+mpeg4_parse_video_plane_short_header (Mpeg4VideoPlaneShortHdr * shorthdr,
+                                      const uint8_t * data, size_t size);
 
 Mpeg4ParseResult
-gst_mpeg4_parse_video_packet_header      (Mpeg4VideoPacketHdr * videopackethdr,
-                                          Mpeg4VideoObjectLayer * vol,
-                                          Mpeg4VideoObjectPlane * vop,
+mpeg4_parse_video_packet_header      (Mpeg4VideoPacketHdr * videopackethdr,
+                                      Mpeg4VideoObjectLayer * vol,
+                                      Mpeg4VideoObjectPlane * vop,
                                           Mpeg4SpriteTrajectory * sprite_trajectory,
                                           const uint8_t * data, size_t size);
 
@@ -237,7 +237,8 @@ mpeg_video_parse (MpegVideoPacket * packet,
   size -= off + 4;
   off = scan_for_start_codes (&br, 0, size);
 
-  if (off > 0)
+  /* packet may be empty, e.g. sequence end code */
+  if (off >= 0)
     packet->size = off;
 
   return TRUE;
@@ -295,7 +296,7 @@ mpeg_video_parse_sequence_header (MpegVideoSequenceHdr * seqhdr,
     seqhdr->bitrate = 0;
   } else {
     /* Value in header is in units of 400 bps */
-    seqhdr->bitrate *= 400;
+    seqhdr->bitrate = seqhdr->bitrate_value * 400;
   }
 
   READ_UINT8 (&br, bits, 1);
@@ -811,6 +812,133 @@ failed:
   return FALSE;
 }
 
+/* macroblock_address_increment vlc, table B-1 */
+typedef struct
+{
+  uint16_t code;
+  uint8_t len;
+  uint8_t value;
+} MbAddrIncVlc;
+
+#define MB_ADDR_INC_ESCAPE 0xfe
+#define MB_ADDR_INC_STUFFING 0xff
+
+static const MbAddrIncVlc mb_addr_inc_table[] = {
+  {0x1, 1, 1}, {0x3, 3, 2}, {0x2, 3, 3}, {0x3, 4, 4},
+  {0x2, 4, 5}, {0x3, 5, 6}, {0x2, 5, 7}, {0x7, 7, 8},
+  {0x6, 7, 9}, {0xb, 8, 10}, {0xa, 8, 11}, {0x9, 8, 12},
+  {0x8, 8, 13}, {0x7, 8, 14}, {0x6, 8, 15}, {0x17, 10, 16},
+  {0x16, 10, 17}, {0x15, 10, 18}, {0x14, 10, 19}, {0x13, 10, 20},
+  {0x12, 10, 21}, {0x23, 11, 22}, {0x22, 11, 23}, {0x21, 11, 24},
+  {0x20, 11, 25}, {0x1f, 11, 26}, {0x1e, 11, 27}, {0x1d, 11, 28},
+  {0x1c, 11, 29}, {0x1b, 11, 30}, {0x1a, 11, 31}, {0x19, 11, 32},
+  {0x18, 11, 33}, {0x8, 11, MB_ADDR_INC_ESCAPE},
+  {0xf, 11, MB_ADDR_INC_STUFFING}
+};
+
+static BOOL
+decode_mb_addr_inc (BitReader * br, uint32_t * inc)
+{
+  uint32_t i, bits;
+  uint16_t code;
+
+  *inc = 0;
+  for (;;) {
+    /* the slice may end in less than 11 bits */
+    bits = bit_reader_get_remaining (br);
+    if (bits > 11)
+      bits = 11;
+    if (!bits || !bit_reader_peek_bits_uint16 (br, &code, bits))
+      return FALSE;
+    code <<= 11 - bits;
+    for (i = 0; i < N_ELEMENTS (mb_addr_inc_table); i++) {
+      const MbAddrIncVlc *vlc = &mb_addr_inc_table[i];
+      if ((code >> (11 - vlc->len)) == vlc->code)
+        break;
+    }
+    if (i == N_ELEMENTS (mb_addr_inc_table))
+      return FALSE;
+    if (!bit_reader_skip (br, mb_addr_inc_table[i].len))
+      return FALSE;
+    if (mb_addr_inc_table[i].value == MB_ADDR_INC_ESCAPE) {
+      *inc += 33;
+    } else if (mb_addr_inc_table[i].value != MB_ADDR_INC_STUFFING) {
+      *inc += mb_addr_inc_table[i].value;
+      return TRUE;
+    }
+  }
+}
+
+/**
+ * mpeg_video_parse_slice_header:
+ * @slice: (out): The #MpegVideoSliceHdr structure to fill
+ * @data: The data from which to parse the slice header
+ * @size: The size of @data
+ * @offset: The offset in byte from which to start the parsing
+ * @type: The slice start code
+ * @height: The vertical size of the sequence
+ *
+ * Parses the @slice Mpeg Video Slice Header structure members from @data,
+ * and the address increment of the first macroblock to find its column.
+ *
+ * Returns: %TRUE if the slice header could be parsed correctly, %FALSE
+ * otherwize.
+ */
+BOOL
+mpeg_video_parse_slice_header (MpegVideoSliceHdr * slice,
+    const uint8_t * data, size_t size, uint32_t offset, uint8_t type,
+    uint32_t height)
+{
+  BitReader br;
+  uint8_t extra_bit_slice;
+  uint32_t mb_inc;
+
+  RETURN_VAL_IF_FAIL (slice != NULL, FALSE);
+  RETURN_VAL_IF_FAIL (MPEG_VIDEO_PACKET_IS_SLICE (type), FALSE);
+
+  if (size <= offset)
+    return FALSE;
+
+  size -= offset;
+  bit_reader_init (&br, &data[offset], size);
+
+  slice->vertical_position = type - 1;
+  slice->vertical_position_ext = 0;
+  if (height > 2800)
+    READ_UINT8 (&br, slice->vertical_position_ext, 3);
+
+  READ_UINT8 (&br, slice->quantiser_scale_code, 5);
+
+  READ_UINT8 (&br, slice->intra_slice_flag, 1);
+  slice->intra_slice = 0;
+  if (slice->intra_slice_flag) {
+    READ_UINT8 (&br, slice->intra_slice, 1);
+    /* slice_picture_id_enable, slice_picture_id */
+    if (!bit_reader_skip (&br, 7))
+      goto failed;
+    READ_UINT8 (&br, extra_bit_slice, 1);
+    while (extra_bit_slice) {
+      /* extra_information_slice */
+      if (!bit_reader_skip (&br, 8))
+        goto failed;
+      READ_UINT8 (&br, extra_bit_slice, 1);
+    }
+  }
+  slice->header_size = bit_reader_get_pos (&br);
+
+  if (!decode_mb_addr_inc (&br, &mb_inc))
+    goto failed;
+
+  slice->mb_row = (slice->vertical_position_ext << 7) + slice->vertical_position;
+  slice->mb_column = mb_inc - 1;
+
+  return TRUE;
+
+failed:
+  WARNING ("error parsing \"Slice Header\"");
+  return FALSE;
+}
+
 /**
  * mpeg_video_quant_matrix_get_raster_from_zigzag:
  * @out_quant: (out): The resulting quantization matrix
@@ -30,6 +30,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stddef.h>
 #include <stdint.h>
 #include "common/common_def.h"
 /**
@@ -177,6 +178,7 @@ typedef struct _MpegVideoPictureHdr      MpegVideoPictureHdr;
 typedef struct _MpegVideoGop             MpegVideoGop;
 typedef struct _MpegVideoPictureExt      MpegVideoPictureExt;
 typedef struct _MpegVideoQuantMatrixExt  MpegVideoQuantMatrixExt;
+typedef struct _MpegVideoSliceHdr        MpegVideoSliceHdr;
 typedef struct _MpegVideoPacket          MpegVideoPacket;
 
 /**
@@ -379,6 +381,35 @@ struct _MpegVideoGop
   uint8_t broken_link;
 };
 
+/**
+ * MpegVideoSliceHdr:
+ * @vertical_position: slice start code minus one
+ * @vertical_position_ext: slice_vertical_position_extension, only present
+ *  when vertical size is larger than 2800
+ * @quantiser_scale_code: Quantiser scale code
+ * @intra_slice_flag: %TRUE if intra_slice is present
+ * @intra_slice: %TRUE if all macroblocks of the slice are intra coded
+ * @header_size: size of the slice header in bits, start code not included,
+ *  it is the offset of the first macroblock
+ * @mb_row: macroblock row of the first macroblock
+ * @mb_column: macroblock column of the first macroblock
+ *
+ * The Mpeg2 Video Slice Header structure, scalable extension is not supported.
+ */
+struct _MpegVideoSliceHdr
+{
+  uint8_t vertical_position;
+  uint8_t vertical_position_ext;
+  uint8_t quantiser_scale_code;
+  uint8_t intra_slice_flag;
+  uint8_t intra_slice;
+
+  /* Calculated values */
+  uint32_t header_size;
+  uint32_t mb_row;
+  uint32_t mb_column;
+};
+
 /**
  * MpegVideoTypeOffsetSize:
  *
@@ -397,41 +428,46 @@ struct _MpegVideoPacket
   int32_t   size;
 };
 
-BOOL gst_mpeg_video_parse                         (MpegVideoPacket * packet,
+BOOL mpeg_video_parse                         (MpegVideoPacket * packet,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_sequence_header         (MpegVideoSequenceHdr * params,
+BOOL mpeg_video_parse_sequence_header         (MpegVideoSequenceHdr * params,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
 /* seqext and displayext may be NULL if not received */
-BOOL gst_mpeg_video_finalise_mpeg2_sequence_header (MpegVideoSequenceHdr *hdr,
+BOOL mpeg_video_finalise_mpeg2_sequence_header (MpegVideoSequenceHdr *hdr,
    MpegVideoSequenceExt *seqext, MpegVideoSequenceDisplayExt *displayext);
 
-BOOL gst_mpeg_video_parse_picture_header          (MpegVideoPictureHdr* hdr,
+BOOL mpeg_video_parse_picture_header          (MpegVideoPictureHdr* hdr,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_picture_extension       (MpegVideoPictureExt *ext,
+BOOL mpeg_video_parse_picture_extension       (MpegVideoPictureExt *ext,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_gop                     (MpegVideoGop * gop,
+BOOL mpeg_video_parse_gop                     (MpegVideoGop * gop,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_sequence_extension      (MpegVideoSequenceExt * seqext,
+BOOL mpeg_video_parse_sequence_extension      (MpegVideoSequenceExt * seqext,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_sequence_display_extension (MpegVideoSequenceDisplayExt * seqdisplayext,
+BOOL mpeg_video_parse_sequence_display_extension (MpegVideoSequenceDisplayExt * seqdisplayext,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-BOOL gst_mpeg_video_parse_quant_matrix_extension  (MpegVideoQuantMatrixExt * quant,
+BOOL mpeg_video_parse_quant_matrix_extension  (MpegVideoQuantMatrixExt * quant,
                                                        const uint8_t * data, size_t size, uint32_t offset);
 
-void gst_mpeg_video_quant_matrix_get_raster_from_zigzag (uint8_t out_quant[64],
+/* @type is the slice start code, @height is the vertical size of the sequence */
+BOOL mpeg_video_parse_slice_header            (MpegVideoSliceHdr * slice,
+                                                       const uint8_t * data, size_t size, uint32_t offset,
+                                                       uint8_t type, uint32_t height);
+
+void mpeg_video_quant_matrix_get_raster_from_zigzag (uint8_t out_quant[64],
                                                              const uint8_t quant[64]);
 
-void gst_mpeg_video_quant_matrix_get_zigzag_from_raster (uint8_t out_quant[64],
+void mpeg_video_quant_matrix_get_zigzag_from_raster (uint8_t out_quant[64],
+                                                            const uint8_t quant[64]);
 
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
-                                                            const uint8_t quant[64]);
 #endif
@@ -84,7 +84,7 @@ static const VLCTable vc1_bfraction_vlc_table[] = {
   {VC1_BFRACTION_BASIS / 2, 0x00, 3},
   {VC1_BFRACTION_BASIS / 3, 0x01, 3},
   {(VC1_BFRACTION_BASIS * 2) / 3, 0x02, 3},
-  {VC1_BFRACTION_BASIS / 4, 0x02, 3},
+  {VC1_BFRACTION_BASIS / 4, 0x03, 3},
   {(VC1_BFRACTION_BASIS * 3) / 4, 0x04, 3},
   {VC1_BFRACTION_BASIS / 5, 0x05, 3},
   {(VC1_BFRACTION_BASIS * 2) / 5, 0x06, 3},
@@ -398,10 +398,12 @@ failed:
 /*** bitplanes decoding ***/
 static BOOL
 bitplane_decoding (BitReader * br, uint8_t * data,
-    VC1SeqHdr * seqhdr, uint8_t * is_raw)
+    VC1SeqHdr * seqhdr, BOOL field, uint8_t * is_raw)
 {
   const uint32_t width = seqhdr->mb_width;
-  const uint32_t height = seqhdr->mb_height;
+  /* A field picture only covers half of the macroblock rows */
+  const uint32_t height =
+      field ? (seqhdr->mb_height + 1) >> 1 : seqhdr->mb_height;
   const uint32_t stride = seqhdr->mb_stride;
   uint32_t imode, invert, invert_mask;
   uint32_t x, y, v, o;
@@ -870,6 +872,7 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
   VC1PicAdvanced *pic = &framehdr->pic.advanced;
   VC1EntryPointHdr *entrypthdr = &advhdr->entrypoint;
   uint8_t mvmodeidx;
+  BOOL field;
 
   DEBUG ("Parsing Frame header advanced %u", advhdr->interlace);
 
@@ -877,18 +880,25 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
   framehdr->profile = seqhdr->profile;
   framehdr->dquant = entrypthdr->dquant;
 
-  if (advhdr->interlace) {
-    int8_t fcm = decode012 (br);
+  /* The second field header starts after the first field elements,
+   * fcm, fptype and frame level fields are kept from the first one */
+  if (!field2) {
+    if (advhdr->interlace) {
+      int8_t fcm = decode012 (br);
 
-    if (fcm < 0)
-      goto failed;
+      if (fcm < 0)
+        goto failed;
 
-    pic->fcm = (uint8_t) fcm;
-  } else
-    pic->fcm = VC1_FRAME_PROGRESSIVE;
+      pic->fcm = (uint8_t) fcm;
+    } else
+      pic->fcm = VC1_FRAME_PROGRESSIVE;
+  }
+  field = pic->fcm == VC1_FIELD_INTERLACE;
+
+  if (field) {
+    if (!field2)
+      READ_UINT8 (br, pic->fptype, 3);
 
-  if (pic->fcm == VC1_FIELD_INTERLACE) {
-    READ_UINT8 (br, pic->fptype, 3);
     if (field2) {
       switch (pic->fptype) {
         case 0x00:
@@ -931,6 +941,9 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
   } else
     framehdr->ptype = (uint8_t) get_unary (br, 0, 4);
 
+  if (field2)
+    goto field_header;
+
   if (advhdr->tfcntrflag) {
     READ_UINT8 (br, pic->tfcntr, 8);
     DEBUG ("tfcntr %u", pic->tfcntr);
@@ -983,7 +996,8 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
       pic->refdist = 0;
   }
 
-  if (advhdr->finterpflag) {
+field_header:
+  if (advhdr->finterpflag && !field2) {
     READ_UINT8 (br, framehdr->interpfrm, 1);
     DEBUG ("interpfrm %u", framehdr->interpfrm);
   }
@@ -1044,12 +1058,12 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
     case VC1_PICTURE_TYPE_BI:
       if (pic->fcm == VC1_FRAME_INTERLACE) {
         if (!bitplane_decoding (br, bitplanes ? bitplanes->fieldtx : NULL,
-                seqhdr, &pic->fieldtx))
+                seqhdr, field, &pic->fieldtx))
           goto failed;
       }
 
       if (!bitplane_decoding (br, bitplanes ? bitplanes->acpred : NULL,
-              seqhdr, &pic->acpred))
+              seqhdr, field, &pic->acpred))
         goto failed;
 
       if (entrypthdr->overlap && framehdr->pquant <= 8) {
@@ -1060,7 +1074,7 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
 
         else if (pic->condover == VC1_CONDOVER_SELECT) {
           if (!bitplane_decoding (br, bitplanes ? bitplanes->overflags : NULL,
-                  seqhdr, &pic->overflags))
+                  seqhdr, field, &pic->overflags))
             goto failed;
 
           DEBUG ("overflags %u", pic->overflags);
@@ -1100,16 +1114,16 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
       if (pic->fcm == VC1_FIELD_INTERLACE) {
 
         if (!bitplane_decoding (br, bitplanes ? bitplanes->forwardmb : NULL,
-                seqhdr, &pic->forwardmb))
+                seqhdr, field, &pic->forwardmb))
           goto failed;
 
       } else {
         if (!bitplane_decoding (br, bitplanes ? bitplanes->directmb : NULL,
-                seqhdr, &pic->directmb))
+                seqhdr, field, &pic->directmb))
           goto failed;
 
         if (!bitplane_decoding (br, bitplanes ? bitplanes->skipmb : NULL,
-                seqhdr, &pic->skipmb))
+                seqhdr, field, &pic->skipmb))
           goto failed;
       }
 
@@ -1208,7 +1222,7 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
                   pic->mvmode2 == VC1_MVMODE_MIXED_MV)) {
 
             if (!bitplane_decoding (br, bitplanes ? bitplanes->mvtypemb : NULL,
-                    seqhdr, &pic->mvtypemb))
+                    seqhdr, field, &pic->mvtypemb))
               goto failed;
 
             DEBUG ("mvtypemb %u", pic->mvtypemb);
@@ -1218,7 +1232,7 @@ parse_frame_header_advanced (BitReader * br, VC1FrameHdr * framehdr,
 
       if (pic->fcm != VC1_FIELD_INTERLACE) {
         if (!bitplane_decoding (br, bitplanes ? bitplanes->skipmb : NULL,
-                seqhdr, &pic->skipmb))
+                seqhdr, field, &pic->skipmb))
           goto failed;
       }
 
@@ -1417,12 +1431,12 @@ parse_frame_header (BitReader * br, VC1FrameHdr * framehdr,
           (pic->mvmode == VC1_MVMODE_INTENSITY_COMP &&
               pic->mvmode2 == VC1_MVMODE_MIXED_MV)) {
         if (!bitplane_decoding (br, bitplanes ? bitplanes->mvtypemb : NULL,
-                seqhdr, &pic->mvtypemb))
+                seqhdr, FALSE, &pic->mvtypemb))
           goto failed;
         DEBUG ("mvtypemb %u", pic->mvtypemb);
       }
       if (!bitplane_decoding (br, bitplanes ? bitplanes->skipmb : NULL,
-              seqhdr, &pic->skipmb))
+              seqhdr, FALSE, &pic->skipmb))
         goto failed;
 
       READ_UINT8 (br, pic->mvtab, 2);
@@ -1453,11 +1467,11 @@ parse_frame_header (BitReader * br, VC1FrameHdr * framehdr,
     case VC1_PICTURE_TYPE_B:
       READ_UINT8 (br, pic->mvmode, 1);
       if (!bitplane_decoding (br, bitplanes ? bitplanes->directmb : NULL,
-              seqhdr, &pic->directmb))
+              seqhdr, FALSE, &pic->directmb))
         goto failed;
 
       if (!bitplane_decoding (br, bitplanes ? bitplanes->skipmb : NULL,
-              seqhdr, &pic->skipmb))
+              seqhdr, FALSE, &pic->skipmb))
         goto failed;
 
       READ_UINT8 (br, pic->mvtab, 2);
@@ -2011,6 +2025,7 @@ vc1_parse_field_header (const uint8_t * data, size_t size,
 
   result = parse_frame_header_advanced (&br, fieldhdr, seqhdr, bitplanes, TRUE);
 
+  fieldhdr->header_size = bit_reader_get_pos (&br);
   return result;
 }
 
@@ -127,11 +127,12 @@ typedef enum
   VC1_MVMODE_INTENSITY_COMP
 } VC1MvMode;
 
+/* values returned by decode012() for the FCM codes 0, 10 and 11 */
 typedef enum
 {
-  VC1_FRAME_PROGRESSIVE = 0x0,
-  VC1_FRAME_INTERLACE   = 0x10,
-  VC1_FIELD_INTERLACE   = 0x11
+  VC1_FRAME_PROGRESSIVE = 0,
+  VC1_FRAME_INTERLACE   = 1,
+  VC1_FIELD_INTERLACE   = 2
 } VC1FrameCodingMode;
 
 typedef struct _VC1SeqHdr            VC1SeqHdr;
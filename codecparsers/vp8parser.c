@@ -634,6 +634,22 @@ mv_prob_update (BOOL_DECODER * bool_decoder, Vp8FrameHdr * frame_hdr)
   return TRUE;
 }
 
+/* probabilities of this frame are dropped after it, keep a copy for the caller */
+static void
+save_entropy_probs (Vp8FrameHdr * frame_hdr)
+{
+  Vp8MultiFrameData *saved = frame_hdr->saved_multi_frame_data;
+
+  if (frame_hdr->refresh_entropy_probs || !saved)
+    return;
+
+  memcpy (&saved->token_prob_update,
+      &frame_hdr->multi_frame_data->token_prob_update,
+      sizeof (Vp8TokenProbUpdate));
+  memcpy (&saved->mv_prob_update, &frame_hdr->multi_frame_data->mv_prob_update,
+      sizeof (Vp8MvProbUpdate));
+}
+
 /**
  * vp8_parse_frame_header:
  * @frame_hdr: The #Vp8FrameHdr to fill
@@ -648,6 +664,8 @@ mv_prob_update (BOOL_DECODER * bool_decoder, Vp8FrameHdr * frame_hdr)
  * @frame->multi_frame_data should be set by caller, which constains
  * parameters inheriting from previous frame; parser may or may not
  * update them for current frame.
+ * if @frame->saved_multi_frame_data is set and the frame doesn't refresh
+ * entropy probs, probabilities before the updates go to it.
  *
  * Returns: a #Vp8ParseResult
  */
@@ -775,6 +793,8 @@ vp8_parse_frame_header (Vp8FrameHdr * frame_hdr, const uint8_t * data,
     READ_BIT (&bool_decoder, frame_hdr->refresh_last, "refresh_last");
   }
 
+  save_entropy_probs (frame_hdr);
+
   if (!token_prob_update (&bool_decoder, frame_hdr)) {
     goto error;
   }
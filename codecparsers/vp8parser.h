@@ -153,6 +153,10 @@ struct Vp8FrameHdr
   uint8_t intra_chroma_prob_update_flag;
   uint8_t intra_chroma_prob[3];
   Vp8MultiFrameData *multi_frame_data;
+  /* optional, set by caller. for a frame doesn't refresh entropy probs, token and mv
+   * probabilities before the updates of this frame are saved here, caller restores them
+   * after the frame. */
+  Vp8MultiFrameData *saved_multi_frame_data;
   Vp8RangeDecoderStatus rangedecoder_state;
 };
 
@@ -26,6 +26,9 @@
 #include "vaapi/vaapitypes.h"
 
 #include "lock.h"
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
 
 namespace YamiMediaCodec{
 
@@ -34,7 +37,12 @@ class Condition
 public:
     explicit Condition(Lock& lock):m_lock(lock)
     {
-        pthread_cond_init(&m_cond, NULL);
+        //timedWait() should not jump with wall clock
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&m_cond, &attr);
+        pthread_condattr_destroy(&attr);
     }
 
     ~Condition()
@@ -47,6 +55,22 @@ public:
         pthread_cond_wait(&m_cond, &m_lock.m_lock);
     }
 
+    /// deadline for timedWait(), @microseconds from now
+    static void getDeadline(uint64_t microseconds, struct timespec& deadline)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        uint64_t nsec = deadline.tv_nsec + (microseconds % 1000000) * 1000;
+        deadline.tv_sec += microseconds / 1000000 + nsec / 1000000000;
+        deadline.tv_nsec = nsec % 1000000000;
+    }
+
+    /// wait until @deadline, return false once it passes.
+    /// like wait(), it may return early, so call it in a loop checking the predicate.
+    bool timedWait(const struct timespec& deadline)
+    {
+        return pthread_cond_timedwait(&m_cond, &m_lock.m_lock, &deadline) != ETIMEDOUT;
+    }
+
     void signal()
     {
         pthread_cond_signal(&m_cond);
@@ -81,6 +81,7 @@ extern int isIni;
 #endif
 
 #ifndef ASSERT
+#include <assert.h>
 #define ASSERT(expr) assert(expr)
 #endif
 
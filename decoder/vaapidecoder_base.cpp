@@ -27,6 +27,8 @@
 #include "common/log.h"
 #include "vaapi/vaapicontext.h"
 #include "vaapi/vaapidisplay.h"
+#include "vaapi/vaapiimageutils.h"
+#include "vaapi/vaapisurface.h"
 #include "vaapi/vaapiutils.h"
 #include "vaapidecsurfacepool.h"
 #include <string.h>
@@ -151,6 +153,7 @@ void VaapiDecoderBase::flush(void)
 {
 
     INFO("base: flush()");
+    flushPictures();
     if (m_surfacePool) {
         m_surfacePool->flush();
     }
@@ -163,10 +166,15 @@ void VaapiDecoderBase::flush(void)
 
 void VaapiDecoderBase::flushOutport(void)
 {
+    if (flushPictures() != DECODE_SUCCESS)
+        ERROR("fail to decode current picture upon EOS");
 }
 
 const VideoRenderBuffer *VaapiDecoderBase::getOutput(bool draining)
 {
+    //not virtual, h264 drains its own dpb before calling here
+    if (draining)
+        VaapiDecoderBase::flushOutport();
     if (!m_surfacePool)
         return NULL;
     return m_surfacePool->getOutput();
@@ -220,9 +228,203 @@ void VaapiDecoderBase::renderDone(VideoRenderBuffer * renderBuf)
         ERROR("surface pool is not initialized yet");
         return;
     }
+    //drop the dma-buf fd and derived image if client exported the frame
+    VaapiSurface *surface = m_surfacePool->getSurface(renderBuf->surface);
+    if (surface)
+        surface->releaseExportedImage();
     m_surfacePool->recycle(renderBuf);
 }
 
+Decode_Status VaapiDecoderBase::exportFrame(const VideoRenderBuffer* buffer, VideoFrameDmaBuf* dmaBuf)
+{
+    if (!buffer || !dmaBuf || !m_surfacePool)
+        return RENDER_INVALID_PARAMETER;
+
+    VaapiSurface *surface = m_surfacePool->getSurface(buffer->surface);
+    if (!surface)
+        return RENDER_INVALID_PARAMETER;
+    if (!surface->sync())
+        return RENDER_FAIL;
+
+    VaapiImage *image = surface->getDerivedImage();
+    if (!image) {
+        ERROR("dma-buf export needs driver support vaDeriveImage");
+        return RENDER_FAIL;
+    }
+    uintptr_t handle;
+    if (!image->acquireBufferHandle(VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME, handle))
+        return RENDER_FAIL;
+
+    const VAImage& vaImage = image->getVAImage();
+    memset(dmaBuf, 0, sizeof(*dmaBuf));
+    dmaBuf->fd = (int32_t)handle;
+    dmaBuf->fourcc = vaImage.format.fourcc;
+    dmaBuf->width = vaImage.width;
+    dmaBuf->height = vaImage.height;
+    dmaBuf->numPlanes = vaImage.num_planes;
+    for (uint32_t i = 0; i < vaImage.num_planes && i < N_ELEMENTS(dmaBuf->pitch); i++) {
+        dmaBuf->pitch[i] = vaImage.pitches[i];
+        dmaBuf->offset[i] = vaImage.offsets[i];
+    }
+    dmaBuf->size = vaImage.data_size;
+    return RENDER_SUCCESS;
+}
+
+Decode_Status VaapiDecoderBase::getOutput(VideoFrameRawData* frame, bool draining)
+{
+    if (!frame)
+        return RENDER_INVALID_PARAMETER;
+    if (!m_rawOutput) {
+        ERROR("raw output is not enabled, set WANT_RAW_OUTPUT in start()");
+        return RENDER_INVALID_PARAMETER;
+    }
+
+    VideoRenderBuffer *renderBuffer = const_cast<VideoRenderBuffer*>(getOutput(draining));
+    if (!renderBuffer)
+        return RENDER_NO_AVAILABLE_FRAME;
+
+    Decode_Status status = RENDER_FAIL;
+    VaapiSurface *surface = m_surfacePool->getSurface(renderBuffer->surface);
+    if (surface && surface->sync()) {
+        frame->timeStamp = renderBuffer->timeStamp;
+        if (!frame->data) {
+            status = mapRawOutput(surface, frame);
+            if (status == RENDER_SUCCESS) {
+                //client holds the surface until renderDone(frame)
+                frame->handle = (intptr_t)renderBuffer;
+                return status;
+            }
+        } else {
+            status = copyRawOutput(surface, frame);
+        }
+    }
+    renderDone(renderBuffer);
+    return status;
+}
+
+void VaapiDecoderBase::renderDone(VideoFrameRawData* frame)
+{
+    if (!frame || !frame->handle)
+        return;
+    if (!m_surfacePool) {
+        ERROR("surface pool is not initialized yet");
+        return;
+    }
+    VideoRenderBuffer *renderBuffer = (VideoRenderBuffer*)frame->handle;
+    VaapiSurface *surface = m_surfacePool->getSurface(renderBuffer->surface);
+    if (surface && surface->getDerivedImage())
+        surface->getDerivedImage()->unmap();
+    frame->handle = 0;
+    frame->data = NULL;
+    renderDone(renderBuffer);
+}
+
+Decode_Status VaapiDecoderBase::mapRawOutput(VaapiSurface* surface, VideoFrameRawData* frame)
+{
+    VaapiImage *image = surface->getDerivedImage();
+    if (!image) {
+        ERROR("mapped raw output needs driver support vaDeriveImage");
+        return RENDER_FAIL;
+    }
+    VaapiImageRaw *raw = image->map();
+    if (!raw)
+        return RENDER_FAIL;
+
+    memset(frame->pitch, 0, sizeof(frame->pitch));
+    memset(frame->offset, 0, sizeof(frame->offset));
+    for (uint32_t i = 0; i < raw->numPlanes && i < N_ELEMENTS(frame->pitch); i++) {
+        frame->pitch[i] = raw->strides[i];
+        frame->offset[i] = raw->pixels[i] - raw->pixels[0];
+    }
+    frame->width = raw->width;
+    frame->height = raw->height;
+    frame->fourcc = raw->format;
+    frame->size = raw->size;
+    frame->data = raw->pixels[0];
+    frame->own = false;
+    return RENDER_SUCCESS;
+}
+
+Decode_Status VaapiDecoderBase::copyRawOutput(VaapiSurface* surface, VideoFrameRawData* frame)
+{
+    uint32_t fourcc = frame->fourcc ? frame->fourcc : VAAPI_IMAGE_NV12;
+    if (fourcc != VAAPI_IMAGE_NV12 && fourcc != VAAPI_IMAGE_I420
+        && fourcc != VAAPI_IMAGE_YV12) {
+        ERROR("unsupported raw output format %.4s", (char*)&fourcc);
+        return RENDER_INVALID_PARAMETER;
+    }
+
+    uint32_t width = surface->getWidth();
+    uint32_t height = surface->getHeight();
+    if (!frame->pitch[0]) {
+        //tightly packed planes
+        uint32_t chromaWidth = (width + 1) / 2;
+        uint32_t chromaHeight = (height + 1) / 2;
+        uint32_t lumaSize = width * height;
+        memset(frame->pitch, 0, sizeof(frame->pitch));
+        memset(frame->offset, 0, sizeof(frame->offset));
+        frame->pitch[0] = width;
+        if (fourcc == VAAPI_IMAGE_NV12) {
+            frame->pitch[1] = chromaWidth * 2;
+            frame->offset[1] = lumaSize;
+        } else {
+            frame->pitch[1] = frame->pitch[2] = chromaWidth;
+            frame->offset[1] = lumaSize;
+            frame->offset[2] = lumaSize + chromaWidth * chromaHeight;
+        }
+    }
+    //check every plane of the layout fits in the client buffer
+    uint32_t planes = fourcc == VAAPI_IMAGE_NV12 ? 2 : 3;
+    int64_t size = 0;
+    for (uint32_t i = 0; i < planes; i++) {
+        int32_t rowBytes = i ? (width + 1) / 2 * (fourcc == VAAPI_IMAGE_NV12 ? 2 : 1) : width;
+        int32_t rows = i ? (height + 1) / 2 : height;
+        if (frame->pitch[i] < rowBytes || frame->offset[i] < 0) {
+            ERROR("bad raw output layout, plane %d pitch %d offset %d", i, frame->pitch[i], frame->offset[i]);
+            return RENDER_INVALID_PARAMETER;
+        }
+        int64_t end = (int64_t)frame->offset[i] + (int64_t)frame->pitch[i] * (rows - 1) + rowBytes;
+        if (end > size)
+            size = end;
+    }
+    if (frame->size < size) {
+        ERROR("raw output buffer is %d bytes, need %d bytes", frame->size, (int32_t)size);
+        return RENDER_INVALID_PARAMETER;
+    }
+
+    VaapiImage *image = surface->getDerivedImage();
+    VaapiImageRaw *raw = image ? image->map() : NULL;
+    if (!raw) {
+        //fallback to vaGetImage
+        image = m_readbackImage.get();
+        if (!image || image->getWidth() != width || image->getHeight() != height) {
+            m_readbackImage.reset(new VaapiImage(m_display->getID(), VAAPI_IMAGE_NV12, width, height));
+            image = m_readbackImage.get();
+        }
+        if (image->getID() == VA_INVALID_ID || !surface->getImage(image))
+            return RENDER_FAIL;
+        raw = image->map();
+        if (!raw)
+            return RENDER_FAIL;
+    }
+
+    uint32_t pitches[3], offsets[3];
+    for (int i = 0; i < 3; i++) {
+        pitches[i] = frame->pitch[i];
+        offsets[i] = frame->offset[i];
+    }
+    bool ret = vaapiCopyImageRaw(raw, fourcc, frame->data, pitches, offsets);
+    image->unmap();
+    if (!ret)
+        return RENDER_FAIL;
+
+    frame->width = width;
+    frame->height = height;
+    frame->fourcc = fourcc;
+    frame->handle = 0;
+    return RENDER_SUCCESS;
+}
+
 Decode_Status VaapiDecoderBase::updateReference(void)
 {
     Decode_Status status;
@@ -326,6 +528,7 @@ Decode_Status
 Decode_Status VaapiDecoderBase::terminateVA(void)
 {
     INFO("base: terminate VA");
+    m_readbackImage.reset();
     m_surfacePool.reset();
     m_context.reset();
     m_display.reset();
@@ -382,4 +585,48 @@ Decode_Status VaapiDecoderBase::outputPicture(const PicturePtr& picture)
         picture->m_timeStamp)?DECODE_SUCCESS:DECODE_FAIL;
 }
 
+Decode_Status VaapiDecoderBase::updateContext(VAProfile profile, uint32_t width, uint32_t height)
+{
+    Decode_Status status;
+
+    // like vp8, only reset va context for a larger picture or a new profile
+    if (!m_VAStarted || profile != m_configBuffer.profile
+        || m_configBuffer.width < width || m_configBuffer.height < height) {
+        INFO("sequence changed, reconfig codec. orig size %d x %d, new size: %d x %d, profile %d",
+             m_configBuffer.width, m_configBuffer.height, width, height, profile);
+        m_configBuffer.profile = profile;
+        m_configBuffer.flag |= HAS_VA_PROFILE;
+        m_configBuffer.width = width;
+        m_configBuffer.height = height;
+        if (m_configBuffer.flag & USE_NATIVE_GRAPHIC_BUFFER) {
+            m_configBuffer.graphicBufferWidth = width;
+            m_configBuffer.graphicBufferHeight = height;
+        }
+
+        if (m_VAStarted) {
+            //references live in the surface pool we are going to destroy
+            clearReferences();
+            status = terminateVA();
+            if (status != DECODE_SUCCESS)
+                return status;
+        }
+
+        DEBUG("Start VA context");
+        status = VaapiDecoderBase::start(&m_configBuffer);
+        if (status != DECODE_SUCCESS)
+            return status;
+        return DECODE_FORMAT_CHANGE;
+    }
+
+    if (m_videoFormatInfo.width != width || m_videoFormatInfo.height != height) {
+        // notify client of resolution change, no need to reset hw context
+        INFO("frame size changed, orig size %d x %d, new size: %d x %d",
+             m_videoFormatInfo.width, m_videoFormatInfo.height, width, height);
+        m_videoFormatInfo.width = width;
+        m_videoFormatInfo.height = height;
+        return DECODE_FORMAT_CHANGE;
+    }
+    return DECODE_SUCCESS;
+}
+
 } //namespace YamiMediaCodec
@@ -46,6 +46,8 @@ namespace YamiMediaCodec{
 
 #define INVALID_PTS ((uint64_t)-1)
 
+template <class Picture> class VaapiRefDPB;
+
 class VaapiDecoderBase:public IVideoDecoder {
   public:
     typedef std::tr1::shared_ptr<VaapiDecPicture> PicturePtr;
@@ -65,6 +67,9 @@ class VaapiDecoderBase:public IVideoDecoder {
         , int frameX = -1, int frameY = -1, int frameWidth = -1, int frameHeight = -1);
     virtual const VideoFormatInfo *getFormatInfo(void);
     virtual void renderDone(VideoRenderBuffer * renderBuf);
+    virtual Decode_Status getOutput(VideoFrameRawData* frame, bool draining = false);
+    virtual void renderDone(VideoFrameRawData* frame);
+    virtual Decode_Status exportFrame(const VideoRenderBuffer* buffer, VideoFrameDmaBuf* dmaBuf);
 
     /* native window related functions */
     void setXDisplay(Display * xDisplay);
@@ -81,6 +86,16 @@ class VaapiDecoderBase:public IVideoDecoder {
     Decode_Status outputPicture(const PicturePtr& picture);
     SurfacePtr createSurface();
 
+    /* for decoders creating va context from stream headers (mpeg2, vc1, mpeg4):
+     * va context is only recreated for a larger picture or a new profile,
+     * clearReferences() is called before the old surfaces go away.
+     * DECODE_FORMAT_CHANGE means client should query the new format */
+    Decode_Status updateContext(VAProfile profile, uint32_t width, uint32_t height);
+    virtual void clearReferences() {}
+    /* decode the current picture and output the ones held for reordering,
+     * flush(), flushOutport() and draining getOutput() call it */
+    virtual Decode_Status flushPictures() { return DECODE_SUCCESS; }
+
     Display*   m_externalDisplay;
     DisplayPtr m_display;
     ContextPtr m_context;
@@ -113,8 +128,14 @@ class VaapiDecoderBase:public IVideoDecoder {
     uint64_t m_currentPTS;
 
   private:
+    template <class Picture> friend class VaapiRefDPB;
+    Decode_Status mapRawOutput(VaapiSurface*, VideoFrameRawData*);
+    Decode_Status copyRawOutput(VaapiSurface*, VideoFrameRawData*);
+
     bool m_lowDelay;
     bool m_rawOutput;
+    //used by copyRawOutput when the driver can't derive image
+    std::tr1::shared_ptr<VaapiImage> m_readbackImage;
     bool m_enableNativeBuffersFlag;
 };
 }
@@ -33,6 +33,16 @@
 #endif
 #if __BUILD_JPEG_DECODER__
 #include "vaapidecoder_jpeg.h"
+#include "vaapidecoder_jpeg_batch.h"
+#endif
+#if __BUILD_MPEG2_DECODER__
+#include "vaapidecoder_mpeg2.h"
+#endif
+#if __BUILD_VC1_DECODER__
+#include "vaapidecoder_vc1.h"
+#endif
+#if __BUILD_MPEG4_DECODER__
+#include "vaapidecoder_mpeg4.h"
 #endif
 #include "vaapi/vaapi_host.h"
 #include <string.h>
@@ -46,6 +56,18 @@ static const DecoderEntry g_decoderEntries[] = {
 #endif
 #if __BUILD_JPEG_DECODER__
     DEFINE_DECODER_ENTRY("image/jpeg", Jpeg),
+    DEFINE_DECODER_ENTRY("video/mjpeg", MJpeg),
+#endif
+#if __BUILD_MPEG2_DECODER__
+    DEFINE_DECODER_ENTRY("video/mpeg2", MPEG2),
+#endif
+#if __BUILD_VC1_DECODER__
+    DEFINE_DECODER_ENTRY("video/x-wmv", VC1),
+    DEFINE_DECODER_ENTRY("video/vc1", VC1),
+#endif
+#if __BUILD_MPEG4_DECODER__
+    DEFINE_DECODER_ENTRY("video/mpeg4", MPEG4),
+    DEFINE_DECODER_ENTRY("video/h263", MPEG4),
 #endif
 #if __BUILD_VP8_DECODER__
     DEFINE_DECODER_ENTRY("video/x-vnd.on2.vp8", VP8)
@@ -78,6 +100,26 @@ void releaseVideoDecoder(IVideoDecoder * p)
     delete p;
 }
 
+IImageBatchDecoder *createImageBatchDecoder(const char *mimeType)
+{
+    yamiTraceInit();
+    if (!mimeType) {
+        ERROR("NULL mime type.");
+        return NULL;
+    }
+#if __BUILD_JPEG_DECODER__
+    if (strcasecmp(mimeType, "image/jpeg") == 0)
+        return new VaapiJpegBatchDecoder();
+#endif
+    ERROR("Failed to create batch decoder for %s", mimeType);
+    return NULL;
+}
+
+void releaseImageBatchDecoder(IImageBatchDecoder * p)
+{
+    delete p;
+}
+
 bool preSandboxInitDecoder()
 {
     // TODO, for hybrid Decoder uses mediasdk, does the prework here
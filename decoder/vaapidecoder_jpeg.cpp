@@ -68,7 +68,33 @@ static uint32_t getMaxVerticalSamples(JpegFrameHdr * frameHdr)
     return maxFactor;
 }
 
-VaapiDecoderJpeg::VaapiDecoderJpeg()
+/* compare segments with the cached bytes of last frame, cache them if changed */
+static bool isSegmentsChanged(const std::vector<std::pair<uint8_t *, uint32_t> >& segments,
+                              std::vector<uint8_t>& cache)
+{
+    uint32_t i, size = 0;
+
+    for (i = 0; i < segments.size(); i++) {
+        if (size + segments[i].second > cache.size()
+            || memcmp(&cache[size], segments[i].first, segments[i].second))
+            break;
+        size += segments[i].second;
+    }
+    if (i == segments.size() && size == cache.size())
+        return false;
+
+    cache.clear();
+    for (i = 0; i < segments.size(); i++)
+        cache.insert(cache.end(), segments[i].first, segments[i].first + segments[i].second);
+    return true;
+}
+
+VaapiDecoderJpeg::VaapiDecoderJpeg(bool streamMode)
+    : m_maxSlices(0)
+    , m_fixedContext(false)
+    , m_streamMode(streamMode)
+    , m_vaHufTableValid(false)
+    , m_vaIqMatrixValid(false)
 {
     m_profile = VAAPI_PROFILE_JPEG_BASELINE;
     m_width = 0;
@@ -175,19 +201,11 @@ Decode_Status VaapiDecoderJpeg::fillPictureParam()
     return DECODE_SUCCESS;
 }
 
-Decode_Status
-    VaapiDecoderJpeg::fillSliceParam(JpegScanHdr * scanHdr,
-                                     uint8_t * scanData, uint32_t scanDataSize)
+void VaapiDecoderJpeg::setSliceComponents(VASliceParameterBufferJPEGBaseline * sliceParam,
+                                          JpegScanHdr * scanHdr)
 {
-
-    VASliceParameterBufferJPEGBaseline *sliceParam = NULL;
-    uint32_t totalHSamples, totalVSamples;
     uint32_t i;
 
-    assert(scanHdr);
-    if (!(m_picture->newSlice(sliceParam, scanData, scanDataSize)))
-        return DECODE_FAIL;
-
     sliceParam->num_components = scanHdr->num_components;
     for (i = 0; i < scanHdr->num_components; i++) {
         sliceParam->components[i].component_selector =
@@ -198,6 +216,75 @@ Decode_Status
             scanHdr->components[i].ac_selector;
     }
     sliceParam->restart_interval = m_mcuRestart;
+}
+
+Decode_Status
+    VaapiDecoderJpeg::fillRestartSlice(JpegScanHdr * scanHdr,
+                                       uint8_t * scanData, uint32_t scanDataSize,
+                                       uint32_t first, uint32_t count,
+                                       uint32_t mcusPerRow, uint32_t numMcus)
+{
+    VASliceParameterBufferJPEGBaseline *sliceParam = NULL;
+    uint32_t start, end, firstMcu;
+
+    /* interval k starts right after the k-th RST marker */
+    start = first ? m_restarts[first - 1] : 0;
+    if (first + count <= m_restarts.size())
+        end = m_restarts[first + count - 1] - 2;
+    else
+        end = scanDataSize;
+    firstMcu = first * m_mcuRestart;
+
+    if (!(m_picture->newSlice(sliceParam, scanData + start, end - start)))
+        return DECODE_FAIL;
+
+    setSliceComponents(sliceParam, scanHdr);
+    sliceParam->slice_horizontal_position = firstMcu % mcusPerRow;
+    sliceParam->slice_vertical_position = firstMcu / mcusPerRow;
+    sliceParam->num_mcus = MIN(count * m_mcuRestart, numMcus - firstMcu);
+    return DECODE_SUCCESS;
+}
+
+Decode_Status
+    VaapiDecoderJpeg::fillSliceParam(JpegScanHdr * scanHdr,
+                                     uint8_t * scanData, uint32_t scanDataSize)
+{
+
+    VASliceParameterBufferJPEGBaseline *sliceParam = NULL;
+    uint32_t totalHSamples, totalVSamples;
+    uint32_t mcusPerRow, numMcus, numIntervals, numSlices, perSlice;
+    uint32_t i;
+    Decode_Status status;
+
+    assert(scanHdr);
+
+    if (scanHdr->num_components > 1 && m_mcuRestart && m_maxSlices > 1) {
+        totalVSamples = getMaxVerticalSamples(&m_frameHdr);
+        totalHSamples = getMaxHorizontalSamples(&m_frameHdr);
+        mcusPerRow = (m_frameHdr.width + totalHSamples * 8 - 1) / (totalHSamples * 8);
+        numMcus = mcusPerRow
+            * ((m_frameHdr.height + totalVSamples * 8 - 1) / (totalVSamples * 8));
+        numIntervals = (numMcus + m_mcuRestart - 1) / m_mcuRestart;
+
+        /* with a lost RST we can't place the slices, the driver resyncs in one slice */
+        if (numIntervals > 1 && m_restarts.size() == numIntervals - 1) {
+            numSlices = MIN(m_maxSlices, numIntervals);
+            perSlice = (numIntervals + numSlices - 1) / numSlices;
+            for (i = 0; i < numIntervals; i += perSlice) {
+                status = fillRestartSlice(scanHdr, scanData, scanDataSize, i,
+                                          MIN(perSlice, numIntervals - i),
+                                          mcusPerRow, numMcus);
+                if (status != DECODE_SUCCESS)
+                    return status;
+            }
+            return DECODE_SUCCESS;
+        }
+    }
+
+    if (!(m_picture->newSlice(sliceParam, scanData, scanDataSize)))
+        return DECODE_FAIL;
+
+    setSliceComponents(sliceParam, scanHdr);
 
     if (scanHdr->num_components == 1) { /*non-interleaved */
         sliceParam->slice_horizontal_position = 0;
@@ -226,18 +313,10 @@ Decode_Status
     return DECODE_SUCCESS;
 }
 
-Decode_Status VaapiDecoderJpeg::fillQuantizationTable()
+void VaapiDecoderJpeg::fillQuantizationTable(VAIQMatrixBufferJPEGBaseline * vaIqMatrix)
 {
-    VAIQMatrixBufferJPEGBaseline *vaIqMatrix = NULL;
-    VaapiBufObject *object;
     uint32_t i, j, numTables;
 
-    if (!m_hasQuantTable)
-        jpeg_get_default_quantization_tables(&m_quantTables);
-
-    if (!(m_picture->editIqMatrix(vaIqMatrix)))
-        return DECODE_FAIL;
-
     numTables = MIN(N_ELEMENTS(vaIqMatrix->quantiser_table),
                     JPEG_MAX_QUANT_ELEMENTS);
 
@@ -252,8 +331,36 @@ Decode_Status VaapiDecoderJpeg::fillQuantizationTable()
         for (j = 0; j < JPEG_MAX_QUANT_ELEMENTS; j++)
             vaIqMatrix->quantiser_table[i][j] = quantTable->quant_table[j];
         vaIqMatrix->load_quantiser_table[i] = 1;
-        quantTable->valid = FALSE;
     }
+}
+
+Decode_Status VaapiDecoderJpeg::fillQuantizationTable()
+{
+    VAIQMatrixBufferJPEGBaseline *vaIqMatrix = NULL;
+    uint32_t i;
+
+    if (m_streamMode) {
+        if (!m_vaIqMatrixValid) {
+            memset(&m_vaIqMatrix, 0, sizeof(m_vaIqMatrix));
+            fillQuantizationTable(&m_vaIqMatrix);
+            m_vaIqMatrixValid = true;
+        }
+        if (!(m_picture->editIqMatrix(vaIqMatrix)))
+            return DECODE_FAIL;
+        *vaIqMatrix = m_vaIqMatrix;
+        return DECODE_SUCCESS;
+    }
+
+    if (!m_hasQuantTable)
+        jpeg_get_default_quantization_tables(&m_quantTables);
+
+    if (!(m_picture->editIqMatrix(vaIqMatrix)))
+        return DECODE_FAIL;
+
+    fillQuantizationTable(vaIqMatrix);
+    /* a still image loads its tables once */
+    for (i = 0; i < JPEG_MAX_SCAN_COMPONENTS; i++)
+        m_quantTables.quant_tables[i].valid = FALSE;
 
     return DECODE_SUCCESS;
 }
@@ -261,9 +368,18 @@ Decode_Status VaapiDecoderJpeg::fillQuantizationTable()
 Decode_Status VaapiDecoderJpeg::fillHuffmanTable()
 {
     VAHuffmanTableBufferJPEGBaseline *vaHuffmanTable = NULL;
-    JpegHuffmanTables *const hufTables = &m_hufTables;
-    VaapiBufObject *object;
-    uint32_t i, numTables;
+
+    if (m_streamMode) {
+        if (!m_vaHufTableValid) {
+            memset(&m_vaHufTable, 0, sizeof(m_vaHufTable));
+            fillHuffmanTable(&m_vaHufTable);
+            m_vaHufTableValid = true;
+        }
+        if (!(m_picture->editHufTable(vaHuffmanTable)))
+            return DECODE_FAIL;
+        *vaHuffmanTable = m_vaHufTable;
+        return DECODE_SUCCESS;
+    }
 
     if (!m_hasHufTable)
         jpeg_get_default_huffman_tables(&m_hufTables);
@@ -271,6 +387,15 @@ Decode_Status VaapiDecoderJpeg::fillHuffmanTable()
     if (!(m_picture->editHufTable(vaHuffmanTable)))
         return DECODE_FAIL;
 
+    fillHuffmanTable(vaHuffmanTable);
+    return DECODE_SUCCESS;
+}
+
+void VaapiDecoderJpeg::fillHuffmanTable(VAHuffmanTableBufferJPEGBaseline * vaHuffmanTable)
+{
+    JpegHuffmanTables *const hufTables = &m_hufTables;
+    uint32_t i, numTables;
+
     numTables = MIN(N_ELEMENTS(vaHuffmanTable->huffman_table),
                     JPEG_MAX_SCAN_COMPONENTS);
 
@@ -295,23 +420,114 @@ Decode_Status VaapiDecoderJpeg::fillHuffmanTable()
         memset(vaHuffmanTable->huffman_table[i].pad,
                0, sizeof(vaHuffmanTable->huffman_table[i].pad));
     }
+}
+
+Decode_Status VaapiDecoderJpeg::indexMarkers(const uint8_t * buf, uint32_t bufSize)
+{
+    JpegMarkerSegment seg;
+    int32_t pos;
+    uint32_t ofs = 0;
+
+    m_markers.clear();
+    while ((pos = jpeg_scan_for_marker_code(buf, bufSize, ofs)) >= 0) {
+        seg.marker = buf[pos + 1];
+        seg.offset = pos + 2;
+        seg.size = 0;
+
+        /* all markers but SOI, EOI and RSTn carry a length */
+        if (seg.marker != JPEG_MARKER_SOI && seg.marker != JPEG_MARKER_EOI
+            && (seg.marker < JPEG_MARKER_RST_MIN || seg.marker > JPEG_MARKER_RST_MAX)) {
+            if (seg.offset + 2 > bufSize) {
+                DEBUG("JPEG: buffer too short for parsing");
+                return DECODE_PARSER_FAIL;
+            }
+            seg.size = (buf[seg.offset] << 8) | buf[seg.offset + 1];
+            if (seg.size < 2 || seg.offset + seg.size > bufSize) {
+                DEBUG("JPEG: marker 0x%02x has a bad length %d", seg.marker, seg.size);
+                return DECODE_PARSER_FAIL;
+            }
+        }
+        m_markers.push_back(seg);
+        if (seg.marker == JPEG_MARKER_EOI)
+            break;
 
+        /* no need to look into a payload, only entropy coded data is scanned */
+        ofs = seg.offset + seg.size;
+    }
     return DECODE_SUCCESS;
 }
 
-Decode_Status VaapiDecoderJpeg::decodePictureStart()
+void VaapiDecoderJpeg::setFixedContext(bool fixed)
+{
+    m_fixedContext = fixed;
+}
+
+bool VaapiDecoderJpeg::isFrameHeaderChanged(const uint8_t * buf, uint32_t bufSize)
+{
+    if (m_frameHdrCache.size() == bufSize
+        && !memcmp(&m_frameHdrCache[0], buf, bufSize))
+        return false;
+    m_frameHdrCache.assign(buf, buf + bufSize);
+    return true;
+}
+
+Decode_Status VaapiDecoderJpeg::updateTables()
+{
+    Decode_Status status;
+    uint32_t i;
+
+    if (isSegmentsChanged(m_hufSegments, m_hufCache) || !m_vaHufTableValid) {
+        /* AVI1 mjpeg leaves out DHT, it uses the tables in K.3 */
+        if (m_hufSegments.empty())
+            jpeg_get_default_huffman_tables(&m_hufTables);
+        for (i = 0; i < m_hufSegments.size(); i++) {
+            status = parseHuffmanTable(m_hufSegments[i].first, m_hufSegments[i].second);
+            if (status != DECODE_SUCCESS) {
+                m_hufCache.clear();
+                return status;
+            }
+        }
+        m_vaHufTableValid = false;
+    }
+
+    if (isSegmentsChanged(m_quantSegments, m_quantCache) || !m_vaIqMatrixValid) {
+        if (m_quantSegments.empty())
+            jpeg_get_default_quantization_tables(&m_quantTables);
+        for (i = 0; i < m_quantSegments.size(); i++) {
+            status = parseQuantTable(m_quantSegments[i].first, m_quantSegments[i].second);
+            if (status != DECODE_SUCCESS) {
+                m_quantCache.clear();
+                return status;
+            }
+        }
+        m_vaIqMatrixValid = false;
+    }
+    return DECODE_SUCCESS;
+}
+
+void VaapiDecoderJpeg::dropTableCache()
+{
+    m_vaHufTableValid = false;
+    m_vaIqMatrixValid = false;
+    m_frameHdrCache.clear();
+}
+
+Decode_Status VaapiDecoderJpeg::decodePictureStart(bool headerChanged)
 {
     Decode_Status status;
     VAProfile profile;
 
     assert(m_profile == VAAPI_PROFILE_JPEG_BASELINE);
 
+    if (!headerChanged)
+        goto createPicture;
+
     m_height = m_frameHdr.height;
     m_width = m_frameHdr.width;
     profile = convertToVaProfile(VAAPI_PROFILE_JPEG_BASELINE);
 
     if (!m_hasContext) {
-        m_configBuffer.surfaceNumber = 2;
+        m_configBuffer.surfaceNumber = m_streamMode ? MJPEG_SURFACE_NUMBER : JPEG_SURFACE_NUMBER;
         m_configBuffer.profile = profile;
         m_configBuffer.width = m_width;
         m_configBuffer.height = m_height;
@@ -319,20 +535,26 @@ Decode_Status VaapiDecoderJpeg::decodePictureStart()
         m_hasContext = TRUE;
         return DECODE_FORMAT_CHANGE;
     } else if (m_configBuffer.profile != profile ||
-               m_configBuffer.width != m_width ||
-               m_configBuffer.height != m_height) {
+               (m_fixedContext ? (m_width > (uint32_t)m_configBuffer.width ||
+                                  m_height > (uint32_t)m_configBuffer.height)
+                : (m_configBuffer.width != m_width ||
+                   m_configBuffer.height != m_height))) {
         m_configBuffer.profile = profile;
         m_configBuffer.width = m_width;
         m_configBuffer.height = m_height;
+        m_picture.reset();
+        dropTableCache();
         VaapiDecoderBase::reset(&m_configBuffer);
         return DECODE_FORMAT_CHANGE;
     }
 
-    if (!m_picture) {
+  createPicture:
+    /* every mjpeg frame needs its own surface, last one may be on display */
+    if (!m_picture || m_streamMode) {
         m_picture = createPicture(m_currentPTS);
 
         if (!m_picture)
-            return false;
+            return DECODE_NO_SURFACE;
     }
 
     if (!m_picture) {
@@ -376,18 +598,19 @@ Decode_Status VaapiDecoderJpeg::decodePictureEnd()
     else if (!outputPicture(m_picture))
         status = DECODE_FAIL;
 
+    if (m_streamMode)
+        m_picture.reset();
     return status;
 }
 
 Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
 {
     Decode_Status status = DECODE_SUCCESS;
-    JpegMarkerSegment seg;
     JpegScanSegment scanSeg;
     BOOL appendEcs;
     uint8_t *buf;
     uint32_t bufSize;
-    uint32_t ofs;
+    uint32_t i;
 
     m_currentPTS = buffer->timeStamp;
     buf = buffer->data;
@@ -398,14 +621,13 @@ Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
 
     memset(&scanSeg, 0, sizeof(scanSeg));
 
-    ofs = 0;
-    while (jpeg_parse(&seg, buf, bufSize, ofs)) {
-        if (seg.size < 0) {
-            DEBUG("JPEG: buffer too short for parsing");
-            return DECODE_PARSER_FAIL;
-        }
+    status = indexMarkers(buf, bufSize);
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    for (i = 0; i < m_markers.size(); i++) {
         // seg.offset points to the byte after current marker (oxFFXY)
-        ofs = seg.offset;
+        const JpegMarkerSegment & seg = m_markers[i];
 
         /* Decode scan, if complete */
         if (seg.marker == JPEG_MARKER_EOI && scanSeg.m_headerSize > 0) {
@@ -440,17 +662,31 @@ Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
             m_hasQuantTable = FALSE;
             m_hasHufTable = FALSE;
             m_mcuRestart = 0;
+            m_hufSegments.clear();
+            m_quantSegments.clear();
             status = DECODE_SUCCESS;
             break;
         case JPEG_MARKER_EOI:
             /* Get out of the loop, trailing data is not needed */
+            if (m_streamMode) {
+                status = updateTables();
+                if (status != DECODE_SUCCESS)
+                    break;
+            }
             status = decodePictureEnd();
             break;
         case JPEG_MARKER_DHT:
-            status = parseHuffmanTable(buf + seg.offset, seg.size);
+            /* mjpeg tables are parsed at EOI, only if they changed */
+            if (m_streamMode)
+                m_hufSegments.push_back(std::make_pair(buf + seg.offset, (uint32_t)seg.size));
+            else
+                status = parseHuffmanTable(buf + seg.offset, seg.size);
             break;
         case JPEG_MARKER_DQT:
-            status = parseQuantTable(buf + seg.offset, seg.size);
+            if (m_streamMode)
+                m_quantSegments.push_back(std::make_pair(buf + seg.offset, (uint32_t)seg.size));
+            else
+                status = parseQuantTable(buf + seg.offset, seg.size);
             break;
         case JPEG_MARKER_DRI:
             status = parseRestartInterval(buf + seg.offset, seg.size);
@@ -464,12 +700,15 @@ Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
             scanSeg.m_headerSize = seg.size;
             scanSeg.m_dataOffset = seg.offset + seg.size;
             scanSeg.m_dataSize = 0;
+            m_restarts.clear();
             appendEcs = FALSE;
             break;
         default:
             /* Restart marker */
             if (seg.marker >= JPEG_MARKER_RST_MIN &&
                 seg.marker <= JPEG_MARKER_RST_MAX) {
+                if (scanSeg.m_headerSize > 0)
+                    m_restarts.push_back(seg.offset - scanSeg.m_dataOffset);
                 appendEcs = FALSE;
                 break;
             }
@@ -477,14 +716,22 @@ Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
             /* Frame header */
             if (seg.marker >= JPEG_MARKER_SOF_MIN &&
                 seg.marker <= JPEG_MARKER_SOF_MAX) {
-
-                status = parseFrameHeader(buf + seg.offset, seg.size);
-                if (status != DECODE_SUCCESS) {
-                    ERROR("JPEG: fail to parse frame header");
-                    return status;
+                bool headerChanged = true;
+
+                /* same frame header as last mjpeg frame, keep the context */
+                if (m_streamMode && m_hasContext)
+                    headerChanged = isFrameHeaderChanged(buf + seg.offset, seg.size);
+
+                if (headerChanged) {
+                    status = parseFrameHeader(buf + seg.offset, seg.size);
+                    if (status != DECODE_SUCCESS) {
+                        ERROR("JPEG: fail to parse frame header");
+                        m_frameHdrCache.clear();
+                        return status;
+                    }
                 }
 
-                status = decodePictureStart();
+                status = decodePictureStart(headerChanged);
                 if (status != DECODE_SUCCESS) {
                     if (status != DECODE_FORMAT_CHANGE)
                         ERROR("JPEG: fail to start picture decoding");
@@ -521,6 +768,8 @@ Decode_Status VaapiDecoderJpeg::decode(VideoDecodeBuffer * buffer)
 
 Decode_Status VaapiDecoderJpeg::start(VideoConfigBuffer * buffer)
 {
+    Decode_Status status;
+
     DEBUG("Jpeg: start()");
 
     if (buffer == NULL) {
@@ -528,6 +777,12 @@ Decode_Status VaapiDecoderJpeg::start(VideoConfigBuffer * buffer)
         return DECODE_SUCCESS;
     }
 
+    if (buffer->jpegMaxSlices > JPEG_MAX_SLICES) {
+        ERROR("jpegMaxSlices %d is larger than %d", buffer->jpegMaxSlices, JPEG_MAX_SLICES);
+        return DECODE_INVALID_DATA;
+    }
+    m_maxSlices = buffer->jpegMaxSlices;
+
     if (buffer->width > 0 && buffer->height > 0) {
         if (!buffer->surfaceNumber)
             buffer->surfaceNumber = 2;
@@ -539,7 +794,9 @@ Decode_Status VaapiDecoderJpeg::start(VideoConfigBuffer * buffer)
         m_configBuffer.height = buffer->height;
         m_configBuffer.profile = buffer->profile;
 
-        VaapiDecoderBase::start(buffer);
+        status = VaapiDecoderBase::start(buffer);
+        if (status != DECODE_SUCCESS)
+            return status;
         m_hasContext = true;
         return DECODE_FORMAT_CHANGE;
     }
@@ -554,6 +811,7 @@ Decode_Status VaapiDecoderJpeg::reset(VideoConfigBuffer * buffer)
     if (m_picture) {
         m_picture.reset();
     }
+    dropTableCache();
 
     return VaapiDecoderBase::reset(buffer);
 }
@@ -561,6 +819,9 @@ Decode_Status VaapiDecoderJpeg::reset(VideoConfigBuffer * buffer)
 void VaapiDecoderJpeg::stop(void)
 {
     DEBUG("Jpeg: stop()");
+    m_picture.reset();
+    dropTableCache();
+    m_hasContext = FALSE;
     VaapiDecoderBase::stop();
 }
 
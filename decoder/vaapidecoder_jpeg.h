@@ -27,18 +27,30 @@
 #include "vaapidecpicture.h"
 #include "vaapidecoder_base.h"
 #include "codecparsers/jpegparser.h"
+#include <vector>
 
 namespace YamiMediaCodec{
+enum {
+    JPEG_SURFACE_NUMBER = 2,
+    // client holds frames on display while next ones are decoded
+    MJPEG_SURFACE_NUMBER = 4,
+};
+
 class VaapiDecoderJpeg:public VaapiDecoderBase {
   public:
     typedef std::tr1::shared_ptr<VaapiDecPicture> PicturePtr;
-    VaapiDecoderJpeg();
+    /* stream mode decodes mjpeg, every frame goes to a new surface,
+     * tables and frame header are parsed and uploaded only when they change */
+    VaapiDecoderJpeg(bool streamMode = false);
     virtual ~ VaapiDecoderJpeg();
     virtual Decode_Status start(VideoConfigBuffer * buffer);
     virtual Decode_Status reset(VideoConfigBuffer * buffer);
     virtual void stop(void);
     virtual void flush(void);
     virtual Decode_Status decode(VideoDecodeBuffer * buf);
+    /* images not larger than the size given in start() are decoded
+     * without a context reset, used by batch decoding */
+    void setFixedContext(bool fixed);
 
   private:
     Decode_Status parseFrameHeader(uint8_t * buf, uint32_t bufSize);
@@ -49,11 +61,29 @@ class VaapiDecoderJpeg:public VaapiDecoderBase {
                                   uint32_t bufSize);
     Decode_Status fillSliceParam(JpegScanHdr * scanHdr, uint8_t * scanData,
                                  uint32_t scanDataSize);
+    /* restart intervals [first, first + count) of current scan as one slice */
+    Decode_Status fillRestartSlice(JpegScanHdr * scanHdr, uint8_t * scanData,
+                                   uint32_t scanDataSize, uint32_t first,
+                                   uint32_t count, uint32_t mcusPerRow,
+                                   uint32_t numMcus);
+    /* locate all markers of buf in one pass, segment payloads are skipped */
+    Decode_Status indexMarkers(const uint8_t * buf, uint32_t bufSize);
+    void setSliceComponents(VASliceParameterBufferJPEGBaseline * sliceParam,
+                            JpegScanHdr * scanHdr);
     Decode_Status fillPictureParam();
     Decode_Status fillQuantizationTable();
+    void fillQuantizationTable(VAIQMatrixBufferJPEGBaseline * vaIqMatrix);
     Decode_Status fillHuffmanTable();
+    void fillHuffmanTable(VAHuffmanTableBufferJPEGBaseline * vaHuffmanTable);
 
-    Decode_Status decodePictureStart();
+    /* segments of one kind in current frame, pointing to input buffer */
+    typedef std::vector<std::pair<uint8_t *, uint32_t> > Segments;
+    bool isFrameHeaderChanged(const uint8_t * buf, uint32_t bufSize);
+    /* stream mode, parse tables of current frame if they differ from last frame */
+    Decode_Status updateTables();
+    void dropTableCache();
+
+    Decode_Status decodePictureStart(bool headerChanged);
     Decode_Status decodePictureEnd();
 
   private:
@@ -68,9 +98,34 @@ class VaapiDecoderJpeg:public VaapiDecoderBase {
     BOOL m_hasHufTable;
     BOOL m_hasQuantTable;
     uint32_t m_mcuRestart;
+    std::vector<JpegMarkerSegment> m_markers;
+    //offsets of RST payloads in current scan data, the start of each restart interval but the first
+    std::vector<uint32_t> m_restarts;
+    //VideoConfigBuffer::jpegMaxSlices, split a scan into this many slices on restart markers, 0 is off
+    uint32_t m_maxSlices;
+    bool m_fixedContext;
+
+    bool m_streamMode;
+    Segments m_hufSegments;
+    Segments m_quantSegments;
+    //segment bytes of last frame, a frame repeating them keeps the tables
+    std::vector<uint8_t> m_frameHdrCache;
+    std::vector<uint8_t> m_hufCache;
+    std::vector<uint8_t> m_quantCache;
+    //va tables of the cached segments, copied into a new buffer for each frame.
+    //the buffers are not shared, some drivers (psb) free a buffer once it's rendered
+    VAHuffmanTableBufferJPEGBaseline m_vaHufTable;
+    VAIQMatrixBufferJPEGBaseline m_vaIqMatrix;
+    bool m_vaHufTableValid;
+    bool m_vaIqMatrixValid;
     DISALLOW_COPY_AND_ASSIGN(VaapiDecoderJpeg);
 };
 
+class VaapiDecoderMJpeg:public VaapiDecoderJpeg {
+  public:
+    VaapiDecoderMJpeg():VaapiDecoderJpeg(true) {}
+};
+
 typedef struct _JpegScanSegment {
     uint32_t m_headerOffset;
     uint32_t m_headerSize;
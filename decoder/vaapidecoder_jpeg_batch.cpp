@@ -0,0 +1,263 @@
+/*
+ *  vaapidecoder_jpeg_batch.cpp - decode independent jpeg images in batch
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "common/log.h"
+#include "vaapidecoder_jpeg_batch.h"
+
+namespace YamiMediaCodec{
+
+static uint32_t alignUp(uint32_t size)
+{
+    return (size + JPEG_BATCH_BUCKET_ALIGN - 1) & ~(JPEG_BATCH_BUCKET_ALIGN - 1);
+}
+
+VaapiJpegBatchDecoder::VaapiJpegBatchDecoder()
+    : m_xDisplay(NULL)
+    , m_useCount(0)
+{
+    memset(&m_config, 0, sizeof(m_config));
+}
+
+VaapiJpegBatchDecoder::~VaapiJpegBatchDecoder()
+{
+    stop();
+}
+
+Decode_Status VaapiJpegBatchDecoder::start(VideoConfigBuffer * buffer)
+{
+    stop();
+    memset(&m_config, 0, sizeof(m_config));
+    if (buffer) {
+        m_config.surfaceNumber = buffer->surfaceNumber;
+        m_config.flag = buffer->flag;
+        m_config.jpegMaxSlices = buffer->jpegMaxSlices;
+    }
+    if (m_config.surfaceNumber <= 0)
+        m_config.surfaceNumber = JPEG_BATCH_SURFACE_NUMBER;
+    m_config.profile = VAProfileJPEGBaseline;
+    return DECODE_SUCCESS;
+}
+
+void VaapiJpegBatchDecoder::stop(void)
+{
+    if (!m_frames.empty())
+        WARNING("jpeg batch: %d frames are not returned", (int)m_frames.size());
+    m_outputs.clear();
+    m_frames.clear();
+    for (size_t i = 0; i < m_buckets.size(); i++)
+        m_buckets[i]->decoder->stop();
+    m_buckets.clear();
+}
+
+bool VaapiJpegBatchDecoder::getImageSize(const VideoDecodeBuffer * buffer,
+                                         int32_t & width, int32_t & height)
+{
+    JpegMarkerSegment seg;
+    uint32_t ofs = 0;
+
+    while (jpeg_parse(&seg, buffer->data, buffer->size, ofs)) {
+        if (seg.size < 0)
+            return false;
+        ofs = seg.offset;
+        if (seg.marker == JPEG_MARKER_SOS || seg.marker == JPEG_MARKER_EOI)
+            break;
+        if (seg.marker >= JPEG_MARKER_SOF_MIN && seg.marker <= JPEG_MARKER_SOF_MAX
+            && seg.marker != JPEG_MARKER_DHT && seg.marker != JPEG_MARKER_DAC
+            && seg.marker != JPEG_MARKER_SOF_MIN + 8) {
+            //Lf(16) P(8) Y(16) X(16)
+            if (seg.size < 8 || seg.offset + 7 > (uint32_t)buffer->size)
+                return false;
+            const uint8_t *hdr = buffer->data + seg.offset;
+            height = (hdr[3] << 8) | hdr[4];
+            width = (hdr[5] << 8) | hdr[6];
+            return width > 0 && height > 0;
+        }
+    }
+    return false;
+}
+
+VaapiJpegBatchDecoder::BucketPtr VaapiJpegBatchDecoder::createBucket(uint32_t width, uint32_t height)
+{
+    BucketPtr bucket(new Bucket);
+    VideoConfigBuffer config = m_config;
+    Decode_Status status;
+
+    bucket->width = width;
+    bucket->height = height;
+    bucket->held = 0;
+    bucket->lastUse = m_useCount;
+    //stream mode gives every image its own surface and keeps tables shared by images
+    bucket->decoder.reset(new VaapiDecoderJpeg(true));
+    bucket->decoder->setFixedContext(true);
+    if (m_xDisplay)
+        bucket->decoder->setXDisplay(m_xDisplay);
+
+    config.width = width;
+    config.height = height;
+    status = bucket->decoder->start(&config);
+    if (status != DECODE_SUCCESS && status != DECODE_FORMAT_CHANGE) {
+        ERROR("jpeg batch: failed to create context for %dx%d", width, height);
+        bucket.reset();
+    }
+    return bucket;
+}
+
+Decode_Status VaapiJpegBatchDecoder::getBucket(uint32_t width, uint32_t height, BucketPtr & bucket)
+{
+    size_t i, idle = m_buckets.size();
+
+    width = alignUp(width);
+    height = alignUp(height);
+    for (i = 0; i < m_buckets.size(); i++) {
+        if (m_buckets[i]->width == width && m_buckets[i]->height == height) {
+            bucket = m_buckets[i];
+            return DECODE_SUCCESS;
+        }
+        if (!m_buckets[i]->held
+            && (idle == m_buckets.size() || m_buckets[i]->lastUse < m_buckets[idle]->lastUse))
+            idle = i;
+    }
+
+    if (m_buckets.size() >= JPEG_BATCH_MAX_BUCKETS) {
+        //client holds frames of every bucket, it has to return some first
+        if (idle == m_buckets.size()) {
+            DEBUG("jpeg batch: all %d buckets are in use", (int)m_buckets.size());
+            return DECODE_NO_SURFACE;
+        }
+        DEBUG("jpeg batch: drop bucket %dx%d", m_buckets[idle]->width, m_buckets[idle]->height);
+        m_buckets[idle]->decoder->stop();
+        m_buckets.erase(m_buckets.begin() + idle);
+    }
+
+    bucket = createBucket(width, height);
+    if (!bucket)
+        return DECODE_DRIVER_FAIL;
+    m_buckets.push_back(bucket);
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiJpegBatchDecoder::decodeImage(const BucketPtr & bucket,
+                                                 VideoDecodeBuffer * buffer,
+                                                 ImageBatchOutput & output)
+{
+    const VideoRenderBuffer *frame;
+    Decode_Status status;
+
+    status = bucket->decoder->decode(buffer);
+    //a new profile resets the context, the image has to be sent again
+    if (status == DECODE_FORMAT_CHANGE)
+        status = bucket->decoder->decode(buffer);
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    frame = bucket->decoder->getOutput(true);
+    if (!frame) {
+        ERROR("jpeg batch: no output for a decoded image");
+        return DECODE_FAIL;
+    }
+    output.buffer = const_cast<VideoRenderBuffer *>(frame);
+    bucket->held++;
+    bucket->lastUse = m_useCount;
+    m_frames[frame] = bucket;
+    return DECODE_SUCCESS;
+}
+
+uint32_t VaapiJpegBatchDecoder::decode(VideoDecodeBuffer * buffers, uint32_t count)
+{
+    uint32_t i;
+
+    if (!m_config.surfaceNumber) {
+        ERROR("jpeg batch: decode before start");
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        VideoDecodeBuffer *buffer = buffers + i;
+        ImageBatchOutput output;
+        BucketPtr bucket;
+
+        memset(&output, 0, sizeof(output));
+        m_useCount++;
+        if (!buffer->data || buffer->size <= 0
+            || !getImageSize(buffer, output.width, output.height)) {
+            output.status = DECODE_INVALID_DATA;
+            m_outputs.push_back(output);
+            continue;
+        }
+
+        output.status = getBucket(output.width, output.height, bucket);
+        if (output.status == DECODE_SUCCESS)
+            output.status = decodeImage(bucket, buffer, output);
+        //client holds all surfaces of the bucket or all buckets, let it return some and retry
+        if (output.status == DECODE_NO_SURFACE) {
+            DEBUG("jpeg batch: out of surfaces at image %d of %d", i, count);
+            break;
+        }
+        m_outputs.push_back(output);
+    }
+    return i;
+}
+
+bool VaapiJpegBatchDecoder::getOutput(ImageBatchOutput * output)
+{
+    if (!output || m_outputs.empty())
+        return false;
+    *output = m_outputs.front();
+    m_outputs.pop_front();
+    return true;
+}
+
+void VaapiJpegBatchDecoder::renderDone(VideoRenderBuffer * buffer)
+{
+    std::map<const VideoRenderBuffer *, BucketPtr>::iterator it = m_frames.find(buffer);
+
+    if (it == m_frames.end()) {
+        ERROR("jpeg batch: %p is not an output frame", buffer);
+        return;
+    }
+    BucketPtr bucket = it->second;
+    m_frames.erase(it);
+    bucket->decoder->renderDone(buffer);
+    bucket->held--;
+}
+
+Decode_Status VaapiJpegBatchDecoder::exportFrame(const VideoRenderBuffer * buffer,
+                                                 VideoFrameDmaBuf * dmaBuf)
+{
+    std::map<const VideoRenderBuffer *, BucketPtr>::iterator it = m_frames.find(buffer);
+
+    if (it == m_frames.end())
+        return RENDER_INVALID_PARAMETER;
+    return it->second->decoder->exportFrame(buffer, dmaBuf);
+}
+
+void VaapiJpegBatchDecoder::setXDisplay(Display * xDisplay)
+{
+    if (!m_buckets.empty())
+        WARNING("jpeg batch: new display only applies to new buckets");
+    m_xDisplay = xDisplay;
+}
+}
@@ -0,0 +1,98 @@
+/*
+ *  vaapidecoder_jpeg_batch.h - decode independent jpeg images in batch
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapidecoder_jpeg_batch_h
+#define vaapidecoder_jpeg_batch_h
+
+#include "interface/ImageBatchDecoderInterface.h"
+#include "vaapidecoder_jpeg.h"
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace YamiMediaCodec{
+enum {
+    //frames client may hold in one bucket, if it doesn't tell
+    JPEG_BATCH_SURFACE_NUMBER = 8,
+    //least recently used idle bucket is destroyed beyond this, never more than this
+    JPEG_BATCH_MAX_BUCKETS = 4,
+    //image size is rounded up to this to pick a bucket
+    JPEG_BATCH_BUCKET_ALIGN = 256,
+};
+
+/**
+ * \class VaapiJpegBatchDecoder
+ * \brief decodes independent jpeg images into surface pools shared per size bucket
+ * <pre>
+ * each bucket is a stream mode jpeg decoder started once with the bucket size,
+ * images fitting in the bucket are decoded without context reset or new surfaces.
+ * an image is decoded when it's submitted, so completions keep the input order.
+ * </pre>
+ */
+class VaapiJpegBatchDecoder:public IImageBatchDecoder {
+  public:
+    VaapiJpegBatchDecoder();
+    virtual ~ VaapiJpegBatchDecoder();
+    virtual Decode_Status start(VideoConfigBuffer * buffer);
+    virtual void stop(void);
+    virtual uint32_t decode(VideoDecodeBuffer * buffers, uint32_t count);
+    virtual bool getOutput(ImageBatchOutput * output);
+    virtual void renderDone(VideoRenderBuffer * buffer);
+    virtual Decode_Status exportFrame(const VideoRenderBuffer * buffer,
+                                      VideoFrameDmaBuf * dmaBuf);
+    virtual void setXDisplay(Display * xDisplay);
+
+  private:
+    typedef std::tr1::shared_ptr<VaapiDecoderJpeg> DecoderPtr;
+    struct Bucket {
+        uint32_t width;
+        uint32_t height;
+        DecoderPtr decoder;
+        //frames not returned by client yet, including pending completions
+        uint32_t held;
+        //m_useCount of last image decoded in it
+        uint64_t lastUse;
+    };
+    typedef std::tr1::shared_ptr<Bucket> BucketPtr;
+
+    /* size from the frame header, the image is not decoded */
+    bool getImageSize(const VideoDecodeBuffer * buffer,
+                      int32_t & width, int32_t & height);
+    /* DECODE_NO_SURFACE if all buckets hold client frames */
+    Decode_Status getBucket(uint32_t width, uint32_t height, BucketPtr & bucket);
+    BucketPtr createBucket(uint32_t width, uint32_t height);
+    Decode_Status decodeImage(const BucketPtr & bucket,
+                              VideoDecodeBuffer * buffer,
+                              ImageBatchOutput & output);
+
+    VideoConfigBuffer m_config;
+    Display *m_xDisplay;
+    std::vector<BucketPtr> m_buckets;
+    std::deque<ImageBatchOutput> m_outputs;
+    //owner bucket of each frame out of the pools
+    std::map<const VideoRenderBuffer *, BucketPtr> m_frames;
+    uint64_t m_useCount;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiJpegBatchDecoder);
+};
+}
+
+#endif
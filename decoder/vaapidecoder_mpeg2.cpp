@@ -0,0 +1,495 @@
+/*
+ *  vaapidecoder_mpeg2.cpp - mpeg2 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "common/log.h"
+#include "vaapidecoder_mpeg2.h"
+
+namespace YamiMediaCodec{
+typedef VaapiDecoderMPEG2::PicturePtr PicturePtr;
+
+//size of 00 00 01 xx
+#define START_CODE_SIZE 4
+
+static VaapiPictureType getPictureType(uint8_t type)
+{
+    switch (type) {
+    case MPEG_VIDEO_PICTURE_TYPE_I:
+        return VAAPI_PICTURE_TYPE_I;
+    case MPEG_VIDEO_PICTURE_TYPE_P:
+        return VAAPI_PICTURE_TYPE_P;
+    case MPEG_VIDEO_PICTURE_TYPE_B:
+        return VAAPI_PICTURE_TYPE_B;
+    default:
+        break;
+    }
+    return VAAPI_PICTURE_TYPE_NONE;
+}
+
+VaapiDecoderMPEG2::VaapiDecoderMPEG2()
+{
+    memset(&m_sequenceHdr, 0, sizeof(m_sequenceHdr));
+    memset(&m_sequenceExt, 0, sizeof(m_sequenceExt));
+    memset(&m_pictureHdr, 0, sizeof(m_pictureHdr));
+    memset(&m_pictureExt, 0, sizeof(m_pictureExt));
+    memset(&m_gop, 0, sizeof(m_gop));
+    memset(&m_quantMatrix, 0, sizeof(m_quantMatrix));
+
+    m_gotSequenceHdr = false;
+    m_gotSequenceExt = false;
+    m_sequenceChanged = false;
+    m_gotPictureHdr = false;
+    m_gotPictureExt = false;
+    m_DPB.reset(new VaapiMPEG2DPB(this));
+}
+
+VaapiDecoderMPEG2::~VaapiDecoderMPEG2()
+{
+    stop();
+}
+
+VAProfile VaapiDecoderMPEG2::getVAProfile()
+{
+    //mpeg1 has no sequence extension, main profile decodes it
+    if (!m_gotSequenceExt)
+        return VAProfileMPEG2Main;
+    switch (m_sequenceExt.profile) {
+    case MPEG_VIDEO_PROFILE_SIMPLE:
+        return VAProfileMPEG2Simple;
+    case MPEG_VIDEO_PROFILE_MAIN:
+        break;
+    default:
+        WARNING("profile %d is not supported, try main profile", m_sequenceExt.profile);
+        break;
+    }
+    return VAProfileMPEG2Main;
+}
+
+Decode_Status VaapiDecoderMPEG2::ensureContext()
+{
+    if (!m_sequenceChanged)
+        return DECODE_SUCCESS;
+    m_sequenceChanged = false;
+    return updateContext(getVAProfile(), m_sequenceHdr.width, m_sequenceHdr.height);
+}
+
+void VaapiDecoderMPEG2::clearReferences()
+{
+    m_DPB->clear();
+    m_firstField.reset();
+}
+
+bool VaapiDecoderMPEG2::fillPictureParam(const PicturePtr& picture,
+                                         const PicturePtr& forward, const PicturePtr& backward)
+{
+    VAPictureParameterBufferMPEG2* param;
+    if (!picture->editPicture(param))
+        return false;
+
+    param->horizontal_size = m_sequenceHdr.width;
+    param->vertical_size = m_sequenceHdr.height;
+    param->forward_reference_picture = forward ? forward->getSurfaceID() : VA_INVALID_SURFACE;
+    param->backward_reference_picture = backward ? backward->getSurfaceID() : VA_INVALID_SURFACE;
+    param->picture_coding_type = m_pictureHdr.pic_type;
+
+    const uint8_t (*fCode)[2] = m_gotPictureExt ? m_pictureExt.f_code : m_pictureHdr.f_code;
+    param->f_code = (fCode[0][0] << 12) | (fCode[0][1] << 8) | (fCode[1][0] << 4) | fCode[1][1];
+
+#define FILL(field) param->picture_coding_extension.bits.field = m_pictureExt.field
+    if (m_gotPictureExt) {
+        FILL(intra_dc_precision);
+        FILL(picture_structure);
+        FILL(top_field_first);
+        FILL(frame_pred_frame_dct);
+        FILL(concealment_motion_vectors);
+        FILL(q_scale_type);
+        FILL(intra_vlc_format);
+        FILL(alternate_scan);
+        FILL(repeat_first_field);
+        FILL(progressive_frame);
+    } else {
+        //mpeg1 pictures are progressive frames
+        param->picture_coding_extension.bits.picture_structure = MPEG_VIDEO_PICTURE_STRUCTURE_FRAME;
+        param->picture_coding_extension.bits.frame_pred_frame_dct = 1;
+        param->picture_coding_extension.bits.progressive_frame = 1;
+    }
+#undef FILL
+    param->picture_coding_extension.bits.is_first_field = VAAPI_PICTURE_IS_FIRST_FIELD(picture);
+    return true;
+}
+
+bool VaapiDecoderMPEG2::fillQuantMatrix(const PicturePtr& picture)
+{
+    VAIQMatrixBufferMPEG2* iqMatrix;
+    if (!picture->editIqMatrix(iqMatrix))
+        return false;
+    *iqMatrix = m_quantMatrix;
+    return true;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodeSequenceHeader(const MpegVideoPacket& packet, uint32_t size)
+{
+    if (!mpeg_video_parse_sequence_header(&m_sequenceHdr, packet.data,
+                                          packet.offset + size, packet.offset)) {
+        ERROR("failed to parse sequence header");
+        return DECODE_PARSER_FAIL;
+    }
+    m_gotSequenceHdr = true;
+    m_gotSequenceExt = false;
+    m_sequenceChanged = true;
+
+    //a sequence header resets all matrices, chroma ones follow luma ones
+    VAIQMatrixBufferMPEG2& matrix = m_quantMatrix;
+    matrix.load_intra_quantiser_matrix = 1;
+    matrix.load_non_intra_quantiser_matrix = 1;
+    matrix.load_chroma_intra_quantiser_matrix = 1;
+    matrix.load_chroma_non_intra_quantiser_matrix = 1;
+    memcpy(matrix.intra_quantiser_matrix, m_sequenceHdr.intra_quantizer_matrix, 64);
+    memcpy(matrix.non_intra_quantiser_matrix, m_sequenceHdr.non_intra_quantizer_matrix, 64);
+    memcpy(matrix.chroma_intra_quantiser_matrix, m_sequenceHdr.intra_quantizer_matrix, 64);
+    memcpy(matrix.chroma_non_intra_quantiser_matrix, m_sequenceHdr.non_intra_quantizer_matrix, 64);
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodeExtension(const MpegVideoPacket& packet, uint32_t size)
+{
+    if (!size)
+        return DECODE_SUCCESS;
+
+    bool ret = true;
+    const uint8_t* data = packet.data;
+    uint32_t end = packet.offset + size;
+    switch (data[packet.offset] >> 4) {
+    case MPEG_VIDEO_PACKET_EXT_SEQUENCE:
+        if (!m_gotSequenceHdr)
+            break;
+        ret = mpeg_video_parse_sequence_extension(&m_sequenceExt, data, end, packet.offset);
+        if (ret) {
+            m_gotSequenceExt = true;
+            mpeg_video_finalise_mpeg2_sequence_header(&m_sequenceHdr, &m_sequenceExt, NULL);
+        }
+        break;
+    case MPEG_VIDEO_PACKET_EXT_QUANT_MATRIX: {
+        MpegVideoQuantMatrixExt quant;
+        ret = mpeg_video_parse_quant_matrix_extension(&quant, data, end, packet.offset);
+        if (!ret)
+            break;
+        //loaded matrices are kept until next sequence header
+        VAIQMatrixBufferMPEG2& matrix = m_quantMatrix;
+        if (quant.load_intra_quantiser_matrix) {
+            memcpy(matrix.intra_quantiser_matrix, quant.intra_quantiser_matrix, 64);
+            memcpy(matrix.chroma_intra_quantiser_matrix, quant.intra_quantiser_matrix, 64);
+        }
+        if (quant.load_non_intra_quantiser_matrix) {
+            memcpy(matrix.non_intra_quantiser_matrix, quant.non_intra_quantiser_matrix, 64);
+            memcpy(matrix.chroma_non_intra_quantiser_matrix, quant.non_intra_quantiser_matrix, 64);
+        }
+        if (quant.load_chroma_intra_quantiser_matrix)
+            memcpy(matrix.chroma_intra_quantiser_matrix, quant.chroma_intra_quantiser_matrix, 64);
+        if (quant.load_chroma_non_intra_quantiser_matrix)
+            memcpy(matrix.chroma_non_intra_quantiser_matrix, quant.chroma_non_intra_quantiser_matrix, 64);
+        break;
+    }
+    case MPEG_VIDEO_PACKET_EXT_PICTURE:
+        if (!m_gotPictureHdr)
+            break;
+        ret = mpeg_video_parse_picture_extension(&m_pictureExt, data, end, packet.offset);
+        if (ret)
+            m_gotPictureExt = true;
+        break;
+    default:
+        //display and scalable extensions are not needed by hw
+        break;
+    }
+    if (!ret) {
+        ERROR("failed to parse extension %d", data[packet.offset] >> 4);
+        return DECODE_PARSER_FAIL;
+    }
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodePictureHeader(const MpegVideoPacket& packet, uint32_t size)
+{
+    m_gotPictureHdr = false;
+    m_gotPictureExt = false;
+    if (!m_gotSequenceHdr) {
+        DEBUG("no sequence header, skip picture");
+        return DECODE_SUCCESS;
+    }
+    if (!mpeg_video_parse_picture_header(&m_pictureHdr, packet.data,
+                                         packet.offset + size, packet.offset)) {
+        ERROR("failed to parse picture header");
+        return DECODE_PARSER_FAIL;
+    }
+    if (getPictureType(m_pictureHdr.pic_type) == VAAPI_PICTURE_TYPE_NONE) {
+        WARNING("picture type %d is not supported, skip it", m_pictureHdr.pic_type);
+        return DECODE_SUCCESS;
+    }
+    m_gotPictureHdr = true;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::beginPicture()
+{
+    Decode_Status status = ensureContext();
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    uint32_t structure = m_gotPictureExt ?
+        m_pictureExt.picture_structure : MPEG_VIDEO_PICTURE_STRUCTURE_FRAME;
+    PicturePtr picture;
+    if (m_firstField) {
+        if (structure != VAAPI_PICTURE_STRUCTURE_FRAME
+            && structure != m_firstField->m_picStructure) {
+            picture = m_firstField->newField();
+        } else {
+            WARNING("field %d has no opposite field", m_firstField->m_picStructure);
+            if (!VAAPI_PICTURE_IS_SKIPPED(m_firstField))
+                m_DPB->add(m_firstField);
+            m_firstField.reset();
+        }
+    }
+    if (!picture) {
+        SurfacePtr surface = createSurface();
+        if (!surface)
+            return DECODE_NO_SURFACE;
+        picture.reset(new VaapiDecPictureMPEG2(m_context, surface, m_currentPTS));
+        VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_FF);
+        if (m_pictureHdr.pic_type != MPEG_VIDEO_PICTURE_TYPE_B)
+            VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_REFERENCE);
+    }
+    picture->m_type = getPictureType(m_pictureHdr.pic_type);
+    picture->m_picStructure = structure;
+    m_currentPicture = picture;
+
+    //second field of a skipped first field is skipped too
+    if (VAAPI_PICTURE_IS_SKIPPED(picture))
+        return DECODE_SUCCESS;
+
+    PicturePtr forward, backward;
+    if (!m_DPB->getReferences(picture, m_gop.closed_gop, forward, backward)) {
+        if (m_firstField && picture->m_type == VAAPI_PICTURE_TYPE_P) {
+            //second field of an I frame only predicts from first field
+            forward = m_firstField;
+        } else {
+            WARNING("missing reference for picture type %d, skip it", picture->m_type);
+            VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_SKIPPED);
+            return DECODE_SUCCESS;
+        }
+    }
+
+    if (!fillPictureParam(picture, forward, backward)) {
+        ERROR("failed to fill picture parameters");
+        return DECODE_FAIL;
+    }
+    if (!fillQuantMatrix(picture)) {
+        ERROR("failed to fill quant matrix");
+        return DECODE_FAIL;
+    }
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodeSlice(const MpegVideoPacket& packet, uint32_t size)
+{
+    Decode_Status status;
+
+    if (!m_currentPicture) {
+        if (!m_gotPictureHdr)
+            return DECODE_SUCCESS;
+        status = beginPicture();
+        if (status != DECODE_SUCCESS)
+            return status;
+    }
+    if (VAAPI_PICTURE_IS_SKIPPED(m_currentPicture))
+        return DECODE_SUCCESS;
+
+    MpegVideoSliceHdr sliceHdr;
+    if (!mpeg_video_parse_slice_header(&sliceHdr, packet.data, packet.offset + size,
+                                       packet.offset, packet.type, m_sequenceHdr.height)) {
+        //a corrupted slice only hurts its own macroblocks
+        WARNING("failed to parse slice header, drop slice %d", packet.type);
+        return DECODE_SUCCESS;
+    }
+
+    //slice data starts from the start code
+    VASliceParameterBufferMPEG2* sliceParam;
+    const uint8_t* sliceData = packet.data + packet.offset - START_CODE_SIZE;
+    if (!m_currentPicture->newSlice(sliceParam, sliceData, size + START_CODE_SIZE))
+        return DECODE_FAIL;
+
+    sliceParam->macroblock_offset = sliceHdr.header_size + START_CODE_SIZE * 8;
+    sliceParam->slice_horizontal_position = sliceHdr.mb_column;
+    sliceParam->slice_vertical_position = sliceHdr.mb_row;
+    sliceParam->quantiser_scale_code = sliceHdr.quantiser_scale_code;
+    sliceParam->intra_slice_flag = sliceHdr.intra_slice;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodeCurrentPicture()
+{
+    if (!m_currentPicture)
+        return DECODE_SUCCESS;
+
+    PicturePtr picture = m_currentPicture;
+    m_currentPicture.reset();
+    m_gotPictureHdr = false;
+    m_gotPictureExt = false;
+
+    bool skipped = VAAPI_PICTURE_IS_SKIPPED(picture);
+    if (!skipped && !picture->decode()) {
+        ERROR("failed to decode picture");
+        m_firstField.reset();
+        return DECODE_FAIL;
+    }
+
+    if (picture->m_picStructure != VAAPI_PICTURE_STRUCTURE_FRAME
+        && VAAPI_PICTURE_IS_FIRST_FIELD(picture)) {
+        m_firstField = picture;
+        return DECODE_SUCCESS;
+    }
+
+    //the first field stands for the whole frame
+    PicturePtr frame = m_firstField ? m_firstField : picture;
+    m_firstField.reset();
+    if (skipped)
+        return DECODE_SUCCESS;
+    return m_DPB->add(frame) ? DECODE_SUCCESS : DECODE_FAIL;
+}
+
+Decode_Status VaapiDecoderMPEG2::flushPictures()
+{
+    Decode_Status status = decodeCurrentPicture();
+    if (m_firstField) {
+        if (!VAAPI_PICTURE_IS_SKIPPED(m_firstField))
+            m_DPB->add(m_firstField);
+        m_firstField.reset();
+    }
+    m_DPB->flush();
+    return status;
+}
+
+Decode_Status VaapiDecoderMPEG2::decodePacket(const MpegVideoPacket& packet, uint32_t size)
+{
+    Decode_Status status = DECODE_SUCCESS;
+
+    if (MPEG_VIDEO_PACKET_IS_SLICE(packet.type))
+        return decodeSlice(packet, size);
+
+    //any other start code ends slices of current picture
+    if (packet.type != MPEG_VIDEO_PACKET_USER_DATA
+        && packet.type != MPEG_VIDEO_PACKET_EXTENSION) {
+        status = decodeCurrentPicture();
+        if (status != DECODE_SUCCESS)
+            return status;
+    }
+
+    switch (packet.type) {
+    case MPEG_VIDEO_PACKET_SEQUENCE:
+        status = decodeSequenceHeader(packet, size);
+        break;
+    case MPEG_VIDEO_PACKET_EXTENSION:
+        status = decodeExtension(packet, size);
+        break;
+    case MPEG_VIDEO_PACKET_GOP:
+        if (!mpeg_video_parse_gop(&m_gop, packet.data, packet.offset + size, packet.offset))
+            WARNING("failed to parse gop header");
+        break;
+    case MPEG_VIDEO_PACKET_PICTURE:
+        status = decodePictureHeader(packet, size);
+        break;
+    case MPEG_VIDEO_PACKET_SEQUENCE_END:
+        status = flushPictures();
+        break;
+    default:
+        break;
+    }
+    return status;
+}
+
+Decode_Status VaapiDecoderMPEG2::start(VideoConfigBuffer * buffer)
+{
+    DEBUG("MPEG2: start()");
+
+    buffer->profile = VAProfileMPEG2Main;
+    buffer->surfaceNumber = REF_DPB_MAX_REFERENCE + 1 + MPEG2_EXTRA_SURFACE_NUMBER;
+
+    m_configBuffer = *buffer;
+    m_configBuffer.data = NULL;
+    m_configBuffer.size = 0;
+
+    // va context is created on first sequence header
+    m_configBuffer.width = 0;
+    m_configBuffer.height = 0;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG2::reset(VideoConfigBuffer * buffer)
+{
+    DEBUG("MPEG2: reset()");
+    clearReferences();
+    m_currentPicture.reset();
+    m_gotPictureHdr = false;
+    return VaapiDecoderBase::reset(buffer);
+}
+
+void VaapiDecoderMPEG2::stop(void)
+{
+    DEBUG("MPEG2: stop()");
+    flush();
+    VaapiDecoderBase::stop();
+}
+
+void VaapiDecoderMPEG2::flush(void)
+{
+    DEBUG("MPEG2: flush()");
+    VaapiDecoderBase::flush();
+    m_gotPictureHdr = false;
+}
+
+Decode_Status VaapiDecoderMPEG2::decode(VideoDecodeBuffer * buffer)
+{
+    Decode_Status status = DECODE_SUCCESS;
+    MpegVideoPacket packet;
+    uint32_t offset = 0;
+
+    if (!buffer || !buffer->data || !buffer->size)
+        return DECODE_INVALID_DATA;
+
+    m_currentPTS = buffer->timeStamp;
+    DEBUG("MPEG2: Decode(bufsize =%d, timestamp=%ld)", buffer->size, m_currentPTS);
+
+    while (mpeg_video_parse(&packet, buffer->data, buffer->size, offset)) {
+        uint32_t size = packet.size < 0 ? buffer->size - packet.offset : packet.size;
+        status = decodePacket(packet, size);
+        if (status != DECODE_SUCCESS)
+            return status;
+        offset = packet.offset + size;
+    }
+
+    //input buffer holds whole pictures, no need to wait for next start code
+    return decodeCurrentPicture();
+}
+
+} //namespace YamiMediaCodec
@@ -0,0 +1,116 @@
+/*
+ *  vaapidecoder_mpeg2.h - mpeg2 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapidecoder_mpeg2_h
+#define vaapidecoder_mpeg2_h
+
+#include "codecparsers/mpegvideoparser.h"
+#include "vaapidecoder_base.h"
+#include "vaapidecoder_ref_dpb.h"
+#include "vaapidecpicture.h"
+
+namespace YamiMediaCodec{
+enum {
+    MPEG2_EXTRA_SURFACE_NUMBER = 5,
+};
+
+class VaapiDecPictureMPEG2 : public VaapiDecPicture
+{
+  public:
+    typedef std::tr1::shared_ptr<VaapiDecPictureMPEG2> PicturePtr;
+    VaapiDecPictureMPEG2(const ContextPtr& context, const SurfacePtr& surface, int64_t timeStamp)
+        : VaapiDecPicture(context, surface, timeStamp)
+        , m_flags(0)
+        , m_picStructure(VAAPI_PICTURE_STRUCTURE_FRAME)
+    {
+    }
+
+    /* second field is decoded to the surface of first field */
+    PicturePtr newField()
+    {
+        PicturePtr field(new VaapiDecPictureMPEG2(m_context, m_surface, m_timeStamp));
+        field->m_flags = m_flags & (VAAPI_PICTURE_FLAG_REFERENCE | VAAPI_PICTURE_FLAG_SKIPPED);
+        return field;
+    }
+
+    uint32_t m_flags;
+    uint32_t m_picStructure;
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecPictureMPEG2);
+};
+
+typedef VaapiRefDPB<VaapiDecPictureMPEG2> VaapiMPEG2DPB;
+
+class VaapiDecoderMPEG2:public VaapiDecoderBase {
+  public:
+    typedef VaapiDecPictureMPEG2::PicturePtr PicturePtr;
+    VaapiDecoderMPEG2();
+    virtual ~ VaapiDecoderMPEG2();
+    virtual Decode_Status start(VideoConfigBuffer * buffer);
+    virtual Decode_Status reset(VideoConfigBuffer * buffer);
+    virtual void stop(void);
+    virtual void flush(void);
+    virtual Decode_Status decode(VideoDecodeBuffer * buffer);
+
+  protected:
+    virtual void clearReferences();
+    virtual Decode_Status flushPictures();
+
+  private:
+    Decode_Status decodePacket(const MpegVideoPacket& packet, uint32_t size);
+    Decode_Status decodeSequenceHeader(const MpegVideoPacket& packet, uint32_t size);
+    Decode_Status decodeExtension(const MpegVideoPacket& packet, uint32_t size);
+    Decode_Status decodePictureHeader(const MpegVideoPacket& packet, uint32_t size);
+    Decode_Status decodeSlice(const MpegVideoPacket& packet, uint32_t size);
+    /* check the context reset senerios */
+    Decode_Status ensureContext();
+    Decode_Status beginPicture();
+    Decode_Status decodeCurrentPicture();
+    bool fillPictureParam(const PicturePtr& picture,
+                          const PicturePtr& forward, const PicturePtr& backward);
+    bool fillQuantMatrix(const PicturePtr& picture);
+    VAProfile getVAProfile();
+
+    VaapiMPEG2DPB::Ptr m_DPB;
+    PicturePtr m_currentPicture;
+    //first field waiting for its second field
+    PicturePtr m_firstField;
+
+    MpegVideoSequenceHdr m_sequenceHdr;
+    MpegVideoSequenceExt m_sequenceExt;
+    MpegVideoPictureHdr m_pictureHdr;
+    MpegVideoPictureExt m_pictureExt;
+    MpegVideoGop m_gop;
+    //quant matrices in zigzag order, sequence header resets them
+    VAIQMatrixBufferMPEG2 m_quantMatrix;
+
+    uint32_t m_gotSequenceHdr:1;
+    uint32_t m_gotSequenceExt:1;
+    uint32_t m_sequenceChanged:1;
+    uint32_t m_gotPictureHdr:1;
+    uint32_t m_gotPictureExt:1;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecoderMPEG2);
+};
+}
+
+#endif
@@ -0,0 +1,547 @@
+/*
+ *  vaapidecoder_mpeg4.cpp - mpeg4 part 2 and h263 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "common/log.h"
+#include "codecparsers/mpegvideoparser.h"
+#include "vaapidecoder_mpeg4.h"
+
+namespace YamiMediaCodec{
+typedef VaapiDecoderMPEG4::PicturePtr PicturePtr;
+
+static VaapiPictureType getPictureType(Mpeg4VideoObjectCodingType type)
+{
+    switch (type) {
+    case MPEG4_I_VOP:
+        return VAAPI_PICTURE_TYPE_I;
+    case MPEG4_P_VOP:
+        return VAAPI_PICTURE_TYPE_P;
+    case MPEG4_B_VOP:
+        return VAAPI_PICTURE_TYPE_B;
+    case MPEG4_S_VOP:
+        return VAAPI_PICTURE_TYPE_S;
+    default:
+        break;
+    }
+    return VAAPI_PICTURE_TYPE_NONE;
+}
+
+//h263 picture start code, 0000 0000 0000 0000 1000 00
+static bool isShortHeader(const uint8_t* data, uint32_t size)
+{
+    return size >= 3 && !data[0] && !data[1] && (data[2] & 0xfc) == 0x80;
+}
+
+//resync marker is bits - 1 zeros followed by a one, it's byte aligned
+static bool isResyncMarker(const uint8_t* data, uint32_t size, uint32_t bits)
+{
+    uint32_t zeros = bits - 1;
+    if (size * 8 < bits)
+        return false;
+    uint32_t i = 0;
+    for (; zeros >= 8; zeros -= 8, i++) {
+        if (data[i])
+            return false;
+    }
+    return (data[i] >> (7 - zeros)) == 1;
+}
+
+//6.3.5.2 resync_marker length depends on vop_coding_type and fcodes
+static uint32_t getResyncMarkerBits(const Mpeg4VideoObjectPlane& vop)
+{
+    switch (vop.coding_type) {
+    case MPEG4_P_VOP:
+    case MPEG4_S_VOP:
+        return 16 + vop.fcode_forward;
+    case MPEG4_B_VOP: {
+        uint32_t fcode = vop.fcode_forward > vop.fcode_backward ? vop.fcode_forward : vop.fcode_backward;
+        return fcode + 16 > 18 ? fcode + 16 : 18;
+    }
+    default:
+        break;
+    }
+    return 17;
+}
+
+VaapiDecoderMPEG4::VaapiDecoderMPEG4()
+{
+    memset(&m_vos, 0, sizeof(m_vos));
+    memset(&m_vo, 0, sizeof(m_vo));
+    memset(&m_vol, 0, sizeof(m_vol));
+    memset(&m_vop, 0, sizeof(m_vop));
+    memset(&m_spriteTrajectory, 0, sizeof(m_spriteTrajectory));
+    memset(&m_shortHdr, 0, sizeof(m_shortHdr));
+    memset(&m_gov, 0, sizeof(m_gov));
+
+    m_syncTime = 0;
+    m_lastSyncTime = 0;
+    m_govTime = 0;
+    m_vopCount = 0;
+
+    m_gotVOS = false;
+    m_gotVOL = false;
+    m_gotGov = false;
+    m_shortVideoHeader = false;
+    m_packedFrame = false;
+    m_DPB.reset(new VaapiMPEG4DPB(this));
+}
+
+VaapiDecoderMPEG4::~VaapiDecoderMPEG4()
+{
+    stop();
+}
+
+VAProfile VaapiDecoderMPEG4::getVAProfile()
+{
+    if (m_shortVideoHeader)
+        return VAProfileH263Baseline;
+    if (m_gotVOS && m_vos.profile == MPEG4_PROFILE_SIMPLE)
+        return VAProfileMPEG4Simple;
+    //advanced simple profile decodes simple profile too
+    return VAProfileMPEG4AdvancedSimple;
+}
+
+Decode_Status VaapiDecoderMPEG4::ensureContext()
+{
+    uint32_t width = m_shortVideoHeader ? m_shortHdr.vop_width : m_vol.width;
+    uint32_t height = m_shortVideoHeader ? m_shortHdr.vop_height : m_vol.height;
+    return updateContext(getVAProfile(), width, height);
+}
+
+void VaapiDecoderMPEG4::clearReferences()
+{
+    m_DPB->clear();
+}
+
+uint32_t VaapiDecoderMPEG4::getVopTime()
+{
+    uint32_t seconds;
+
+    //modulo_time_base of a B-VOP counts from the reference before the latest one
+    if (m_vop.coding_type == MPEG4_B_VOP) {
+        seconds = m_lastSyncTime + m_vop.modulo_time_base;
+    } else {
+        m_lastSyncTime = m_syncTime;
+        m_syncTime = (m_gotGov ? m_govTime : m_syncTime) + m_vop.modulo_time_base;
+        m_gotGov = false;
+        seconds = m_syncTime;
+    }
+    //wraps around on long streams, only differences are used
+    return seconds * m_vol.vop_time_increment_resolution + m_vop.time_increment;
+}
+
+void VaapiDecoderMPEG4::fillShortHeaderParam(VAPictureParameterBufferMPEG4* param)
+{
+    param->vop_width = m_shortHdr.vop_width;
+    param->vop_height = m_shortHdr.vop_height;
+    param->vol_fields.bits.short_video_header = 1;
+    param->vol_fields.bits.chroma_format = MPEG4_CHROMA_4_2_0;
+    param->vol_fields.bits.obmc_disable = 1;
+    param->quant_precision = 5;
+    param->vop_fields.bits.vop_coding_type = m_shortHdr.picture_coding_type;
+    param->vop_fcode_forward = 1;
+    param->vop_fcode_backward = 1;
+    param->num_gobs_in_vop = m_shortHdr.num_gobs_in_vop;
+    param->num_macroblocks_in_gob = m_shortHdr.num_macroblocks_in_gob;
+}
+
+bool VaapiDecoderMPEG4::fillPictureParam(const PicturePtr& picture,
+                                         const PicturePtr& forward, const PicturePtr& backward)
+{
+    VAPictureParameterBufferMPEG4* param;
+    if (!picture->editPicture(param))
+        return false;
+
+    param->forward_reference_picture = forward ? forward->getSurfaceID() : VA_INVALID_SURFACE;
+    param->backward_reference_picture = backward ? backward->getSurfaceID() : VA_INVALID_SURFACE;
+    if (m_shortVideoHeader) {
+        fillShortHeaderParam(param);
+        return true;
+    }
+
+    param->vop_width = m_vol.width;
+    param->vop_height = m_vol.height;
+
+#define FILL(field) param->vol_fields.bits.field = m_vol.field
+    FILL(chroma_format);
+    FILL(interlaced);
+    FILL(obmc_disable);
+    FILL(sprite_enable);
+    FILL(sprite_warping_accuracy);
+    FILL(quant_type);
+    FILL(quarter_sample);
+    FILL(data_partitioned);
+    FILL(reversible_vlc);
+    FILL(resync_marker_disable);
+#undef FILL
+    param->no_of_sprite_warping_points = m_vol.no_of_sprite_warping_points;
+    if (m_vop.coding_type == MPEG4_S_VOP) {
+        //va takes at most 3 warping points, the gmc limit of advanced simple profile
+        for (uint32_t i = 0; i < m_vol.no_of_sprite_warping_points && i < N_ELEMENTS(param->sprite_trajectory_du); i++) {
+            param->sprite_trajectory_du[i] = m_spriteTrajectory.vop_ref_points[i];
+            param->sprite_trajectory_dv[i] = m_spriteTrajectory.sprite_ref_points[i];
+        }
+    }
+    param->quant_precision = m_vol.quant_precision;
+
+    param->vop_fields.bits.vop_coding_type = m_vop.coding_type;
+    if (backward)
+        param->vop_fields.bits.backward_reference_vop_coding_type = backward->m_codingType;
+    param->vop_fields.bits.vop_rounding_type = m_vop.rounding_type;
+    param->vop_fields.bits.intra_dc_vlc_thr = m_vop.intra_dc_vlc_thr;
+    param->vop_fields.bits.top_field_first = m_vop.top_field_first;
+    param->vop_fields.bits.alternate_vertical_scan_flag = m_vop.alternate_vertical_scan_flag;
+    param->vop_fcode_forward = m_vop.fcode_forward;
+    param->vop_fcode_backward = m_vop.fcode_backward;
+    param->vop_time_increment_resolution = m_vol.vop_time_increment_resolution;
+
+    //temporal distances for direct mode of B-VOP, 7.6.9.5
+    if (m_vop.coding_type == MPEG4_B_VOP && forward && backward) {
+        param->TRB = (int32_t)(picture->m_time - forward->m_time);
+        param->TRD = (int32_t)(backward->m_time - forward->m_time);
+    }
+    return true;
+}
+
+bool VaapiDecoderMPEG4::fillQuantMatrix(const PicturePtr& picture)
+{
+    VAIQMatrixBufferMPEG4* iqMatrix;
+    if (!picture->editIqMatrix(iqMatrix))
+        return false;
+    if (!m_vol.quant_type)
+        return true;
+
+    //parser gives matrices in raster order, va takes zigzag scan order
+    iqMatrix->load_intra_quant_mat = 1;
+    iqMatrix->load_non_intra_quant_mat = 1;
+    mpeg_video_quant_matrix_get_zigzag_from_raster(iqMatrix->intra_quant_mat, m_vol.intra_quant_mat);
+    mpeg_video_quant_matrix_get_zigzag_from_raster(iqMatrix->non_intra_quant_mat, m_vol.non_intra_quant_mat);
+    return true;
+}
+
+Decode_Status VaapiDecoderMPEG4::decodeVideoObjectLayer(const uint8_t* data, uint32_t size)
+{
+    if (mpeg4_parse_video_object_layer(&m_vol, m_vo.verid ? &m_vo : NULL, data, size) != MPEG4_PARSER_OK) {
+        ERROR("failed to parse video object layer");
+        m_gotVOL = false;
+        return DECODE_PARSER_FAIL;
+    }
+    m_gotVOL = true;
+    m_shortVideoHeader = false;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG4::beginPicture(Mpeg4VideoObjectCodingType codingType, uint32_t time)
+{
+    SurfacePtr surface = createSurface();
+    if (!surface)
+        return DECODE_NO_SURFACE;
+
+    PicturePtr picture(new VaapiDecPictureMPEG4(m_context, surface, m_currentPTS));
+    picture->m_type = getPictureType(codingType);
+    picture->m_codingType = codingType;
+    picture->m_time = time;
+    if (codingType != MPEG4_B_VOP)
+        VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_REFERENCE);
+    m_currentPicture = picture;
+
+    PicturePtr forward, backward;
+    if (!m_DPB->getReferences(picture, m_gov.closed, forward, backward)) {
+        WARNING("missing reference for picture type %d, skip it", picture->m_type);
+        VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_SKIPPED);
+        return DECODE_SUCCESS;
+    }
+
+    if (!fillPictureParam(picture, forward, backward)) {
+        ERROR("failed to fill picture parameters");
+        return DECODE_FAIL;
+    }
+    if (!m_shortVideoHeader && !fillQuantMatrix(picture)) {
+        ERROR("failed to fill quant matrix");
+        return DECODE_FAIL;
+    }
+    return DECODE_SUCCESS;
+}
+
+bool VaapiDecoderMPEG4::newSlice(const uint8_t* data, uint32_t size, uint32_t headerSize,
+                                 uint32_t macroblockNumber, uint32_t quantScale)
+{
+    VASliceParameterBufferMPEG4* sliceParam;
+    if (!m_currentPicture->newSlice(sliceParam, data, size))
+        return false;
+    sliceParam->macroblock_offset = headerSize;
+    sliceParam->macroblock_number = macroblockNumber;
+    sliceParam->quant_scale = quantScale;
+    return true;
+}
+
+bool VaapiDecoderMPEG4::decodeSlices(const uint8_t* data, uint32_t size)
+{
+    //first slice starts from the vop start code
+    uint32_t start = 0;
+    uint32_t headerSize = m_vop.size;
+    uint32_t macroblockNumber = 0;
+    uint32_t quantScale = m_vop.quant;
+
+    if (!m_vol.resync_marker_disable) {
+        uint32_t markerBits = getResyncMarkerBits(m_vop);
+        for (uint32_t pos = (m_vop.size + 7) / 8; pos < size; pos++) {
+            if (!isResyncMarker(data + pos, size - pos, markerBits))
+                continue;
+            //header extension may change the vop fields, keep ours
+            Mpeg4VideoObjectPlane vop = m_vop;
+            Mpeg4VideoPacketHdr packetHdr;
+            if (mpeg4_parse_video_packet_header(&packetHdr, &m_vol, &vop, NULL,
+                                                data + pos, size - pos) != MPEG4_PARSER_OK) {
+                WARNING("failed to parse video packet header at %d", pos);
+                continue;
+            }
+            if (!newSlice(data + start, pos - start, headerSize, macroblockNumber, quantScale))
+                return false;
+            start = pos;
+            headerSize = packetHdr.size;
+            macroblockNumber = packetHdr.macroblock_number;
+            quantScale = packetHdr.quant_scale;
+        }
+    }
+    return newSlice(data + start, size - start, headerSize, macroblockNumber, quantScale);
+}
+
+Decode_Status VaapiDecoderMPEG4::decodeVideoObjectPlane(const uint8_t* data, uint32_t size)
+{
+    Decode_Status status;
+
+    if (!m_gotVOL) {
+        DEBUG("no video object layer, skip vop");
+        return DECODE_SUCCESS;
+    }
+    if (mpeg4_parse_video_object_plane(&m_vop, &m_spriteTrajectory, &m_vol, data, size) != MPEG4_PARSER_OK) {
+        ERROR("failed to parse video object plane");
+        return DECODE_PARSER_FAIL;
+    }
+    //before time base update, a format change makes client resend the buffer
+    status = ensureContext();
+    if (status != DECODE_SUCCESS)
+        return status;
+    uint32_t time = getVopTime();
+
+    if (!m_vop.coded) {
+        //divx packed bitstream puts a not coded vop where the packed reference displays
+        if (m_packedFrame) {
+            PicturePtr reference = m_DPB->pending();
+            if (reference)
+                reference->m_timeStamp = m_currentPTS;
+        }
+        m_packedFrame = false;
+        return DECODE_SUCCESS;
+    }
+    m_packedFrame = m_vopCount++ && m_vop.coding_type == MPEG4_B_VOP;
+
+    status = beginPicture(m_vop.coding_type, time);
+    if (status != DECODE_SUCCESS)
+        return status;
+    if (!VAAPI_PICTURE_IS_SKIPPED(m_currentPicture) && !decodeSlices(data, size))
+        return DECODE_FAIL;
+    return decodeCurrentPicture();
+}
+
+Decode_Status VaapiDecoderMPEG4::decodeShortHeader(const uint8_t* data, uint32_t size)
+{
+    Decode_Status status;
+
+    if (mpeg4_parse_video_plane_short_header(&m_shortHdr, data, size) != MPEG4_PARSER_OK) {
+        ERROR("failed to parse short header");
+        return DECODE_PARSER_FAIL;
+    }
+    if (!m_shortHdr.vop_width) {
+        ERROR("source format %d is not supported", m_shortHdr.source_format);
+        return DECODE_PARSER_FAIL;
+    }
+    m_shortVideoHeader = true;
+    status = ensureContext();
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    Mpeg4VideoObjectCodingType codingType = m_shortHdr.picture_coding_type ? MPEG4_P_VOP : MPEG4_I_VOP;
+    status = beginPicture(codingType, 0);
+    if (status != DECODE_SUCCESS)
+        return status;
+    if (!VAAPI_PICTURE_IS_SKIPPED(m_currentPicture)
+        && !newSlice(data, size, m_shortHdr.size, 0, m_shortHdr.vop_quant))
+        return DECODE_FAIL;
+    return decodeCurrentPicture();
+}
+
+Decode_Status VaapiDecoderMPEG4::decodeCurrentPicture()
+{
+    if (!m_currentPicture)
+        return DECODE_SUCCESS;
+
+    PicturePtr picture = m_currentPicture;
+    m_currentPicture.reset();
+    if (VAAPI_PICTURE_IS_SKIPPED(picture))
+        return DECODE_SUCCESS;
+    if (!picture->decode()) {
+        ERROR("failed to decode picture");
+        return DECODE_FAIL;
+    }
+    return m_DPB->add(picture) ? DECODE_SUCCESS : DECODE_FAIL;
+}
+
+Decode_Status VaapiDecoderMPEG4::flushPictures()
+{
+    Decode_Status status = decodeCurrentPicture();
+    m_DPB->flush();
+    m_packedFrame = false;
+    return status;
+}
+
+Decode_Status VaapiDecoderMPEG4::decodePacket(const Mpeg4Packet& packet, uint32_t size)
+{
+    Decode_Status status = DECODE_SUCCESS;
+    const uint8_t* data = packet.data + packet.offset;
+
+    //video object start codes carry nothing
+    if (packet.type <= MPEG4_VIDEO_OBJ_LAST)
+        return DECODE_SUCCESS;
+    if (packet.type >= MPEG4_VIDEO_LAYER_FIRST && packet.type <= MPEG4_VIDEO_LAYER_LAST)
+        return decodeVideoObjectLayer(data, size);
+
+    switch (packet.type) {
+    case MPEG4_VISUAL_OBJ_SEQ_START:
+        m_gotVOS = mpeg4_parse_visual_object_sequence(&m_vos, data, size) == MPEG4_PARSER_OK;
+        if (!m_gotVOS)
+            WARNING("failed to parse visual object sequence");
+        break;
+    case MPEG4_VISUAL_OBJ:
+        if (mpeg4_parse_visual_object(&m_vo, NULL, data, size) != MPEG4_PARSER_OK) {
+            WARNING("failed to parse visual object");
+            memset(&m_vo, 0, sizeof(m_vo));
+        }
+        break;
+    case MPEG4_GROUP_OF_VOP:
+        if (mpeg4_parse_group_of_vop(&m_gov, data, size) != MPEG4_PARSER_OK) {
+            WARNING("failed to parse group of vop");
+            break;
+        }
+        m_govTime = (m_gov.hours * 60 + m_gov.minutes) * 60 + m_gov.seconds;
+        m_gotGov = true;
+        break;
+    case MPEG4_VIDEO_OBJ_PLANE:
+        status = decodeVideoObjectPlane(data, size);
+        break;
+    case MPEG4_VISUAL_OBJ_SEQ_END:
+        status = flushPictures();
+        break;
+    default:
+        break;
+    }
+    return status;
+}
+
+Decode_Status VaapiDecoderMPEG4::decodeBuffer(const uint8_t* data, uint32_t size)
+{
+    Decode_Status status;
+    Mpeg4ParseResult result;
+    Mpeg4Packet packet;
+    uint32_t offset = 0;
+
+    if (isShortHeader(data, size)) {
+        while ((result = h263_parse(&packet, data, offset, size)) == MPEG4_PARSER_OK
+               || result == MPEG4_PARSER_NO_PACKET_END) {
+            uint32_t packetSize = result == MPEG4_PARSER_OK ? packet.size : size - packet.offset;
+            status = decodeShortHeader(data + packet.offset, packetSize);
+            if (status != DECODE_SUCCESS)
+                return status;
+            offset = packet.offset + packetSize;
+            if (result == MPEG4_PARSER_NO_PACKET_END)
+                break;
+        }
+        return DECODE_SUCCESS;
+    }
+
+    while ((result = mpeg4_parse(&packet, TRUE, NULL, data, offset, size)) == MPEG4_PARSER_OK
+           || result == MPEG4_PARSER_NO_PACKET_END) {
+        uint32_t packetSize = result == MPEG4_PARSER_OK ? packet.size : size - packet.offset;
+        status = decodePacket(packet, packetSize);
+        if (status != DECODE_SUCCESS)
+            return status;
+        offset = packet.offset + packetSize;
+        if (result == MPEG4_PARSER_NO_PACKET_END)
+            break;
+    }
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG4::start(VideoConfigBuffer * buffer)
+{
+    DEBUG("MPEG4: start()");
+
+    buffer->profile = VAProfileMPEG4AdvancedSimple;
+    buffer->surfaceNumber = REF_DPB_MAX_REFERENCE + 1 + MPEG4_EXTRA_SURFACE_NUMBER;
+
+    m_configBuffer = *buffer;
+    m_configBuffer.data = NULL;
+    m_configBuffer.size = 0;
+
+    // va context is created on first vop
+    m_configBuffer.width = 0;
+    m_configBuffer.height = 0;
+
+    //codec data holds the visual object sequence and video object layer
+    if (buffer->data && buffer->size)
+        return decodeBuffer(buffer->data, buffer->size);
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderMPEG4::reset(VideoConfigBuffer * buffer)
+{
+    DEBUG("MPEG4: reset()");
+    clearReferences();
+    m_currentPicture.reset();
+    m_packedFrame = false;
+    return VaapiDecoderBase::reset(buffer);
+}
+
+void VaapiDecoderMPEG4::stop(void)
+{
+    DEBUG("MPEG4: stop()");
+    flush();
+    VaapiDecoderBase::stop();
+}
+
+Decode_Status VaapiDecoderMPEG4::decode(VideoDecodeBuffer * buffer)
+{
+    if (!buffer || !buffer->data || !buffer->size)
+        return DECODE_INVALID_DATA;
+
+    m_currentPTS = buffer->timeStamp;
+    DEBUG("MPEG4: Decode(bufsize =%d, timestamp=%ld)", buffer->size, m_currentPTS);
+
+    m_vopCount = 0;
+    return decodeBuffer(buffer->data, buffer->size);
+}
+
+} //namespace YamiMediaCodec
@@ -0,0 +1,142 @@
+/*
+ *  vaapidecoder_mpeg4.h - mpeg4 part 2 and h263 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapidecoder_mpeg4_h
+#define vaapidecoder_mpeg4_h
+
+#include "codecparsers/mpeg4parser.h"
+#include "vaapidecoder_base.h"
+#include "vaapidecoder_ref_dpb.h"
+#include "vaapidecpicture.h"
+
+namespace YamiMediaCodec{
+enum {
+    MPEG4_EXTRA_SURFACE_NUMBER = 5,
+};
+
+class VaapiDecPictureMPEG4 : public VaapiDecPicture
+{
+  public:
+    typedef std::tr1::shared_ptr<VaapiDecPictureMPEG4> PicturePtr;
+    VaapiDecPictureMPEG4(const ContextPtr& context, const SurfacePtr& surface, int64_t timeStamp)
+        : VaapiDecPicture(context, surface, timeStamp)
+        , m_flags(0)
+        , m_codingType(MPEG4_I_VOP)
+        , m_time(0)
+    {
+    }
+
+    uint32_t m_flags;
+    //vop_coding_type, a B-VOP needs the one of its backward reference
+    Mpeg4VideoObjectCodingType m_codingType;
+    //display time in vop_time_increment_resolution units, for TRB and TRD
+    uint32_t m_time;
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecPictureMPEG4);
+};
+
+/* S-VOPs (GMC) predict from the forward reference like P-VOPs */
+class VaapiMPEG4DPB : public VaapiRefDPB<VaapiDecPictureMPEG4> {
+  public:
+    VaapiMPEG4DPB(VaapiDecoderBase* decoder)
+        : VaapiRefDPB<VaapiDecPictureMPEG4>(decoder)
+    {
+    }
+
+  protected:
+    virtual VaapiPictureType predictionType(const PicturePtr& picture)
+    {
+        if (picture->m_type == VAAPI_PICTURE_TYPE_S)
+            return VAAPI_PICTURE_TYPE_P;
+        return picture->m_type;
+    }
+};
+
+class VaapiDecoderMPEG4:public VaapiDecoderBase {
+  public:
+    typedef VaapiDecPictureMPEG4::PicturePtr PicturePtr;
+    VaapiDecoderMPEG4();
+    virtual ~ VaapiDecoderMPEG4();
+    virtual Decode_Status start(VideoConfigBuffer * buffer);
+    virtual Decode_Status reset(VideoConfigBuffer * buffer);
+    virtual void stop(void);
+    virtual Decode_Status decode(VideoDecodeBuffer * buffer);
+
+  protected:
+    virtual void clearReferences();
+    virtual Decode_Status flushPictures();
+
+  private:
+    /* start code delimited mpeg4 data, or h263 pictures */
+    Decode_Status decodeBuffer(const uint8_t* data, uint32_t size);
+    Decode_Status decodePacket(const Mpeg4Packet& packet, uint32_t size);
+    Decode_Status decodeVideoObjectLayer(const uint8_t* data, uint32_t size);
+    Decode_Status decodeVideoObjectPlane(const uint8_t* data, uint32_t size);
+    /* h263 picture, starts from the picture start code */
+    Decode_Status decodeShortHeader(const uint8_t* data, uint32_t size);
+    /* check the context reset senerios */
+    Decode_Status ensureContext();
+    Decode_Status beginPicture(Mpeg4VideoObjectCodingType codingType, uint32_t time);
+    Decode_Status decodeCurrentPicture();
+    /* split the vop into video packets on resync markers */
+    bool decodeSlices(const uint8_t* data, uint32_t size);
+    bool newSlice(const uint8_t* data, uint32_t size, uint32_t headerSize,
+                  uint32_t macroblockNumber, uint32_t quantScale);
+    bool fillPictureParam(const PicturePtr& picture,
+                          const PicturePtr& forward, const PicturePtr& backward);
+    void fillShortHeaderParam(VAPictureParameterBufferMPEG4* param);
+    bool fillQuantMatrix(const PicturePtr& picture);
+    /* display time of current vop, updates the time base of reference vops */
+    uint32_t getVopTime();
+    VAProfile getVAProfile();
+
+    VaapiMPEG4DPB::Ptr m_DPB;
+    PicturePtr m_currentPicture;
+
+    Mpeg4VisualObjectSequence m_vos;
+    Mpeg4VisualObject m_vo;
+    Mpeg4VideoObjectLayer m_vol;
+    Mpeg4VideoObjectPlane m_vop;
+    Mpeg4SpriteTrajectory m_spriteTrajectory;
+    Mpeg4VideoPlaneShortHdr m_shortHdr;
+    Mpeg4GroupOfVOP m_gov;
+
+    //seconds of the latest reference vop and the one before it
+    uint32_t m_syncTime;
+    uint32_t m_lastSyncTime;
+    //seconds of a gov header, the next reference vop counts from it
+    uint32_t m_govTime;
+    //coded vops in current input buffer
+    uint32_t m_vopCount;
+
+    uint32_t m_gotVOS:1;
+    uint32_t m_gotVOL:1;
+    uint32_t m_gotGov:1;
+    uint32_t m_shortVideoHeader:1;
+    //divx packed bitstream, last buffer carried a reference and a B-VOP
+    uint32_t m_packedFrame:1;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecoderMPEG4);
+};
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ *  vaapidecoder_ref_dpb.h - two reference DPB for mpeg2, vc1 and mpeg4 decoders
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapidecoder_ref_dpb_h
+#define vaapidecoder_ref_dpb_h
+
+#include <assert.h>
+#include "vaapidecoder_base.h"
+
+namespace YamiMediaCodec{
+enum {
+    REF_DPB_MAX_REFERENCE = 2,  // forward and backward reference
+};
+
+/**
+ * \class VaapiRefDPB
+ * \brief keeps the two latest reference pictures of mpeg2, vc1 and mpeg4
+ * <pre>
+ * pictures come in decoding order, I0 P3 B1 B2 P6 B4 B5 ...
+ * 1. a B picture is never referenced, it's output right away.
+ * 2. a reference picture is held until next reference picture arrives,
+ *    the B pictures between them are displayed before it.
+ * Picture is the codec picture class, it carries m_flags.
+ * </pre>
+ */
+template <class Picture>
+class VaapiRefDPB {
+  public:
+    typedef std::tr1::shared_ptr<VaapiRefDPB> Ptr;
+    typedef std::tr1::shared_ptr<Picture> PicturePtr;
+    VaapiRefDPB(VaapiDecoderBase* decoder);
+    virtual ~VaapiRefDPB() {}
+
+    /* add a frame after both fields are decoded */
+    bool add(const PicturePtr& picture);
+    /* references of picture to decode, false if a needed one is missing.
+     * leading B pictures of a closed gop only predict from backward */
+    bool getReferences(const PicturePtr& picture, bool closedGop,
+                       PicturePtr& forward, PicturePtr& backward);
+    /* the reference picture held for output, NULL if none */
+    PicturePtr pending();
+    /* output the held reference picture, references are kept */
+    void drain();
+    /* output the held reference picture, drop all references */
+    void flush();
+    /* drop all references without output */
+    void clear();
+
+  protected:
+    /* I, P or B, the way picture uses references */
+    virtual VaapiPictureType predictionType(const PicturePtr& picture)
+    {
+        return picture->m_type;
+    }
+
+  private:
+    bool output(const PicturePtr& picture);
+
+    VaapiDecoderBase* m_decoder;
+    //m_refs[m_numRefs - 1] is the latest one
+    PicturePtr m_refs[REF_DPB_MAX_REFERENCE];
+    uint32_t m_numRefs;
+    //latest reference picture is not output yet
+    bool m_pending;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiRefDPB);
+};
+
+template <class Picture>
+VaapiRefDPB<Picture>::VaapiRefDPB(VaapiDecoderBase* decoder)
+    : m_decoder(decoder)
+    , m_numRefs(0)
+    , m_pending(false)
+{
+}
+
+template <class Picture>
+bool VaapiRefDPB<Picture>::output(const PicturePtr& picture)
+{
+    VaapiDecoderBase::PicturePtr base = std::tr1::static_pointer_cast<VaapiDecPicture>(picture);
+    return m_decoder->outputPicture(base) == DECODE_SUCCESS;
+}
+
+template <class Picture>
+bool VaapiRefDPB<Picture>::add(const PicturePtr& picture)
+{
+    if (!VAAPI_PICTURE_IS_REFERENCE(picture))
+        return output(picture);
+
+    bool ret = true;
+    if (m_pending) {
+        ret = output(m_refs[m_numRefs - 1]);
+        m_pending = false;
+    }
+    if (m_numRefs == REF_DPB_MAX_REFERENCE) {
+        m_refs[0] = m_refs[1];
+        m_numRefs--;
+    }
+    m_refs[m_numRefs++] = picture;
+    m_pending = true;
+    return ret;
+}
+
+template <class Picture>
+bool VaapiRefDPB<Picture>::getReferences(const PicturePtr& picture, bool closedGop,
+                                         PicturePtr& forward, PicturePtr& backward)
+{
+    forward.reset();
+    backward.reset();
+    switch (predictionType(picture)) {
+    case VAAPI_PICTURE_TYPE_I:
+        return true;
+    case VAAPI_PICTURE_TYPE_P:
+        if (!m_numRefs)
+            return false;
+        forward = m_refs[m_numRefs - 1];
+        return true;
+    case VAAPI_PICTURE_TYPE_B:
+        if (m_numRefs == REF_DPB_MAX_REFERENCE) {
+            forward = m_refs[0];
+            backward = m_refs[1];
+            return true;
+        }
+        if (m_numRefs && closedGop) {
+            forward = backward = m_refs[0];
+            return true;
+        }
+        return false;
+    default:
+        break;
+    }
+    return false;
+}
+
+template <class Picture>
+typename VaapiRefDPB<Picture>::PicturePtr VaapiRefDPB<Picture>::pending()
+{
+    if (!m_pending)
+        return PicturePtr();
+    return m_refs[m_numRefs - 1];
+}
+
+template <class Picture>
+void VaapiRefDPB<Picture>::drain()
+{
+    if (m_pending) {
+        assert(m_numRefs);
+        output(m_refs[m_numRefs - 1]);
+        m_pending = false;
+    }
+}
+
+template <class Picture>
+void VaapiRefDPB<Picture>::flush()
+{
+    drain();
+    clear();
+}
+
+template <class Picture>
+void VaapiRefDPB<Picture>::clear()
+{
+    for (uint32_t i = 0; i < m_numRefs; i++)
+        m_refs[i].reset();
+    m_numRefs = 0;
+    m_pending = false;
+}
+
+} //namespace YamiMediaCodec
+
+#endif
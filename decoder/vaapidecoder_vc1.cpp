@@ -0,0 +1,853 @@
+/*
+ *  vaapidecoder_vc1.cpp - vc1 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the
+ *  Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "common/log.h"
+#include "vaapidecoder_vc1.h"
+
+namespace YamiMediaCodec{
+typedef VaapiDecoderVC1::PicturePtr PicturePtr;
+
+//size of 00 00 01 xx
+#define START_CODE_SIZE 4
+
+static VaapiPictureType getPictureType(VC1PictureType type)
+{
+    switch (type) {
+    case VC1_PICTURE_TYPE_I:
+        return VAAPI_PICTURE_TYPE_I;
+    case VC1_PICTURE_TYPE_P:
+    case VC1_PICTURE_TYPE_SKIPPED:
+        return VAAPI_PICTURE_TYPE_P;
+    case VC1_PICTURE_TYPE_B:
+        return VAAPI_PICTURE_TYPE_B;
+    case VC1_PICTURE_TYPE_BI:
+        return VAAPI_PICTURE_TYPE_BI;
+    default:
+        break;
+    }
+    return VAAPI_PICTURE_TYPE_NONE;
+}
+
+//picture_type of VAPictureParameterBufferVC1
+static uint32_t getPTYPE(VC1PictureType type)
+{
+    switch (type) {
+    case VC1_PICTURE_TYPE_I:
+        return 0;
+    case VC1_PICTURE_TYPE_P:
+        return 1;
+    case VC1_PICTURE_TYPE_B:
+        return 2;
+    case VC1_PICTURE_TYPE_BI:
+        return 3;
+    default:
+        break;
+    }
+    return 4; //skipped P frame
+}
+
+//index of BFRACTION vlc table 40, the parser gives value in VC1_BFRACTION_BASIS
+static uint32_t getBFRACTION(uint32_t bfraction)
+{
+    static const uint8_t numerator[] = {
+        1, 1, 2, 1, 3, 1, 2, 3, 4, 1, 5, 1, 2, 3, 4, 5, 6, 1, 3, 5, 7
+    };
+    static const uint8_t denominator[] = {
+        2, 3, 3, 4, 4, 5, 5, 5, 5, 6, 6, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8
+    };
+    if (!bfraction)
+        return 0;
+    if (bfraction == VC1_BFRACTION_PTYPE_BI)
+        return 22;
+    for (uint32_t i = 0; i < N_ELEMENTS(numerator); i++) {
+        if (VC1_BFRACTION_BASIS * numerator[i] / denominator[i] == bfraction)
+            return i;
+    }
+    return 21; //reserved
+}
+
+static uint32_t getVAMvMode(uint8_t mvmode)
+{
+    switch (mvmode) {
+    case VC1_MVMODE_1MV_HPEL_BILINEAR:
+        return VAMvMode1MvHalfPelBilinear;
+    case VC1_MVMODE_1MV:
+        return VAMvMode1Mv;
+    case VC1_MVMODE_1MV_HPEL:
+        return VAMvMode1MvHalfPel;
+    case VC1_MVMODE_MIXED_MV:
+        return VAMvModeMixedMv;
+    case VC1_MVMODE_INTENSITY_COMP:
+        return VAMvModeIntensityCompensation;
+    default:
+        break;
+    }
+    return 0;
+}
+
+//a start code can't be emulated, 00 00 0x is escaped to 00 00 03 0x
+static inline bool isEmulationPreventionByte(const uint8_t* data, uint32_t size, uint32_t i)
+{
+    return i >= 2 && i + 1 < size && data[i] == 3
+        && !data[i - 1] && !data[i - 2] && data[i + 1] < 4;
+}
+
+//pack 3 bitplanes of one macroblock into a nibble, two macroblocks per byte
+static inline void packBitPlanes(uint8_t* bitPlane, uint32_t n,
+                                 const uint8_t* planes[3], uint32_t index)
+{
+    uint8_t v = 0;
+    if (planes[0])
+        v |= planes[0][index];
+    if (planes[1])
+        v |= planes[1][index] << 1;
+    if (planes[2])
+        v |= planes[2][index] << 2;
+    bitPlane[n / 2] = (bitPlane[n / 2] << 4) | v;
+}
+
+VaapiDecoderVC1::VaapiDecoderVC1()
+{
+    memset(&m_sequenceHdr, 0, sizeof(m_sequenceHdr));
+    memset(&m_entryPointHdr, 0, sizeof(m_entryPointHdr));
+    memset(&m_frameHdr, 0, sizeof(m_frameHdr));
+    m_bitPlanes = vc1_bitplanes_new();
+    m_width = 0;
+    m_height = 0;
+    m_rndCtrl = 0;
+
+    m_gotSequenceHdr = false;
+    m_gotEntryPoint = false;
+    m_sequenceChanged = false;
+    m_DPB.reset(new VaapiVC1DPB(this));
+}
+
+VaapiDecoderVC1::~VaapiDecoderVC1()
+{
+    stop();
+    vc1_bitplanes_free(m_bitPlanes);
+}
+
+bool VaapiDecoderVC1::isAdvanced() const
+{
+    return m_sequenceHdr.profile == VC1_PROFILE_ADVANCED;
+}
+
+bool VaapiDecoderVC1::isFieldPicture() const
+{
+    return isAdvanced() && m_frameHdr.pic.advanced.fcm == VC1_FIELD_INTERLACE;
+}
+
+bool VaapiDecoderVC1::isTopFieldFirst() const
+{
+    //tff is only sent with pulldown of interlaced content, it's 1 otherwise
+    const VC1AdvancedSeqHdr& seq = m_sequenceHdr.advanced;
+    if (seq.pulldown && seq.interlace && !seq.psf)
+        return m_frameHdr.pic.advanced.tff;
+    return true;
+}
+
+VAProfile VaapiDecoderVC1::getVAProfile()
+{
+    switch (m_sequenceHdr.profile) {
+    case VC1_PROFILE_SIMPLE:
+        return VAProfileVC1Simple;
+    case VC1_PROFILE_MAIN:
+        return VAProfileVC1Main;
+    default:
+        break;
+    }
+    return VAProfileVC1Advanced;
+}
+
+Decode_Status VaapiDecoderVC1::ensureContext()
+{
+    if (!m_sequenceChanged)
+        return DECODE_SUCCESS;
+    m_sequenceChanged = false;
+    return updateContext(getVAProfile(), m_width, m_height);
+}
+
+void VaapiDecoderVC1::clearReferences()
+{
+    m_DPB->clear();
+    m_firstField.reset();
+}
+
+const uint8_t* VaapiDecoderVC1::unescape(const uint8_t* data, uint32_t& size)
+{
+    m_rbdu.resize(size + 1);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        if (!isEmulationPreventionByte(data, size, i))
+            m_rbdu[n++] = data[i];
+    }
+    size = n;
+    return &m_rbdu[0];
+}
+
+void VaapiDecoderVC1::fillPictureStructC(VAPictureParameterBufferVC1* param)
+{
+    const VC1SeqStructC& structC = m_sequenceHdr.struct_c;
+    const VC1PicSimpleMain& pic = m_frameHdr.pic.simple;
+
+    param->sequence_fields.bits.finterpflag = structC.finterpflag;
+    param->sequence_fields.bits.multires = structC.multires;
+    param->sequence_fields.bits.overlap = structC.overlap;
+    param->sequence_fields.bits.syncmarker = structC.syncmarker;
+    param->sequence_fields.bits.rangered = structC.rangered;
+    param->sequence_fields.bits.max_b_frames = structC.maxbframes;
+    param->fast_uvmc_flag = structC.fastuvmc;
+    param->b_picture_fraction = getBFRACTION(pic.bfraction);
+    param->cbp_table = pic.cbptab;
+    param->range_reduction_frame = pic.rangeredfrm;
+    param->picture_resolution_index = pic.respic;
+    param->luma_scale = pic.lumscale;
+    param->luma_shift = pic.lumshift;
+    param->raw_coding.flags.mv_type_mb = pic.mvtypemb;
+    param->raw_coding.flags.direct_mb = pic.directmb;
+    param->raw_coding.flags.skip_mb = pic.skipmb;
+
+    VC1PictureType type = m_frameHdr.ptype;
+    bool mixedMv = pic.mvmode == VC1_MVMODE_MIXED_MV
+        || (pic.mvmode == VC1_MVMODE_INTENSITY_COMP && pic.mvmode2 == VC1_MVMODE_MIXED_MV);
+    param->bitplane_present.flags.bp_mv_type_mb = type == VC1_PICTURE_TYPE_P && mixedMv;
+    param->bitplane_present.flags.bp_direct_mb = type == VC1_PICTURE_TYPE_B;
+    param->bitplane_present.flags.bp_skip_mb = type == VC1_PICTURE_TYPE_P || type == VC1_PICTURE_TYPE_B;
+
+    param->mv_fields.bits.mv_table = pic.mvtab;
+    param->mv_fields.bits.extended_mv_flag = structC.extended_mv;
+    param->mv_fields.bits.extended_mv_range = pic.mvrange;
+    param->pic_quantizer_fields.bits.dquant = structC.dquant;
+    param->pic_quantizer_fields.bits.quantizer = structC.quantizer;
+    param->transform_fields.bits.variable_sized_transform_flag = structC.vstransform;
+    param->transform_fields.bits.mb_level_transform_type_flag = pic.ttmbf;
+    param->transform_fields.bits.frame_level_transform_type = pic.ttfrm;
+    param->transform_fields.bits.transform_ac_codingset_idx2 = pic.transacfrm2;
+
+    //8.3.7, rounding control is reset by I frames and toggled by P frames
+    if (type == VC1_PICTURE_TYPE_I || type == VC1_PICTURE_TYPE_BI)
+        m_rndCtrl = 1;
+    else if (type == VC1_PICTURE_TYPE_P)
+        m_rndCtrl ^= 1;
+    param->rounding_control = m_rndCtrl;
+}
+
+void VaapiDecoderVC1::fillPictureAdvanced(VAPictureParameterBufferVC1* param,
+                                          const PicturePtr& picture)
+{
+    const VC1AdvancedSeqHdr& seq = m_sequenceHdr.advanced;
+    const VC1EntryPointHdr& entry = m_entryPointHdr;
+    const VC1PicAdvanced& pic = m_frameHdr.pic.advanced;
+    bool progressive = pic.fcm == VC1_FRAME_PROGRESSIVE;
+    bool field = pic.fcm == VC1_FIELD_INTERLACE;
+
+    param->sequence_fields.bits.pulldown = seq.pulldown;
+    param->sequence_fields.bits.interlace = seq.interlace;
+    param->sequence_fields.bits.tfcntrflag = seq.tfcntrflag;
+    param->sequence_fields.bits.finterpflag = seq.finterpflag;
+    param->sequence_fields.bits.psf = seq.psf;
+    param->sequence_fields.bits.overlap = entry.overlap;
+    param->entrypoint_fields.bits.broken_link = entry.broken_link;
+    param->entrypoint_fields.bits.closed_entry = entry.closed_entry;
+    param->entrypoint_fields.bits.panscan_flag = entry.panscan_flag;
+    param->entrypoint_fields.bits.loopfilter = entry.loopfilter;
+    param->conditional_overlap_flag = pic.condover;
+    param->fast_uvmc_flag = entry.fastuvmc;
+    param->range_mapping_fields.bits.luma_flag = entry.range_mapy_flag;
+    param->range_mapping_fields.bits.luma = entry.range_mapy;
+    param->range_mapping_fields.bits.chroma_flag = entry.range_mapuv_flag;
+    param->range_mapping_fields.bits.chroma = entry.range_mapuv;
+    param->b_picture_fraction = getBFRACTION(pic.bfraction);
+    //interlaced pictures use their own tables
+    param->cbp_table = progressive ? pic.cbptab : pic.icbptab;
+    param->mb_mode_table = pic.mbmodetab;
+    param->rounding_control = pic.rndctrl;
+    param->post_processing = pic.postproc;
+    param->luma_scale = pic.lumscale;
+    param->luma_shift = pic.lumshift;
+
+    param->picture_fields.bits.frame_coding_mode = pic.fcm;
+    param->picture_fields.bits.top_field_first = isTopFieldFirst();
+    param->picture_fields.bits.is_first_field = !field || VAAPI_PICTURE_IS_FIRST_FIELD(picture);
+    param->picture_fields.bits.intensity_compensation =
+        pic.mvmode == VC1_MVMODE_INTENSITY_COMP || pic.intcomp;
+
+    param->raw_coding.flags.mv_type_mb = pic.mvtypemb;
+    param->raw_coding.flags.direct_mb = pic.directmb;
+    param->raw_coding.flags.skip_mb = pic.skipmb;
+    param->raw_coding.flags.field_tx = pic.fieldtx;
+    param->raw_coding.flags.forward_mb = pic.forwardmb;
+    param->raw_coding.flags.ac_pred = pic.acpred;
+    param->raw_coding.flags.overflags = pic.overflags;
+
+    VC1PictureType type = m_frameHdr.ptype;
+    bool intra = type == VC1_PICTURE_TYPE_I || type == VC1_PICTURE_TYPE_BI;
+    bool mixedMv = pic.mvmode == VC1_MVMODE_MIXED_MV
+        || (pic.mvmode == VC1_MVMODE_INTENSITY_COMP && pic.mvmode2 == VC1_MVMODE_MIXED_MV);
+    param->bitplane_present.flags.bp_mv_type_mb = progressive && type == VC1_PICTURE_TYPE_P && mixedMv;
+    param->bitplane_present.flags.bp_direct_mb = !field && type == VC1_PICTURE_TYPE_B;
+    param->bitplane_present.flags.bp_skip_mb = !field
+        && (type == VC1_PICTURE_TYPE_P || type == VC1_PICTURE_TYPE_B);
+    param->bitplane_present.flags.bp_field_tx = pic.fcm == VC1_FRAME_INTERLACE && intra;
+    param->bitplane_present.flags.bp_forward_mb = field && type == VC1_PICTURE_TYPE_B;
+    param->bitplane_present.flags.bp_ac_pred = intra;
+    param->bitplane_present.flags.bp_overflags = intra && entry.overlap
+        && m_frameHdr.pquant <= 8 && pic.condover == VC1_CONDOVER_SELECT;
+
+    param->reference_fields.bits.reference_distance_flag = entry.refdist_flag;
+    param->reference_fields.bits.reference_distance = pic.refdist;
+    param->reference_fields.bits.num_reference_pictures = pic.numref;
+    param->reference_fields.bits.reference_field_pic_indicator = pic.reffield;
+
+    param->mv_fields.bits.mv_table = progressive ? pic.mvtab : pic.imvtab;
+    param->mv_fields.bits.two_mv_block_pattern_table = pic.mvbptab2;
+    param->mv_fields.bits.four_mv_switch = pic.mvswitch4;
+    param->mv_fields.bits.four_mv_block_pattern_table = pic.mvbptab4;
+    param->mv_fields.bits.extended_mv_flag = entry.extended_mv;
+    param->mv_fields.bits.extended_mv_range = pic.mvrange;
+    param->mv_fields.bits.extended_dmv_flag = entry.extended_dmv;
+    param->mv_fields.bits.extended_dmv_range = pic.dmvrange;
+    param->pic_quantizer_fields.bits.dquant = entry.dquant;
+    param->pic_quantizer_fields.bits.quantizer = entry.quantizer;
+    param->transform_fields.bits.variable_sized_transform_flag = entry.vstransform;
+    param->transform_fields.bits.mb_level_transform_type_flag = pic.ttmbf;
+    param->transform_fields.bits.frame_level_transform_type = pic.ttfrm;
+    param->transform_fields.bits.transform_ac_codingset_idx2 = pic.transacfrm2;
+}
+
+bool VaapiDecoderVC1::fillBitPlane(const PicturePtr& picture,
+                                   const VAPictureParameterBufferVC1* param)
+{
+    if (!param->bitplane_present.value)
+        return true;
+
+    //the order follows bit 0, 1, 2 of the nibble hw expects
+    const uint8_t* planes[3] = { NULL, NULL, NULL };
+    switch (picture->m_type) {
+    case VAAPI_PICTURE_TYPE_P:
+        if (param->bitplane_present.flags.bp_skip_mb)
+            planes[1] = m_bitPlanes->skipmb;
+        if (param->bitplane_present.flags.bp_mv_type_mb)
+            planes[2] = m_bitPlanes->mvtypemb;
+        break;
+    case VAAPI_PICTURE_TYPE_B:
+        if (param->bitplane_present.flags.bp_direct_mb)
+            planes[0] = m_bitPlanes->directmb;
+        if (param->bitplane_present.flags.bp_skip_mb)
+            planes[1] = m_bitPlanes->skipmb;
+        if (param->bitplane_present.flags.bp_forward_mb)
+            planes[2] = m_bitPlanes->forwardmb;
+        break;
+    case VAAPI_PICTURE_TYPE_I:
+    case VAAPI_PICTURE_TYPE_BI:
+        if (param->bitplane_present.flags.bp_field_tx)
+            planes[0] = m_bitPlanes->fieldtx;
+        if (param->bitplane_present.flags.bp_ac_pred)
+            planes[1] = m_bitPlanes->acpred;
+        if (param->bitplane_present.flags.bp_overflags)
+            planes[2] = m_bitPlanes->overflags;
+        break;
+    default:
+        break;
+    }
+
+    uint32_t width = m_sequenceHdr.mb_width;
+    uint32_t height = m_sequenceHdr.mb_height;
+    if (isFieldPicture())
+        height = (height + 1) / 2;
+    uint8_t* bitPlane;
+    if (!picture->editBitPlane(bitPlane, (width * height + 1) / 2))
+        return false;
+
+    uint32_t n = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++, n++)
+            packBitPlanes(bitPlane, n, planes, y * m_sequenceHdr.mb_stride + x);
+    }
+    //move the last nibble to high order
+    if (n & 1)
+        bitPlane[n / 2] <<= 4;
+    return true;
+}
+
+bool VaapiDecoderVC1::fillPictureParam(const PicturePtr& picture,
+                                       const PicturePtr& forward, const PicturePtr& backward)
+{
+    VAPictureParameterBufferVC1* param;
+    if (!picture->editPicture(param))
+        return false;
+
+    const VC1VopDquant& dquant = m_frameHdr.vopdquant;
+    param->forward_reference_picture = forward ? forward->getSurfaceID() : VA_INVALID_SURFACE;
+    param->backward_reference_picture = backward ? backward->getSurfaceID() : VA_INVALID_SURFACE;
+    param->inloop_decoded_picture = VA_INVALID_SURFACE;
+    param->sequence_fields.bits.profile = m_sequenceHdr.profile;
+    param->coded_width = m_width;
+    param->coded_height = m_height;
+    param->picture_fields.bits.picture_type = getPTYPE(m_frameHdr.ptype);
+
+    const VC1PictureType type = m_frameHdr.ptype;
+    uint8_t mvmode, mvmode2;
+    if (isAdvanced()) {
+        mvmode = m_frameHdr.pic.advanced.mvmode;
+        mvmode2 = m_frameHdr.pic.advanced.mvmode2;
+    } else {
+        mvmode = m_frameHdr.pic.simple.mvmode;
+        mvmode2 = m_frameHdr.pic.simple.mvmode2;
+    }
+    if (type == VC1_PICTURE_TYPE_P || type == VC1_PICTURE_TYPE_B)
+        param->mv_fields.bits.mv_mode = getVAMvMode(mvmode);
+    if (type == VC1_PICTURE_TYPE_P && mvmode == VC1_MVMODE_INTENSITY_COMP)
+        param->mv_fields.bits.mv_mode2 = getVAMvMode(mvmode2);
+
+    param->pic_quantizer_fields.bits.half_qp = m_frameHdr.halfqp;
+    param->pic_quantizer_fields.bits.pic_quantizer_scale = m_frameHdr.pquant;
+    param->pic_quantizer_fields.bits.pic_quantizer_type = m_frameHdr.pquantizer;
+    param->pic_quantizer_fields.bits.dq_frame = dquant.dquantfrm;
+    param->pic_quantizer_fields.bits.dq_profile = dquant.dqprofile;
+    if (dquant.dqprofile == VC1_DQPROFILE_SINGLE_EDGE)
+        param->pic_quantizer_fields.bits.dq_sb_edge = dquant.dqbedge;
+    if (dquant.dqprofile == VC1_DQPROFILE_DOUBLE_EDGES)
+        param->pic_quantizer_fields.bits.dq_db_edge = dquant.dqbedge;
+    param->pic_quantizer_fields.bits.dq_binary_level = dquant.dqbilevel;
+    param->pic_quantizer_fields.bits.alt_pic_quantizer = dquant.altpquant;
+    param->transform_fields.bits.transform_ac_codingset_idx1 = m_frameHdr.transacfrm;
+    param->transform_fields.bits.intra_transform_dc_table = m_frameHdr.transdctab;
+
+    if (isAdvanced())
+        fillPictureAdvanced(param, picture);
+    else
+        fillPictureStructC(param);
+    return fillBitPlane(picture, param);
+}
+
+Decode_Status VaapiDecoderVC1::decodeSequenceHeader(const uint8_t* data, uint32_t size)
+{
+    const uint8_t* rbdu = unescape(data, size);
+    if (vc1_parse_sequence_header(rbdu, size, &m_sequenceHdr) != VC1_PARSER_OK) {
+        ERROR("failed to parse sequence header");
+        return DECODE_PARSER_FAIL;
+    }
+    if (!isAdvanced()) {
+        ERROR("sequence header of profile %d in stream", m_sequenceHdr.profile);
+        return DECODE_PARSER_FAIL;
+    }
+    m_width = m_sequenceHdr.advanced.max_coded_width;
+    m_height = m_sequenceHdr.advanced.max_coded_height;
+    m_gotSequenceHdr = true;
+    m_gotEntryPoint = false;
+    m_sequenceChanged = true;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::decodeEntryPoint(const uint8_t* data, uint32_t size)
+{
+    if (!m_gotSequenceHdr) {
+        DEBUG("no sequence header, skip entry point");
+        return DECODE_SUCCESS;
+    }
+    const uint8_t* rbdu = unescape(data, size);
+    if (vc1_parse_entry_point_header(rbdu, size, &m_entryPointHdr, &m_sequenceHdr) != VC1_PARSER_OK) {
+        ERROR("failed to parse entry point header");
+        return DECODE_PARSER_FAIL;
+    }
+    if (m_entryPointHdr.coded_size_flag) {
+        m_width = m_entryPointHdr.coded_width;
+        m_height = m_entryPointHdr.coded_height;
+        m_sequenceChanged = true;
+    }
+    //mb size is updated by sequence header and entry point
+    if (!vc1_bitplanes_ensure_size(m_bitPlanes, &m_sequenceHdr)) {
+        ERROR("failed to allocate bitplanes");
+        return DECODE_MEMORY_FAIL;
+    }
+    m_gotEntryPoint = true;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::beginPicture(bool secondField)
+{
+    uint32_t structure = VAAPI_PICTURE_STRUCTURE_FRAME;
+    if (isFieldPicture()) {
+        structure = (isTopFieldFirst() != secondField) ?
+            VAAPI_PICTURE_STRUCTURE_TOP_FIELD : VAAPI_PICTURE_STRUCTURE_BOTTOM_FIELD;
+    }
+
+    PicturePtr picture;
+    if (secondField) {
+        if (!m_firstField) {
+            WARNING("field has no first field, skip it");
+            return DECODE_SUCCESS;
+        }
+        picture = m_firstField->newField();
+    } else {
+        if (m_firstField) {
+            WARNING("field %d has no opposite field", m_firstField->m_picStructure);
+            if (!VAAPI_PICTURE_IS_SKIPPED(m_firstField))
+                m_DPB->add(m_firstField);
+            m_firstField.reset();
+        }
+        SurfacePtr surface = createSurface();
+        if (!surface)
+            return DECODE_NO_SURFACE;
+        picture.reset(new VaapiDecPictureVC1(m_context, surface, m_currentPTS));
+        VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_FF);
+        VaapiPictureType type = getPictureType(m_frameHdr.ptype);
+        if (type == VAAPI_PICTURE_TYPE_I || type == VAAPI_PICTURE_TYPE_P)
+            VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_REFERENCE);
+    }
+    picture->m_type = getPictureType(m_frameHdr.ptype);
+    picture->m_picStructure = structure;
+    m_currentPicture = picture;
+
+    //second field of a skipped first field is skipped too
+    if (VAAPI_PICTURE_IS_SKIPPED(picture))
+        return DECODE_SUCCESS;
+
+    PicturePtr forward, backward;
+    bool closedEntry = isAdvanced() && m_entryPointHdr.closed_entry;
+    if (!m_DPB->getReferences(picture, closedEntry, forward, backward)) {
+        if (m_firstField && picture->m_type == VAAPI_PICTURE_TYPE_P) {
+            //second field of an I frame only predicts from first field
+            forward = m_firstField;
+        } else {
+            WARNING("missing reference for picture type %d, skip it", picture->m_type);
+            VAAPI_PICTURE_FLAG_SET(picture, VAAPI_PICTURE_FLAG_SKIPPED);
+            return DECODE_SUCCESS;
+        }
+    }
+
+    if (!fillPictureParam(picture, forward, backward)) {
+        ERROR("failed to fill picture parameters");
+        return DECODE_FAIL;
+    }
+    return DECODE_SUCCESS;
+}
+
+bool VaapiDecoderVC1::newSlice(const uint8_t* data, uint32_t size,
+                               uint32_t headerSize, uint32_t position)
+{
+    VASliceParameterBufferVC1* sliceParam;
+    if (!m_currentPicture->newSlice(sliceParam, data, size))
+        return false;
+    //header size counts bits without emulation prevention bytes, driver skips them
+    sliceParam->macroblock_offset = headerSize;
+    sliceParam->slice_vertical_position = position;
+    return true;
+}
+
+Decode_Status VaapiDecoderVC1::decodeFrame(const uint8_t* data, uint32_t size)
+{
+    Decode_Status status;
+
+    if (!m_gotSequenceHdr || (isAdvanced() && !m_gotEntryPoint)) {
+        DEBUG("no sequence header or entry point, skip frame");
+        return DECODE_SUCCESS;
+    }
+    status = ensureContext();
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    memset(&m_frameHdr, 0, sizeof(m_frameHdr));
+    if (!isAdvanced() && size <= 1) {
+        //container signals skipped frames of simple/main profile by frame size
+        m_frameHdr.ptype = VC1_PICTURE_TYPE_SKIPPED;
+    } else {
+        uint32_t rbduSize = size;
+        const uint8_t* rbdu = isAdvanced() ? unescape(data, rbduSize) : data;
+        if (vc1_parse_frame_header(rbdu, rbduSize, &m_frameHdr, &m_sequenceHdr, m_bitPlanes)
+            != VC1_PARSER_OK) {
+            ERROR("failed to parse frame header");
+            return DECODE_PARSER_FAIL;
+        }
+    }
+
+    status = beginPicture(false);
+    if (status != DECODE_SUCCESS || VAAPI_PICTURE_IS_SKIPPED(m_currentPicture))
+        return status;
+    if (!newSlice(data, size, m_frameHdr.header_size, 0))
+        return DECODE_FAIL;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::decodeField(const uint8_t* data, uint32_t size)
+{
+    if (!m_firstField) {
+        DEBUG("no first field, skip second field");
+        return DECODE_SUCCESS;
+    }
+
+    //second field header keeps frame level elements of first field
+    uint32_t rbduSize = size;
+    const uint8_t* rbdu = unescape(data, rbduSize);
+    if (vc1_parse_field_header(rbdu, rbduSize, &m_frameHdr, &m_sequenceHdr, m_bitPlanes)
+        != VC1_PARSER_OK) {
+        ERROR("failed to parse field header");
+        return DECODE_PARSER_FAIL;
+    }
+
+    Decode_Status status = beginPicture(true);
+    if (status != DECODE_SUCCESS || !m_currentPicture
+        || VAAPI_PICTURE_IS_SKIPPED(m_currentPicture))
+        return status;
+    if (!newSlice(data, size, m_frameHdr.header_size, 0))
+        return DECODE_FAIL;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::decodeSlice(const uint8_t* data, uint32_t size)
+{
+    if (!m_currentPicture || VAAPI_PICTURE_IS_SKIPPED(m_currentPicture))
+        return DECODE_SUCCESS;
+
+    VC1SliceHdr sliceHdr;
+    uint32_t rbduSize = size;
+    const uint8_t* rbdu = unescape(data, rbduSize);
+    if (vc1_parse_slice_header(rbdu, rbduSize, &sliceHdr, &m_sequenceHdr) != VC1_PARSER_OK) {
+        //a corrupted slice only hurts its own macroblocks
+        WARNING("failed to parse slice header, drop it");
+        return DECODE_SUCCESS;
+    }
+
+    //slice address counts macroblock rows of the frame
+    uint32_t position = sliceHdr.slice_addr;
+    uint32_t fieldRows = (m_sequenceHdr.mb_height + 1) / 2;
+    if (!VAAPI_PICTURE_IS_FIRST_FIELD(m_currentPicture) && position >= fieldRows)
+        position -= fieldRows;
+    if (!newSlice(data, size, sliceHdr.header_size, position))
+        return DECODE_FAIL;
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::decodeCurrentPicture()
+{
+    if (!m_currentPicture)
+        return DECODE_SUCCESS;
+
+    PicturePtr picture = m_currentPicture;
+    m_currentPicture.reset();
+
+    bool skipped = VAAPI_PICTURE_IS_SKIPPED(picture);
+    if (!skipped && !picture->decode()) {
+        ERROR("failed to decode picture");
+        m_firstField.reset();
+        return DECODE_FAIL;
+    }
+
+    if (picture->m_picStructure != VAAPI_PICTURE_STRUCTURE_FRAME
+        && VAAPI_PICTURE_IS_FIRST_FIELD(picture)) {
+        m_firstField = picture;
+        return DECODE_SUCCESS;
+    }
+
+    //the first field stands for the whole frame
+    PicturePtr frame = m_firstField ? m_firstField : picture;
+    m_firstField.reset();
+    if (skipped)
+        return DECODE_SUCCESS;
+    return m_DPB->add(frame) ? DECODE_SUCCESS : DECODE_FAIL;
+}
+
+Decode_Status VaapiDecoderVC1::flushPictures()
+{
+    Decode_Status status = decodeCurrentPicture();
+    if (m_firstField) {
+        if (!VAAPI_PICTURE_IS_SKIPPED(m_firstField))
+            m_DPB->add(m_firstField);
+        m_firstField.reset();
+    }
+    m_DPB->flush();
+    return status;
+}
+
+Decode_Status VaapiDecoderVC1::decodeBDU(VC1StartCode type, const uint8_t* data, uint32_t size)
+{
+    Decode_Status status = DECODE_SUCCESS;
+
+    if (type == VC1_SLICE)
+        return decodeSlice(data, size);
+
+    //any other BDU but user data ends slices of current picture
+    if (type == VC1_SEQUENCE || type == VC1_ENTRYPOINT || type == VC1_FRAME || type == VC1_FIELD) {
+        status = decodeCurrentPicture();
+        if (status != DECODE_SUCCESS)
+            return status;
+    }
+
+    switch (type) {
+    case VC1_SEQUENCE:
+        status = decodeSequenceHeader(data, size);
+        break;
+    case VC1_ENTRYPOINT:
+        status = decodeEntryPoint(data, size);
+        break;
+    case VC1_FRAME:
+        status = decodeFrame(data, size);
+        break;
+    case VC1_FIELD:
+        status = decodeField(data, size);
+        break;
+    case VC1_END_OF_SEQ:
+        status = flushPictures();
+        break;
+    default:
+        break;
+    }
+    return status;
+}
+
+Decode_Status VaapiDecoderVC1::decodeBDUs(const uint8_t* data, uint32_t size, bool frame)
+{
+    Decode_Status status;
+    VC1BDU bdu;
+    uint32_t offset = 0;
+
+    while (offset + START_CODE_SIZE <= size) {
+        VC1ParserResult result = vc1_identify_next_bdu(data + offset, size - offset, &bdu);
+        if (result == VC1_PARSER_NO_BDU)
+            bdu.sc_offset = size - offset;
+        else if (result == VC1_PARSER_NO_BDU_END)
+            bdu.size = size - offset - bdu.offset;
+        else if (result != VC1_PARSER_OK)
+            break;
+
+        //asf carries advanced profile frames without start code
+        if (frame && !offset && bdu.sc_offset) {
+            status = decodeBDU(VC1_FRAME, data, bdu.sc_offset);
+            if (status != DECODE_SUCCESS)
+                return status;
+        }
+        if (result == VC1_PARSER_NO_BDU)
+            return DECODE_SUCCESS;
+
+        status = decodeBDU(bdu.type, data + offset + bdu.offset, bdu.size);
+        if (status != DECODE_SUCCESS)
+            return status;
+        offset += bdu.offset + bdu.size;
+    }
+    //too short to have a start code
+    if (frame && !offset && size)
+        return decodeBDU(VC1_FRAME, data, size);
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::decodeCodecData(const uint8_t* data, uint32_t size,
+                                               uint32_t width, uint32_t height)
+{
+    VC1SeqStructC& structC = m_sequenceHdr.struct_c;
+    if (vc1_parse_sequence_header_struct_c(data, size, &structC) == VC1_PARSER_OK
+        && structC.profile != VC1_PROFILE_ADVANCED) {
+        m_sequenceHdr.profile = structC.profile;
+        if (m_sequenceHdr.profile == VC1_PROFILE_RESERVED) {
+            ERROR("reserved profile");
+            return DECODE_PARSER_FAIL;
+        }
+        //coded size of simple/main profile comes from container
+        m_width = structC.wmvp ? structC.coded_width : width;
+        m_height = structC.wmvp ? structC.coded_height : height;
+        if (!m_width || !m_height) {
+            ERROR("no coded size for simple/main profile");
+            return DECODE_INVALID_DATA;
+        }
+        m_sequenceHdr.mb_width = (m_width + 15) >> 4;
+        m_sequenceHdr.mb_height = (m_height + 15) >> 4;
+        m_sequenceHdr.mb_stride = m_sequenceHdr.mb_width + 1;
+        if (!vc1_bitplanes_ensure_size(m_bitPlanes, &m_sequenceHdr)) {
+            ERROR("failed to allocate bitplanes");
+            return DECODE_MEMORY_FAIL;
+        }
+        m_rndCtrl = 0;
+        m_gotSequenceHdr = true;
+        m_sequenceChanged = true;
+        return DECODE_SUCCESS;
+    }
+    //advanced profile, sequence header and entry point follow some leading bytes
+    return decodeBDUs(data, size, false);
+}
+
+Decode_Status VaapiDecoderVC1::start(VideoConfigBuffer * buffer)
+{
+    DEBUG("VC1: start()");
+
+    buffer->profile = VAProfileVC1Advanced;
+    buffer->surfaceNumber = REF_DPB_MAX_REFERENCE + 1 + VC1_EXTRA_SURFACE_NUMBER;
+
+    m_configBuffer = *buffer;
+    m_configBuffer.data = NULL;
+    m_configBuffer.size = 0;
+
+    // va context is created on first frame
+    m_configBuffer.width = 0;
+    m_configBuffer.height = 0;
+
+    if (buffer->data && buffer->size) {
+        Decode_Status status = decodeCodecData(buffer->data, buffer->size,
+                                               buffer->width, buffer->height);
+        if (status != DECODE_SUCCESS)
+            return status;
+    }
+    return DECODE_SUCCESS;
+}
+
+Decode_Status VaapiDecoderVC1::reset(VideoConfigBuffer * buffer)
+{
+    DEBUG("VC1: reset()");
+    clearReferences();
+    m_currentPicture.reset();
+    return VaapiDecoderBase::reset(buffer);
+}
+
+void VaapiDecoderVC1::stop(void)
+{
+    DEBUG("VC1: stop()");
+    flush();
+    VaapiDecoderBase::stop();
+}
+
+Decode_Status VaapiDecoderVC1::decode(VideoDecodeBuffer * buffer)
+{
+    Decode_Status status;
+
+    if (!buffer || !buffer->data || !buffer->size)
+        return DECODE_INVALID_DATA;
+
+    m_currentPTS = buffer->timeStamp;
+    DEBUG("VC1: Decode(bufsize =%d, timestamp=%ld)", buffer->size, m_currentPTS);
+
+    //simple/main profile has no start code, a buffer is a frame
+    if (m_gotSequenceHdr && !isAdvanced())
+        status = decodeFrame(buffer->data, buffer->size);
+    else
+        status = decodeBDUs(buffer->data, buffer->size, true);
+    if (status != DECODE_SUCCESS)
+        return status;
+
+    //input buffer holds whole pictures, no need to wait for next start code
+    return decodeCurrentPicture();
+}
+
+} //namespace YamiMediaCodec
@@ -0,0 +1,147 @@
+/*
+ *  vaapidecoder_vc1.h - vc1 decoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapidecoder_vc1_h
+#define vaapidecoder_vc1_h
+
+#include "codecparsers/vc1parser.h"
+#include "vaapidecoder_base.h"
+#include "vaapidecoder_ref_dpb.h"
+#include "vaapidecpicture.h"
+#include <vector>
+
+namespace YamiMediaCodec{
+enum {
+    VC1_EXTRA_SURFACE_NUMBER = 5,
+};
+
+class VaapiDecPictureVC1 : public VaapiDecPicture
+{
+  public:
+    typedef std::tr1::shared_ptr<VaapiDecPictureVC1> PicturePtr;
+    VaapiDecPictureVC1(const ContextPtr& context, const SurfacePtr& surface, int64_t timeStamp)
+        : VaapiDecPicture(context, surface, timeStamp)
+        , m_flags(0)
+        , m_picStructure(VAAPI_PICTURE_STRUCTURE_FRAME)
+    {
+    }
+
+    /* second field is decoded to the surface of first field */
+    PicturePtr newField()
+    {
+        PicturePtr field(new VaapiDecPictureVC1(m_context, m_surface, m_timeStamp));
+        field->m_flags = m_flags & (VAAPI_PICTURE_FLAG_REFERENCE | VAAPI_PICTURE_FLAG_SKIPPED);
+        return field;
+    }
+
+    uint32_t m_flags;
+    uint32_t m_picStructure;
+
+  private:
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecPictureVC1);
+};
+
+/* BI frames are intra coded like I frames, but not referenced */
+class VaapiVC1DPB : public VaapiRefDPB<VaapiDecPictureVC1> {
+  public:
+    VaapiVC1DPB(VaapiDecoderBase* decoder)
+        : VaapiRefDPB<VaapiDecPictureVC1>(decoder)
+    {
+    }
+
+  protected:
+    virtual VaapiPictureType predictionType(const PicturePtr& picture)
+    {
+        if (picture->m_type == VAAPI_PICTURE_TYPE_BI)
+            return VAAPI_PICTURE_TYPE_I;
+        return picture->m_type;
+    }
+};
+
+class VaapiDecoderVC1:public VaapiDecoderBase {
+  public:
+    typedef VaapiDecPictureVC1::PicturePtr PicturePtr;
+    VaapiDecoderVC1();
+    virtual ~ VaapiDecoderVC1();
+    virtual Decode_Status start(VideoConfigBuffer * buffer);
+    virtual Decode_Status reset(VideoConfigBuffer * buffer);
+    virtual void stop(void);
+    virtual Decode_Status decode(VideoDecodeBuffer * buffer);
+
+  protected:
+    virtual void clearReferences();
+    virtual Decode_Status flushPictures();
+
+  private:
+    /* struct C of simple/main profile, or sequence and entry point BDUs */
+    Decode_Status decodeCodecData(const uint8_t* data, uint32_t size,
+                                  uint32_t width, uint32_t height);
+    /* advanced profile data, a frame without start code is allowed at the beginning */
+    Decode_Status decodeBDUs(const uint8_t* data, uint32_t size, bool frame);
+    /* BDU payload after the start code, emulation prevention bytes not removed */
+    Decode_Status decodeBDU(VC1StartCode type, const uint8_t* data, uint32_t size);
+    Decode_Status decodeSequenceHeader(const uint8_t* data, uint32_t size);
+    Decode_Status decodeEntryPoint(const uint8_t* data, uint32_t size);
+    Decode_Status decodeFrame(const uint8_t* data, uint32_t size);
+    Decode_Status decodeField(const uint8_t* data, uint32_t size);
+    Decode_Status decodeSlice(const uint8_t* data, uint32_t size);
+    /* check the context reset senerios */
+    Decode_Status ensureContext();
+    Decode_Status beginPicture(bool secondField);
+    Decode_Status decodeCurrentPicture();
+    bool fillPictureParam(const PicturePtr& picture,
+                          const PicturePtr& forward, const PicturePtr& backward);
+    void fillPictureStructC(VAPictureParameterBufferVC1* param);
+    void fillPictureAdvanced(VAPictureParameterBufferVC1* param, const PicturePtr& picture);
+    bool fillBitPlane(const PicturePtr& picture, const VAPictureParameterBufferVC1* param);
+    bool newSlice(const uint8_t* data, uint32_t size, uint32_t headerSize, uint32_t position);
+    /* remove emulation prevention bytes for header parsing */
+    const uint8_t* unescape(const uint8_t* data, uint32_t& size);
+    bool isAdvanced() const;
+    bool isFieldPicture() const;
+    bool isTopFieldFirst() const;
+    VAProfile getVAProfile();
+
+    VaapiVC1DPB::Ptr m_DPB;
+    PicturePtr m_currentPicture;
+    //first field waiting for its second field
+    PicturePtr m_firstField;
+
+    VC1SeqHdr m_sequenceHdr;
+    VC1EntryPointHdr m_entryPointHdr;
+    VC1FrameHdr m_frameHdr;
+    VC1BitPlanes* m_bitPlanes;
+    std::vector<uint8_t> m_rbdu;
+    //coded size, from config buffer for simple/main profile
+    uint32_t m_width;
+    uint32_t m_height;
+    //rounding control toggles on P frames of simple/main profile
+    uint8_t m_rndCtrl;
+
+    uint32_t m_gotSequenceHdr:1;
+    uint32_t m_gotEntryPoint:1;
+    uint32_t m_sequenceChanged:1;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiDecoderVC1);
+};
+}
+
+#endif
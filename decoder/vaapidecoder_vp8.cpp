@@ -25,6 +25,7 @@
 #include "config.h"
 #endif
 
+#include <assert.h>
 #include <string.h>
 #include "common/log.h"
 #include "vaapidecoder_vp8.h"
@@ -108,6 +109,7 @@ Decode_Status VaapiDecoderVP8::ensureContext()
             m_configBuffer.graphicBufferHeight = m_configBuffer.height;
         }
 
+        releasePictures();
         if (m_hasContext)
             status = VaapiDecoderBase::terminateVA();
         m_hasContext = false;
@@ -214,15 +216,9 @@ bool VaapiDecoderVP8::fillPictureParam(const PicturePtr&  picture)
         picParam->golden_ref_frame = VA_INVALID_SURFACE;
         picParam->alt_ref_frame = VA_INVALID_SURFACE;
     } else {
-        picParam->last_ref_frame =
-            m_lastPicture ? m_lastPicture->getSurfaceID() :
-            VA_INVALID_SURFACE;
-        picParam->golden_ref_frame =
-            m_goldenRefPicture ? m_goldenRefPicture->getSurfaceID() :
-            VA_INVALID_SURFACE;
-        picParam->alt_ref_frame =
-            m_altRefPicture ? m_altRefPicture->getSurfaceID() :
-            VA_INVALID_SURFACE;
+        picParam->last_ref_frame = getRefSurfaceID(VP8_REF_LAST);
+        picParam->golden_ref_frame = getRefSurfaceID(VP8_REF_GOLDEN);
+        picParam->alt_ref_frame = getRefSurfaceID(VP8_REF_ALTREF);
     }
     picParam->out_of_loop_frame = VA_INVALID_SURFACE;   // not used currently
 
@@ -372,13 +368,11 @@ bool VaapiDecoderVP8::ensureQuantMatrix(const PicturePtr&  pic)
     return true;
 }
 
-/* fill quant parameter buffers functions*/
 bool VaapiDecoderVP8::ensureProbabilityTable(const PicturePtr&  pic)
 {
     VAProbabilityDataBufferVP8 *probTable = NULL;
-    int32_t i;
 
-    // XXX, create/render VAProbabilityDataBufferVP8 in base class
+    // a buffer for each picture, some drivers (psb) free it once it's rendered
     if (!pic->editProbTable(probTable))
         return false;
     memcpy(probTable->dct_coeff_probs,
@@ -387,102 +381,139 @@ bool VaapiDecoderVP8::ensureProbabilityTable(const PicturePtr&  pic)
     return true;
 }
 
+bool VaapiDecoderVP8::isReference(int32_t index) const
+{
+    int32_t i;
+
+    for (i = 0; i < VP8_REF_COUNT; i++) {
+        if (m_refSlots[i] == index)
+            return true;
+    }
+    return false;
+}
+
+VASurfaceID VaapiDecoderVP8::getRefSurfaceID(Vp8RefSlot slot) const
+{
+    int32_t index = m_refSlots[slot];
+
+    if (index < 0)
+        return VA_INVALID_SURFACE;
+    return m_pictures[index]->getSurfaceID();
+}
+
 void VaapiDecoderVP8::updateReferencePictures()
 {
-    const PicturePtr& picture = m_currentPicture;
+    int32_t* refs = m_refSlots;
+    int32_t i;
 
-    // update picture reference
+    // same order as libvpx: buffer copies see old references, alt ref copy goes first
     if (m_frameHdr.key_frame == VP8_KEY_FRAME) {
-        m_goldenRefPicture = picture;
-        m_altRefPicture = picture;
+        refs[VP8_REF_GOLDEN] = m_currentIndex;
+        refs[VP8_REF_ALTREF] = m_currentIndex;
     } else {
-        // process refresh_alternate_frame/copy_buffer_to_alternate first
-        if (m_frameHdr.refresh_alternate_frame) {
-            m_altRefPicture = picture;
-        } else {
-            switch (m_frameHdr.copy_buffer_to_alternate) {
-            case 0:
-                // do nothing
-                break;
-            case 1:
-                m_altRefPicture = m_lastPicture;
-                break;
-            case 2:
-                m_altRefPicture = m_goldenRefPicture;
-                break;
-            default:
-                WARNING
-                    ("WARNING: VP8 decoder: unrecognized copy_buffer_to_alternate");
-            }
+        switch (m_frameHdr.copy_buffer_to_alternate) {
+        case 0:
+            // do nothing
+            break;
+        case 1:
+            refs[VP8_REF_ALTREF] = refs[VP8_REF_LAST];
+            break;
+        case 2:
+            refs[VP8_REF_ALTREF] = refs[VP8_REF_GOLDEN];
+            break;
+        default:
+            WARNING
+                ("WARNING: VP8 decoder: unrecognized copy_buffer_to_alternate");
         }
 
-        if (m_frameHdr.refresh_golden_frame) {
-            m_goldenRefPicture = picture;
-        } else {
-            switch (m_frameHdr.copy_buffer_to_golden) {
-            case 0:
-                // do nothing
-                break;
-            case 1:
-                m_goldenRefPicture = m_lastPicture;
-                break;
-            case 2:
-                m_goldenRefPicture = m_altRefPicture;
-                break;
-            default:
-                WARNING
-                    ("WARNING: VP8 decoder: unrecognized copy_buffer_to_golden");
-            }
+        switch (m_frameHdr.copy_buffer_to_golden) {
+        case 0:
+            // do nothing
+            break;
+        case 1:
+            refs[VP8_REF_GOLDEN] = refs[VP8_REF_LAST];
+            break;
+        case 2:
+            refs[VP8_REF_GOLDEN] = refs[VP8_REF_ALTREF];
+            break;
+        default:
+            WARNING
+                ("WARNING: VP8 decoder: unrecognized copy_buffer_to_golden");
         }
+
+        if (m_frameHdr.refresh_golden_frame)
+            refs[VP8_REF_GOLDEN] = m_currentIndex;
+        if (m_frameHdr.refresh_alternate_frame)
+            refs[VP8_REF_ALTREF] = m_currentIndex;
     }
     if (m_frameHdr.key_frame == VP8_KEY_FRAME || m_frameHdr.refresh_last)
-        m_lastPicture = picture;
-    if (m_goldenRefPicture)
-        DEBUG("m_goldenRefPicture: %p, SurfaceID: %x",
-              m_goldenRefPicture.get(), m_goldenRefPicture->getSurfaceID());
-    if (m_altRefPicture)
-        DEBUG("m_altRefPicture: %p, SurfaceID: %x", m_altRefPicture.get(),
-              m_altRefPicture->getSurfaceID());
-    if (m_lastPicture)
-        DEBUG("m_lastPicture: %p, SurfaceID: %x", m_lastPicture.get(),
-              m_lastPicture->getSurfaceID());
-    if (m_currentPicture)
-        DEBUG("m_currentPicture: %p, SurfaceID: %x", m_currentPicture.get(),
-              m_currentPicture->getSurfaceID());
+        refs[VP8_REF_LAST] = m_currentIndex;
 
+    DEBUG("reference slots: last %d, golden %d, alt ref %d, current %d",
+          refs[VP8_REF_LAST], refs[VP8_REF_GOLDEN], refs[VP8_REF_ALTREF], m_currentIndex);
+
+    // out of all slots, the surface can go back to the pool
+    for (i = 0; i < VP8_MAX_PICTURE_COUNT; i++) {
+        if (m_pictures[i] && !isReference(i))
+            m_pictures[i]->reset(SurfacePtr(), 0);
+    }
 }
 
 bool VaapiDecoderVP8::allocNewPicture()
 {
-    m_currentPicture = createPicture(m_currentPTS);
+    int32_t i;
+    SurfacePtr surface;
 
-    if (!m_currentPicture)
+    // three references at most, there is always a free picture
+    for (i = 0; i < VP8_MAX_PICTURE_COUNT; i++) {
+        if (!isReference(i))
+            break;
+    }
+    assert(i < VP8_MAX_PICTURE_COUNT);
+
+    surface = createSurface();
+    if (!surface)
         return false;
 
-    DEBUG ("alloc new picture: %p with surface ID: %x",
-         m_currentPicture.get(), m_currentPicture->getSurfaceID());
+    if (m_pictures[i])
+        m_pictures[i]->reset(surface, m_currentPTS);
+    else
+        m_pictures[i].reset(new VaapiDecPicture(m_context, surface, m_currentPTS));
+    m_currentIndex = i;
+
+    DEBUG ("alloc new picture: %d with surface ID: %x",
+         i, m_pictures[i]->getSurfaceID());
 
     return true;
 }
 
+void VaapiDecoderVP8::releasePictures()
+{
+    int32_t i;
+
+    for (i = 0; i < VP8_REF_COUNT; i++)
+        m_refSlots[i] = -1;
+    for (i = 0; i < VP8_MAX_PICTURE_COUNT; i++)
+        m_pictures[i].reset();
+    m_currentIndex = -1;
+}
+
 Decode_Status VaapiDecoderVP8::decodePicture()
 {
     Decode_Status status = DECODE_SUCCESS;
+    const PicturePtr& picture = m_pictures[m_currentIndex];
 
-    if (!allocNewPicture())
-        return DECODE_FAIL;
-
-    if (!ensureQuantMatrix(m_currentPicture)) {
+    if (!ensureQuantMatrix(picture)) {
         ERROR("failed to reset quantizer matrix");
         return DECODE_FAIL;
     }
 
-    if (!ensureProbabilityTable(m_currentPicture)) {
+    if (!ensureProbabilityTable(picture)) {
         ERROR("failed to reset probability table");
         return DECODE_FAIL;
     }
 
-    if (!fillPictureParam(m_currentPicture)) {
+    if (!fillPictureParam(picture)) {
         ERROR("failed to fill picture parameters");
         return DECODE_FAIL;
     }
@@ -497,12 +528,12 @@ Decode_Status VaapiDecoderVP8::decodePicture()
 #endif
 
 
-    if (!m_currentPicture->newSlice(sliceParam, sliceData, sliceSize))
+    if (!picture->newSlice(sliceParam, sliceData, sliceSize))
         return DECODE_FAIL;
 
     if (!fillSliceParam(sliceParam))
         return DECODE_FAIL;
-    if (!m_currentPicture->decode())
+    if (!picture->decode())
         return DECODE_FAIL;
 
     DEBUG("VaapiDecoderVP8::decodePicture success");
@@ -518,13 +549,16 @@ VaapiDecoderVP8::VaapiDecoderVP8()
     m_buffer = 0;
     m_frameSize = 0;
     memset(&m_frameHdr, 0, sizeof(Vp8FrameHdr));
-    memset(&m_lastFrameContext, 0, sizeof(Vp8MultiFrameData));
-    memset(&m_currFrameContext, 0, sizeof(Vp8MultiFrameData));
+    memset(m_frameContexts, 0, sizeof(m_frameContexts));
+    m_contextIndex = 0;
 
     // m_yModeProbs[4];
     // m_uvModeProbs[3];
     m_sizeChanged = 0;
     m_hasContext = false;
+    releasePictures();
+
+    m_isFirstFrame = false;
 }
 
 VaapiDecoderVP8::~VaapiDecoderVP8()
@@ -546,7 +580,8 @@ Decode_Status VaapiDecoderVP8::start(VideoConfigBuffer * buffer)
     buffer->profile = VAProfileVP8Version0_3;
     buffer->surfaceNumber = 3 + VP8_EXTRA_SURFACE_NUMBER;
 
-    vp8_parse_init_default_multi_frame_data(&m_lastFrameContext);
+    m_contextIndex = 0;
+    vp8_parse_init_default_multi_frame_data(&m_frameContexts[m_contextIndex]);
 
     DEBUG("disable native graphics buffer");
     buffer->flag &= ~USE_NATIVE_GRAPHIC_BUFFER;
@@ -558,9 +593,8 @@ Decode_Status VaapiDecoderVP8::start(VideoConfigBuffer * buffer)
     // so we force to update resolution on first key frame
     m_configBuffer.width = 0;
     m_configBuffer.height = 0;
-#if __PSB_CACHE_DRAIN_FOR_FIRST_FRAME__
-    m_isFirstFrame = true;
-#endif
+    m_isFirstFrame = __PSB_CACHE_DRAIN_FOR_FIRST_FRAME__
+        || (buffer->flag & WANT_DRAIN_FIRST_FRAME);
     return DECODE_SUCCESS;
 }
 
@@ -582,10 +616,7 @@ void VaapiDecoderVP8::flush(void)
 {
     DEBUG("VP8: flush()");
     /*FIXME: should output all surfaces in drain mode*/
-    m_currentPicture.reset();
-    m_lastPicture.reset();
-    m_goldenRefPicture.reset();
-    m_altRefPicture.reset();
+    releasePictures();
 
     VaapiDecoderBase::flush();
 }
@@ -611,7 +642,8 @@ Decode_Status VaapiDecoderVP8::decode(VideoDecodeBuffer * buffer)
         }
 
         memset(&m_frameHdr, 0, sizeof(m_frameHdr));
-        m_frameHdr.multi_frame_data = &m_currFrameContext;
+        m_frameHdr.multi_frame_data = &m_frameContexts[m_contextIndex];
+        m_frameHdr.saved_multi_frame_data = &m_frameContexts[!m_contextIndex];
         result =
             vp8_parse_frame_header(&m_frameHdr, m_buffer, 0, m_frameSize);
         status = getStatus(result);
@@ -624,7 +656,11 @@ Decode_Status VaapiDecoderVP8::decode(VideoDecodeBuffer * buffer)
             if (status != DECODE_SUCCESS)
                 return status;
         }
-#if __PSB_CACHE_DRAIN_FOR_FIRST_FRAME__
+        if (!allocNewPicture()) {
+            status = DECODE_FAIL;
+            break;
+        }
+
         int ii = 0;
         int decodeCount = 1;
 
@@ -637,44 +673,19 @@ Decode_Status VaapiDecoderVP8::decode(VideoDecodeBuffer * buffer)
             status = decodePicture();
         } while (status == DECODE_SUCCESS && ++ii < decodeCount);
 
-#else
-        status = decodePicture();
-#endif
-
         if (status != DECODE_SUCCESS)
             break;
 
         if (m_frameHdr.show_frame) {
-            m_currentPicture->m_timeStamp = m_currentPTS;
             //FIXME: add output
-            outputPicture(m_currentPicture);
+            outputPicture(m_pictures[m_currentIndex]);
         } else {
             WARNING("warning: this picture isn't sent to render");
         }
 
         updateReferencePictures();
 
-        if (m_frameHdr.refresh_entropy_probs) {
-            memcpy(&m_lastFrameContext.token_prob_update,
-                   &m_currFrameContext.token_prob_update,
-                   sizeof(Vp8TokenProbUpdate));
-            memcpy(&m_lastFrameContext.mv_prob_update,
-                   &m_currFrameContext.mv_prob_update,
-                   sizeof(Vp8MvProbUpdate));
-
-            if (m_frameHdr.intra_16x16_prob_update_flag)
-                memcpy(m_yModeProbs, m_frameHdr.intra_16x16_prob, 4);
-            if (m_frameHdr.intra_chroma_prob_update_flag)
-                memcpy(m_uvModeProbs, m_frameHdr.intra_chroma_prob, 3);
-        } else {
-            memcpy(&m_currFrameContext.token_prob_update,
-                   &m_lastFrameContext.token_prob_update,
-                   sizeof(Vp8TokenProbUpdate));
-            memcpy(&m_currFrameContext.mv_prob_update,
-                   &m_lastFrameContext.mv_prob_update,
-                   sizeof(Vp8MvProbUpdate));
-        }
-
+        updateEntropyContext();
     } while (0);
 
     if (status != DECODE_SUCCESS) {
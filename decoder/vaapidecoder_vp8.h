@@ -28,6 +28,7 @@
 #include "vaapidecpicture.h"
 #include "va/va_dec_vp8.h"
 
+// drain cache for first frame on psb, other platforms ask for it with WANT_DRAIN_FIRST_FRAME
 #if __PLATFORM_BYT__
 #define __PSB_CACHE_DRAIN_FOR_FIRST_FRAME__ 1
 #define __PSB_VP8_INTERFACE_WORK_AROUND__   0
@@ -39,7 +40,14 @@
 namespace YamiMediaCodec{
 enum {
     VP8_EXTRA_SURFACE_NUMBER = 5,
-    VP8_MAX_PICTURE_COUNT = 5,  // gold_ref, alt_ref, last_ref, previous (m_currentPicture, optional), and the newly allocated one
+    VP8_MAX_PICTURE_COUNT = 5,  // gold_ref, alt_ref, last_ref, the current one, and a spare
+};
+
+enum Vp8RefSlot {
+    VP8_REF_LAST,
+    VP8_REF_GOLDEN,
+    VP8_REF_ALTREF,
+    VP8_REF_COUNT,
 };
 
 class VaapiDecoderVP8:public VaapiDecoderBase {
@@ -59,17 +67,22 @@ class VaapiDecoderVP8:public VaapiDecoderBase {
     /* fill Quant matrix parameters */
     bool ensureQuantMatrix(const PicturePtr& pic);
     bool ensureProbabilityTable(const PicturePtr& pic);
+    void updateEntropyContext();
     bool fillSliceParam(VASliceParameterBufferVP8* sliceParam);
     /* check the context reset senerios */
     Decode_Status ensureContext();
     /* decoding functions */
     Decode_Status decodePicture();
     void updateReferencePictures();
+    bool isReference(int32_t index) const;
+    VASurfaceID getRefSurfaceID(Vp8RefSlot slot) const;
+    void releasePictures();
   private:
-    PicturePtr m_currentPicture;
-    PicturePtr m_lastPicture;
-    PicturePtr m_goldenRefPicture;
-    PicturePtr m_altRefPicture;
+    /* picture objects are reused, current picture and reference slots index into them,
+     * a picture gives back its surface once it leaves all slots */
+    PicturePtr m_pictures[VP8_MAX_PICTURE_COUNT];
+    int32_t m_currentIndex;
+    int32_t m_refSlots[VP8_REF_COUNT];  // -1 for an empty slot
 
     uint32_t m_hasContext:1;
 
@@ -79,15 +92,15 @@ class VaapiDecoderVP8:public VaapiDecoderBase {
     const uint8_t *m_buffer;
     uint32_t m_frameSize;
     Vp8FrameHdr m_frameHdr;
-    Vp8MultiFrameData m_lastFrameContext;
-    Vp8MultiFrameData m_currFrameContext;
+    /* m_frameContexts[m_contextIndex] persists across frames, parser saves it to the other
+     * one when a frame doesn't refresh entropy probs, we switch to the saved one after it */
+    Vp8MultiFrameData m_frameContexts[2];
+    uint32_t m_contextIndex;
     uint8_t m_yModeProbs[4];
     uint8_t m_uvModeProbs[3];
     uint32_t m_sizeChanged:1;
 
-#if __PSB_CACHE_DRAIN_FOR_FIRST_FRAME__
     bool m_isFirstFrame;
-#endif
 };
 }
 
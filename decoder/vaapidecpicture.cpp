@@ -26,6 +26,7 @@
 #include "vaapidecpicture.h"
 
 #include "log.h"
+#include <string.h>
 
 namespace YamiMediaCodec{
 VaapiDecPicture::VaapiDecPicture(const ContextPtr& context,
@@ -34,11 +35,37 @@ VaapiDecPicture::VaapiDecPicture(const ContextPtr& context,
 {
 }
 
+bool VaapiDecPicture::editBitPlane(uint8_t*& plane, uint32_t size)
+{
+    if (m_bitPlane)
+        return false;
+    m_bitPlane = createBufferObject(VABitPlaneBufferType, size, NULL, (void**)&plane);
+    if (!m_bitPlane)
+        return false;
+    memset(plane, 0, size);
+    return true;
+}
+
 bool VaapiDecPicture::decode()
 {
     return render();
 }
 
+void VaapiDecPicture::reset(const SurfacePtr& surface, int64_t timeStamp)
+{
+    m_surface = surface;
+    m_timeStamp = timeStamp;
+    m_type = VAAPI_PICTURE_TYPE_NONE;
+
+    // rendered buffers are gone already, these are left by a failed decode
+    m_picture.reset();
+    m_iqMatrix.reset();
+    m_bitPlane.reset();
+    m_hufTable.reset();
+    m_probTable.reset();
+    m_slices.clear();
+}
+
 bool VaapiDecPicture::doRender()
 {
     RENDER_OBJECT(m_picture);
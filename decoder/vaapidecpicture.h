@@ -40,6 +40,8 @@ public:
 
     template <class T>
     bool editBitPlane(T*& plane);
+    /* bitplane size depends on picture size, vc1 uses this one */
+    bool editBitPlane(uint8_t*& plane, uint32_t size);
 
     template <class T>
     bool editHufTable(T*& hufTable);
@@ -52,6 +54,9 @@ public:
 
     bool decode();
 
+    /* vp8 reuses picture objects, a new surface makes it a new picture, an empty one releases it */
+    void reset(const SurfacePtr& surface, int64_t timeStamp);
+
 private:
     virtual bool doRender();
 
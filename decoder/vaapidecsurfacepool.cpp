@@ -41,7 +41,6 @@ DecSurfacePoolPtr VaapiDecSurfacePool::create(const DisplayPtr& display, VideoCo
     surfaces.reserve(size);
     assert(!(config->flag & WANT_SURFACE_PROTECTION));
     assert(!(config->flag & USE_NATIVE_GRAPHIC_BUFFER));
-    assert(!(config->flag & WANT_RAW_OUTPUT));
     for (size_t i = 0; i < size; ++i) {
         SurfacePtr s = VaapiSurface::create(display, VAAPI_CHROMA_TYPE_YUV420,
                                    config->width,config->height,NULL,0);
@@ -50,6 +49,7 @@ DecSurfacePoolPtr VaapiDecSurfacePool::create(const DisplayPtr& display, VideoCo
         surfaces.push_back(s);
     }
     pool.reset(new VaapiDecSurfacePool(display, surfaces));
+    return pool;
 }
 
 VaapiDecSurfacePool::VaapiDecSurfacePool(const DisplayPtr& display, std::vector<SurfacePtr> surfaces):
@@ -83,6 +83,15 @@ void VaapiDecSurfacePool::getSurfaceIDs(std::vector<VASurfaceID>& ids)
         ids.push_back(m_renderBuffers[i].surface);
 }
 
+VaapiSurface* VaapiDecSurfacePool::getSurface(VASurfaceID id)
+{
+    //no need hold lock, it never changed from start
+    SurfaceMap::iterator it = m_surfaceMap.find(id);
+    if (it == m_surfaceMap.end())
+        return NULL;
+    return it->second;
+}
+
 struct VaapiDecSurfacePool::SurfaceRecycler
 {
     SurfaceRecycler(const DecSurfacePoolPtr& pool): m_pool(pool) {}
@@ -64,6 +64,8 @@ class VaapiDecSurfacePool : public std::tr1::enable_shared_from_this<VaapiDecSur
 public:
     static DecSurfacePoolPtr create(const DisplayPtr&, VideoConfigBuffer* config);
     void getSurfaceIDs(std::vector<VASurfaceID>& ids);
+    /// find surface by id, for accessing the content of an output buffer
+    VaapiSurface* getSurface(VASurfaceID);
     /// get a free surface,
     /// it always return null buffer if it's flushed.
     SurfacePtr acquireWithWait();
@@ -89,7 +91,7 @@ private:
 
     VaapiDecSurfacePool(const DisplayPtr&, std::vector<SurfacePtr>);
 
-    void VaapiDecSurfacePool::recycleLocked(VASurfaceID, SurfaceState);
+    void recycleLocked(VASurfaceID, SurfaceState);
     void recycle(VASurfaceID, SurfaceState);
 
     //following member only change in constructor.
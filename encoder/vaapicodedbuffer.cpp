@@ -25,8 +25,11 @@
 #include "vaapicodedbuffer.h"
 
 #include "vaapicontext.h"
+#include "common/log.h"
 #include <string.h>
 
+using YamiMediaCodec::VideoEncCodedSegment;
+
 CodedBufferPtr VaapiCodedBuffer::create(const ContextPtr& context, uint32_t bufSize)
 {
     CodedBufferPtr coded;
@@ -47,7 +50,7 @@ uint32_t VaapiCodedBuffer::size()
 {
     if (!map())
         return 0;
-    uint32_t size = 0;
+    uint32_t size = m_prefix.size();
     VACodedBufferSegment* segment = m_segments;
     while (segment != NULL) {
         size += segment->size;
@@ -63,6 +66,10 @@ bool VaapiCodedBuffer::copyInto(void* data)
     if (!map())
         return false;
     uint8_t* dest = static_cast<uint8_t*>(data);
+    if (!m_prefix.empty()) {
+        memcpy(dest, &m_prefix[0], m_prefix.size());
+        dest += m_prefix.size();
+    }
     VACodedBufferSegment* segment = m_segments;
     while (segment != NULL) {
         memcpy(dest, segment->buf, segment->size);
@@ -71,3 +78,181 @@ bool VaapiCodedBuffer::copyInto(void* data)
     }
     return true;
 }
+
+const VideoEncCodedSegment* VaapiCodedBuffer::getSegments()
+{
+    if (!map())
+        return NULL;
+    if (m_clientSegments.empty()) {
+        if (!m_prefix.empty()) {
+            VideoEncCodedSegment s;
+            s.data = &m_prefix[0];
+            s.size = m_prefix.size();
+            s.next = NULL;
+            m_clientSegments.push_back(s);
+        }
+        VACodedBufferSegment* segment = m_segments;
+        while (segment != NULL) {
+            VideoEncCodedSegment s;
+            s.data = static_cast<uint8_t*>(segment->buf);
+            s.size = segment->size;
+            s.next = NULL;
+            m_clientSegments.push_back(s);
+            segment = static_cast<VACodedBufferSegment*>(segment->next);
+        }
+        //link after push_back, vector may reallocate
+        for (size_t i = 1; i < m_clientSegments.size(); i++)
+            m_clientSegments[i - 1].next = &m_clientSegments[i];
+    }
+    if (m_clientSegments.empty())
+        return NULL;
+    return &m_clientSegments[0];
+}
+
+void VaapiCodedBuffer::reset()
+{
+    m_buf->unmap();
+    m_segments = NULL;
+    m_clientSegments.clear();
+    m_flags = 0;
+    m_readSegment = NULL;
+    m_readOffset = 0;
+    m_nalSize = 0;
+    m_prefix.clear();
+    m_prefixRead = false;
+}
+
+void VaapiCodedBuffer::setPrefix(const uint8_t* data, uint32_t size)
+{
+    ASSERT(size > 4 && !data[0] && !data[1] && !data[2] && data[3] == 1);
+    m_prefix.assign(data, data + size);
+    m_prefixRead = false;
+    m_clientSegments.clear();
+}
+
+// find 00 00 01 in [p, end), return end if not found.
+// a start code needs p[2] == 1, so we can skip 3 bytes when p[2] > 1
+static const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end)
+{
+    for (p += 2; p < end; ) {
+        if (*p > 1)
+            p += 3;
+        else if (!*p)
+            p++;
+        else if (!p[-1] && !p[-2])
+            return p - 2;
+        else
+            p += 3;
+    }
+    return end;
+}
+
+bool VaapiCodedBuffer::peekNal(const uint8_t*& nal, uint32_t& size, uint32_t& startCodeSize)
+{
+    if (!map())
+        return false;
+    if (!m_prefix.empty() && !m_prefixRead) {
+        nal = &m_prefix[0];
+        size = m_prefix.size();
+        startCodeSize = 4;
+        return true;
+    }
+    if (!m_readSegment) {
+        m_readSegment = m_segments;
+        m_readOffset = 0;
+    }
+    //skip finished or empty segments
+    while (m_readSegment && m_readOffset >= m_readSegment->size) {
+        m_readSegment = static_cast<VACodedBufferSegment*>(m_readSegment->next);
+        m_readOffset = 0;
+    }
+    if (!m_readSegment)
+        return false;
+
+    const uint8_t* data = static_cast<const uint8_t*>(m_readSegment->buf);
+    const uint8_t* end = data + m_readSegment->size;
+    const uint8_t* start = findStartCode(data + m_readOffset, end);
+    if (start == end) {
+        //no start code, treat the rest as one nal
+        start = data + m_readOffset;
+        startCodeSize = 0;
+    } else {
+        startCodeSize = 3;
+        //4 bytes start code
+        if (start > data + m_readOffset && !start[-1]) {
+            start--;
+            startCodeSize = 4;
+        }
+    }
+    const uint8_t* next = findStartCode(start + startCodeSize, end);
+    //trailing zero belongs to next 4 bytes start code
+    if (next != end && next > start + startCodeSize && !next[-1])
+        next--;
+    nal = start;
+    size = next - start;
+    m_nalSize = next - (data + m_readOffset);
+    return true;
+}
+
+void VaapiCodedBuffer::popNal()
+{
+    if (!m_prefix.empty() && !m_prefixRead) {
+        m_prefixRead = true;
+        return;
+    }
+    m_readOffset += m_nalSize;
+    m_nalSize = 0;
+}
+
+CodedBufferPoolPtr VaapiCodedBufferPool::create(const ContextPtr& context, uint32_t bufSize, uint32_t maxSize)
+{
+    CodedBufferPoolPtr pool;
+    if (!context || !bufSize || !maxSize)
+        return pool;
+    pool.reset(new VaapiCodedBufferPool(context, bufSize, maxSize));
+    return pool;
+}
+
+VaapiCodedBufferPool::VaapiCodedBufferPool(const ContextPtr& context, uint32_t bufSize, uint32_t maxSize)
+    : m_context(context), m_bufSize(bufSize), m_maxSize(maxSize)
+{
+}
+
+struct VaapiCodedBufferPool::BufferRecycler
+{
+    BufferRecycler(const CodedBufferPoolPtr& pool): m_pool(pool) {}
+    void operator()(VaapiCodedBuffer* buffer) { m_pool->recycle(buffer);}
+private:
+    CodedBufferPoolPtr m_pool;
+};
+
+CodedBufferPtr VaapiCodedBufferPool::acquire()
+{
+    CodedBufferPtr coded;
+    YamiMediaCodec::AutoLock lock(m_lock);
+    if (m_freed.empty()) {
+        if (m_buffers.size() >= m_maxSize) {
+            ERROR("all %d coded buffers are in use", m_maxSize);
+            return coded;
+        }
+        CodedBufferPtr buffer = VaapiCodedBuffer::create(m_context, m_bufSize);
+        if (!buffer) {
+            ERROR("create coded buffer with size %d failed", m_bufSize);
+            return coded;
+        }
+        m_buffers.push_back(buffer);
+        m_freed.push_back(buffer.get());
+        DEBUG("coded buffer pool grows to %d", (int)m_buffers.size());
+    }
+    VaapiCodedBuffer* buffer = m_freed.front();
+    m_freed.pop_front();
+    coded.reset(buffer, BufferRecycler(shared_from_this()));
+    return coded;
+}
+
+void VaapiCodedBufferPool::recycle(VaapiCodedBuffer* buffer)
+{
+    buffer->reset();
+    YamiMediaCodec::AutoLock lock(m_lock);
+    m_freed.push_back(buffer);
+}
@@ -22,11 +22,14 @@
 #ifndef vaapicodedbuffer_h
 #define vaapicodedbuffer_h
 
+#include <deque>
+#include <stdlib.h>
+#include <vector>
 #include "vaapi/vaapibuffer.h"
 #include "vaapi/vaapiptrs.h"
 #include "vaapi/vaapitypes.h"
-#include <stdlib.h>
-
+#include "interface/VideoEncoderDef.h"
+#include "common/lock.h"
 
 class VaapiCodedBuffer
 {
@@ -38,16 +41,68 @@ public:
         return m_buf->getID();
     }
     bool copyInto(void* data);
-    bool setFlag(uint32_t flag) { m_flags |= flag; }
-    bool clearFlag(uint32_t flag) { m_flags &= !flag; }
+    //map coded data and describe it as a client segment chain, valid until buffer recycled
+    const YamiMediaCodec::VideoEncCodedSegment* getSegments();
+    //NAL unit at read position, including its start code.
+    //NALs don't cross segments, so only the current segment is scanned.
+    bool peekNal(const uint8_t*& nal, uint32_t& size, uint32_t& startCodeSize);
+    //move read position to next NAL unit
+    void popNal();
+    //bytes go before coded data, such as SEI NAL units generated by us.
+    //@data starts with a 4 bytes start code, it's copied
+    void setPrefix(const uint8_t* data, uint32_t size);
+    bool setFlag(uint32_t flag) { m_flags |= flag; return true; }
+    bool clearFlag(uint32_t flag) { m_flags &= ~flag; return true; }
     uint32_t getFlags() { return m_flags; }
 
 private:
-    VaapiCodedBuffer(const BufObjectPtr& buf):m_buf(buf), m_segments(NULL), m_flags(0) {}
+    friend class VaapiCodedBufferPool;
+    VaapiCodedBuffer(const BufObjectPtr& buf):m_buf(buf), m_segments(NULL), m_flags(0),
+        m_readSegment(NULL), m_readOffset(0), m_nalSize(0), m_prefixRead(false) {}
     bool map();
+    //unmap and clear state, so driver can write it again
+    void reset();
     BufObjectPtr m_buf;
     VACodedBufferSegment* m_segments;
+    std::vector<YamiMediaCodec::VideoEncCodedSegment> m_clientSegments;
     uint32_t m_flags;
+    //read position of peekNal/popNal
+    VACodedBufferSegment* m_readSegment;
+    uint32_t m_readOffset;
+    uint32_t m_nalSize;
+    std::vector<uint8_t> m_prefix;
+    //prefix is returned by peekNal as the first NAL unit
+    bool m_prefixRead;
+};
+
+/**
+ * \class VaapiCodedBufferPool
+ * \brief reuse coded buffers, they are sized for worst case and expensive to create.
+ * buffers are created on demand, at most maxSize of them, and come back to the pool
+ * when last CodedBufferPtr released. acquire() returns null when all are in use.
+ */
+class VaapiCodedBufferPool : public std::tr1::enable_shared_from_this<VaapiCodedBufferPool>
+{
+public:
+    static CodedBufferPoolPtr create(const ContextPtr&, uint32_t bufSize, uint32_t maxSize);
+    CodedBufferPtr acquire();
+    uint32_t getBufSize() const { return m_bufSize; }
+    uint32_t getMaxSize() const { return m_maxSize; }
+
+private:
+    VaapiCodedBufferPool(const ContextPtr&, uint32_t bufSize, uint32_t maxSize);
+    void recycle(VaapiCodedBuffer*);
+
+    ContextPtr m_context;
+    uint32_t m_bufSize;
+    uint32_t m_maxSize;
+    std::vector<CodedBufferPtr> m_buffers;
+    std::deque<VaapiCodedBuffer*> m_freed;
+    YamiMediaCodec::Lock m_lock;
+
+    struct BufferRecycler;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiCodedBufferPool);
 };
 
 #endif //vaapicodedbuffer_h
@@ -27,6 +27,10 @@
 #include "vaapiencoder_base.h"
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "common/common_def.h"
 #include "scopedlogger.h"
 #include "vaapicodedbuffer.h"
@@ -35,12 +39,39 @@
 #include "vaapi/vaapiutils.h"
 
 const uint32_t MaxOutputBuffer=5;
+//user pointer import needs page aligned memory and a stride the gpu likes
+const uint32_t UsrptrAlignment = 4096;
+const uint32_t UsrptrStrideAlignment = 128;
+const uint32_t UsrptrHeightAlignment = 32;
 namespace YamiMediaCodec{
+//microseconds, cheap enough to call per frame
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int typeIndex(VaapiPictureType type)
+{
+    if (type == VAAPI_PICTURE_TYPE_I)
+        return 0;
+    if (type == VAAPI_PICTURE_TYPE_B)
+        return 2;
+    return 1;
+}
+
 VaapiEncoderBase::VaapiEncoderBase():
     m_entrypoint(VAEntrypointEncSlice),
     m_externalDisplay(NULL),
     m_maxOutputBuffer(MaxOutputBuffer),
-    m_maxCodedbufSize(0)
+    m_maxCodedbufSize(0),
+    m_resolutionChanged(false),
+    m_rateControlChanged(false),
+    m_outputQueueCond(m_outputQueueLock),
+    m_endOfStream(false),
+    m_bufferMode(BUFFER_SHARING_NONE),
+    m_releasedInputs(new ReleasedInputs)
 {
     FUNC_ENTER();
     m_videoParamCommon.rawFormat = RAW_FORMAT_NV12;
@@ -56,6 +87,8 @@ VaapiEncoderBase::VaapiEncoderBase():
     m_videoParamCommon.cyclicFrameInterval = 30;
     m_videoParamCommon.refreshType = VIDEO_ENC_NONIR;
     m_videoParamCommon.airParams.airAuto = 1;
+    memset(&m_bufferAttrib, 0, sizeof(m_bufferAttrib));
+    resetStatistics();
 
     updateMaxOutputBufferCount();
 }
@@ -63,6 +96,8 @@ VaapiEncoderBase::VaapiEncoderBase():
 VaapiEncoderBase::~VaapiEncoderBase()
 {
     cleanupVA();
+    for (size_t i = 0; i < m_usrptrBuffers.size(); i++)
+        free(m_usrptrBuffers[i]);
     INFO("~VaapiEncoderBase");
 }
 
@@ -95,18 +130,230 @@ Encode_Status VaapiEncoderBase::encode(VideoEncRawBuffer *inBuffer)
     if (isBusy())
         return ENCODE_IS_BUSY;
 
-    SurfacePtr surface = createSurface(inBuffer);
+    //a buffer without data means end of stream
+    if (!inBuffer->data && !inBuffer->size) {
+        ret = drainLookAhead();
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+        ret = drain();
+        if (ret == ENCODE_SUCCESS)
+            endOfStream();
+        return ret;
+    }
+
+    if (m_resolutionChanged) {
+        ret = applyResolution();
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+    }
+
+    SurfacePtr surface = findImportedSurface(inBuffer);
+    if (!surface && m_bufferMode == BUFFER_SHARING_NONE) {
+        if (!ensureSurfacePools())
+            return ENCODE_NO_MEMORY;
+        surface = m_inputPool->acquire();
+        if (!surface)
+            return ENCODE_IS_BUSY;
+        if (!copyInput(surface, inBuffer))
+            return ENCODE_FAIL;
+    }
     if (!surface)
-        ret = ENCODE_NO_MEMORY;
-    else
-        ret = reorder(surface, inBuffer->timeStamp, inBuffer->forceKeyFrame);
+        return ENCODE_NO_MEMORY;
+
+    FrameCost cost;
+    if (m_rateControl)
+        analyzeInput(inBuffer, cost);
+    return encode(surface, inBuffer->timeStamp, inBuffer->forceKeyFrame || cost.sceneCut, cost);
+}
+
+Encode_Status VaapiEncoderBase::encode(SurfacePtr surface, uint64_t timeStamp, bool forceKeyFrame, const FrameCost& cost)
+{
+    Encode_Status ret;
+    InputFrame& input = m_inputFrames[surface.get()];
+    input.cost = cost;
+    input.inputTime = monotonicTime();
+
+    //getOutput(withWait = true) waits for this frame
+    m_outputQueueLock.acquire();
+    m_endOfStream = false;
+    m_outputQueueLock.release();
 
+    if (m_rateControl) {
+        LookAheadFrame frame = {surface, timeStamp, forceKeyFrame};
+        m_lookAheadFrames.push_back(frame);
+        if (m_lookAheadFrames.size() <= m_rateControl->lookAhead())
+            return ENCODE_SUCCESS;
+        surface = m_lookAheadFrames.front().surface;
+        timeStamp = m_lookAheadFrames.front().timeStamp;
+        forceKeyFrame = m_lookAheadFrames.front().forceKeyFrame;
+        m_lookAheadFrames.pop_front();
+    }
+
+    ret = reorder(surface, timeStamp, forceKeyFrame);
     if (ret != ENCODE_SUCCESS)
         return ret;
     ret = submitEncode();
     return ret;
 }
 
+void VaapiEncoderBase::analyzeInput(VideoEncRawBuffer* inBuffer, FrameCost& cost)
+{
+    //only system memory input can be read by cpu, dma-buf frames go without analysis
+    uint32_t stride;
+    if (m_bufferMode == BUFFER_SHARING_NONE)
+        stride = width();
+    else if (m_bufferMode == BUFFER_SHARING_USRPTR)
+        stride = m_bufferAttrib.lumaStride ? m_bufferAttrib.lumaStride : width();
+    else
+        return;
+
+    m_rateControl->analyze(inBuffer->data, stride, width(), height(), cost);
+}
+
+/* encode frames held for look-ahead, one at a time so client can retry on ENCODE_IS_BUSY */
+Encode_Status VaapiEncoderBase::drainLookAhead()
+{
+    Encode_Status ret;
+    while (!m_lookAheadFrames.empty()) {
+        if (isBusy())
+            return ENCODE_IS_BUSY;
+        LookAheadFrame frame = m_lookAheadFrames.front();
+        m_lookAheadFrames.pop_front();
+        ret = reorder(frame.surface, frame.timeStamp, frame.forceKeyFrame);
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+        ret = submitEncode();
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+    }
+    return ENCODE_SUCCESS;
+}
+
+/* hierarchical P of 2^(layers-1) frames: layer 0 at the start of each period,
+ * frames at odd positions on the top layer, the others in between */
+uint32_t VaapiEncoderBase::temporalLayerId(uint32_t index, uint32_t layers)
+{
+    uint32_t pos = index % (1 << (layers - 1));
+    uint32_t id = layers - 1;
+    if (!pos)
+        return 0;
+    while (!(pos & 1)) {
+        pos >>= 1;
+        id--;
+    }
+    return id;
+}
+
+void VaapiEncoderBase::clearPendingFrames()
+{
+    m_lookAheadFrames.clear();
+    m_inputFrames.clear();
+    AutoLock lock(m_statisticsLock);
+    m_statistics.submitted = m_statistics.stat.total_frames;
+}
+
+void VaapiEncoderBase::submitPicture(VaapiEncPicture* picture)
+{
+    uint64_t now = monotonicTime();
+    InputFrames::iterator it = m_inputFrames.find(picture->getSurface().get());
+    if (it != m_inputFrames.end()) {
+        picture->m_cost = it->second.cost;
+        picture->m_inputTime = it->second.inputTime;
+        m_inputFrames.erase(it);
+    } else {
+        picture->m_inputTime = now;
+    }
+    picture->m_submitTime = now;
+    if (m_rateControl)
+        picture->m_qp = m_rateControl->getQP(picture->m_type, picture->m_cost);
+    else
+        picture->m_qp = initQP();
+
+    AutoLock lock(m_statisticsLock);
+    picture->m_codingNum = m_statistics.submitted++;
+    picture->m_queueDepth = m_statistics.submitted - m_statistics.stat.total_frames;
+}
+
+void VaapiEncoderBase::syncPicture(VaapiEncPicture* picture) const
+{
+    picture->sync();
+    if (!picture->m_syncTime)
+        picture->m_syncTime = monotonicTime();
+}
+
+void VaapiEncoderBase::outputPicture(const VaapiEncPicture* picture, uint32_t size) const
+{
+    if (m_rateControl)
+        m_rateControl->update(picture->m_type, picture->m_qp, picture->m_cost, size * 8);
+
+    VideoFrameStatistics frame;
+    frame.frame_num = picture->m_codingNum;
+    frame.timeStamp = picture->m_timeStamp;
+    frame.type = typeIndex(picture->m_type);
+    frame.size = size;
+    //driver picks qp in other modes, we don't know it
+    frame.qp = rateControlMode() == RATE_CONTROL_CQP ? picture->m_qp : 0;
+    frame.wait_time = picture->m_submitTime - picture->m_inputTime;
+    frame.latency = picture->m_syncTime ? picture->m_syncTime - picture->m_submitTime : 0;
+    frame.queue_depth = picture->m_queueDepth;
+
+    {
+        AutoLock lock(m_statisticsLock);
+        VideoStatistics& stat = m_statistics.stat;
+        if (!stat.total_frames || frame.latency > stat.max_latency) {
+            stat.max_latency = frame.latency;
+            stat.max_latency_frame = frame.frame_num;
+        }
+        if (!stat.total_frames || frame.latency < stat.min_latency) {
+            stat.min_latency = frame.latency;
+            stat.min_latency_frame = frame.frame_num;
+        }
+        if (frame.wait_time > stat.max_wait_time)
+            stat.max_wait_time = frame.wait_time;
+        if (frame.queue_depth > stat.max_queue_depth)
+            stat.max_queue_depth = frame.queue_depth;
+        stat.total_frames++;
+        m_statistics.latency += frame.latency;
+        m_statistics.waitTime += frame.wait_time;
+
+        VideoFrameTypeStatistics& type = stat.frame_types[frame.type];
+        type.frames++;
+        type.total_size += size;
+        if (size > type.max_size)
+            type.max_size = size;
+        m_statistics.qp[frame.type] += frame.qp;
+    }
+
+    if (m_statisticsCallback.callback)
+        m_statisticsCallback.callback(m_statisticsCallback.user, &frame);
+}
+
+Encode_Status VaapiEncoderBase::getStatistics(VideoStatistics *videoStat)
+{
+    if (!videoStat)
+        return ENCODE_INVALID_PARAMS;
+    AutoLock lock(m_statisticsLock);
+    *videoStat = m_statistics.stat;
+    uint32_t frames = videoStat->total_frames;
+    if (frames) {
+        videoStat->average_latency = m_statistics.latency / frames;
+        videoStat->average_wait_time = m_statistics.waitTime / frames;
+    }
+    videoStat->queue_depth = m_statistics.submitted - frames;
+    for (int i = 0; i < 3; i++) {
+        VideoFrameTypeStatistics& type = videoStat->frame_types[i];
+        if (type.frames)
+            type.average_qp = m_statistics.qp[i] / type.frames;
+    }
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncoderBase::resetStatistics()
+{
+    AutoLock lock(m_statisticsLock);
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
 Encode_Status VaapiEncoderBase::getParameters(VideoParamConfigSet *videoEncParams)
 {
     FUNC_ENTER();
@@ -124,6 +371,12 @@ Encode_Status VaapiEncoderBase::getParameters(VideoParamConfigSet *videoEncParam
         }
         break;
     }
+    case VideoParamsTypeUsrptrBuffer: {
+        VideoParamsUsrptrBuffer* usrptr = (VideoParamsUsrptrBuffer*)videoEncParams;
+        if (usrptr->size == sizeof(VideoParamsUsrptrBuffer))
+            ret = allocUsrptrBuffer(usrptr);
+        break;
+    }
     default:
         ret = ENCODE_SUCCESS;
         break;
@@ -144,19 +397,88 @@ Encode_Status VaapiEncoderBase::setParameters(VideoParamConfigSet *videoEncParam
         VideoParamsCommon* common = (VideoParamsCommon*)videoEncParams;
         if (common->size == sizeof(VideoParamsCommon)) {
             m_videoParamCommon = *common;
+            updateMaxOutputBufferCount();
+            //resolution or buffer count may change, pools are recreated on next encode
+            m_inputPool.reset();
+            m_reconPool.reset();
         } else
             ret = ENCODE_INVALID_PARAMS;
         m_maxCodedbufSize = 0; // resolution may change, recalculate max codec buffer size when it is requested
         break;
     }
+    case VideoParamsTypeUpSteamBuffer: {
+        VideoParamsUpstreamBuffer* upstream = (VideoParamsUpstreamBuffer*)videoEncParams;
+        if (upstream->size == sizeof(VideoParamsUpstreamBuffer))
+            ret = setUpstreamBuffer(upstream);
+        else
+            ret = ENCODE_INVALID_PARAMS;
+        break;
+    }
     case VideoConfigTypeFrameRate: {
         VideoConfigFrameRate* frameRateConfig = (VideoConfigFrameRate*)videoEncParams;
+        if (!frameRateConfig->frameRate.frameRateNum || !frameRateConfig->frameRate.frameRateDenom) {
+            ret = ENCODE_INVALID_PARAMS;
+            break;
+        }
         m_videoParamCommon.frameRate = frameRateConfig->frameRate;
+        rateControlChanged();
         }
         break;
     case VideoConfigTypeBitRate: {
         VideoConfigBitRate* rcParamsConfig = (VideoConfigBitRate*)videoEncParams;
+        //look-ahead depth sizes the input pool, it can't change on the fly
+        uint32_t lookAhead = m_videoParamCommon.rcParams.lookAhead;
         m_videoParamCommon.rcParams = rcParamsConfig->rcParams;
+        m_videoParamCommon.rcParams.lookAhead = lookAhead;
+        rateControlChanged();
+        }
+        break;
+    case VideoConfigTypeResolution: {
+        VideoConfigResoltuion* resolutionConfig = (VideoConfigResoltuion*)videoEncParams;
+        VideoResolution& resolution = resolutionConfig->resolution;
+        if (!resolution.width || !resolution.height) {
+            ret = ENCODE_INVALID_PARAMS;
+            break;
+        }
+        if (resolution.width == width() && resolution.height == height())
+            break;
+        m_videoParamCommon.resolution = resolution;
+        //applied by next encode() if we are running, it starts with an IDR
+        if (m_context)
+            m_resolutionChanged = true;
+        else
+            m_maxCodedbufSize = 0;
+        }
+        break;
+    case VideoConfigTypeIntraRefreshType: {
+        VideoConfigIntraRefreshType* refreshConfig = (VideoConfigIntraRefreshType*)videoEncParams;
+        if (refreshConfig->refreshType >= VIDEO_ENC_LAST) {
+            ret = ENCODE_INVALID_PARAMS;
+            break;
+        }
+        m_videoParamCommon.refreshType = refreshConfig->refreshType;
+        }
+        break;
+    case VideoConfigTypeCyclicFrameInterval: {
+        VideoConfigCyclicFrameInterval* cyclicConfig = (VideoConfigCyclicFrameInterval*)videoEncParams;
+        if (cyclicConfig->cyclicFrameInterval < 0) {
+            ret = ENCODE_INVALID_PARAMS;
+            break;
+        }
+        m_videoParamCommon.cyclicFrameInterval = cyclicConfig->cyclicFrameInterval;
+        }
+        break;
+    case VideoConfigTypeAIR: {
+        VideoConfigAIR* airConfig = (VideoConfigAIR*)videoEncParams;
+        m_videoParamCommon.airParams = airConfig->airParams;
+        }
+        break;
+    case VideoParamsTypeStatisticsCallback: {
+        VideoParamsStatisticsCallback* callback = (VideoParamsStatisticsCallback*)videoEncParams;
+        if (callback->size == sizeof(VideoParamsStatisticsCallback))
+            m_statisticsCallback = *callback;
+        else
+            ret = ENCODE_INVALID_PARAMS;
         }
         break;
     default:
@@ -170,8 +492,18 @@ Encode_Status VaapiEncoderBase::setParameters(VideoParamConfigSet *videoEncParam
 Encode_Status VaapiEncoderBase::setConfig(VideoParamConfigSet *videoEncConfig)
 {
     FUNC_ENTER();
+    if (!videoEncConfig)
+        return ENCODE_INVALID_PARAMS;
     DEBUG("type = %d", videoEncConfig->type);
-    return ENCODE_SUCCESS;
+    //configs take effect on next frame, they share the path with parameters
+    return setParameters(videoEncConfig);
+}
+
+void VaapiEncoderBase::rateControlChanged()
+{
+    m_rateControlChanged = true;
+    if (m_rateControl)
+        m_rateControl->reconfigure(m_videoParamCommon);
 }
 
 Encode_Status VaapiEncoderBase::getConfig(VideoParamConfigSet *videoEncConfig)
@@ -187,38 +519,75 @@ Encode_Status VaapiEncoderBase::getMaxOutSize(uint32_t *maxSize)
     return ENCODE_SUCCESS;
 }
 
-SurfacePtr VaapiEncoderBase::createSurface()
+uint32_t VaapiEncoderBase::maxInputCount() const
 {
-    VASurfaceAttrib attrib;
-    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
-    attrib.type = VASurfaceAttribPixelFormat;
-    attrib.value.type = VAGenericValueTypeInteger;
-    attrib.value.value.i = VA_FOURCC_NV12;
-    return VaapiSurface::create(m_display, VAAPI_CHROMA_TYPE_YUV420,
-                                m_videoParamCommon.resolution.width, m_videoParamCommon.resolution.height, &attrib, 1);
+    //frames held for look-ahead and reordering, plus frames in output queue
+    return m_videoParamCommon.leastInputCount + m_maxOutputBuffer + maxReorderCount()
+        + m_videoParamCommon.rcParams.lookAhead;
+}
+
+bool VaapiEncoderBase::ensureSurfacePools()
+{
+    if (m_inputPool && m_reconPool)
+        return true;
+    if (!m_display)
+        return false;
+
+    uint32_t inputSize = maxInputCount();
+    //references, plus frames in output queue, plus the one being encoded
+    uint32_t reconSize = maxReferenceCount() + m_maxOutputBuffer + 1;
+    if (!m_inputPool)
+        m_inputPool = VaapiEncSurfacePool::create(m_display, VA_FOURCC_NV12, width(), height(), inputSize);
+    if (!m_reconPool)
+        m_reconPool = VaapiEncSurfacePool::create(m_display, VA_FOURCC_NV12, width(), height(), reconSize);
+    if (!m_inputPool || !m_reconPool) {
+        ERROR("failed to create encoder surface pool");
+        return false;
+    }
+    INFO("encoder surface pool size: input %d, reconstructed %d", inputSize, reconSize);
+    return true;
+}
 
+SurfacePtr VaapiEncoderBase::createSurface()
+{
+    SurfacePtr surface;
+    if (!ensureSurfacePools())
+        return surface;
+    surface = m_reconPool->acquire();
+    if (!surface)
+        ERROR("no free reconstructed surface, pool size %d", m_reconPool->getMaxSize());
+    return surface;
 }
 
 SurfacePtr VaapiEncoderBase::createSurface(VideoEncRawBuffer* inBuffer)
 {
-    SurfacePtr surface = createSurface();
-    if (!surface)
+    SurfacePtr surface;
+    if (!ensureSurfacePools())
         return surface;
+    surface = m_inputPool->acquire();
+    if (surface && !copyInput(surface, inBuffer))
+        surface.reset();
+    return surface;
+}
 
+bool VaapiEncoderBase::copyInput(const SurfacePtr& surface, VideoEncRawBuffer* inBuffer)
+{
+    //derived image is cached by surface, it stays mapped while surface is in pool
     VaapiImage* image = surface->getDerivedImage();
     if (!image) {
         ERROR("surface->getDerivedImage() failed");
-        surface.reset();
-        return surface;
+        return false;
     }
     VaapiImageRaw* raw = image->map();
     if (!raw) {
         ERROR("image->map() failed");
-        surface.reset();
-        return surface;
+        return false;
     }
 
-    assert(inBuffer->size == raw->width * raw->height * 3 / 2);
+    if (inBuffer->size < raw->width * raw->height * 3 / 2) {
+        ERROR("input buffer size %d is too small for %dx%d", inBuffer->size, raw->width, raw->height);
+        return false;
+    }
 
     uint8_t* src = inBuffer->data;
     uint8_t* dest = raw->pixels[0];
@@ -235,7 +604,189 @@ SurfacePtr VaapiEncoderBase::createSurface(VideoEncRawBuffer* inBuffer)
     }
 
     inBuffer->bufAvailable = true;
-    return surface;
+    return true;
+}
+
+Encode_Status VaapiEncoderBase::setUpstreamBuffer(const VideoParamsUpstreamBuffer* upstream)
+{
+    switch (upstream->bufferMode) {
+    case BUFFER_SHARING_NONE:
+    case BUFFER_SHARING_USRPTR:
+    case BUFFER_SHARING_KBUFHANDLE:
+        break;
+    default:
+        ERROR("buffer sharing mode %d is not supported", upstream->bufferMode);
+        return ENCODE_NOT_SUPPORTED;
+    }
+    //handles may be reused for other buffers, or the layout changes
+    releaseImportedSurfaces();
+    m_bufferMode = upstream->bufferMode;
+    if (upstream->bufAttrib)
+        m_bufferAttrib = *upstream->bufAttrib;
+    else
+        memset(&m_bufferAttrib, 0, sizeof(m_bufferAttrib));
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncoderBase::allocUsrptrBuffer(VideoParamsUsrptrBuffer* usrptr)
+{
+    if (usrptr->format && usrptr->format != RAW_FORMAT_NV12
+        && usrptr->format != VA_FOURCC_NV12) {
+        ERROR("only NV12 user pointer buffer is supported");
+        return ENCODE_NOT_SUPPORTED;
+    }
+    if (m_bufferMode != BUFFER_SHARING_NONE && m_bufferMode != BUFFER_SHARING_USRPTR) {
+        ERROR("can't mix user pointer buffers with buffer sharing mode %d", m_bufferMode);
+        return ENCODE_WRONG_STATE;
+    }
+
+    uint32_t w = usrptr->width ? usrptr->width : width();
+    uint32_t h = usrptr->height ? usrptr->height : height();
+    uint32_t stride = (w + UsrptrStrideAlignment - 1) & ~(UsrptrStrideAlignment - 1);
+    uint32_t alignedHeight = (h + UsrptrHeightAlignment - 1) & ~(UsrptrHeightAlignment - 1);
+    uint32_t size = stride * alignedHeight * 3 / 2;
+    if (size < usrptr->expectedSize)
+        size = usrptr->expectedSize;
+    size = (size + UsrptrAlignment - 1) & ~(UsrptrAlignment - 1);
+
+    void* ptr;
+    if (posix_memalign(&ptr, UsrptrAlignment, size))
+        return ENCODE_NO_MEMORY;
+    m_usrptrBuffers.push_back(ptr);
+
+    m_bufferMode = BUFFER_SHARING_USRPTR;
+    m_bufferAttrib.realWidth = w;
+    m_bufferAttrib.realHeight = alignedHeight;
+    m_bufferAttrib.lumaStride = stride;
+    m_bufferAttrib.chromStride = stride;
+    m_bufferAttrib.format = VA_FOURCC_NV12;
+
+    usrptr->usrPtr = (uint8_t*)ptr;
+    usrptr->stride = stride;
+    usrptr->actualSize = size;
+    return ENCODE_SUCCESS;
+}
+
+SurfacePtr VaapiEncoderBase::importSurface(uintptr_t handle, uint32_t memType,
+    uint32_t lumaStride, uint32_t chromaStride, uint32_t chromaOffset)
+{
+    VASurfaceAttribExternalBuffers external;
+    memset(&external, 0, sizeof(external));
+    unsigned long buffer = handle;
+    external.pixel_format = VA_FOURCC_NV12;
+    external.width = width();
+    external.height = height();
+    external.num_planes = 2;
+    external.pitches[0] = lumaStride;
+    external.pitches[1] = chromaStride;
+    external.offsets[0] = 0;
+    external.offsets[1] = chromaOffset;
+    external.data_size = chromaOffset + chromaStride * ((height() + 1) / 2);
+    external.buffers = &buffer;
+    external.num_buffers = 1;
+
+    VASurfaceAttrib attribs[2];
+    attribs[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attribs[0].type = VASurfaceAttribMemoryType;
+    attribs[0].value.type = VAGenericValueTypeInteger;
+    attribs[0].value.value.i = memType;
+
+    attribs[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attribs[1].type = VASurfaceAttribExternalBufferDescriptor;
+    attribs[1].value.type = VAGenericValueTypePointer;
+    attribs[1].value.value.p = &external;
+
+    return VaapiSurface::create(m_display, VAAPI_CHROMA_TYPE_YUV420,
+                                width(), height(), attribs, N_ELEMENTS(attribs));
+}
+
+//drops one use of an imported surface, the client buffer is free when it runs
+struct VaapiEncoderBase::InputRelease
+{
+    InputRelease(const std::tr1::shared_ptr<ReleasedInputs>& released, uintptr_t handle, const SurfacePtr& surface)
+        : m_released(released), m_handle(handle), m_surface(surface) {}
+    void operator()(VaapiSurface*)
+    {
+        //nobody to tell if the encoder is gone
+        std::tr1::shared_ptr<ReleasedInputs> released = m_released.lock();
+        if (!released)
+            return;
+        AutoLock lock(released->lock);
+        released->handles.push_back(m_handle);
+    }
+    std::tr1::weak_ptr<ReleasedInputs> m_released;
+    uintptr_t m_handle;
+    SurfacePtr m_surface;
+};
+
+Encode_Status VaapiEncoderBase::getReleasedInput(VideoEncRawBuffer * inBuffer)
+{
+    if (!inBuffer)
+        return ENCODE_NULL_PTR;
+    AutoLock lock(m_releasedInputs->lock);
+    std::deque<uintptr_t>& handles = m_releasedInputs->handles;
+    if (handles.empty())
+        return ENCODE_BUFFER_NO_MORE;
+    inBuffer->data = (uint8_t*)handles.front();
+    inBuffer->bufAvailable = true;
+    handles.pop_front();
+    return ENCODE_SUCCESS;
+}
+
+SurfacePtr VaapiEncoderBase::findImportedSurface(VideoEncRawBuffer* inBuffer)
+{
+    SurfacePtr surface;
+    uintptr_t handle = (uintptr_t)inBuffer->data;
+    uint64_t inode = 0;
+    uint32_t memType;
+
+    if (m_bufferMode == BUFFER_SHARING_KBUFHANDLE) {
+        //every dma-buf has its own inode, a closed and reused fd number has another one
+        struct stat st;
+        if (fstat((int)handle, &st)) {
+            ERROR("input dma-buf fd %d is invalid", (int)handle);
+            return surface;
+        }
+        inode = st.st_ino;
+        memType = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME;
+    } else if (m_bufferMode == BUFFER_SHARING_USRPTR) {
+        memType = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+    } else {
+        return surface;
+    }
+
+    ImportedSurfaces::iterator it = m_importedSurfaces.find(handle);
+    if (it != m_importedSurfaces.end()
+        && (it->second.inode != inode || it->second.size != inBuffer->size)) {
+        DEBUG("input handle %p is reused for another buffer, import again", inBuffer->data);
+        m_importedSurfaces.erase(it);
+        it = m_importedSurfaces.end();
+    }
+    if (it != m_importedSurfaces.end()) {
+        surface = it->second.surface;
+    } else {
+
+        uint32_t lumaStride = m_bufferAttrib.lumaStride ? m_bufferAttrib.lumaStride : width();
+        uint32_t chromaStride = m_bufferAttrib.chromStride ? m_bufferAttrib.chromStride : lumaStride;
+        uint32_t lumaHeight = m_bufferAttrib.realHeight ? m_bufferAttrib.realHeight : height();
+        surface = importSurface(handle, memType, lumaStride, chromaStride, lumaStride * lumaHeight);
+        if (!surface) {
+            ERROR("import input buffer %p failed", inBuffer->data);
+            return surface;
+        }
+        ImportedSurface& imported = m_importedSurfaces[handle];
+        imported.surface = surface;
+        imported.size = inBuffer->size;
+        imported.inode = inode;
+    }
+    //gpu reads the client buffer directly, it's busy until the frame drops this use
+    inBuffer->bufAvailable = false;
+    return SurfacePtr(surface.get(), InputRelease(m_releasedInputs, handle, surface));
+}
+
+void VaapiEncoderBase::releaseImportedSurfaces()
+{
+    m_importedSurfaces.clear();
 }
 
 Encode_Status VaapiEncoderBase::copyCodedBuffer(VideoEncOutputBuffer *outBuffer, const CodedBufferPtr& codedBuffer) const
@@ -253,6 +804,147 @@ Encode_Status VaapiEncoderBase::copyCodedBuffer(VideoEncOutputBuffer *outBuffer,
     return ENCODE_SUCCESS;
 }
 
+CodedBufferPtr VaapiEncoderBase::createCodedBuffer()
+{
+    CodedBufferPtr coded;
+    //frames in output queue and held by client in mapped mode are limited by isBusy(),
+    //but one encode() may submit the B frames waiting for it too.
+    uint32_t maxSize = m_maxOutputBuffer + maxReorderCount();
+    if (!m_codedBufferPool || m_codedBufferPool->getBufSize() != m_maxCodedbufSize
+        || m_codedBufferPool->getMaxSize() != maxSize) {
+        //size changed, buffers in old pool go away when client releases them
+        m_codedBufferPool = VaapiCodedBufferPool::create(m_context, m_maxCodedbufSize, maxSize);
+        if (!m_codedBufferPool) {
+            ERROR("failed to create coded buffer pool");
+            return coded;
+        }
+    }
+    return m_codedBufferPool->acquire();
+}
+
+Encode_Status VaapiEncoderBase::mapCodedBuffer(VideoEncMappedBuffer *outBuffer,
+    const CodedBufferPtr& codedBuffer, int64_t timeStamp)
+{
+    const VideoEncCodedSegment* segments = codedBuffer->getSegments();
+    if (!segments)
+        return ENCODE_FAIL;
+    outBuffer->segments = segments;
+    outBuffer->dataSize = codedBuffer->size();
+    outBuffer->flag = codedBuffer->getFlags();
+    outBuffer->timeStamp = timeStamp;
+    outBuffer->handle = (intptr_t)codedBuffer.get();
+
+    AutoLock lock(m_mappedLock);
+    m_mappedOutputs[codedBuffer.get()] = codedBuffer;
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncoderBase::releaseMappedOutput(VideoEncMappedBuffer * outBuffer)
+{
+    if (!outBuffer)
+        return;
+    AutoLock lock(m_mappedLock);
+    MappedOutputs::iterator it = m_mappedOutputs.find((VaapiCodedBuffer*)outBuffer->handle);
+    if (it == m_mappedOutputs.end()) {
+        ERROR("release invalid mapped output %p", (void*)outBuffer->handle);
+        return;
+    }
+    m_mappedOutputs.erase(it);
+    outBuffer->segments = NULL;
+    outBuffer->handle = 0;
+}
+
+uint32_t VaapiEncoderBase::mappedOutputCount()
+{
+    AutoLock lock(m_mappedLock);
+    return m_mappedOutputs.size();
+}
+
+Encode_Status VaapiEncoderBase::getMappedOutput(VideoEncMappedBuffer * outBuffer, bool withWait)
+{
+    PicturePtr picture;
+    CodedBufferPtr codedBuffer;
+    Encode_Status ret;
+
+    FUNC_ENTER();
+    if (!outBuffer)
+        return ENCODE_INVALID_PARAMS;
+
+    if (!peekOutput(picture, codedBuffer, withWait))
+        return ENCODE_BUFFER_NO_MORE;
+
+    syncPicture(picture.get());
+    ret = mapCodedBuffer(outBuffer, codedBuffer, picture->m_timeStamp);
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    outBuffer->temporalId = picture->m_temporalId;
+    outputPicture(picture.get(), outBuffer->dataSize);
+    popOutput();
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncoderBase::queueOutput(const PicturePtr& picture, const CodedBufferPtr& codedBuffer)
+{
+    AutoLock locker(m_outputQueueLock);
+    m_outputQueue.push(std::make_pair(picture, codedBuffer));
+    m_outputQueueCond.signal();
+}
+
+bool VaapiEncoderBase::peekOutput(PicturePtr& picture, CodedBufferPtr& codedBuffer, bool withWait) const
+{
+    AutoLock locker(m_outputQueueLock);
+    if (withWait) {
+        uint32_t timeout = m_videoParamCommon.outputTimeout;
+        struct timespec deadline;
+        if (timeout)
+            Condition::getDeadline((uint64_t)timeout * 1000, deadline);
+        while (m_outputQueue.empty() && !m_endOfStream) {
+            if (!timeout)
+                m_outputQueueCond.wait();
+            else if (!m_outputQueueCond.timedWait(deadline))
+                break;
+        }
+    }
+    if (m_outputQueue.empty())
+        return false;
+    picture = m_outputQueue.front().first;
+    codedBuffer = m_outputQueue.front().second;
+    return true;
+}
+
+void VaapiEncoderBase::popOutput() const
+{
+    AutoLock locker(m_outputQueueLock);
+    if (!m_outputQueue.empty())
+        m_outputQueue.pop();
+}
+
+void VaapiEncoderBase::clearOutputs()
+{
+    AutoLock locker(m_outputQueueLock);
+    INFO("output queue size: %ld", m_outputQueue.size());
+    while (!m_outputQueue.empty())
+        m_outputQueue.pop();
+    //wake up getOutput(withWait = true), there is nothing to wait for
+    m_endOfStream = true;
+    m_outputQueueCond.broadcast();
+}
+
+void VaapiEncoderBase::endOfStream()
+{
+    AutoLock locker(m_outputQueueLock);
+    m_endOfStream = true;
+    m_outputQueueCond.broadcast();
+}
+
+bool VaapiEncoderBase::isBusy()
+{
+    m_outputQueueLock.acquire();
+    uint32_t queued = m_outputQueue.size();
+    m_outputQueueLock.release();
+    return queued + mappedOutputCount() >= m_maxOutputBuffer;
+}
+
 void VaapiEncoderBase::fill(VAEncMiscParameterHRD* hrd) const
 {
     hrd->buffer_size = m_videoParamCommon.rcParams.bitRate * m_videoParamCommon.rcParams.windowSize/1000;
@@ -261,6 +953,17 @@ void VaapiEncoderBase::fill(VAEncMiscParameterHRD* hrd) const
         m_videoParamCommon.rcParams.bitRate, hrd->buffer_size,hrd->initial_buffer_fullness);
 }
 
+void VaapiEncoderBase::fill(VAEncMiscParameterFrameRate* frameRate) const
+{
+    uint32_t num = frameRateNum();
+    uint32_t denom = frameRateDenom();
+    //fractional form is denom << 16 | num, integer fps for older drivers
+    if (denom <= 1)
+        frameRate->framerate = num;
+    else
+        frameRate->framerate = (denom << 16) | (num & 0xffff);
+}
+
 void VaapiEncoderBase::fill(VAEncMiscParameterRateControl* rateControl) const
 {
     rateControl->bits_per_second = m_videoParamCommon.rcParams.bitRate;
@@ -271,6 +974,30 @@ void VaapiEncoderBase::fill(VAEncMiscParameterRateControl* rateControl) const
     rateControl->target_percentage = m_videoParamCommon.rcParams.targetPercentage;
     rateControl->rc_flags.bits.disable_frame_skip = m_videoParamCommon.rcParams.disableFrameSkip;
     rateControl->rc_flags.bits.disable_bit_stuffing = m_videoParamCommon.rcParams.disableBitsStuffing;
+    //driver restarts its rate control with new bitrate or frame rate
+    rateControl->rc_flags.bits.reset = m_rateControlChanged;
+}
+
+void VaapiEncoderBase::fill(VAEncMiscParameterCIR* cir) const
+{
+    //every macroblock is intra coded once in a cycle
+    uint32_t mbCount = ((width() + 15) / 16) * ((height() + 15) / 16);
+    uint32_t interval = m_videoParamCommon.cyclicFrameInterval;
+    cir->cir_num_mbs = (mbCount + interval - 1) / interval;
+}
+
+void VaapiEncoderBase::fill(VAEncMiscParameterAIR* air) const
+{
+    air->air_num_mbs = m_videoParamCommon.airParams.airMBs;
+    air->air_threshold = m_videoParamCommon.airParams.airThreshold;
+    air->air_auto = m_videoParamCommon.airParams.airAuto;
+}
+
+bool VaapiEncoderBase::gradualRefresh() const
+{
+    VideoIntraRefreshType type = m_videoParamCommon.refreshType;
+    return (type == VIDEO_ENC_CIR || type == VIDEO_ENC_BOTH)
+        && m_videoParamCommon.cyclicFrameInterval > 0;
 }
 
 /* Generates additional control parameters */
@@ -287,7 +1014,28 @@ bool VaapiEncoderBase::ensureMiscParams (VaapiEncPicture* picture)
         if (!picture->newMisc(VAEncMiscParameterTypeRateControl, rateControl))
             return false;
         fill(rateControl);
+        VAEncMiscParameterFrameRate* frameRate;
+        if (!picture->newMisc(VAEncMiscParameterTypeFrameRate, frameRate))
+            return false;
+        fill(frameRate);
+    }
+    //intra pictures have nothing to refresh
+    if (picture->m_type != VAAPI_PICTURE_TYPE_I) {
+        if (gradualRefresh()) {
+            VAEncMiscParameterCIR* cir;
+            if (!picture->newMisc(VAEncMiscParameterTypeCIR, cir))
+                return false;
+            fill(cir);
+        }
+        VideoIntraRefreshType type = m_videoParamCommon.refreshType;
+        if (type == VIDEO_ENC_AIR || type == VIDEO_ENC_BOTH) {
+            VAEncMiscParameterAIR* air;
+            if (!picture->newMisc(VAEncMiscParameterTypeAIR, air))
+                return false;
+            fill(air);
+        }
     }
+    m_rateControlChanged = false;
     return true;
 }
 
@@ -302,6 +1050,7 @@ const ProfileMapItem g_profileMap[] =
     {VAAPI_PROFILE_H264_CONSTRAINED_BASELINE,VAProfileH264ConstrainedBaseline},
     {VAAPI_PROFILE_H264_MAIN, VAProfileH264Main},
     {VAAPI_PROFILE_H264_HIGH,VAProfileH264High},
+    {VAAPI_PROFILE_JPEG_BASELINE, VAProfileJPEGBaseline},
 };
 
 VaapiProfile VaapiEncoderBase::profile() const
@@ -315,42 +1064,91 @@ VaapiProfile VaapiEncoderBase::profile() const
 
 void VaapiEncoderBase::cleanupVA()
 {
+    clearPendingFrames();
+    m_rateControl.reset();
+    releaseImportedSurfaces();
+    m_inputPool.reset();
+    m_reconPool.reset();
+    m_codedBufferPool.reset();
     m_context.reset();
+    m_config.reset();
     m_display.reset();
 }
 
+bool VaapiEncoderBase::createContext()
+{
+    m_context = VaapiContext::create(m_config,
+                             m_videoParamCommon.resolution.width,
+                             m_videoParamCommon.resolution.height,
+                             VA_PROGRESSIVE, 0, 0);
+    if (!m_context) {
+        ERROR("failed to create context");
+        return false;
+    }
+    return true;
+}
+
+/* encode frames of old resolution, then switch context and pools to the new one.
+ * pictures and buffers in flight hold the old context and pools until they are done */
+Encode_Status VaapiEncoderBase::applyResolution()
+{
+    Encode_Status ret = drainLookAhead();
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    ret = drain();
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    if (!createContext())
+        return ENCODE_FAIL;
+    releaseImportedSurfaces();
+    m_inputPool.reset();
+    m_reconPool.reset();
+    m_codedBufferPool.reset();
+    m_maxCodedbufSize = 0;
+    resolutionChanged();
+    m_resolutionChanged = false;
+    INFO("resolution changed to %dx%d", width(), height());
+    return ENCODE_SUCCESS;
+}
+
 bool VaapiEncoderBase::initVA()
 {
-    VAConfigAttrib attrib, *pAttrib = NULL;
+    VAConfigAttrib attribs[2];
     int32_t attribCount = 0;
     FUNC_ENTER();
 
-    m_display = VaapiDisplay::create(m_externalDisplay);
+    if (m_sharedDisplay)
+        m_display = m_sharedDisplay;
+    else
+        m_display = VaapiDisplay::create(m_externalDisplay);
     if (!m_display) {
         ERROR("failed to create display");
         return false;
     }
 
     if (RATE_CONTROL_NONE != m_videoParamCommon.rcMode) {
-        attrib.type = VAConfigAttribRateControl;
-        attrib.value = m_videoParamCommon.rcMode;
-        pAttrib = &attrib;
-        attribCount = 1;
+        attribs[attribCount].type = VAConfigAttribRateControl;
+        attribs[attribCount].value = m_videoParamCommon.rcMode;
+        attribCount++;
+    }
+    if (packedHeaders() != VA_ENC_PACKED_HEADER_NONE) {
+        attribs[attribCount].type = VAConfigAttribEncPackedHeaders;
+        attribs[attribCount].value = packedHeaders();
+        attribCount++;
     }
-    ConfigPtr config = VaapiConfig::create(m_display, m_videoParamCommon.profile, m_entrypoint, pAttrib, attribCount);
-    if (!config) {
+    m_config = VaapiConfig::create(m_display, m_videoParamCommon.profile, m_entrypoint,
+                                   attribCount ? attribs : NULL, attribCount);
+    if (!m_config) {
         ERROR("failed to create config");
         return false;
     }
 
-    m_context = VaapiContext::create(config,
-                             m_videoParamCommon.resolution.width,
-                             m_videoParamCommon.resolution.height,
-                             VA_PROGRESSIVE, 0, 0);
-    if (!m_context) {
-        ERROR("failed to create context");
+    if (!createContext())
         return false;
-    }
+    m_resolutionChanged = false;
+    m_rateControlChanged = true;
+    m_rateControl = VaapiEncRateControl::create(m_videoParamCommon);
+    resetStatistics();
     return true;
 }
 }
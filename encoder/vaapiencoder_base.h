@@ -28,9 +28,17 @@
 #include "interface/VideoEncoderInterface.h"
 #include "common/log.h"
 #include "vaapiencpicture.h"
+#include "vaapiencratecontrol.h"
+#include "vaapiencsurfacepool.h"
+#include "common/condition.h"
+#include "common/lock.h"
 #include "vaapi/vaapibuffer.h"
 #include "vaapi/vaapiptrs.h"
 #include "vaapi/vaapisurface.h"
+#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
 
 namespace YamiMediaCodec{
 enum VaapiEncReorderState
@@ -40,8 +48,13 @@ enum VaapiEncReorderState
     VAAPI_ENC_REORD_WAIT_FRAMES = 2
 };
 
+class VaapiEncodeSession;
+
 class VaapiEncoderBase : public IVideoEncoder {
+    //feeds surfaces to encoders directly, see VaapiEncodeSession
+    friend class VaapiEncodeSession;
 public:
+    typedef std::tr1::shared_ptr<VaapiEncPicture> PicturePtr;
     VaapiEncoderBase();
     virtual ~VaapiEncoderBase();
 
@@ -58,6 +71,9 @@ public:
     * and caller should provide a big enough buffer and call again
     */
     virtual Encode_Status getOutput(VideoEncOutputBuffer * outBuffer, bool withWait = false) const = 0;
+    virtual Encode_Status getMappedOutput(VideoEncMappedBuffer * outBuffer, bool withWait = false);
+    virtual void releaseMappedOutput(VideoEncMappedBuffer * outBuffer);
+    virtual Encode_Status getReleasedInput(VideoEncRawBuffer * inBuffer);
 
     virtual Encode_Status getParameters(VideoParamConfigSet *);
     virtual Encode_Status setParameters(VideoParamConfigSet *);
@@ -66,24 +82,66 @@ public:
 
     virtual Encode_Status getMaxOutSize(uint32_t *maxSize);
 
-    virtual Encode_Status getStatistics(VideoStatistics *videoStat) {
-        return ENCODE_SUCCESS;
-    };
+    virtual Encode_Status getStatistics(VideoStatistics *videoStat);
 
 protected:
     //utils functions for derived class
+    //get a reconstructed surface from pool, null if all of them are in use
     SurfacePtr createSurface();
+    //get an input surface from pool and copy inBuffer to it
     SurfacePtr createSurface(VideoEncRawBuffer* inBuffer);
+    static bool copyInput(const SurfacePtr&, VideoEncRawBuffer* inBuffer);
+    //wrap client dma-buf fd or user pointer as surface, no copy
+    SurfacePtr importSurface(uintptr_t handle, uint32_t memType,
+                             uint32_t lumaStride, uint32_t chromaStride, uint32_t chromaOffset);
+    SurfacePtr findImportedSurface(VideoEncRawBuffer* inBuffer);
     Encode_Status copyCodedBuffer(VideoEncOutputBuffer *, const CodedBufferPtr&) const;
+    //coded buffer from pool, sized m_maxCodedbufSize, null if all are in use
+    CodedBufferPtr createCodedBuffer();
+    //hand coded buffer to client without copy, it's held until releaseMappedOutput
+    Encode_Status mapCodedBuffer(VideoEncMappedBuffer *, const CodedBufferPtr&, int64_t timeStamp);
+    uint32_t mappedOutputCount();
+    //coded pictures wait in output queue in coding order, getOutput takes them out
+    void queueOutput(const PicturePtr&, const CodedBufferPtr&);
+    //front of output queue, false if it's empty. with @withWait, block until a frame
+    //is queued, the stream is drained or flushed, or outputTimeout passes
+    bool peekOutput(PicturePtr&, CodedBufferPtr&, bool withWait) const;
+    void popOutput() const;
+    //drop queued frames, getOutput(withWait = true) stops waiting. for flush
+    void clearOutputs();
 
     //virtual functions
     virtual Encode_Status reorder(const SurfacePtr& , uint64_t timeStamp, bool forceKeyFrame = false) = 0;
     virtual Encode_Status submitEncode() = 0;
+    //encode frames held for reordering, at end of stream or before resolution change
+    virtual Encode_Status drain() { return ENCODE_SUCCESS; }
+    //context and pools have new resolution, next frame must be an IDR
+    virtual void resolutionChanged() {}
 
     //rate control related things
     void fill(VAEncMiscParameterHRD*) const ;
     void fill(VAEncMiscParameterRateControl*) const ;
+    void fill(VAEncMiscParameterFrameRate*) const ;
+    void fill(VAEncMiscParameterCIR*) const ;
+    void fill(VAEncMiscParameterAIR*) const ;
     bool ensureMiscParams (VaapiEncPicture*);
+    //cyclic intra refresh replaces periodic key frames, decoder recovers in cyclicFrameInterval frames
+    bool gradualRefresh() const;
+    //software rate control, see VaapiEncRateControl
+    bool useSoftwareRateControl() const {
+        return !!m_rateControl;
+    }
+    //call it in coding order after picture type is decided, right before the picture is submitted.
+    //it sets m_qp and m_cost for rate control, and timing for statistics
+    void submitPicture(VaapiEncPicture*);
+    //sync picture with hardware, the first sync is recorded as end of encoding
+    void syncPicture(VaapiEncPicture*) const;
+    //picture of @size bytes is returned to client, feed it to rate control and statistics
+    void outputPicture(const VaapiEncPicture*, uint32_t size) const;
+    //drop frames held for look-ahead and forget frames in flight, for flush
+    void clearPendingFrames();
+    //temporal layer of the @index-th frame after a key frame, for hierarchical P of @layers
+    static uint32_t temporalLayerId(uint32_t index, uint32_t layers);
 
     //properties
     VaapiProfile profile() const;
@@ -123,7 +181,14 @@ protected:
     uint32_t& minQP() {
         return m_videoParamCommon.rcParams.minQP;
     }
-    virtual bool isBusy() = 0 ;
+    //frames held by client in mapped mode still occupy coded buffers
+    virtual bool isBusy();
+    //max count of reconstructed frames kept as reference
+    virtual uint32_t maxReferenceCount() const { return 1; }
+    //max count of input frames held for reordering
+    virtual uint32_t maxReorderCount() const { return 0; }
+    //VA_ENC_PACKED_HEADER_* we may send to driver, it's asked when config is created
+    virtual uint32_t packedHeaders() const { return VA_ENC_PACKED_HEADER_NONE; }
 
     DisplayPtr m_display;
     ContextPtr m_context;
@@ -135,9 +200,100 @@ protected:
 private:
     bool initVA();
     void cleanupVA();
+    bool createContext();
+    Encode_Status applyResolution();
+    void rateControlChanged();
+    Encode_Status setUpstreamBuffer(const VideoParamsUpstreamBuffer*);
+    Encode_Status allocUsrptrBuffer(VideoParamsUsrptrBuffer*);
+    void releaseImportedSurfaces();
+    bool ensureSurfacePools();
+    //max input surfaces held by encoder
+    uint32_t maxInputCount() const;
+    //encode a surface on m_display, it's held until the frame is coded
+    Encode_Status encode(SurfacePtr, uint64_t timeStamp, bool forceKeyFrame, const FrameCost&);
+    void analyzeInput(VideoEncRawBuffer* inBuffer, FrameCost&);
+    Encode_Status drainLookAhead();
+    //all frames of the stream are submitted
+    void endOfStream();
     Display* m_externalDisplay;
+    //display owned by an encode session, used instead of creating one
+    DisplayPtr m_sharedDisplay;
+    ConfigPtr m_config;
+    //VideoConfigTypeResolution is waiting for next encode()
+    bool m_resolutionChanged;
+    //bitrate or frame rate changed, driver rate control resets on next picture
+    bool m_rateControlChanged;
+
+    //input and reconstructed surfaces, created on demand and reused
+    EncSurfacePoolPtr m_inputPool;
+    EncSurfacePoolPtr m_reconPool;
+    CodedBufferPoolPtr m_codedBufferPool;
+    //coded buffers held by client, see getMappedOutput
+    typedef std::map<VaapiCodedBuffer*, CodedBufferPtr> MappedOutputs;
+    MappedOutputs m_mappedOutputs;
+    Lock m_mappedLock;
+
+    //output queue
+    mutable std::queue<std::pair<PicturePtr, CodedBufferPtr> > m_outputQueue;
+    mutable Lock m_outputQueueLock;
+    //signalled when a frame is queued, or no more frames will be queued
+    mutable Condition m_outputQueueCond;
+    //drained or flushed, nothing comes to output queue until next input
+    bool m_endOfStream;
+
+    //input buffer sharing, see VideoParamsUpstreamBuffer
+    VideoBufferSharingMode m_bufferMode;
+    ExternalBufferAttrib m_bufferAttrib;
+    //imported surfaces, keyed by dma-buf fd or user pointer
+    struct ImportedSurface {
+        SurfacePtr surface;
+        //the handle is reused for another buffer if they don't match
+        uint32_t size;
+        uint64_t inode;     //dma-buf inode, 0 for user pointer
+    };
+    typedef std::map<uintptr_t, ImportedSurface> ImportedSurfaces;
+    ImportedSurfaces m_importedSurfaces;
+    //imported buffers done by gpu, see getReleasedInput.
+    //surfaces given to client may outlive the encoder, so they only hold it weakly
+    struct ReleasedInputs {
+        Lock lock;
+        std::deque<uintptr_t> handles;
+    };
+    struct InputRelease;
+    std::tr1::shared_ptr<ReleasedInputs> m_releasedInputs;
+    //memory allocated for client by VideoParamsTypeUsrptrBuffer
+    std::vector<void*> m_usrptrBuffers;
+
+    //input frames wait here until lookAhead frames after them are analyzed
+    struct LookAheadFrame {
+        SurfacePtr surface;
+        uint64_t timeStamp;
+        bool forceKeyFrame;
+    };
+    RateControlPtr m_rateControl;
+    std::deque<LookAheadFrame> m_lookAheadFrames;
+    //input frames not yet taken by submitPicture
+    struct InputFrame {
+        FrameCost cost;
+        uint64_t inputTime;
+    };
+    typedef std::map<VaapiSurface*, InputFrame> InputFrames;
+    InputFrames m_inputFrames;
+
+    //statistics, updated by both encode thread and output thread
+    struct Statistics {
+        VideoStatistics stat;
+        uint32_t submitted;
+        uint64_t latency;
+        uint64_t waitTime;
+        uint64_t qp[3];
+    };
+    void resetStatistics();
+    mutable Statistics m_statistics;
+    mutable Lock m_statisticsLock;
+    VideoParamsStatisticsCallback m_statisticsCallback;
 
-    bool updateMaxOutputBufferCount() {
+    void updateMaxOutputBufferCount() {
         if (m_maxOutputBuffer < m_videoParamCommon.leastInputCount + 3)
             m_maxOutputBuffer = m_videoParamCommon.leastInputCount + 3;
     }
@@ -44,6 +44,8 @@ using std::vector;
 /* Define the maximum IDR period */
 #define MAX_IDR_PERIOD 512
 
+#define MAX_TEMPORAL_LAYERS 4
+
 
 #define VAAPI_ENCODER_H264_NAL_REF_IDC_NONE        0
 #define VAAPI_ENCODER_H264_NAL_REF_IDC_LOW         1
@@ -198,12 +200,12 @@ static BOOL
 bit_writer_write_sps(
     BitWriter *bitwriter,
     const VAEncSequenceParameterBufferH264* const seq,
-    VaapiProfile profile
+    VaapiProfile profile,
+    BOOL gaps_in_frame_num_value_allowed_flag
 )
 {
     uint32_t constraint_set0_flag, constraint_set1_flag;
     uint32_t constraint_set2_flag, constraint_set3_flag;
-    uint32_t gaps_in_frame_num_value_allowed_flag = 0; // ??
     BOOL nal_hrd_parameters_present_flag;
 
     uint32_t b_qpprime_y_zero_transform_bypass = 0;
@@ -475,6 +477,107 @@ bit_writer_write_pps(
     return TRUE;
 }
 
+/* P slice header of a picture referencing one frame that is not the latest,
+ * the driver only writes default reference list, so we send it as packed header.
+ * @pic_num_diff is CurrPicNum - PicNum of the reference */
+static BOOL
+bit_writer_write_p_slice_header(
+    BitWriter *bitwriter,
+    const VAEncSliceParameterBufferH264* const slice,
+    uint32_t frame_num,
+    uint32_t log2_max_frame_num,
+    uint32_t log2_max_pic_order_cnt_lsb,
+    BOOL is_reference,
+    BOOL entropy_coding_mode_flag,
+    uint32_t pic_num_diff
+)
+{
+    bit_writer_put_bits_uint32 (bitwriter, 0x00000001, 32);   /* start code */
+    bit_writer_write_nal_header (bitwriter,
+                         is_reference ? VAAPI_ENCODER_H264_NAL_REF_IDC_MEDIUM : VAAPI_ENCODER_H264_NAL_REF_IDC_NONE,
+                         VAAPI_ENCODER_H264_NAL_NON_IDR);
+    /* first_mb_in_slice */
+    bit_writer_put_ue(bitwriter, slice->macroblock_address);
+    /* slice_type */
+    bit_writer_put_ue(bitwriter, slice->slice_type);
+    /* pic_parameter_set_id */
+    bit_writer_put_ue(bitwriter, 0);
+    bit_writer_put_bits_uint32(bitwriter, frame_num, log2_max_frame_num);
+    /* frame_mbs_only_flag is 1, pic_order_cnt_type is 0 */
+    bit_writer_put_bits_uint32(bitwriter, slice->pic_order_cnt_lsb, log2_max_pic_order_cnt_lsb);
+
+    /* num_ref_idx_active_override_flag */
+    bit_writer_put_bits_uint32(bitwriter, slice->num_ref_idx_active_override_flag, 1);
+    if (slice->num_ref_idx_active_override_flag)
+        bit_writer_put_ue(bitwriter, slice->num_ref_idx_l0_active_minus1);
+
+    /* ref_pic_list_modification_flag_l0 */
+    bit_writer_put_bits_uint32(bitwriter, 1, 1);
+    /* modification_of_pic_nums_idc, subtract from predicted pic num */
+    bit_writer_put_ue(bitwriter, 0);
+    /* abs_diff_pic_num_minus1 */
+    bit_writer_put_ue(bitwriter, pic_num_diff - 1);
+    /* end of modification */
+    bit_writer_put_ue(bitwriter, 3);
+
+    /* dec_ref_pic_marking, sliding window */
+    if (is_reference)
+        bit_writer_put_bits_uint32(bitwriter, 0, 1);
+    if (entropy_coding_mode_flag)
+        bit_writer_put_ue(bitwriter, slice->cabac_init_idc);
+    bit_writer_put_se(bitwriter, slice->slice_qp_delta);
+
+    /* deblocking_filter_control_present_flag is 1 */
+    bit_writer_put_ue(bitwriter, slice->disable_deblocking_filter_idc);
+    if (slice->disable_deblocking_filter_idc != 1) {
+        bit_writer_put_se(bitwriter, slice->slice_alpha_c0_offset_div2);
+        bit_writer_put_se(bitwriter, slice->slice_beta_offset_div2);
+    }
+
+    /* cabac_alignment_one_bit */
+    if (entropy_coding_mode_flag)
+        bit_writer_align_bytes_unchecked(bitwriter, 1);
+    return TRUE;
+}
+
+/* recovery point SEI, decoding starts from this picture is correct
+ * after @recovery_frame_cnt frames in frame_num order */
+static BOOL
+bit_writer_write_sei_recovery_point(
+    BitWriter *bitwriter,
+    uint32_t recovery_frame_cnt
+)
+{
+    const uint32_t payload_type_recovery_point = 6;
+    BitWriter payload;
+    uint32_t payload_size;
+
+    bit_writer_init (&payload, 16 * 8);
+    bit_writer_put_ue(&payload, recovery_frame_cnt);
+    /* exact_match_flag, intra refresh doesn't restrict motion vectors */
+    bit_writer_put_bits_uint32(&payload, 0, 1);
+    /* broken_link_flag */
+    bit_writer_put_bits_uint32(&payload, 0, 1);
+    /* changing_slice_group_idc */
+    bit_writer_put_bits_uint32(&payload, 0, 2);
+    /* bit_equal_to_one, then bit_equal_to_zero until byte aligned */
+    if (BIT_WRITER_BIT_SIZE(&payload) % 8)
+        bit_writer_write_trailing_bits(&payload);
+    payload_size = BIT_WRITER_BIT_SIZE(&payload) / 8;
+
+    bit_writer_put_bits_uint32 (bitwriter, 0x00000001, 32);   /* start code */
+    bit_writer_write_nal_header (bitwriter,
+                         VAAPI_ENCODER_H264_NAL_REF_IDC_NONE, VAAPI_ENCODER_H264_NAL_SEI);
+    bit_writer_put_bits_uint32(bitwriter, payload_type_recovery_point, 8);
+    bit_writer_put_bits_uint32(bitwriter, payload_size, 8);
+    bit_writer_put_bytes(bitwriter, BIT_WRITER_DATA(&payload), payload_size);
+    bit_writer_clear (&payload, TRUE);
+
+    /* rbsp_trailing_bits */
+    bit_writer_write_trailing_bits(bitwriter);
+    return TRUE;
+}
+
 class VaapiEncStreamHeaderH264
 {
   public:
@@ -537,17 +640,29 @@ private:
     VaapiEncPictureH264(const ContextPtr& context, const SurfacePtr& surface, int64_t timeStamp):
         VaapiEncPicture(context, surface, timeStamp),
         m_frameNum(0),
-        m_poc(0)
+        m_poc(0),
+        m_isIdr(false),
+        m_isReference(true)
     {
     }
 
     bool isIdr() const {
-        return m_type == VAAPI_PICTURE_TYPE_I && !m_frameNum;
+        return m_isIdr;
+    }
+    //sps/pps go before I frames and recovery points, a decoder may start from both
+    bool hasStreamHeaders() const {
+        return m_type == VAAPI_PICTURE_TYPE_I || m_sei;
     }
     uint32_t m_frameNum;
+    //not wrapped, for reference ordering and driver; slice header has its lsb
     uint32_t m_poc;
+    bool m_isIdr;
+    //I/P frames and the middle B frame of a pyramid
+    bool m_isReference;
     StreamHeaderPtr m_sps;
     StreamHeaderPtr m_pps;
+    //recovery point SEI of the first picture in an intra refresh cycle
+    StreamHeaderPtr m_sei;
 };
 
 class VaapiEncoderH264Ref
@@ -556,18 +671,35 @@ public:
     VaapiEncoderH264Ref(const PicturePtr& picture, const SurfacePtr& surface):
         m_frameNum(picture->m_frameNum),
         m_poc(picture->m_poc),
+        m_temporalId(picture->m_temporalId),
         m_pic(surface)
     {
     }
+    void fill(VAPictureH264& pic) const
+    {
+        pic.picture_id = m_pic->getID();
+        pic.frame_idx = m_frameNum;
+        pic.flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+        pic.TopFieldOrderCnt = m_poc;
+        pic.BottomFieldOrderCnt = m_poc;
+    }
     SurfacePtr m_pic;
     uint32_t m_frameNum;
     uint32_t m_poc;
+    uint32_t m_temporalId;
 };
 
 VaapiEncoderH264::VaapiEncoderH264():
+    m_numBFrames(0),
+    m_bPyramid(false),
     m_useCabac(false),
     m_useDct8x8(false),
-    m_reorderState(VAAPI_ENC_REORD_WAIT_FRAMES)
+    m_reorderState(VAAPI_ENC_REORD_WAIT_FRAMES),
+    m_curFrameNum(0),
+    m_refreshCount(0),
+    m_temporalLayers(1),
+    m_temporalIndex(0),
+    m_nalIndex(0)
 {
     m_videoParamCommon.profile = VAProfileH264Main;
     m_videoParamCommon.level = 40;
@@ -575,13 +707,11 @@ VaapiEncoderH264::VaapiEncoderH264():
     m_videoParamCommon.rcParams.minQP = 1;
 
     m_videoParamAVC.idrInterval = 30;
-    pthread_mutex_init(&m_outputQueueMutex, NULL);
 }
 
 VaapiEncoderH264::~VaapiEncoderH264()
 {
     FUNC_ENTER();
-    pthread_mutex_destroy(&m_outputQueueMutex);
 }
 
 bool VaapiEncoderH264::ensureCodedBufferSize()
@@ -601,7 +731,9 @@ bool VaapiEncoderH264::ensureCodedBufferSize()
     m_mbWidth = (width() + 15) / 16;
     m_mbHeight = (height() + 15)/ 16;
     //FIXME:
-    m_numSlices = 1;
+    m_numSlices = std::max(m_videoParamAVC.sliceNum.iSliceNum, m_videoParamAVC.sliceNum.pSliceNum);
+    if (!m_numSlices)
+        m_numSlices = 1;
     mbSize = m_mbWidth * m_mbHeight;
     if (m_numSlices > (mbSize + 1) / 2)
         m_numSlices = (mbSize + 1) / 2;
@@ -631,8 +763,11 @@ bool VaapiEncoderH264::ensureCodedBufferSize()
     /* XXX: exclude slice groups, scaling lists, MVC/SVC extensions */
     m_maxCodedbufSize += 4 + (MAX_PPS_HDR_SIZE + 7) / 8;
 
-    /* Account for slice header */
-    m_maxCodedbufSize += m_numSlices * (4 +
+    /* Account for slice header, driver may split slices further for max slice size */
+    uint32_t maxSlices = m_numSlices;
+    if (m_videoParamAVC.maxSliceSize > 0)
+        maxSlices += m_maxCodedbufSize / m_videoParamAVC.maxSliceSize + 1;
+    m_maxCodedbufSize += maxSlices * (4 +
         (MAX_SLICE_HDR_SIZE + 7) / 8);
     DEBUG("m_maxCodedbufSize: %u", m_maxCodedbufSize);
 
@@ -648,7 +783,23 @@ void VaapiEncoderH264::resetParams ()
     ensureCodedBufferSize();
 
     //FIXME:
-    m_numBFrames = 0;
+    m_numBFrames = m_videoParamAVC.bFrameNum;
+    m_temporalLayers = m_videoParamAVC.temporalLayers;
+    if (!m_temporalLayers)
+        m_temporalLayers = 1;
+    if (m_temporalLayers > MAX_TEMPORAL_LAYERS) {
+        WARNING("at most %d temporal layers", MAX_TEMPORAL_LAYERS);
+        m_temporalLayers = MAX_TEMPORAL_LAYERS;
+    }
+    if (m_numBFrames && m_temporalLayers > 1) {
+        WARNING("temporal layers use hierarchical P frames, disable B frames");
+        m_numBFrames = 0;
+    }
+    if (m_numBFrames && (profile() == VAAPI_PROFILE_H264_BASELINE
+        || profile() == VAAPI_PROFILE_H264_CONSTRAINED_BASELINE)) {
+        WARNING("baseline profile has no B frames, disable them");
+        m_numBFrames = 0;
+    }
 
     if (keyFramePeriod() < intraPeriod())
         keyFramePeriod() = intraPeriod();
@@ -670,15 +821,26 @@ void VaapiEncoderH264::resetParams ()
     m_log2MaxPicOrderCnt = m_log2MaxFrameNum + 1;
     m_maxPicOrderCnt = (1 << m_log2MaxPicOrderCnt);
 
+    //pyramid needs 2 B frames at least, one of them is reference
+    m_bPyramid = m_videoParamAVC.bPyramid && m_numBFrames >= 2;
+
     m_maxRefList0Count = 1;
     m_maxRefList1Count = m_numBFrames > 0;
     m_maxRefFrames =
         m_maxRefList0Count + m_maxRefList1Count;
+    //reference B frame should not kick out the forward reference of other B frames
+    if (m_bPyramid)
+        m_maxRefFrames++;
+    //sliding window keeps latest frame of each layer below the top one,
+    //layer 0 frame is referenced by next layer 0 frame 2^(layers-2) reference frames later
+    if (m_temporalLayers > 2)
+        m_maxRefFrames = 1 << (m_temporalLayers - 2);
 
-    INFO("m_maxRefFrames: %d", m_maxRefFrames);
+    INFO("m_maxRefFrames: %d, B frames: %d, pyramid: %d", m_maxRefFrames, m_numBFrames, m_bPyramid);
 
 
     resetGopStart();
+    m_curFrameNum = 0;
 }
 
 Encode_Status VaapiEncoderH264::getMaxOutSize(uint32_t *maxSize)
@@ -704,14 +866,13 @@ void VaapiEncoderH264::flush()
 {
     FUNC_ENTER();
     resetGopStart();
+    m_curFrameNum = 0;
     m_reorderFrameList.clear();
     m_refList.clear();
+    clearPendingFrames();
 
-    INFO("output queue size: %ld", m_outputQueue.size());
-    pthread_mutex_lock(&m_outputQueueMutex);
-    while (!m_outputQueue.empty())
-        m_outputQueue.pop();
-    pthread_mutex_unlock(&m_outputQueueMutex);
+    clearOutputs();
+    m_nalIndex = 0;
 }
 
 Encode_Status VaapiEncoderH264::stop()
@@ -733,6 +894,8 @@ Encode_Status VaapiEncoderH264::setParameters(VideoParamConfigSet *videoEncParam
     case VideoParamsTypeAVC: {
             VideoParamsAVC* avc = (VideoParamsAVC*)videoEncParams;
             m_videoParamAVC = *avc;
+            // slice number and size change the max coded buffer size
+            m_maxCodedbufSize = 0;
         }
         break;
     case VideoConfigTypeAVCIntraPeriod: {
@@ -765,6 +928,30 @@ Encode_Status VaapiEncoderH264::getParameters(VideoParamConfigSet *videoEncParam
     return VaapiEncoderBase::getParameters(videoEncParams);
 }
 
+/* move frames waiting for backward reference to m_reorderFrameList in coding order,
+ * @picture closes them as a P frame, it is coded first */
+void VaapiEncoderH264::dumpFrames(const PicturePtr& picture)
+{
+    list<PicturePtr> bFrames;
+    bFrames.swap(m_reorderFrameList);
+
+    setPFrame(picture);
+    m_reorderFrameList.push_back(picture);
+    if (m_bPyramid && bFrames.size() >= 2) {
+        list<PicturePtr>::iterator mid = bFrames.begin();
+        std::advance(mid, bFrames.size() / 2);
+        setBFrame(*mid, true);
+        m_reorderFrameList.push_back(*mid);
+        bFrames.erase(mid);
+    }
+    list<PicturePtr>::iterator it;
+    for (it = bFrames.begin(); it != bFrames.end(); ++it) {
+        setBFrame(*it, false);
+        m_reorderFrameList.push_back(*it);
+    }
+    m_reorderState = VAAPI_ENC_REORD_DUMP_FRAMES;
+}
+
 Encode_Status VaapiEncoderH264::reorder(const SurfacePtr& surface, uint64_t timeStamp, bool forceKeyFrame)
 {
     if (!surface)
@@ -772,20 +959,24 @@ Encode_Status VaapiEncoderH264::reorder(const SurfacePtr& surface, uint64_t time
 
     ++m_curPresentIndex;
     PicturePtr picture(new VaapiEncPictureH264(m_context, surface, timeStamp));
-    picture->m_poc = ((m_curPresentIndex * 2) % m_maxPicOrderCnt);
+    /* poc keeps growing without IDR (gradual refresh), only its lsb goes to bitstream */
+    picture->m_poc = m_curPresentIndex * 2;
 
-    bool isIdr = (m_frameIndex == 0 ||m_frameIndex >= keyFramePeriod() || forceKeyFrame);
+    /* with gradual refresh, only the first frame or a forced one is key frame */
+    bool periodic = !gradualRefresh();
+    bool isIdr = (m_frameIndex == 0 || (periodic && m_frameIndex >= keyFramePeriod()) || forceKeyFrame);
 
     /* check key frames */
-    if (isIdr || (m_frameIndex % intraPeriod() == 0)) {
-        ++m_curFrameNum;
-        ++m_frameIndex;
-        /* b frame enabled,  check queue of reorder_frame_list */
-        if (m_numBFrames
-                && (m_reorderFrameList.size() > 0)) {
-            assert(0);
-
+    if (isIdr || (periodic && m_frameIndex % intraPeriod() == 0)) {
+        /* b frames can't reference across key frame, close them with a P frame */
+        if (!m_reorderFrameList.empty()) {
+            PicturePtr last = m_reorderFrameList.back();
+            m_reorderFrameList.pop_back();
+            dumpFrames(last);
         }
+        ++m_frameIndex;
+        m_temporalIndex = 0;
+        setTemporalLayer(picture);
         setIntraFrame (picture, isIdr);
         m_reorderFrameList.push_back(picture);
         m_reorderState = VAAPI_ENC_REORD_DUMP_FRAMES;
@@ -793,18 +984,37 @@ Encode_Status VaapiEncoderH264::reorder(const SurfacePtr& surface, uint64_t time
     }
     /* new p/b frames coming */
     ++m_frameIndex;
+    setTemporalLayer(picture);
     if (m_reorderFrameList.size() < m_numBFrames) {
-        assert(0);
         m_reorderFrameList.push_back(picture);
+        m_reorderState = VAAPI_ENC_REORD_WAIT_FRAMES;
         return ENCODE_SUCCESS;
     }
-    ++m_curFrameNum;
-    setPFrame (picture);
-    m_reorderFrameList.push_front(picture);
-    m_reorderState = VAAPI_ENC_REORD_DUMP_FRAMES;
+    dumpFrames(picture);
     return ENCODE_SUCCESS;
 }
 
+Encode_Status VaapiEncoderH264::drain()
+{
+    /* no more frames, the last waiting one becomes P */
+    if (m_reorderState == VAAPI_ENC_REORD_WAIT_FRAMES && !m_reorderFrameList.empty()) {
+        PicturePtr last = m_reorderFrameList.back();
+        m_reorderFrameList.pop_back();
+        dumpFrames(last);
+    }
+    return submitEncode();
+}
+
+void VaapiEncoderH264::resolutionChanged()
+{
+    /* old references are gone with old resolution, start over from an IDR.
+     * m_idrNum goes on, idr_pic_id of consecutive IDRs should differ */
+    m_refList.clear();
+    m_frameIndex = 0;
+    m_curPresentIndex = 0;
+    m_curFrameNum = 0;
+}
+
 Encode_Status VaapiEncoderH264::getStreamHeader(VideoEncOutputBuffer *outBuffer, PicturePtr picture)
 {
     uint8_t *data = outBuffer->data;
@@ -814,7 +1024,7 @@ Encode_Status VaapiEncoderH264::getStreamHeader(VideoEncOutputBuffer *outBuffer,
     int i;
 
     if (picture) {
-        if (picture->m_type == VAAPI_PICTURE_TYPE_I) {
+        if (picture->hasStreamHeaders()) {
             // XXX, when we distinguish IDR from I frame, update here
             header[0] = picture->m_sps;
             header[1] = picture->m_pps;
@@ -917,42 +1127,57 @@ Encode_Status VaapiEncoderH264::submitEncode()
 {
     FUNC_ENTER();
     Encode_Status ret;
-    if (m_reorderState == VAAPI_ENC_REORD_DUMP_FRAMES) {
+    while (m_reorderState == VAAPI_ENC_REORD_DUMP_FRAMES) {
         if (!m_maxCodedbufSize)
             ensureCodedBufferSize();
-        CodedBufferPtr codedBuffer = VaapiCodedBuffer::create(m_context, m_maxCodedbufSize);
+        CodedBufferPtr codedBuffer = createCodedBuffer();
+        if (!codedBuffer)
+            return ENCODE_IS_BUSY;
         PicturePtr picture = m_reorderFrameList.front();
         m_reorderFrameList.pop_front();
         if (m_reorderFrameList.empty())
             m_reorderState = VAAPI_ENC_REORD_WAIT_FRAMES;
 
+        /* frame_num counts reference frames in coding order */
+        if (picture->isIdr())
+            m_curFrameNum = 0;
+        picture->m_frameNum = m_curFrameNum % m_maxFrameNum;
+        if (!ensureRecoveryPoint(picture))
+            return ENCODE_FAIL;
+        submitPicture(picture.get());
         ret =  encodePicture(picture, codedBuffer);
         if (ret != ENCODE_SUCCESS) {
+            //following frames may reference this one, drop them
+            m_reorderFrameList.clear();
+            m_reorderState = VAAPI_ENC_REORD_WAIT_FRAMES;
             return ret;
         }
+        if (picture->m_isReference)
+            ++m_curFrameNum;
         codedBuffer->setFlag(ENCODE_BUFFERFLAG_ENDOFFRAME);
         INFO("picture->m_type: 0x%x", picture->m_type);
-        if (picture->m_type == VAAPI_PICTURE_TYPE_I) {
+        if (picture->hasStreamHeaders()) {
             codedBuffer->setFlag(ENCODE_BUFFERFLAG_SYNCFRAME);
         }
+        if (picture->m_sei)
+            codedBuffer->setPrefix(&picture->m_sei->m_emulation[0], picture->m_sei->m_emulation.size());
 
-        pthread_mutex_lock(&m_outputQueueMutex);
-        m_outputQueue.push(std::make_pair(picture, codedBuffer));
-        pthread_mutex_unlock(&m_outputQueueMutex);
+        queueOutput(picture, codedBuffer);
     }
 
     INFO();
     return ENCODE_SUCCESS;
 }
 /** getOutput suppose to run in a separated thread with other functions, be carefull
- * 1) it update m_outputQueue only for now, we use m_outputQueueMutex for it
+ * 1) it update output queue only for now, VaapiEncoderBase locks it
  * 2) the rest which are not protected by mutex is generally fine
  *   a). getCodecCofnig() read some sps/pps parameter only, we suppose client doesn't change sps/pps at the same time.
- *   b). read/peek of the m_outputQueue is fine since getOutput is the only place to erase element
+ *   b). peek of the output queue is fine since getOutput is the only place to erase element
  *   c). picture->sync and copyCodecBuffer are fine as well
 */
 Encode_Status VaapiEncoderH264::getOutput(VideoEncOutputBuffer * outBuffer, bool withWait) const
 {
+    VaapiEncoderBase::PicturePtr front;
     PicturePtr picture;
     CodedBufferPtr codedBuffer;
     Encode_Status ret;
@@ -964,16 +1189,13 @@ Encode_Status VaapiEncoderH264::getOutput(VideoEncOutputBuffer * outBuffer, bool
         return ENCODE_INVALID_PARAMS;
 
     ASSERT(outBuffer->format == OUTPUT_CODEC_DATA || outBuffer->format == OUTPUT_STREAM_HEADER
-        || outBuffer->format == OUTPUT_EVERYTHING || outBuffer->format == OUTPUT_FRAME_DATA);
+        || outBuffer->format == OUTPUT_EVERYTHING || outBuffer->format == OUTPUT_FRAME_DATA
+        || outBuffer->format == OUTPUT_ONE_NAL || outBuffer->format == OUTPUT_ONE_NAL_WITHOUT_STARTCODE);
 
-    pthread_mutex_lock(&m_outputQueueMutex);
-    isEmpty = m_outputQueue.empty();
-    pthread_mutex_unlock(&m_outputQueueMutex);
-
-    if (!isEmpty) {
-        picture = m_outputQueue.front().first;
-        codedBuffer = m_outputQueue.front().second;
-    }
+    //stream headers don't need a frame in queue
+    isEmpty = !peekOutput(front, codedBuffer,
+                          withWait && !(outBuffer->format & (OUTPUT_CODEC_DATA | OUTPUT_STREAM_HEADER)));
+    picture = std::tr1::static_pointer_cast<VaapiEncPictureH264>(front);
 
     if (outBuffer->format & OUTPUT_CODEC_DATA)
         return getCodecCofnig(outBuffer, picture);
@@ -984,6 +1206,9 @@ Encode_Status VaapiEncoderH264::getOutput(VideoEncOutputBuffer * outBuffer, bool
         return ENCODE_BUFFER_NO_MORE;
     }
 
+    if (outBuffer->format & (OUTPUT_ONE_NAL | OUTPUT_ONE_NAL_WITHOUT_STARTCODE))
+        return getOneNal(outBuffer, picture, codedBuffer);
+
     if (outBuffer->format == OUTPUT_EVERYTHING) {
         // fill stream header first
         ret = getStreamHeader(outBuffer, picture);
@@ -995,8 +1220,11 @@ Encode_Status VaapiEncoderH264::getOutput(VideoEncOutputBuffer * outBuffer, bool
         outBuffer->bufferSize -= headerSize;
     }
 
-    picture->sync();
+    syncPicture(picture.get());
     ret = copyCodedBuffer(outBuffer, codedBuffer);
+    //frames come out in coding order, carry the presentation time of this one
+    outBuffer->timeStamp = picture->m_timeStamp;
+    outBuffer->temporalId = picture->m_temporalId;
     if (outBuffer->format == OUTPUT_EVERYTHING) {
         outBuffer->data -= headerSize;
         outBuffer->bufferSize += headerSize;
@@ -1004,52 +1232,117 @@ Encode_Status VaapiEncoderH264::getOutput(VideoEncOutputBuffer * outBuffer, bool
 
     if (ret != ENCODE_SUCCESS)
         return ret;
+    outputPicture(picture.get(), codedBuffer->size());
+
+    popOutput();
 
-    pthread_mutex_lock(&m_outputQueueMutex);
-    m_outputQueue.pop();
-    pthread_mutex_unlock(&m_outputQueueMutex);
+    return ENCODE_SUCCESS;
+}
+
+/* return sps, pps (for I frames and recovery points) and slices one by one,
+ * m_nalIndex tracks the headers, coded buffer tracks its own read position */
+Encode_Status VaapiEncoderH264::getOneNal(VideoEncOutputBuffer * outBuffer,
+    const PicturePtr& picture, const CodedBufferPtr& codedBuffer) const
+{
+    bool withStartCode = outBuffer->format & OUTPUT_ONE_NAL;
+    const uint8_t* nal;
+    uint32_t size;
+    uint32_t startCodeSize;
+
+    if (picture->hasStreamHeaders() && m_nalIndex < 2) {
+        const StreamHeaderPtr& header = m_nalIndex ? picture->m_pps : picture->m_sps;
+        ASSERT(header && header->m_raw.size());
+        if (!header->m_emulation.size())
+            header->generateByteStreamWithEmulation();
+        nal = &header->m_emulation[0];
+        size = header->m_emulation.size();
+        startCodeSize = 4;
+    } else {
+        syncPicture(picture.get());
+        if (!codedBuffer->peekNal(nal, size, startCodeSize)) {
+            ERROR("no slice in coded buffer");
+            return ENCODE_FAIL;
+        }
+    }
 
+    if (!withStartCode) {
+        nal += startCodeSize;
+        size -= startCodeSize;
+    }
+    if (size > outBuffer->bufferSize) {
+        outBuffer->dataSize = 0;
+        outBuffer->remainingSize = size;
+        return ENCODE_BUFFER_TOO_SMALL;
+    }
+    memcpy(outBuffer->data, nal, size);
+    outBuffer->dataSize = size;
+    outBuffer->remainingSize = 0;
+    outBuffer->timeStamp = picture->m_timeStamp;
+    outBuffer->temporalId = picture->m_temporalId;
+
+    if (picture->hasStreamHeaders() && m_nalIndex < 2) {
+        outBuffer->flag = ENCODE_BUFFERFLAG_CODECCONFIG | ENCODE_BUFFERFLAG_PARTIALFRAME;
+        m_nalIndex++;
+        return ENCODE_SUCCESS;
+    }
+    codedBuffer->popNal();
+    if (codedBuffer->peekNal(nal, size, startCodeSize)) {
+        outBuffer->flag = ENCODE_BUFFERFLAG_PARTIALFRAME;
+        return ENCODE_SUCCESS;
+    }
+    outBuffer->flag = codedBuffer->getFlags();
+    m_nalIndex = 0;
+    outputPicture(picture.get(), codedBuffer->size());
+    popOutput();
     return ENCODE_SUCCESS;
 }
 
 /* Handle new GOP starts */
+/* frame_num is not reset here, frames before the IDR in coding order still need it.
+ * it's assigned in coding order by submitEncode() */
 void VaapiEncoderH264::resetGopStart ()
 {
     m_idrNum = 0;
     m_frameIndex = 0;
-    m_curFrameNum = 0;
     m_curPresentIndex = 0;
 }
 
 /* Marks the supplied picture as a B-frame */
-void VaapiEncoderH264::setBFrame (const PicturePtr& pic)
+void VaapiEncoderH264::setBFrame (const PicturePtr& pic, bool isReference)
 {
     pic->m_type = VAAPI_PICTURE_TYPE_B;
-    pic->m_frameNum = (m_curFrameNum % m_maxFrameNum);
+    pic->m_isReference = isReference;
 }
 
 /* Marks the supplied picture as a P-frame */
 void VaapiEncoderH264::setPFrame (const PicturePtr& pic)
 {
     pic->m_type = VAAPI_PICTURE_TYPE_P;
-    pic->m_frameNum = (m_curFrameNum % m_maxFrameNum);
 }
 
 /* Marks the supplied picture as an I-frame */
 void VaapiEncoderH264::setIFrame (const PicturePtr& pic)
 {
     pic->m_type = VAAPI_PICTURE_TYPE_I;
-    pic->m_frameNum = (m_curFrameNum % m_maxFrameNum);
 }
 
 /* Marks the supplied picture as an IDR frame */
 void VaapiEncoderH264::setIdrFrame (const PicturePtr& pic)
 {
     pic->m_type = VAAPI_PICTURE_TYPE_I;
-    pic->m_frameNum = 0;
+    pic->m_isIdr = true;
     pic->m_poc = 0;
 }
 
+/* Picks temporal layer of the supplied picture, top layer is not referenced */
+void VaapiEncoderH264::setTemporalLayer (const PicturePtr& pic)
+{
+    if (m_temporalLayers <= 1)
+        return;
+    pic->m_temporalId = temporalLayerId(m_temporalIndex++, m_temporalLayers);
+    pic->m_isReference = pic->m_temporalId < m_temporalLayers - 1;
+}
+
 /* Marks the supplied picture a a key-frame */
 void VaapiEncoderH264::setIntraFrame (const PicturePtr& picture,bool idIdr)
 {
@@ -1065,13 +1358,14 @@ void VaapiEncoderH264::setIntraFrame (const PicturePtr& picture,bool idIdr)
 bool VaapiEncoderH264::
 referenceListUpdate (const PicturePtr& picture, const SurfacePtr& surface)
 {
-    if (VAAPI_PICTURE_TYPE_B == picture->m_type) {
+    if (!picture->m_isReference) {
         return true;
     }
     if (picture->isIdr()) {
         referenceListFree();
     } else if (m_refList.size() >= m_maxRefFrames) {
-        m_refList.pop_front();
+        //sliding window, drop the oldest one
+        m_refList.pop_back();
     }
     ReferencePtr ref(new VaapiEncoderH264Ref(picture, surface));
     m_refList.push_front(ref); // recent first
@@ -1079,20 +1373,70 @@ referenceListUpdate (const PicturePtr& picture, const SurfacePtr& surface)
     return true;
 }
 
+static bool refPocGreater(const ReferencePtr& r1, const ReferencePtr& r2)
+{
+    return r1->m_poc > r2->m_poc;
+}
+
+static bool refPocLess(const ReferencePtr& r1, const ReferencePtr& r2)
+{
+    return r1->m_poc < r2->m_poc;
+}
+
+/* default reference lists of 8.2.4.2, the driver does not write list modification:
+ * P: descending frame_num, m_refList is kept this way.
+ *    with temporal layers it's the only allowed reference, see addSliceHeaders().
+ * B: list0 has earlier frames closest first, list1 has later frames closest first.
+ */
 bool  VaapiEncoderH264::referenceListInit (
     const PicturePtr& picture,
     vector<ReferencePtr>& refList0,
     vector<ReferencePtr>& refList1) const
 {
-    assert(picture->m_type == VAAPI_PICTURE_TYPE_P);
-    refList0.reserve(m_refList.size());
-    refList0.insert(refList0.end(), m_refList.begin(), m_refList.end());
+    if (picture->m_type == VAAPI_PICTURE_TYPE_P && m_temporalLayers > 1) {
+        /* latest frame of a lower layer, or of layer 0 for layer 0 frames,
+         * so dropping upper layers doesn't break this one */
+        list<ReferencePtr>::const_iterator it;
+        for (it = m_refList.begin(); it != m_refList.end(); ++it) {
+            if ((*it)->m_temporalId < picture->m_temporalId || !(*it)->m_temporalId) {
+                refList0.push_back(*it);
+                break;
+            }
+        }
+        if (refList0.empty()) {
+            ERROR("no reference for temporal layer %d", picture->m_temporalId);
+            return false;
+        }
+    } else if (picture->m_type == VAAPI_PICTURE_TYPE_P) {
+        refList0.reserve(m_refList.size());
+        refList0.insert(refList0.end(), m_refList.begin(), m_refList.end());
+    } else {
+        assert(picture->m_type == VAAPI_PICTURE_TYPE_B);
+        vector<ReferencePtr> before, after;
+        list<ReferencePtr>::const_iterator it;
+        for (it = m_refList.begin(); it != m_refList.end(); ++it) {
+            if ((*it)->m_poc < picture->m_poc)
+                before.push_back(*it);
+            else
+                after.push_back(*it);
+        }
+        std::sort(before.begin(), before.end(), refPocGreater);
+        std::sort(after.begin(), after.end(), refPocLess);
+        refList0 = before;
+        refList0.insert(refList0.end(), after.begin(), after.end());
+        refList1 = after;
+        refList1.insert(refList1.end(), before.begin(), before.end());
+        if (before.empty() || after.empty()) {
+            ERROR("B frame (poc %d) needs both forward and backward reference", picture->m_poc);
+            return false;
+        }
+    }
 
-    assert (refList0.size() + refList1.size() <= m_maxRefFrames);
     if (refList0.size() > m_maxRefList0Count)
         refList0.resize(m_maxRefList0Count);
     if (refList1.size() > m_maxRefList1Count)
         refList1.resize(m_maxRefList1Count);
+    assert (refList0.size() + refList1.size() <= m_maxRefFrames);
 
     return true;
 }
@@ -1176,16 +1520,20 @@ bool VaapiEncoderH264::fill(VAEncPictureParameterBufferH264* picParam, const Pic
     picParam->CurrPic.picture_id = surface->getID();
     picParam->CurrPic.TopFieldOrderCnt = picture->m_poc;
 
+    picParam->CurrPic.BottomFieldOrderCnt = picture->m_poc;
+    picParam->CurrPic.frame_idx = picture->m_frameNum;
+
     if (picture->m_type != VAAPI_PICTURE_TYPE_I) {
         list<ReferencePtr>::const_iterator it;
         for (it = m_refList.begin(); it != m_refList.end(); ++it) {
             assert(*it && (*it)->m_pic && ((*it)->m_pic->getID() != VA_INVALID_ID));
-            picParam->ReferenceFrames[i].picture_id = (*it)->m_pic->getID();
+            (*it)->fill(picParam->ReferenceFrames[i]);
             ++i;
         }
     }
     for (; i < 16; ++i) {
         picParam->ReferenceFrames[i].picture_id = VA_INVALID_ID;
+        picParam->ReferenceFrames[i].flags = VA_PICTURE_H264_INVALID;
     }
     picParam->coded_buf = codedbuf->getID();
 
@@ -1203,7 +1551,7 @@ bool VaapiEncoderH264::fill(VAEncPictureParameterBufferH264* picParam, const Pic
 
     /* set picture fields */
     picParam->pic_fields.bits.idr_pic_flag = picture->isIdr();
-    picParam->pic_fields.bits.reference_pic_flag = (picture->m_type != VAAPI_PICTURE_TYPE_B);
+    picParam->pic_fields.bits.reference_pic_flag = picture->m_isReference;
     picParam->pic_fields.bits.entropy_coding_mode_flag = m_useCabac;
     picParam->pic_fields.bits.transform_8x8_mode_flag = m_useDct8x8;
     /* enable debloking */
@@ -1221,7 +1569,8 @@ bool VaapiEncoderH264::ensureSequenceHeader(const PicturePtr& picture,const VAEn
     AutoLock locker(m_paramLock);
 
     bit_writer_init (&bs, 128 * 8);
-    bit_writer_write_sps (&bs, sequence, profile());
+    //middle layers are referenced, dropping them leaves gaps in frame_num
+    bit_writer_write_sps (&bs, sequence, profile(), m_temporalLayers > 2);
     assert (BIT_WRITER_BIT_SIZE (&bs) % 8 == 0);
     dataBitSize = BIT_WRITER_BIT_SIZE (&bs);
     data = BIT_WRITER_DATA (&bs);
@@ -1303,9 +1652,11 @@ static void fillReferenceList(VAEncSliceParameterBufferH264* slice, const vector
     }
     int i = 0;
     for (; i < refList.size(); i++)
-        picList[i].picture_id = refList[i]->m_pic->getID();
-    for (; i <total; i++)
+        refList[i]->fill(picList[i]);
+    for (; i <total; i++) {
         picList[i].picture_id = VA_INVALID_SURFACE;
+        picList[i].flags = VA_PICTURE_H264_INVALID;
+    }
 }
 
 /* Adds slice headers to picture */
@@ -1320,23 +1671,25 @@ bool VaapiEncoderH264::addSliceHeaders (const PicturePtr& picture,
     uint32_t lastMbIndex;
 
     assert (picture);
-    /*one reference frame supported */
     if (picture->m_type == VAAPI_PICTURE_TYPE_I) {
         assert(!refList0.size() && !refList1.size());
     }
     else {
-        assert(refList0.size() == 1);
+        assert(refList0.size());
         if (picture->m_type == VAAPI_PICTURE_TYPE_B)
-            assert(refList1.size() == 1);
+            assert(refList1.size());
     }
 
     mbSize = m_mbWidth * m_mbHeight;
 
-    assert (m_numSlices && m_numSlices < mbSize);
-    sliceOfMbs = mbSize / m_numSlices;
-    sliceModMbs = mbSize % m_numSlices;
+    uint32_t numSlices = (picture->m_type == VAAPI_PICTURE_TYPE_I) ?
+        m_videoParamAVC.sliceNum.iSliceNum : m_videoParamAVC.sliceNum.pSliceNum;
+    numSlices = std::min(std::max(numSlices, 1u), m_numSlices);
+    assert (numSlices && numSlices <= mbSize);
+    sliceOfMbs = mbSize / numSlices;
+    sliceModMbs = mbSize % numSlices;
     lastMbIndex = 0;
-    for (int i = 0; i < m_numSlices; ++i) {
+    for (int i = 0; i < numSlices; ++i) {
         curSliceMbs = sliceOfMbs;
         if (sliceModMbs) {
             ++curSliceMbs;
@@ -1351,23 +1704,35 @@ bool VaapiEncoderH264::addSliceHeaders (const PicturePtr& picture,
         sliceParam->slice_type = h264_get_slice_type (picture->m_type);
         assert (sliceParam->slice_type != -1);
         sliceParam->idr_pic_id = m_idrNum;
-        sliceParam->pic_order_cnt_lsb = picture->m_poc;
+        sliceParam->pic_order_cnt_lsb = picture->m_poc % m_maxPicOrderCnt;
 
         if (picture->m_type != VAAPI_PICTURE_TYPE_I && refList0.size() > 0)
             sliceParam->num_ref_idx_l0_active_minus1 = refList0.size() - 1;
         if (picture->m_type == VAAPI_PICTURE_TYPE_B && refList1.size() > 0)
             sliceParam->num_ref_idx_l1_active_minus1 = refList1.size() - 1;
+        sliceParam->num_ref_idx_active_override_flag = picture->m_type != VAAPI_PICTURE_TYPE_I;
+        if (picture->m_type == VAAPI_PICTURE_TYPE_B)
+            sliceParam->direct_spatial_mv_pred_flag = 1;
 
         fillReferenceList(sliceParam, refList0, 0);
         fillReferenceList(sliceParam, refList1, 1);
 
 
-        sliceParam->slice_qp_delta = initQP() - minQP();
-        if (sliceParam->slice_qp_delta > 4)
-            sliceParam->slice_qp_delta = 4;
+        if (useSoftwareRateControl()) {
+            //pps keeps initQP, qp of each picture goes to its slices
+            sliceParam->slice_qp_delta = (int)picture->m_qp - (int)initQP();
+        } else {
+            sliceParam->slice_qp_delta = initQP() - minQP();
+            if (sliceParam->slice_qp_delta > 4)
+                sliceParam->slice_qp_delta = 4;
+        }
         sliceParam->slice_alpha_c0_offset_div2 = 2;
         sliceParam->slice_beta_offset_div2 = 2;
 
+        if (picture->m_type == VAAPI_PICTURE_TYPE_P && refList0[0] != m_refList.front()
+            && !addPackedSliceHeader(picture, sliceParam, refList0[0]))
+            return false;
+
         /* set calculation for next slice */
         lastMbIndex += curSliceMbs;
     }
@@ -1375,6 +1740,69 @@ bool VaapiEncoderH264::addSliceHeaders (const PicturePtr& picture,
     return true;
 }
 
+/* in gradual refresh mode, every cyclicFrameInterval P/B pictures after an intra one
+ * starts a refresh cycle, mark it as a random access point with recovery point SEI,
+ * sps/pps are repeated before it since no more I frames carry them */
+bool VaapiEncoderH264::ensureRecoveryPoint(const PicturePtr& picture)
+{
+    if (picture->m_type == VAAPI_PICTURE_TYPE_I) {
+        m_refreshCount = 0;
+        return true;
+    }
+    if (!gradualRefresh())
+        return true;
+    uint32_t interval = m_videoParamCommon.cyclicFrameInterval;
+    if (m_refreshCount++ % interval)
+        return true;
+
+    BitWriter bs;
+    StreamHeaderPtr sei(new VaapiEncStreamHeaderH264);
+    uint32_t recoveryFrameCnt = interval;
+    if (recoveryFrameCnt >= m_maxFrameNum)
+        recoveryFrameCnt = m_maxFrameNum - 1;
+
+    bit_writer_init (&bs, 16 * 8);
+    bit_writer_write_sei_recovery_point (&bs, recoveryFrameCnt);
+    assert (BIT_WRITER_BIT_SIZE (&bs) % 8 == 0);
+    sei->setParamSet(BIT_WRITER_DATA (&bs), BIT_WRITER_BIT_SIZE (&bs) / 8);
+    bit_writer_clear (&bs, TRUE);
+    sei->generateByteStreamWithEmulation();
+
+    picture->m_sei = sei;
+    return true;
+}
+
+/* reference is not head of the default list, write slice header with list modification */
+bool VaapiEncoderH264::addPackedSliceHeader(const PicturePtr& picture,
+                                            const VAEncSliceParameterBufferH264* const sliceParam,
+                                            const ReferencePtr& ref) const
+{
+    BitWriter bs;
+    uint32_t picNumDiff = (picture->m_frameNum + m_maxFrameNum - ref->m_frameNum) % m_maxFrameNum;
+    bool ret;
+
+    bit_writer_init (&bs, 64 * 8);
+    bit_writer_write_p_slice_header (&bs, sliceParam, picture->m_frameNum,
+                                     m_log2MaxFrameNum, m_log2MaxPicOrderCnt,
+                                     picture->m_isReference, m_useCabac, picNumDiff);
+    ret = picture->addPackedSliceHeader(BIT_WRITER_DATA (&bs), BIT_WRITER_BIT_SIZE (&bs));
+    bit_writer_clear (&bs, TRUE);
+    if (!ret)
+        ERROR("failed to add packed slice header");
+    return ret;
+}
+
+bool VaapiEncoderH264::ensureMaxSliceSize(const PicturePtr& picture)
+{
+    if (m_videoParamAVC.maxSliceSize <= 0)
+        return true;
+    VAEncMiscParameterMaxSliceSize* maxSliceSize;
+    if (!picture->newMisc(VAEncMiscParameterTypeMaxSliceSize, maxSliceSize))
+        return false;
+    maxSliceSize->max_slice_size = m_videoParamAVC.maxSliceSize;
+    return true;
+}
+
 bool VaapiEncoderH264::ensureSequence(const PicturePtr& picture)
 {
     if (picture->m_type != VAAPI_PICTURE_TYPE_I) {
@@ -1445,6 +1873,8 @@ Encode_Status VaapiEncoderH264::encodePicture(const PicturePtr& picture,const Co
         return ret;
     if (!ensureMiscParams (picture.get()))
         return ret;
+    if (!ensureMaxSliceSize (picture))
+        return ret;
     if (!ensurePicture(picture, codedBuf, reconstruct))
         return ret;
     if (!ensureSlices (picture))
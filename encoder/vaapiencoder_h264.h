@@ -29,7 +29,6 @@
 #include "common/lock.h"
 #include <list>
 #include <queue>
-#include <pthread.h>
 #include <tr1/memory>
 #include <va/va_enc_h264.h>
 
@@ -59,7 +58,14 @@ public:
 
 protected:
     virtual Encode_Status reorder(const SurfacePtr&, uint64_t timeStamp, bool forceKeyFrame = false);
-    virtual bool isBusy() { return m_outputQueue.size() >= m_maxOutputBuffer; } ;
+    virtual Encode_Status drain();
+    virtual void resolutionChanged();
+    virtual uint32_t maxReferenceCount() const { return m_maxRefFrames; }
+    virtual uint32_t maxReorderCount() const { return m_numBFrames; }
+    //list modification of 3 or more temporal layers is written by us
+    virtual uint32_t packedHeaders() const {
+        return m_temporalLayers > 2 ? VA_ENC_PACKED_HEADER_SLICE : VA_ENC_PACKED_HEADER_NONE;
+    }
 
 private:
     //following code is a template for other encoder implementation
@@ -72,12 +78,17 @@ private:
     bool addSliceHeaders (const PicturePtr&,
                           const std::vector<ReferencePtr>& refList0,
                           const std::vector<ReferencePtr>& refList1) const;
+    bool addPackedSliceHeader(const PicturePtr&, const VAEncSliceParameterBufferH264* const,
+                              const ReferencePtr&) const;
     bool ensureSequence(const PicturePtr&);
     bool ensurePicture (const PicturePtr&,const CodedBufferPtr&, const SurfacePtr&);
     bool ensureSlices(const PicturePtr&);
     bool ensureCodedBufferSize();
     Encode_Status getCodecCofnig(VideoEncOutputBuffer *outBuffer, PicturePtr picture);
     Encode_Status getStreamHeader(VideoEncOutputBuffer *outBuffer, PicturePtr picture);
+    Encode_Status getOneNal(VideoEncOutputBuffer *outBuffer, const PicturePtr&, const CodedBufferPtr&) const;
+    bool ensureMaxSliceSize(const PicturePtr&);
+    bool ensureRecoveryPoint(const PicturePtr&);
 
     //reference list related
     bool referenceListUpdate (const PicturePtr&, const SurfacePtr&);
@@ -93,19 +104,22 @@ private:
         return m_videoParamAVC.idrInterval;
     }
     void resetGopStart();
-    void setBFrame(const PicturePtr&);
+    void dumpFrames(const PicturePtr&);
+    void setBFrame(const PicturePtr&, bool isReference);
     void setPFrame(const PicturePtr&);
     void setIFrame(const PicturePtr&);
     void setIdrFrame(const PicturePtr&);
     void setIntraFrame(const PicturePtr&, bool idIdr);
+    void setTemporalLayer(const PicturePtr&);
 
     void resetParams();
 
     VideoParamsAVC m_videoParamAVC;
 
     uint8_t m_levelIdc;
-    uint32_t m_numSlices;
+    uint32_t m_numSlices; // max slices of I and P/B pictures
     uint32_t m_numBFrames;
+    bool m_bPyramid;
     uint32_t m_mbWidth;
     uint32_t m_mbHeight;
     bool  m_useCabac;
@@ -117,6 +131,11 @@ private:
     uint32_t m_frameIndex;
     uint32_t m_curFrameNum;
     uint32_t m_curPresentIndex;
+    /* P/B pictures coded since last intra one, for gradual refresh */
+    uint32_t m_refreshCount;
+    /* temporal layers, and frames since last intra frame to pick the layer */
+    uint32_t m_temporalLayers;
+    uint32_t m_temporalIndex;
     /* reference list */
     std::list<ReferencePtr> m_refList;
     uint32_t m_maxRefFrames;
@@ -124,9 +143,8 @@ private:
     uint32_t m_maxRefList0Count;
     uint32_t m_maxRefList1Count;
 
-    /* output queue */
-    mutable std::queue<std::pair<PicturePtr, CodedBufferPtr> >  m_outputQueue;
-    mutable pthread_mutex_t m_outputQueueMutex;
+    /* sps/pps already returned for the front frame in OUTPUT_ONE_NAL mode */
+    mutable uint32_t m_nalIndex;
 
     /* frame, poc */
     uint32_t m_maxFrameNum;
@@ -30,7 +30,14 @@
 #if __BUILD_H264_ENCODER__
 #include "vaapiencoder_h264.h"
 #endif
+#if __BUILD_JPEG_ENCODER__
+#include "vaapiencoder_jpeg.h"
+#endif
+#if __BUILD_VP8_ENCODER__
+#include "vaapiencoder_vp8.h"
+#endif
 #include "vaapi/vaapi_host.h"
+#include "vaapiencodesession.h"
 #include <string.h>
 
 using namespace YamiMediaCodec;
@@ -38,7 +45,13 @@ DEFINE_CLASS_FACTORY(Encoder)
 static const EncoderEntry g_encoderEntries[] = {
 #if __BUILD_H264_ENCODER__
     DEFINE_ENCODER_ENTRY("video/avc", H264),
-    DEFINE_ENCODER_ENTRY("video/h264", H264)
+    DEFINE_ENCODER_ENTRY("video/h264", H264),
+#endif
+#if __BUILD_JPEG_ENCODER__
+    DEFINE_ENCODER_ENTRY("image/jpeg", Jpeg),
+#endif
+#if __BUILD_VP8_ENCODER__
+    DEFINE_ENCODER_ENTRY("video/x-vnd.on2.vp8", VP8),
 #endif
 };
 extern "C" {
@@ -62,6 +75,15 @@ void releaseVideoEncoder(IVideoEncoder* p) {
     delete p;
 }
 
+IVideoEncodeSession* createVideoEncodeSession() {
+    yamiTraceInit();
+    return new VaapiEncodeSession();
+}
+
+void releaseVideoEncodeSession(IVideoEncodeSession* p) {
+    delete p;
+}
+
 bool preSandboxInitEncoder() {
     // TODO, for hybrid VP8 encoder uses mediasdk, does the prework here
     return true;
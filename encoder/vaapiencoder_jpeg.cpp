@@ -0,0 +1,505 @@
+/*
+ *  vaapiencoder_jpeg.cpp - jpeg encoder for va
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "vaapiencoder_jpeg.h"
+#include <string.h>
+#include "scopedlogger.h"
+#include "vaapicodedbuffer.h"
+#include "vaapiencpicture.h"
+#include "vaapi/vaapicontext.h"
+#include "vaapi/vaapidisplay.h"
+
+namespace YamiMediaCodec{
+
+enum {
+    JPEG_NUM_COMPONENTS = 3,
+    JPEG_DEFAULT_QUALITY = 50,
+    /* SOI, APP0, DQT, DRI, SOF0, DHT and SOS of 3 components take about 620 bytes */
+    JPEG_MAX_HEADER_SIZE = 1024,
+};
+
+/* Y, Cb and Cr. luma uses table 0, chroma uses table 1 */
+static const uint8_t componentId[JPEG_NUM_COMPONENTS] = { 1, 2, 3 };
+static const uint8_t tableSelector[JPEG_NUM_COMPONENTS] = { 0, 1, 1 };
+/* input is 4:2:0, H and V sampling factors in one byte */
+static const uint8_t samplingFactor[JPEG_NUM_COMPONENTS] = { 0x22, 0x11, 0x11 };
+
+/* same scaling as jpeg_quality_scaling() and jpeg_add_quant_table() of libjpeg */
+static uint8_t scaleQuant(uint16_t value, uint32_t quality)
+{
+    uint32_t scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    uint32_t q = (value * scale + 50) / 100;
+    if (q < 1)
+        q = 1;
+    if (q > 255)
+        q = 255;
+    return q;
+}
+
+static void putByte(std::vector<uint8_t>& header, uint8_t value)
+{
+    header.push_back(value);
+}
+
+static void putWord(std::vector<uint8_t>& header, uint16_t value)
+{
+    header.push_back(value >> 8);
+    header.push_back(value & 0xff);
+}
+
+static void putMarker(std::vector<uint8_t>& header, uint8_t marker, uint16_t length)
+{
+    putByte(header, 0xff);
+    putByte(header, marker);
+    putWord(header, length);
+}
+
+static uint32_t countHuffmanValues(const JpegHuffmanTable& table)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < 16; i++)
+        count += table.huf_bits[i];
+    return count;
+}
+
+static void putHuffmanTable(std::vector<uint8_t>& header, uint8_t classAndId,
+                            const JpegHuffmanTable& table)
+{
+    uint32_t count = countHuffmanValues(table);
+    putByte(header, classAndId);
+    header.insert(header.end(), table.huf_bits, table.huf_bits + 16);
+    header.insert(header.end(), table.huf_values, table.huf_values + count);
+}
+
+VaapiEncoderJpeg::VaapiEncoderJpeg()
+{
+    m_entrypoint = VAEntrypointEncPicture;
+    m_videoParamCommon.profile = VAProfileJPEGBaseline;
+    //quality instead of bitrate
+    m_videoParamCommon.rcMode = RATE_CONTROL_NONE;
+    m_videoParamJPEG.quality = JPEG_DEFAULT_QUALITY;
+
+    jpeg_get_default_quantization_tables(&m_quantTables);
+    jpeg_get_default_huffman_tables(&m_huffmanTables);
+}
+
+VaapiEncoderJpeg::~VaapiEncoderJpeg()
+{
+    FUNC_ENTER();
+}
+
+bool VaapiEncoderJpeg::ensureCodedBufferSize()
+{
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+
+    if (m_maxCodedbufSize)
+        return true;
+
+    if (!width() || !height())
+        return false;
+
+    //4:2:0 raw size is enough for usual quality, tables near quality 100 barely compress
+    uint32_t rawSize = ((width() + 15) & ~15) * ((height() + 15) & ~15) * 3 / 2;
+    m_maxCodedbufSize = (m_videoParamJPEG.quality > 90 ? rawSize * 2 : rawSize) + JPEG_MAX_HEADER_SIZE;
+    INFO("m_maxCodedbufSize: %u", m_maxCodedbufSize);
+    return true;
+}
+
+Encode_Status VaapiEncoderJpeg::getMaxOutSize(uint32_t *maxSize)
+{
+    FUNC_ENTER();
+
+    if (ensureCodedBufferSize())
+        *maxSize = m_maxCodedbufSize;
+    else
+        *maxSize = 0;
+
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncoderJpeg::start()
+{
+    FUNC_ENTER();
+    m_paramLock.acquire();
+    m_header.clear();
+    m_paramLock.release();
+    return VaapiEncoderBase::start();
+}
+
+void VaapiEncoderJpeg::flush()
+{
+    FUNC_ENTER();
+    m_currentPicture.reset();
+    clearPendingFrames();
+    clearOutputs();
+}
+
+Encode_Status VaapiEncoderJpeg::stop()
+{
+    flush();
+    return VaapiEncoderBase::stop();
+}
+
+Encode_Status VaapiEncoderJpeg::setParameters(VideoParamConfigSet *videoEncParams)
+{
+    Encode_Status status = ENCODE_SUCCESS;
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+    if (!videoEncParams)
+        return ENCODE_INVALID_PARAMS;
+
+    switch (videoEncParams->type) {
+    case VideoParamsTypeJPEG: {
+            VideoParamsJPEG* jpeg = (VideoParamsJPEG*)videoEncParams;
+            if (jpeg->quality < 1 || jpeg->quality > 100 || jpeg->restartInterval > 0xffff) {
+                ERROR("invalid jpeg quality %d or restart interval %d", jpeg->quality, jpeg->restartInterval);
+                return ENCODE_INVALID_PARAMS;
+            }
+            m_videoParamJPEG = *jpeg;
+            m_header.clear();
+            // quality changes the max coded buffer size
+            m_maxCodedbufSize = 0;
+        }
+        break;
+    default:
+        status = VaapiEncoderBase::setParameters(videoEncParams);
+        break;
+    }
+    return status;
+}
+
+Encode_Status VaapiEncoderJpeg::getParameters(VideoParamConfigSet *videoEncParams)
+{
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+    if (!videoEncParams)
+        return ENCODE_INVALID_PARAMS;
+    if (videoEncParams->type == VideoParamsTypeJPEG) {
+        VideoParamsJPEG* jpeg = (VideoParamsJPEG*)videoEncParams;
+        *jpeg = m_videoParamJPEG;
+        return ENCODE_SUCCESS;
+    }
+
+    return VaapiEncoderBase::getParameters(videoEncParams);
+}
+
+Encode_Status VaapiEncoderJpeg::reorder(const SurfacePtr& surface, uint64_t timeStamp, bool forceKeyFrame)
+{
+    if (!surface)
+        return ENCODE_INVALID_PARAMS;
+
+    //every image is a key frame, it's coded right away
+    m_currentPicture.reset(new VaapiEncPicture(m_context, surface, timeStamp));
+    m_currentPicture->m_type = VAAPI_PICTURE_TYPE_I;
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncoderJpeg::drain()
+{
+    return submitEncode();
+}
+
+void VaapiEncoderJpeg::resolutionChanged()
+{
+    AutoLock locker(m_paramLock);
+    m_header.clear();
+}
+
+Encode_Status VaapiEncoderJpeg::submitEncode()
+{
+    FUNC_ENTER();
+    Encode_Status ret;
+
+    if (!m_currentPicture)
+        return ENCODE_SUCCESS;
+
+    if (!m_maxCodedbufSize)
+        ensureCodedBufferSize();
+    CodedBufferPtr codedBuffer = createCodedBuffer();
+    if (!codedBuffer)
+        return ENCODE_NO_MEMORY;
+    PicturePtr picture = m_currentPicture;
+    m_currentPicture.reset();
+
+    submitPicture(picture.get());
+    ret = encodePicture(picture, codedBuffer);
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    codedBuffer->setFlag(ENCODE_BUFFERFLAG_ENDOFFRAME);
+    codedBuffer->setFlag(ENCODE_BUFFERFLAG_SYNCFRAME);
+
+    queueOutput(picture, codedBuffer);
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncoderJpeg::getOutput(VideoEncOutputBuffer * outBuffer, bool withWait) const
+{
+    PicturePtr picture;
+    CodedBufferPtr codedBuffer;
+    Encode_Status ret;
+
+    FUNC_ENTER();
+    if (!outBuffer)
+        return ENCODE_INVALID_PARAMS;
+
+    //every image carries its own headers, there is no separate codec data
+    if (outBuffer->format & (OUTPUT_CODEC_DATA | OUTPUT_STREAM_HEADER)) {
+        outBuffer->dataSize = 0;
+        return ENCODE_SUCCESS;
+    }
+    if (outBuffer->format != OUTPUT_EVERYTHING && outBuffer->format != OUTPUT_FRAME_DATA) {
+        ERROR("output format %d is not supported by jpeg", outBuffer->format);
+        return ENCODE_INVALID_PARAMS;
+    }
+
+    if (!peekOutput(picture, codedBuffer, withWait))
+        return ENCODE_BUFFER_NO_MORE;
+
+    syncPicture(picture.get());
+    ret = copyCodedBuffer(outBuffer, codedBuffer);
+    outBuffer->timeStamp = picture->m_timeStamp;
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    outputPicture(picture.get(), codedBuffer->size());
+
+    popOutput();
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncoderJpeg::writeHeader()
+{
+    std::vector<uint8_t>& header = m_header;
+    uint32_t quality = m_videoParamJPEG.quality;
+    uint32_t dhtSize;
+    int i, j;
+
+    header.clear();
+    header.reserve(JPEG_MAX_HEADER_SIZE);
+
+    //SOI
+    putByte(header, 0xff);
+    putByte(header, JPEG_MARKER_SOI);
+
+    //APP0, JFIF 1.01 without thumbnail
+    if (m_videoParamJPEG.jfifHeader) {
+        static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+        putMarker(header, JPEG_MARKER_APP_MIN, 2 + sizeof(jfif));
+        header.insert(header.end(), jfif, jfif + sizeof(jfif));
+    }
+
+    //DQT, both tables in one segment, 8 bits precision
+    putMarker(header, JPEG_MARKER_DQT, 2 + 2 * (1 + JPEG_MAX_QUANT_ELEMENTS));
+    for (i = 0; i < 2; i++) {
+        putByte(header, i);
+        for (j = 0; j < JPEG_MAX_QUANT_ELEMENTS; j++)
+            putByte(header, scaleQuant(m_quantTables.quant_tables[i].quant_table[j], quality));
+    }
+
+    //DRI
+    if (m_videoParamJPEG.restartInterval) {
+        putMarker(header, JPEG_MARKER_DRI, 4);
+        putWord(header, m_videoParamJPEG.restartInterval);
+    }
+
+    //SOF0, baseline
+    putMarker(header, JPEG_MARKER_SOF_MIN, 8 + 3 * JPEG_NUM_COMPONENTS);
+    putByte(header, 8);
+    putWord(header, height());
+    putWord(header, width());
+    putByte(header, JPEG_NUM_COMPONENTS);
+    for (i = 0; i < JPEG_NUM_COMPONENTS; i++) {
+        putByte(header, componentId[i]);
+        putByte(header, samplingFactor[i]);
+        putByte(header, tableSelector[i]);
+    }
+
+    //DHT, dc and ac tables of luma and chroma in one segment
+    dhtSize = 2;
+    for (i = 0; i < 2; i++) {
+        dhtSize += 17 + countHuffmanValues(m_huffmanTables.dc_tables[i]);
+        dhtSize += 17 + countHuffmanValues(m_huffmanTables.ac_tables[i]);
+    }
+    putMarker(header, JPEG_MARKER_DHT, dhtSize);
+    for (i = 0; i < 2; i++) {
+        putHuffmanTable(header, i, m_huffmanTables.dc_tables[i]);
+        putHuffmanTable(header, 0x10 | i, m_huffmanTables.ac_tables[i]);
+    }
+
+    //SOS, one interleaved scan, driver writes entropy coded data after it
+    putMarker(header, JPEG_MARKER_SOS, 6 + 2 * JPEG_NUM_COMPONENTS);
+    putByte(header, JPEG_NUM_COMPONENTS);
+    for (i = 0; i < JPEG_NUM_COMPONENTS; i++) {
+        putByte(header, componentId[i]);
+        putByte(header, (tableSelector[i] << 4) | tableSelector[i]);
+    }
+    putByte(header, 0);
+    putByte(header, 63);
+    putByte(header, 0);
+
+    INFO("jpeg header of quality %d: %d bytes", quality, (int)header.size());
+}
+
+bool VaapiEncoderJpeg::fill(VAEncPictureParameterBufferJPEG* picParam, const PicturePtr& picture,
+                            const CodedBufferPtr& codedBuffer) const
+{
+    //there is no reconstructed frame in jpeg, driver reads source from the render target
+    picParam->reconstructed_picture = picture->getSurfaceID();
+    picParam->picture_width = width();
+    picParam->picture_height = height();
+    picParam->coded_buf = codedBuffer->getID();
+
+    picParam->pic_flags.bits.profile = 0;       //baseline
+    picParam->pic_flags.bits.progressive = 0;
+    picParam->pic_flags.bits.huffman = 1;
+    picParam->pic_flags.bits.interleaved = 1;
+    picParam->pic_flags.bits.differential = 0;
+
+    picParam->sample_bit_depth = 8;
+    picParam->num_scan = 1;
+    picParam->num_components = JPEG_NUM_COMPONENTS;
+    for (int i = 0; i < JPEG_NUM_COMPONENTS; i++) {
+        picParam->component_id[i] = componentId[i];
+        picParam->quantiser_table_selector[i] = tableSelector[i];
+    }
+    picParam->quality = m_videoParamJPEG.quality;
+    return true;
+}
+
+/* unscaled tables, driver scales them by picParam->quality */
+bool VaapiEncoderJpeg::fill(VAQMatrixBufferJPEG* qMatrix) const
+{
+    const JpegQuantTable& luma = m_quantTables.quant_tables[0];
+    const JpegQuantTable& chroma = m_quantTables.quant_tables[1];
+
+    qMatrix->load_lum_quantiser_matrix = 1;
+    qMatrix->load_chroma_quantiser_matrix = 1;
+    for (int i = 0; i < JPEG_MAX_QUANT_ELEMENTS; i++) {
+        qMatrix->lum_quantiser_matrix[i] = luma.quant_table[i];
+        qMatrix->chroma_quantiser_matrix[i] = chroma.quant_table[i];
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::fill(VAHuffmanTableBufferJPEGBaseline* huffmanTable) const
+{
+    for (int i = 0; i < 2; i++) {
+        const JpegHuffmanTable& dc = m_huffmanTables.dc_tables[i];
+        const JpegHuffmanTable& ac = m_huffmanTables.ac_tables[i];
+
+        huffmanTable->load_huffman_table[i] = 1;
+        memcpy(huffmanTable->huffman_table[i].num_dc_codes, dc.huf_bits,
+               sizeof(huffmanTable->huffman_table[i].num_dc_codes));
+        memcpy(huffmanTable->huffman_table[i].dc_values, dc.huf_values,
+               sizeof(huffmanTable->huffman_table[i].dc_values));
+        memcpy(huffmanTable->huffman_table[i].num_ac_codes, ac.huf_bits,
+               sizeof(huffmanTable->huffman_table[i].num_ac_codes));
+        memcpy(huffmanTable->huffman_table[i].ac_values, ac.huf_values,
+               sizeof(huffmanTable->huffman_table[i].ac_values));
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::fill(VAEncSliceParameterBufferJPEG* sliceParam) const
+{
+    sliceParam->restart_interval = m_videoParamJPEG.restartInterval;
+    sliceParam->num_components = JPEG_NUM_COMPONENTS;
+    for (int i = 0; i < JPEG_NUM_COMPONENTS; i++) {
+        sliceParam->components[i].component_selector = componentId[i];
+        sliceParam->components[i].dc_table_selector = tableSelector[i];
+        sliceParam->components[i].ac_table_selector = tableSelector[i];
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::ensurePicture(const PicturePtr& picture, const CodedBufferPtr& codedBuffer)
+{
+    VAEncPictureParameterBufferJPEG *picParam;
+
+    if (!picture->editPicture(picParam) || !fill(picParam, picture, codedBuffer)) {
+        ERROR("failed to create picture parameter buffer");
+        return false;
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::ensureTables(const PicturePtr& picture)
+{
+    VAQMatrixBufferJPEG *qMatrix;
+    VAHuffmanTableBufferJPEGBaseline *huffmanTable;
+
+    if (!picture->editQMatrix(qMatrix) || !fill(qMatrix)) {
+        ERROR("failed to create quantization table buffer");
+        return false;
+    }
+    if (!picture->editHuffmanTable(huffmanTable) || !fill(huffmanTable)) {
+        ERROR("failed to create huffman table buffer");
+        return false;
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::ensureSlice(const PicturePtr& picture)
+{
+    VAEncSliceParameterBufferJPEG *sliceParam;
+
+    if (!picture->newSlice(sliceParam) || !fill(sliceParam)) {
+        ERROR("failed to create slice parameter buffer");
+        return false;
+    }
+    return true;
+}
+
+bool VaapiEncoderJpeg::ensureHeader(const PicturePtr& picture)
+{
+    AutoLock locker(m_paramLock);
+
+    if (m_header.empty())
+        writeHeader();
+    if (!picture->addPackedHeader(VAEncPackedHeaderRawData, &m_header[0], m_header.size() * 8)) {
+        ERROR("failed to add jpeg header");
+        return false;
+    }
+    return true;
+}
+
+Encode_Status VaapiEncoderJpeg::encodePicture(const PicturePtr& picture, const CodedBufferPtr& codedBuffer)
+{
+    Encode_Status ret = ENCODE_FAIL;
+
+    if (!ensurePicture(picture, codedBuffer))
+        return ret;
+    if (!ensureTables(picture))
+        return ret;
+    if (!ensureSlice(picture))
+        return ret;
+    if (!ensureHeader(picture))
+        return ret;
+    if (!picture->encode())
+        return ret;
+    return ENCODE_SUCCESS;
+}
+}
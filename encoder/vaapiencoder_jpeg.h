@@ -0,0 +1,95 @@
+/*
+ *  vaapiencoder_jpeg.h - jpeg encoder for va
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapiencoder_jpeg_h
+#define vaapiencoder_jpeg_h
+
+#include "vaapiencoder_base.h"
+#include "vaapi/vaapiptrs.h"
+#include "common/lock.h"
+#include "codecparsers/jpegparser.h"
+#include <vector>
+#include <tr1/memory>
+#include <va/va_enc_jpeg.h>
+
+namespace YamiMediaCodec{
+
+/**
+ * \class VaapiEncoderJpeg
+ * \brief baseline jpeg encoder, every input frame becomes a 4:2:0 jpeg image
+ * <pre>
+ * quantization and huffman tables are the defaults of jpeg spec annex K.
+ * driver scales the quantization tables by quality, we scale them the same way for DQT.
+ * headers from SOI to SOS go to driver as packed raw data, driver puts them in front of the
+ * entropy coded data, so a coded buffer is a complete image.
+ * </pre>
+ */
+class VaapiEncoderJpeg : public VaapiEncoderBase {
+public:
+    VaapiEncoderJpeg();
+    ~VaapiEncoderJpeg();
+    virtual Encode_Status start();
+    virtual void flush();
+    virtual Encode_Status stop();
+    virtual Encode_Status getOutput(VideoEncOutputBuffer * outBuffer, bool withWait = false) const;
+
+    virtual Encode_Status getParameters(VideoParamConfigSet *);
+    virtual Encode_Status setParameters(VideoParamConfigSet *);
+    virtual Encode_Status getMaxOutSize(uint32_t *maxSize);
+
+protected:
+    virtual Encode_Status reorder(const SurfacePtr&, uint64_t timeStamp, bool forceKeyFrame = false);
+    virtual Encode_Status submitEncode();
+    virtual Encode_Status drain();
+    virtual void resolutionChanged();
+    //no reference frames
+    virtual uint32_t maxReferenceCount() const { return 0; }
+    virtual uint32_t packedHeaders() const { return VA_ENC_PACKED_HEADER_RAW_DATA; }
+
+private:
+    Encode_Status encodePicture(const PicturePtr&, const CodedBufferPtr&);
+    bool fill(VAEncPictureParameterBufferJPEG*, const PicturePtr&, const CodedBufferPtr&) const;
+    bool fill(VAQMatrixBufferJPEG*) const;
+    bool fill(VAHuffmanTableBufferJPEGBaseline*) const;
+    bool fill(VAEncSliceParameterBufferJPEG*) const;
+    bool ensurePicture(const PicturePtr&, const CodedBufferPtr&);
+    bool ensureTables(const PicturePtr&);
+    bool ensureSlice(const PicturePtr&);
+    bool ensureHeader(const PicturePtr&);
+    /* SOI to SOS, written once for each parameter set */
+    void writeHeader();
+    bool ensureCodedBufferSize();
+
+    VideoParamsJPEG m_videoParamJPEG;
+
+    /* defaults of annex K, quantization tables are in zigzag order */
+    JpegQuantTables m_quantTables;
+    JpegHuffmanTables m_huffmanTables;
+    /* packed header of current parameters, empty if it needs a rewrite */
+    std::vector<uint8_t> m_header;
+
+    /* frame waiting for submitEncode */
+    PicturePtr m_currentPicture;
+
+    Lock m_paramLock; // locker for parameters update, m_header and m_maxCodedbufSize
+};
+}
+#endif /* vaapiencoder_jpeg_h */
@@ -0,0 +1,568 @@
+/*
+ *  vaapiencoder_vp8.cpp - vp8 encoder for va
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "vaapiencoder_vp8.h"
+#include "scopedlogger.h"
+#include "vaapicodedbuffer.h"
+#include "vaapiencpicture.h"
+#include "vaapi/vaapicontext.h"
+#include "vaapi/vaapidisplay.h"
+
+namespace YamiMediaCodec{
+
+enum {
+    VP8_MAX_TEMPORAL_LAYERS = 4,
+    VP8_MAX_QINDEX = 127,
+    VP8_MAX_LOOP_FILTER_LEVEL = 63,
+    VP8_MAX_SHARPNESS_LEVEL = 7,
+    //software rate control picks qp of h264 range
+    H264_MAX_QP = 51,
+    /* uncompressed data chunk, frame header in first partition and partition sizes */
+    VP8_MAX_FRAME_HEADER_SIZE = 4096,
+    IVF_FILE_HEADER_SIZE = 32,
+    IVF_FRAME_HEADER_SIZE = 12,
+};
+
+class VaapiEncPictureVP8 : public VaapiEncPicture
+{
+public:
+    VaapiEncPictureVP8(const ContextPtr& context, const SurfacePtr& surface, int64_t timeStamp):
+        VaapiEncPicture(context, surface, timeStamp),
+        m_refreshLast(false),
+        m_refreshGolden(false),
+        m_refreshAltRef(false),
+        m_copyGoldenToAltRef(false),
+        m_refreshEntropy(true),
+        m_useGolden(false),
+        m_useAltRef(false)
+    {
+    }
+
+    bool isKeyFrame() const {
+        return m_type == VAAPI_PICTURE_TYPE_I;
+    }
+
+    bool m_refreshLast;
+    bool m_refreshGolden;
+    bool m_refreshAltRef;
+    //alt ref frame takes the golden frame before this one refreshes it
+    bool m_copyGoldenToAltRef;
+    //probabilities updated by this frame are kept for following frames
+    bool m_refreshEntropy;
+    //golden and alt ref frames may be referenced, last frame always may
+    bool m_useGolden;
+    bool m_useAltRef;
+    //driver writes it, it's held until the frame is done even if it's not a reference
+    SurfacePtr m_recon;
+};
+
+static void putLE16(uint8_t*& p, uint16_t value)
+{
+    *p++ = value & 0xff;
+    *p++ = value >> 8;
+}
+
+static void putLE32(uint8_t*& p, uint32_t value)
+{
+    putLE16(p, value & 0xffff);
+    putLE16(p, value >> 16);
+}
+
+VaapiEncoderVP8::VaapiEncoderVP8():
+    m_temporalLayers(1),
+    m_frameIndex(0),
+    m_ivfHeaderDone(false),
+    m_ivfFrameCount(0)
+{
+    m_videoParamCommon.profile = VAProfileVP8Version0_3;
+    //q index of vp8, 0 to 127
+    m_videoParamCommon.rcParams.initQP = 40;
+    m_videoParamCommon.rcParams.minQP = 0;
+}
+
+VaapiEncoderVP8::~VaapiEncoderVP8()
+{
+    FUNC_ENTER();
+}
+
+bool VaapiEncoderVP8::ensureCodedBufferSize()
+{
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+
+    if (m_maxCodedbufSize)
+        return true;
+
+    if (!width() || !height())
+        return false;
+
+    /* 3200 bits per 4:2:0 macroblock, same as h264 */
+    uint32_t mbCount = ((width() + 15) / 16) * ((height() + 15) / 16);
+    m_maxCodedbufSize = mbCount * 400 + VP8_MAX_FRAME_HEADER_SIZE;
+    DEBUG("m_maxCodedbufSize: %u", m_maxCodedbufSize);
+    return true;
+}
+
+Encode_Status VaapiEncoderVP8::getMaxOutSize(uint32_t *maxSize)
+{
+    FUNC_ENTER();
+
+    if (ensureCodedBufferSize()) {
+        *maxSize = m_maxCodedbufSize;
+        if (m_videoParamVP8.ivfContainer)
+            *maxSize += IVF_FILE_HEADER_SIZE + IVF_FRAME_HEADER_SIZE;
+    } else {
+        *maxSize = 0;
+    }
+
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncoderVP8::resetParams()
+{
+    m_frameIndex = 0;
+    m_last.reset();
+    m_golden.reset();
+    m_altRef.reset();
+}
+
+Encode_Status VaapiEncoderVP8::start()
+{
+    FUNC_ENTER();
+    resetParams();
+    m_ivfHeaderDone = false;
+    m_ivfFrameCount = 0;
+    return VaapiEncoderBase::start();
+}
+
+void VaapiEncoderVP8::flush()
+{
+    FUNC_ENTER();
+    resetParams();
+    m_currentPicture.reset();
+    clearPendingFrames();
+    clearOutputs();
+}
+
+Encode_Status VaapiEncoderVP8::stop()
+{
+    flush();
+    return VaapiEncoderBase::stop();
+}
+
+Encode_Status VaapiEncoderVP8::setParameters(VideoParamConfigSet *videoEncParams)
+{
+    Encode_Status status = ENCODE_SUCCESS;
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+    if (!videoEncParams)
+        return ENCODE_INVALID_PARAMS;
+
+    switch (videoEncParams->type) {
+    case VideoParamsTypeVP8: {
+            VideoParamsVP8* vp8 = (VideoParamsVP8*)videoEncParams;
+            if (vp8->loopFilterLevel > VP8_MAX_LOOP_FILTER_LEVEL
+                || vp8->sharpnessLevel > VP8_MAX_SHARPNESS_LEVEL) {
+                ERROR("invalid loop filter level %d or sharpness %d", vp8->loopFilterLevel, vp8->sharpnessLevel);
+                return ENCODE_INVALID_PARAMS;
+            }
+            m_videoParamVP8 = *vp8;
+        }
+        break;
+    default:
+        status = VaapiEncoderBase::setParameters(videoEncParams);
+        break;
+    }
+    return status;
+}
+
+Encode_Status VaapiEncoderVP8::getParameters(VideoParamConfigSet *videoEncParams)
+{
+    AutoLock locker(m_paramLock);
+
+    FUNC_ENTER();
+    if (!videoEncParams)
+        return ENCODE_INVALID_PARAMS;
+    if (videoEncParams->type == VideoParamsTypeVP8) {
+        VideoParamsVP8* vp8 = (VideoParamsVP8*)videoEncParams;
+        *vp8 = m_videoParamVP8;
+        return ENCODE_SUCCESS;
+    }
+
+    return VaapiEncoderBase::getParameters(videoEncParams);
+}
+
+/* Marks the supplied picture as a key frame, new temporal layering starts from it */
+void VaapiEncoderVP8::setKeyFrame(const PicturePtr& picture)
+{
+    m_temporalLayers = m_videoParamVP8.temporalLayers;
+    if (!m_temporalLayers)
+        m_temporalLayers = 1;
+    if (m_temporalLayers > VP8_MAX_TEMPORAL_LAYERS) {
+        WARNING("at most %d temporal layers", VP8_MAX_TEMPORAL_LAYERS);
+        m_temporalLayers = VP8_MAX_TEMPORAL_LAYERS;
+    }
+
+    picture->m_type = VAAPI_PICTURE_TYPE_I;
+    picture->m_refreshLast = true;
+    picture->m_refreshGolden = true;
+    picture->m_refreshAltRef = true;
+    picture->m_refreshEntropy = !m_videoParamVP8.errorResilient;
+    //+1 for next frame
+    m_frameIndex = 1;
+}
+
+/* Marks the supplied picture as an inter frame, and picks reference frames it refreshes */
+void VaapiEncoderVP8::setInterFrame(const PicturePtr& picture)
+{
+    uint32_t index = m_frameIndex++;
+
+    picture->m_type = VAAPI_PICTURE_TYPE_P;
+    if (m_temporalLayers > 1) {
+        uint32_t id = temporalLayerId(index, m_temporalLayers);
+        picture->m_temporalId = id;
+        //top layer is not referenced
+        if (id < m_temporalLayers - 1) {
+            picture->m_refreshLast = id == 0;
+            picture->m_refreshGolden = id == 1;
+            picture->m_refreshAltRef = id == 2;
+        }
+        picture->m_useGolden = id >= 1;
+        picture->m_useAltRef = id >= 2;
+        //upper layers may be dropped, decoder state must not depend on them
+        picture->m_refreshEntropy = !id && !m_videoParamVP8.errorResilient;
+        return;
+    }
+
+    uint32_t goldenPeriod = m_videoParamVP8.goldenFramePeriod;
+    picture->m_refreshLast = true;
+    if (goldenPeriod && index % goldenPeriod == 0) {
+        picture->m_refreshGolden = true;
+        picture->m_copyGoldenToAltRef = m_videoParamVP8.altRefPolicy == VP8_ALTREF_PREVIOUS_GOLDEN;
+    }
+    picture->m_useGolden = true;
+    picture->m_useAltRef = true;
+    picture->m_refreshEntropy = !m_videoParamVP8.errorResilient;
+}
+
+Encode_Status VaapiEncoderVP8::reorder(const SurfacePtr& surface, uint64_t timeStamp, bool forceKeyFrame)
+{
+    if (!surface)
+        return ENCODE_INVALID_PARAMS;
+
+    PicturePtr picture(new VaapiEncPictureVP8(m_context, surface, timeStamp));
+
+    /* with gradual refresh, only the first frame or a forced one is key frame */
+    bool periodic = !gradualRefresh() && intraPeriod();
+    if (!m_frameIndex || (periodic && m_frameIndex >= intraPeriod()) || forceKeyFrame)
+        setKeyFrame(picture);
+    else
+        setInterFrame(picture);
+    //no b frames, frames are coded right away
+    m_currentPicture = picture;
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncoderVP8::drain()
+{
+    return submitEncode();
+}
+
+void VaapiEncoderVP8::resolutionChanged()
+{
+    /* old references are gone with old resolution, start over from a key frame */
+    resetParams();
+}
+
+Encode_Status VaapiEncoderVP8::submitEncode()
+{
+    FUNC_ENTER();
+    Encode_Status ret;
+
+    if (!m_currentPicture)
+        return ENCODE_SUCCESS;
+
+    if (!m_maxCodedbufSize)
+        ensureCodedBufferSize();
+    CodedBufferPtr codedBuffer = createCodedBuffer();
+    if (!codedBuffer)
+        return ENCODE_NO_MEMORY;
+    PicturePtr picture = m_currentPicture;
+    m_currentPicture.reset();
+
+    submitPicture(picture.get());
+    ret = encodePicture(picture, codedBuffer);
+    if (ret != ENCODE_SUCCESS) {
+        //references may be refreshed by the lost frame, restart from a key frame
+        resetParams();
+        return ret;
+    }
+    codedBuffer->setFlag(ENCODE_BUFFERFLAG_ENDOFFRAME);
+    if (picture->isKeyFrame())
+        codedBuffer->setFlag(ENCODE_BUFFERFLAG_SYNCFRAME);
+
+    queueOutput(picture, codedBuffer);
+    return ENCODE_SUCCESS;
+}
+
+uint32_t VaapiEncoderVP8::writeIvfHeader(uint8_t* data) const
+{
+    uint8_t* p = data;
+    *p++ = 'D';
+    *p++ = 'K';
+    *p++ = 'I';
+    *p++ = 'F';
+    putLE16(p, 0);
+    putLE16(p, IVF_FILE_HEADER_SIZE);
+    *p++ = 'V';
+    *p++ = 'P';
+    *p++ = '8';
+    *p++ = '0';
+    putLE16(p, width());
+    putLE16(p, height());
+    //time base is one frame
+    putLE32(p, frameRateNum());
+    putLE32(p, frameRateDenom());
+    putLE32(p, 0);
+    putLE32(p, 0);
+    return p - data;
+}
+
+/** getOutput suppose to run in a separated thread with other functions, see VaapiEncoderH264::getOutput
+ * ivf headers are written around coded data when m_videoParamVP8.ivfContainer is set
+ */
+Encode_Status VaapiEncoderVP8::getOutput(VideoEncOutputBuffer * outBuffer, bool withWait) const
+{
+    VaapiEncoderBase::PicturePtr picture;
+    CodedBufferPtr codedBuffer;
+    Encode_Status ret;
+    bool ivf = m_videoParamVP8.ivfContainer;
+    bool fileHeader;
+    uint32_t headerSize = 0;
+
+    FUNC_ENTER();
+    if (!outBuffer)
+        return ENCODE_INVALID_PARAMS;
+
+    //vp8 has no codec data, stream header is the ivf file header
+    if (outBuffer->format & OUTPUT_CODEC_DATA) {
+        outBuffer->dataSize = 0;
+        return ENCODE_SUCCESS;
+    }
+    if (outBuffer->format & OUTPUT_STREAM_HEADER) {
+        outBuffer->dataSize = 0;
+        if (!ivf)
+            return ENCODE_SUCCESS;
+        if (outBuffer->bufferSize < IVF_FILE_HEADER_SIZE)
+            return ENCODE_BUFFER_TOO_SMALL;
+        outBuffer->dataSize = writeIvfHeader(outBuffer->data);
+        m_ivfHeaderDone = true;
+        return ENCODE_SUCCESS;
+    }
+    if (outBuffer->format != OUTPUT_EVERYTHING && outBuffer->format != OUTPUT_FRAME_DATA) {
+        ERROR("output format %d is not supported by vp8", outBuffer->format);
+        return ENCODE_INVALID_PARAMS;
+    }
+
+    if (!peekOutput(picture, codedBuffer, withWait))
+        return ENCODE_BUFFER_NO_MORE;
+
+    fileHeader = ivf && outBuffer->format == OUTPUT_EVERYTHING && !m_ivfHeaderDone;
+    if (ivf)
+        headerSize = IVF_FRAME_HEADER_SIZE + (fileHeader ? IVF_FILE_HEADER_SIZE : 0);
+    if (outBuffer->bufferSize < headerSize) {
+        outBuffer->dataSize = 0;
+        return ENCODE_BUFFER_TOO_SMALL;
+    }
+
+    syncPicture(picture.get());
+    outBuffer->data += headerSize;
+    outBuffer->bufferSize -= headerSize;
+    ret = copyCodedBuffer(outBuffer, codedBuffer);
+    outBuffer->data -= headerSize;
+    outBuffer->bufferSize += headerSize;
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+
+    if (ivf) {
+        uint8_t* p = outBuffer->data;
+        if (fileHeader) {
+            p += writeIvfHeader(p);
+            m_ivfHeaderDone = true;
+        }
+        putLE32(p, outBuffer->dataSize);
+        putLE32(p, m_ivfFrameCount & 0xffffffff);
+        putLE32(p, m_ivfFrameCount >> 32);
+        m_ivfFrameCount++;
+        outBuffer->dataSize += headerSize;
+    }
+    outBuffer->timeStamp = picture->m_timeStamp;
+    outBuffer->temporalId = picture->m_temporalId;
+    outputPicture(picture.get(), codedBuffer->size());
+
+    popOutput();
+    return ENCODE_SUCCESS;
+}
+
+bool VaapiEncoderVP8::fill(VAEncSequenceParameterBufferVP8* seqParam) const
+{
+    seqParam->frame_width = width();
+    seqParam->frame_height = height();
+    seqParam->error_resilient = m_videoParamVP8.errorResilient;
+    //key frames are picked by us
+    seqParam->kf_auto = 0;
+    seqParam->kf_min_dist = 1;
+    seqParam->kf_max_dist = intraPeriod();
+    seqParam->bits_per_second = bitRate();
+    seqParam->intra_period = intraPeriod();
+    for (int i = 0; i < 4; i++)
+        seqParam->reference_frames[i] = VA_INVALID_SURFACE;
+    return true;
+}
+
+bool VaapiEncoderVP8::fill(VAEncPictureParameterBufferVP8* picParam, const PicturePtr& picture,
+                           const CodedBufferPtr& codedBuffer) const
+{
+    bool isKey = picture->isKeyFrame();
+
+    picParam->reconstructed_frame = picture->m_recon->getID();
+    picParam->ref_last_frame = isKey ? VA_INVALID_SURFACE : m_last->getID();
+    picParam->ref_gf_frame = isKey ? VA_INVALID_SURFACE : m_golden->getID();
+    picParam->ref_arf_frame = isKey ? VA_INVALID_SURFACE : m_altRef->getID();
+    picParam->coded_buf = codedBuffer->getID();
+
+    picParam->ref_flags.bits.force_kf = isKey;
+    picParam->ref_flags.bits.no_ref_last = 0;
+    picParam->ref_flags.bits.no_ref_gf = !picture->m_useGolden;
+    picParam->ref_flags.bits.no_ref_arf = !picture->m_useAltRef;
+
+    //0 for key frame, 1 for inter frame
+    picParam->pic_flags.bits.frame_type = !isKey;
+    picParam->pic_flags.bits.show_frame = 1;
+    picParam->pic_flags.bits.refresh_entropy_probs = picture->m_refreshEntropy;
+    picParam->pic_flags.bits.refresh_last = picture->m_refreshLast;
+    picParam->pic_flags.bits.refresh_golden_frame = picture->m_refreshGolden;
+    picParam->pic_flags.bits.refresh_alternate_frame = picture->m_refreshAltRef;
+    //2 is golden frame
+    picParam->pic_flags.bits.copy_buffer_to_alternate = picture->m_copyGoldenToAltRef ? 2 : 0;
+    picParam->pic_flags.bits.mb_no_coeff_skip = 1;
+
+    for (int i = 0; i < 4; i++)
+        picParam->loop_filter_level[i] = m_videoParamVP8.loopFilterLevel;
+    picParam->sharpness_level = m_videoParamVP8.sharpnessLevel;
+    picParam->clamp_qindex_high = VP8_MAX_QINDEX;
+    picParam->clamp_qindex_low = 0;
+    return true;
+}
+
+bool VaapiEncoderVP8::fill(VAQMatrixBufferVP8* qMatrix, const PicturePtr& picture) const
+{
+    uint32_t qIndex = picture->m_qp;
+    if (useSoftwareRateControl())
+        qIndex = qIndex * VP8_MAX_QINDEX / H264_MAX_QP;
+    if (qIndex > VP8_MAX_QINDEX)
+        qIndex = VP8_MAX_QINDEX;
+
+    //no segmentation, all segments use the same q index
+    for (int i = 0; i < 4; i++)
+        qMatrix->quantization_index[i] = qIndex;
+    return true;
+}
+
+bool VaapiEncoderVP8::ensureSequence(const PicturePtr& picture)
+{
+    VAEncSequenceParameterBufferVP8* seqParam;
+
+    if (!picture->isKeyFrame())
+        return true;
+    if (!picture->editSequence(seqParam) || !fill(seqParam)) {
+        ERROR("failed to create sequence parameter buffer (SPS)");
+        return false;
+    }
+    return true;
+}
+
+bool VaapiEncoderVP8::ensurePicture(const PicturePtr& picture, const CodedBufferPtr& codedBuffer)
+{
+    VAEncPictureParameterBufferVP8 *picParam;
+
+    if (!picture->isKeyFrame() && !m_last) {
+        ERROR("inter frame without reference");
+        return false;
+    }
+    if (!picture->editPicture(picParam) || !fill(picParam, picture, codedBuffer)) {
+        ERROR("failed to create picture parameter buffer (PPS)");
+        return false;
+    }
+    return true;
+}
+
+bool VaapiEncoderVP8::ensureQMatrix(const PicturePtr& picture)
+{
+    VAQMatrixBufferVP8 *qMatrix;
+
+    if (!picture->editQMatrix(qMatrix) || !fill(qMatrix, picture)) {
+        ERROR("failed to create quantization buffer");
+        return false;
+    }
+    return true;
+}
+
+/* same order as decoder: copy to alt ref, then refresh golden, alt ref and last frame */
+void VaapiEncoderVP8::referenceListUpdate(const PicturePtr& picture)
+{
+    if (picture->m_copyGoldenToAltRef)
+        m_altRef = m_golden;
+    if (picture->m_refreshGolden)
+        m_golden = picture->m_recon;
+    if (picture->m_refreshAltRef)
+        m_altRef = picture->m_recon;
+    if (picture->m_refreshLast)
+        m_last = picture->m_recon;
+}
+
+Encode_Status VaapiEncoderVP8::encodePicture(const PicturePtr& picture, const CodedBufferPtr& codedBuffer)
+{
+    Encode_Status ret = ENCODE_FAIL;
+
+    picture->m_recon = createSurface();
+    if (!picture->m_recon)
+        return ret;
+
+    if (!ensureSequence(picture))
+        return ret;
+    if (!ensureMiscParams(picture.get()))
+        return ret;
+    if (!ensurePicture(picture, codedBuffer))
+        return ret;
+    if (!ensureQMatrix(picture))
+        return ret;
+    if (!picture->encode())
+        return ret;
+
+    referenceListUpdate(picture);
+    return ENCODE_SUCCESS;
+}
+}
@@ -0,0 +1,107 @@
+/*
+ *  vaapiencoder_vp8.h - vp8 encoder for va
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapiencoder_vp8_h
+#define vaapiencoder_vp8_h
+
+#include "vaapiencoder_base.h"
+#include "vaapi/vaapiptrs.h"
+#include "common/lock.h"
+#include <tr1/memory>
+#include <va/va_enc_vp8.h>
+
+namespace YamiMediaCodec{
+class VaapiEncPictureVP8;
+
+/**
+ * \class VaapiEncoderVP8
+ * \brief vp8 encoder, frames are coded in input order with I and P frames only
+ * <pre>
+ * three reference frames are tracked the same way as decoder does:
+ * 1. key frame refreshes last, golden and alt ref frames.
+ * 2. inter frame refreshes last frame, and golden/alt ref frame by VideoParamsVP8 policy.
+ * 3. with temporal layers, layer 0, 1 and 2 refresh last, golden and alt ref frame,
+ *    top layer refreshes nothing. a frame only references frames of its layer or lower ones.
+ * driver writes the frame header, so coded buffer is a complete frame.
+ * </pre>
+ */
+class VaapiEncoderVP8 : public VaapiEncoderBase {
+public:
+    typedef std::tr1::shared_ptr<VaapiEncPictureVP8> PicturePtr;
+
+    VaapiEncoderVP8();
+    ~VaapiEncoderVP8();
+    virtual Encode_Status start();
+    virtual void flush();
+    virtual Encode_Status stop();
+    virtual Encode_Status getOutput(VideoEncOutputBuffer * outBuffer, bool withWait = false) const;
+
+    virtual Encode_Status getParameters(VideoParamConfigSet *);
+    virtual Encode_Status setParameters(VideoParamConfigSet *);
+    virtual Encode_Status getMaxOutSize(uint32_t *maxSize);
+
+protected:
+    virtual Encode_Status reorder(const SurfacePtr&, uint64_t timeStamp, bool forceKeyFrame = false);
+    virtual Encode_Status submitEncode();
+    virtual Encode_Status drain();
+    virtual void resolutionChanged();
+    //frames held by client in mapped mode still occupy coded buffers
+    //last, golden and alt ref frames
+    virtual uint32_t maxReferenceCount() const { return 3; }
+
+private:
+    Encode_Status encodePicture(const PicturePtr&, const CodedBufferPtr&);
+    bool fill(VAEncSequenceParameterBufferVP8*) const;
+    bool fill(VAEncPictureParameterBufferVP8*, const PicturePtr&, const CodedBufferPtr&) const;
+    bool fill(VAQMatrixBufferVP8*, const PicturePtr&) const;
+    bool ensureSequence(const PicturePtr&);
+    bool ensurePicture(const PicturePtr&, const CodedBufferPtr&);
+    bool ensureQMatrix(const PicturePtr&);
+    void referenceListUpdate(const PicturePtr&);
+    bool ensureCodedBufferSize();
+    uint32_t writeIvfHeader(uint8_t* data) const;
+
+    //picks frame type, temporal layer and reference frame updates
+    void setKeyFrame(const PicturePtr&);
+    void setInterFrame(const PicturePtr&);
+    void resetParams();
+
+    VideoParamsVP8 m_videoParamVP8;
+    uint32_t m_temporalLayers;
+
+    /* frames since last key frame */
+    uint32_t m_frameIndex;
+    /* frame waiting for submitEncode */
+    PicturePtr m_currentPicture;
+
+    /* reference frames */
+    SurfacePtr m_last;
+    SurfacePtr m_golden;
+    SurfacePtr m_altRef;
+
+    /* ivf file header is written, and frames written after it */
+    mutable bool m_ivfHeaderDone;
+    mutable uint64_t m_ivfFrameCount;
+
+    Lock m_paramLock; // locker for parameters update, for example: m_videoParamVP8 and m_maxCodedbufSize
+};
+}
+#endif /* vaapiencoder_vp8_h */
@@ -0,0 +1,253 @@
+/*
+ *  vaapiencodesession.cpp - encode one input to several outputs
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "vaapiencoder_base.h"
+#include "vaapiencodesession.h"
+
+#include "common/log.h"
+#include "interface/VideoEncoderHost.h"
+#include "scopedlogger.h"
+#include "vaapiencsurfacepool.h"
+#include "vaapi/vaapidisplay.h"
+#include "vaapi/vaapisurface.h"
+#include "vaapi/vaapivpp.h"
+
+namespace YamiMediaCodec{
+VaapiEncodeSession::VaapiEncodeSession()
+    : m_xDisplay(NULL)
+    , m_width(0)
+    , m_height(0)
+    , m_started(false)
+{
+}
+
+VaapiEncodeSession::~VaapiEncodeSession()
+{
+    stop();
+    for (size_t i = 0; i < m_outputs.size(); i++)
+        releaseVideoEncoder(m_outputs[i].encoder);
+}
+
+void VaapiEncodeSession::setXDisplay(Display * xdisplay)
+{
+    m_xDisplay = xdisplay;
+}
+
+Encode_Status VaapiEncodeSession::setInputResolution(uint32_t width, uint32_t height)
+{
+    if (m_started)
+        return ENCODE_WRONG_STATE;
+    if (!width || !height)
+        return ENCODE_INVALID_PARAMS;
+    m_width = width;
+    m_height = height;
+    return ENCODE_SUCCESS;
+}
+
+IVideoEncoder* VaapiEncodeSession::addOutput(const char* mimeType)
+{
+    if (m_started) {
+        ERROR("can't add output after start");
+        return NULL;
+    }
+    IVideoEncoder* encoder = createVideoEncoder(mimeType);
+    if (!encoder)
+        return NULL;
+    Output output;
+    output.encoder = dynamic_cast<VaapiEncoderBase*>(encoder);
+    if (!output.encoder) {
+        ERROR("%s encoder can't join a session", mimeType);
+        releaseVideoEncoder(encoder);
+        return NULL;
+    }
+    m_outputs.push_back(output);
+    return encoder;
+}
+
+Encode_Status VaapiEncodeSession::start(void)
+{
+    FUNC_ENTER();
+    if (m_started)
+        return ENCODE_WRONG_STATE;
+    if (m_outputs.empty() || !m_width || !m_height) {
+        ERROR("session needs input resolution and outputs");
+        return ENCODE_INVALID_PARAMS;
+    }
+    m_display = VaapiDisplay::create(m_xDisplay);
+    if (!m_display) {
+        ERROR("failed to create display");
+        return ENCODE_FAIL;
+    }
+
+    //input stays until the output holds it longest is done
+    uint32_t inputSize = 1;
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Output& output = m_outputs[i];
+        VaapiEncoderBase* encoder = output.encoder;
+        encoder->m_sharedDisplay = m_display;
+        Encode_Status ret = encoder->start();
+        if (ret != ENCODE_SUCCESS) {
+            stop();
+            return ret;
+        }
+        if (!createScaler(output)) {
+            stop();
+            return ENCODE_FAIL;
+        }
+        uint32_t count = encoder->maxInputCount() + 1;
+        if (!output.vpp && count > inputSize)
+            inputSize = count;
+    }
+    m_inputPool = VaapiEncSurfacePool::create(m_display, VA_FOURCC_NV12, m_width, m_height, inputSize);
+    if (!m_inputPool) {
+        stop();
+        return ENCODE_NO_MEMORY;
+    }
+    INFO("encode session: %d outputs, %d input surfaces", (int)m_outputs.size(), inputSize);
+    m_started = true;
+    return ENCODE_SUCCESS;
+}
+
+bool VaapiEncodeSession::createScaler(Output& output)
+{
+    VaapiEncoderBase* encoder = output.encoder;
+    output.vpp.reset();
+    output.pool.reset();
+    if (encoder->width() == m_width && encoder->height() == m_height)
+        return true;
+    output.vpp = VaapiVpp::create(m_display, encoder->width(), encoder->height());
+    output.pool = VaapiEncSurfacePool::create(m_display, VA_FOURCC_NV12,
+                                              encoder->width(), encoder->height(), encoder->maxInputCount() + 1);
+    if (!output.vpp || !output.pool) {
+        ERROR("failed to scale %dx%d to %dx%d", m_width, m_height, encoder->width(), encoder->height());
+        return false;
+    }
+    return true;
+}
+
+/* the session encodes surfaces directly, so resolution set on an output by setConfig() is applied here */
+Encode_Status VaapiEncodeSession::applyResolution(Output& output)
+{
+    VaapiEncoderBase* encoder = output.encoder;
+    if (!encoder->m_resolutionChanged)
+        return ENCODE_SUCCESS;
+    Encode_Status ret = encoder->applyResolution();
+    if (ret != ENCODE_SUCCESS)
+        return ret;
+    return createScaler(output) ? ENCODE_SUCCESS : ENCODE_FAIL;
+}
+
+Encode_Status VaapiEncodeSession::stop(void)
+{
+    FUNC_ENTER();
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Output& output = m_outputs[i];
+        output.encoder->stop();
+        output.encoder->m_sharedDisplay.reset();
+        output.vpp.reset();
+        output.pool.reset();
+    }
+    m_inputPool.reset();
+    m_display.reset();
+    m_started = false;
+    return ENCODE_SUCCESS;
+}
+
+void VaapiEncodeSession::flush(void)
+{
+    for (size_t i = 0; i < m_outputs.size(); i++)
+        m_outputs[i].encoder->flush();
+}
+
+/* outputs are drained one by one, draining again is harmless if client retries on ENCODE_IS_BUSY */
+Encode_Status VaapiEncodeSession::drain(VideoEncRawBuffer* inBuffer)
+{
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Encode_Status ret = m_outputs[i].encoder->encode(inBuffer);
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+    }
+    return ENCODE_SUCCESS;
+}
+
+Encode_Status VaapiEncodeSession::encode(VideoEncRawBuffer* inBuffer)
+{
+    FUNC_ENTER();
+    if (!m_started)
+        return ENCODE_WRONG_STATE;
+    if (!inBuffer)
+        return ENCODE_INVALID_PARAMS;
+    if (!inBuffer->data && !inBuffer->size)
+        return drain(inBuffer);
+
+    Encode_Status ret;
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        ret = applyResolution(m_outputs[i]);
+        if (ret != ENCODE_SUCCESS)
+            return ret;
+    }
+
+    //all or none of the outputs take the frame
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        if (m_outputs[i].encoder->isBusy())
+            return ENCODE_IS_BUSY;
+    }
+
+    SurfacePtr input = m_inputPool->acquire();
+    if (!input)
+        return ENCODE_IS_BUSY;
+    //vpp may still read it for last frame
+    input->sync();
+    if (!VaapiEncoderBase::copyInput(input, inBuffer))
+        return ENCODE_FAIL;
+
+    //scale for every output first, nothing is encoded if one of them fails
+    std::vector<SurfacePtr> surfaces(m_outputs.size(), input);
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Output& output = m_outputs[i];
+        if (!output.vpp)
+            continue;
+        surfaces[i] = output.pool->acquire();
+        if (!surfaces[i])
+            return ENCODE_IS_BUSY;
+        if (!output.vpp->process(input, surfaces[i])) {
+            ERROR("scale input for output %d failed", (int)i);
+            return ENCODE_FAIL;
+        }
+    }
+
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        ret = m_outputs[i].encoder->encode(surfaces[i], inBuffer->timeStamp, inBuffer->forceKeyFrame, FrameCost());
+        if (ret != ENCODE_SUCCESS) {
+            //outputs before this one have submitted the frame and can't take it back,
+            //drop frames of all outputs, so they start again from a key frame together
+            ERROR("output %d failed to encode, status %d, flush all outputs", (int)i, ret);
+            flush();
+            return ret;
+        }
+    }
+    return ENCODE_SUCCESS;
+}
+}
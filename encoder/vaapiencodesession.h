@@ -0,0 +1,80 @@
+/*
+ *  vaapiencodesession.h - encode one input to several outputs
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef vaapiencodesession_h
+#define vaapiencodesession_h
+
+#include <vector>
+#include "interface/VideoEncoderInterface.h"
+#include "vaapi/vaapiptrs.h"
+#include "vaapi/vaapitypes.h"
+
+namespace YamiMediaCodec{
+class VaapiEncoderBase;
+
+/**
+ * \class VaapiEncodeSession
+ * \brief IVideoEncodeSession on one VaapiDisplay
+ * <pre>
+ * input is copied to a surface from m_inputPool once.
+ * outputs with input resolution get the same SurfacePtr, others get a surface from their own pool scaled by vpp.
+ * encoders keep the SurfacePtr until the frame is coded, the last one returns it to pool.
+ * </pre>
+ */
+class VaapiEncodeSession : public IVideoEncodeSession
+{
+public:
+    VaapiEncodeSession();
+    virtual ~VaapiEncodeSession();
+
+    virtual void setXDisplay(Display * xdisplay);
+    virtual Encode_Status setInputResolution(uint32_t width, uint32_t height);
+    virtual IVideoEncoder* addOutput(const char* mimeType);
+    virtual Encode_Status start(void);
+    virtual Encode_Status stop(void);
+    virtual Encode_Status encode(VideoEncRawBuffer* inBuffer);
+    virtual void flush(void);
+
+private:
+    struct Output {
+        VaapiEncoderBase* encoder;
+        //null if the output has input resolution
+        VppPtr vpp;
+        EncSurfacePoolPtr pool;
+    };
+    Encode_Status drain(VideoEncRawBuffer* inBuffer);
+    //vpp and surface pool for an output not in input resolution
+    bool createScaler(Output& output);
+    Encode_Status applyResolution(Output& output);
+
+    Display* m_xDisplay;
+    DisplayPtr m_display;
+    uint32_t m_width;
+    uint32_t m_height;
+    EncSurfacePoolPtr m_inputPool;
+    std::vector<Output> m_outputs;
+    bool m_started;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiEncodeSession);
+};
+}
+#endif //vaapiencodesession_h
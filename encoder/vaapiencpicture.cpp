@@ -31,6 +31,13 @@ VaapiEncPicture::VaapiEncPicture(const ContextPtr& context,
                                  const SurfacePtr & surface,
                                  int64_t timeStamp)
 :VaapiPicture(context, surface, timeStamp)
+, m_qp(0)
+, m_inputTime(0)
+, m_submitTime(0)
+, m_syncTime(0)
+, m_codingNum(0)
+, m_queueDepth(0)
+, m_temporalId(0)
 {
 }
 
@@ -45,6 +52,8 @@ bool VaapiEncPicture::doRender()
     RENDER_OBJECT(m_packedHeaders);
     RENDER_OBJECT(m_miscParams);
     RENDER_OBJECT(m_picture);
+    RENDER_OBJECT(m_qMatrix);
+    RENDER_OBJECT(m_huffmanTable);
     RENDER_OBJECT(m_slices);
     return true;
 }
@@ -68,4 +77,25 @@ addPackedHeader(VAEncPackedHeaderType packedHeaderType, const void *header,
     }
     return ret;
 }
+
+bool VaapiEncPicture::addPackedSliceHeader(const void *header, uint32_t headerBitSize)
+{
+    VAEncPackedHeaderParameterBuffer *packedHeader;
+    BufObjectPtr param =
+        createBufferObject(VAEncPackedHeaderParameterBufferType,
+                           packedHeader);
+    BufObjectPtr data =
+        createBufferObject(VAEncPackedHeaderDataBufferType,
+                           (headerBitSize + 7) / 8, header, NULL);
+    //slices are rendered in order, driver binds packed header to next slice
+    if (!param || !data || m_slices.empty())
+        return false;
+    std::vector < BufObjectPtr >::iterator it =
+        m_slices.insert(m_slices.end() - 1, data);
+    m_slices.insert(it, param);
+    packedHeader->type = VAEncPackedHeaderSlice;
+    packedHeader->bit_length = headerBitSize;
+    packedHeader->has_emulation_bytes = 0;
+    return true;
+}
 }
@@ -24,6 +24,7 @@
 #define vaapiencpicture_h
 
 #include "vaapi/vaapipicture.h"
+#include "vaapiencratecontrol.h"
 
 namespace YamiMediaCodec{
 class VaapiEncPicture:public VaapiPicture {
@@ -41,15 +42,40 @@ class VaapiEncPicture:public VaapiPicture {
     template < class T >
     bool newSlice(T * &sliceParam);
 
+    //tables of picture level coding, such as jpeg quantization and huffman tables
+    template < class T >
+    bool editQMatrix(T * &qMatrix);
+
+    template < class T >
+    bool editHuffmanTable(T * &huffmanTable);
+
 
     template < class T >
     bool newMisc(VAEncMiscParameterType, T * &miscParam);
 
     bool addPackedHeader(VAEncPackedHeaderType, const void *header,
                          uint32_t headerBitSize);
+    //packed slice header goes right before the slice it belongs to,
+    //call it after newSlice() of that slice, it's put in front of the slice
+    bool addPackedSliceHeader(const void *header, uint32_t headerBitSize);
 
     bool encode();
 
+    //qp of this picture, picked by software rate control, initQP if it's disabled
+    uint32_t m_qp;
+    //look-ahead cost of the input frame, see VaapiEncRateControl
+    FrameCost m_cost;
+
+    //for statistics, monotonic time in microseconds
+    uint64_t m_inputTime;
+    uint64_t m_submitTime;
+    uint64_t m_syncTime;
+    uint32_t m_codingNum;
+    //frames in flight when this one is submitted
+    uint32_t m_queueDepth;
+    //temporal layer, told to client with the coded frame
+    uint32_t m_temporalId;
+
   private:
     bool doRender();
 
@@ -58,6 +84,8 @@ class VaapiEncPicture:public VaapiPicture {
 
     BufObjectPtr m_sequence;
     BufObjectPtr m_picture;
+    BufObjectPtr m_qMatrix;
+    BufObjectPtr m_huffmanTable;
     std::vector < BufObjectPtr > m_miscParams;
     std::vector < BufObjectPtr > m_slices;
     std::vector < std::pair < BufObjectPtr,
@@ -83,6 +111,17 @@ template < class T > bool VaapiEncPicture::newSlice(T * &sliceParam)
     return addObject(m_slices, slice);
 }
 
+template < class T > bool VaapiEncPicture::editQMatrix(T * &qMatrix)
+{
+    return editObject(m_qMatrix, VAQMatrixBufferType, qMatrix);
+}
+
+template < class T > bool VaapiEncPicture::editHuffmanTable(T * &huffmanTable)
+{
+    return editObject(m_huffmanTable, VAHuffmanTableBufferType,
+                      huffmanTable);
+}
+
 template < class T >
     BufObjectPtr VaapiEncPicture::
 createMiscObject(VAEncMiscParameterType miscType, T * &bufPtr)
@@ -0,0 +1,298 @@
+/*
+ *  vaapiencratecontrol.cpp - software rate control for encoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+//system headers first, VideoEncoderDef.h defines min and max macros
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vaapiencratecontrol.h"
+#include "common/log.h"
+
+namespace YamiMediaCodec{
+
+//block size on half resolution luma, it's a 16x16 macroblock of input
+#define BLOCK_SIZE 8
+#define MAX_QP 51
+
+//not the macros, they evaluate arguments twice
+template <typename T>
+static inline T minOf(T a, T b)
+{
+    return a < b ? a : b;
+}
+
+template <typename T>
+static inline T maxOf(T a, T b)
+{
+    return a > b ? a : b;
+}
+//qp of a type can't move more than this from its last value, except on scene cut
+#define MAX_QP_STEP 4
+//inter cost no better than this part of intra cost is a new scene
+#define SCENE_CUT_RATIO 0.6
+//and it's a sudden change compare to recent frames
+#define SCENE_CUT_JUMP 3.0
+
+static void downscale(uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight,
+                      const uint8_t* src, uint32_t srcStride)
+{
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        const uint8_t* r0 = src + 2 * y * srcStride;
+        const uint8_t* r1 = r0 + srcStride;
+        uint8_t* d = dst + y * dstWidth;
+        uint32_t x = 0;
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi16(0xff);
+        for (; x + 16 <= dstWidth; x += 16) {
+            __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(r0 + 2 * x)),
+                                     _mm_loadu_si128((const __m128i*)(r1 + 2 * x)));
+            __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(r0 + 2 * x + 16)),
+                                     _mm_loadu_si128((const __m128i*)(r1 + 2 * x + 16)));
+            a = _mm_avg_epu16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+            b = _mm_avg_epu16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8));
+            _mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(a, b));
+        }
+#endif
+        for (; x < dstWidth; x++)
+            d[x] = (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2;
+    }
+}
+
+static uint32_t isqrt(uint32_t v)
+{
+    return (uint32_t)(sqrt((double)v) + 0.5);
+}
+
+//intra cost is estimated from deviation, 8 * sqrt(sum of squared deviation) ~ sum of absolute deviation
+static void blockCost(const uint8_t* cur, const uint8_t* prev, uint32_t stride,
+                      uint32_t& intra, uint32_t& inter)
+{
+    uint32_t sum = 0, sqr = 0, sad = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vsum = zero, vsqr = zero, vsad = zero;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        __m128i c = _mm_loadl_epi64((const __m128i*)(cur + i * stride));
+        vsum = _mm_add_epi64(vsum, _mm_sad_epu8(c, zero));
+        if (prev) {
+            __m128i p = _mm_loadl_epi64((const __m128i*)(prev + i * stride));
+            vsad = _mm_add_epi64(vsad, _mm_sad_epu8(c, p));
+        }
+        __m128i c16 = _mm_unpacklo_epi8(c, zero);
+        vsqr = _mm_add_epi32(vsqr, _mm_madd_epi16(c16, c16));
+    }
+    vsqr = _mm_add_epi32(vsqr, _mm_srli_si128(vsqr, 8));
+    vsqr = _mm_add_epi32(vsqr, _mm_srli_si128(vsqr, 4));
+    sum = _mm_cvtsi128_si32(vsum);
+    sqr = _mm_cvtsi128_si32(vsqr);
+    sad = _mm_cvtsi128_si32(vsad);
+#else
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        for (int j = 0; j < BLOCK_SIZE; j++) {
+            uint32_t c = cur[i * stride + j];
+            sum += c;
+            sqr += c * c;
+            if (prev)
+                sad += abs((int)c - (int)prev[i * stride + j]);
+        }
+    }
+#endif
+    uint32_t n = BLOCK_SIZE * BLOCK_SIZE;
+    intra = BLOCK_SIZE * isqrt(sqr - sum * sum / n);
+    inter = prev ? sad : intra;
+}
+
+static double qpToQstep(uint32_t qp)
+{
+    return 0.85 * pow(2.0, ((double)qp - 12) / 6);
+}
+
+static int qstepToQP(double qstep)
+{
+    return (int)floor(12 + 6 * log2(qstep / 0.85) + 0.5);
+}
+
+RateControlPtr VaapiEncRateControl::create(const VideoParamsCommon& common)
+{
+    RateControlPtr rc;
+    if (!common.rcParams.lookAhead)
+        return rc;
+    if (common.rcMode != RATE_CONTROL_CQP || !common.rcParams.bitRate) {
+        WARNING("software rate control needs RATE_CONTROL_CQP and bitRate, disable it");
+        return rc;
+    }
+    rc.reset(new VaapiEncRateControl(common));
+    return rc;
+}
+
+VaapiEncRateControl::VaapiEncRateControl(const VideoParamsCommon& common)
+    : m_lookAhead(common.rcParams.lookAhead)
+    , m_initQP(common.rcParams.initQP)
+    , m_fullness(0)
+    , m_width(0)
+    , m_height(0)
+    , m_avgInter(0)
+{
+    memset(m_alpha, 0, sizeof(m_alpha));
+    for (int i = 0; i < 3; i++)
+        m_lastQP[i] = minOf(m_initQP, (uint32_t)MAX_QP);
+    reconfigure(common);
+}
+
+void VaapiEncRateControl::reconfigure(const VideoParamsCommon& common)
+{
+    AutoLock lock(m_lock);
+    if (!common.rcParams.bitRate) {
+        WARNING("software rate control needs bitRate, keep the old one");
+        return;
+    }
+    double fps = common.frameRate.frameRateDenom ?
+        (double)common.frameRate.frameRateNum / common.frameRate.frameRateDenom : 30;
+    if (fps <= 0)
+        fps = 30;
+    m_minQP = common.rcParams.minQP;
+    m_frameBits = common.rcParams.bitRate / fps;
+    uint32_t window = common.rcParams.windowSize ? common.rcParams.windowSize : 1000;
+    m_bufferSize = (double)common.rcParams.bitRate * window / 1000;
+    //debt of old bitrate doesn't fit new buffer
+    m_fullness = maxOf(-m_bufferSize, minOf(m_fullness, m_bufferSize));
+    INFO("software rate control, look ahead %d frames, %.0f bits per frame", m_lookAhead, m_frameBits);
+}
+
+int VaapiEncRateControl::typeIndex(VaapiPictureType type)
+{
+    if (type == VAAPI_PICTURE_TYPE_I)
+        return 0;
+    if (type == VAAPI_PICTURE_TYPE_B)
+        return 2;
+    return 1;
+}
+
+void VaapiEncRateControl::analyze(const uint8_t* luma, uint32_t stride,
+                                  uint32_t width, uint32_t height, FrameCost& cost)
+{
+    AutoLock lock(m_lock);
+    uint32_t w = width / 2;
+    uint32_t h = height / 2;
+    if (w != m_width || h != m_height) {
+        m_width = w;
+        m_height = h;
+        m_prev.clear();
+    }
+    m_cur.resize(w * h);
+    downscale(&m_cur[0], w, h, luma, stride);
+
+    const uint8_t* prev = m_prev.empty() ? NULL : &m_prev[0];
+    uint64_t intraSum = 0, interSum = 0;
+    for (uint32_t y = 0; y + BLOCK_SIZE <= h; y += BLOCK_SIZE) {
+        for (uint32_t x = 0; x + BLOCK_SIZE <= w; x += BLOCK_SIZE) {
+            uint32_t offset = y * w + x;
+            uint32_t intra, inter;
+            blockCost(&m_cur[offset], prev ? prev + offset : NULL, w, intra, inter);
+            intraSum += intra;
+            //encoder takes the better one for each macroblock
+            interSum += minOf(intra, inter);
+        }
+    }
+    cost.intra = intraSum + 1;
+    cost.inter = interSum + 1;
+    cost.sceneCut = prev && cost.inter > cost.intra * SCENE_CUT_RATIO
+        && m_avgInter && cost.inter > m_avgInter * SCENE_CUT_JUMP;
+    if (cost.sceneCut) {
+        INFO("scene cut, intra cost %d, inter cost %d, average %.0f", cost.intra, cost.inter, m_avgInter);
+        m_avgInter = cost.inter;
+    } else {
+        m_avgInter = m_avgInter ? m_avgInter * 0.9 + cost.inter * 0.1 : cost.inter;
+    }
+
+    m_window.push_back(cost.inter);
+    while (m_window.size() > m_lookAhead + 1)
+        m_window.pop_front();
+    m_cur.swap(m_prev);
+}
+
+uint32_t VaapiEncRateControl::getQP(VaapiPictureType type, const FrameCost& cost)
+{
+    AutoLock lock(m_lock);
+    int index = typeIndex(type);
+    //frame was not analyzed, keep the last qp of this type
+    if (!cost.intra)
+        return m_lastQP[index];
+    double alpha = m_alpha[index];
+    if (!alpha) {
+        //borrow model of other types until we have one
+        alpha = m_alpha[1] ? m_alpha[1] : m_alpha[0];
+        if (!alpha) {
+            uint32_t qp = minOf(m_initQP + (index == 2 ? 2 : 0), (uint32_t)MAX_QP);
+            m_lastQP[index] = qp;
+            return qp;
+        }
+    }
+
+    double windowCost = 0;
+    for (std::deque<uint32_t>::iterator it = m_window.begin(); it != m_window.end(); ++it)
+        windowCost += *it;
+    double c = (index == 0) ? cost.intra : cost.inter;
+    double mean = m_window.empty() ? c : windowCost / m_window.size();
+
+    //complex frames get more bits, I frames may take several frame budgets
+    double weight = c / mean;
+    weight = maxOf(0.25, minOf(weight, index == 0 ? 8.0 : 4.0));
+    double target = m_frameBits * weight;
+    //pay back bits over budget
+    double correction = 1 - m_fullness / m_bufferSize;
+    target *= maxOf(0.5, minOf(correction, 1.5));
+
+    int qp = qstepToQP(alpha * c / target);
+    if (!cost.sceneCut && index != 0) {
+        qp = maxOf(qp, (int)m_lastQP[index] - MAX_QP_STEP);
+        qp = minOf(qp, (int)m_lastQP[index] + MAX_QP_STEP);
+    }
+    qp = maxOf(qp, (int)m_minQP);
+    qp = minOf(qp, MAX_QP);
+    m_lastQP[index] = qp;
+    DEBUG("rate control: type %d, cost %.0f, mean %.0f, target %.0f bits, qp %d", index, c, mean, target, qp);
+    return qp;
+}
+
+void VaapiEncRateControl::update(VaapiPictureType type, uint32_t qp, const FrameCost& cost, uint32_t bits)
+{
+    AutoLock lock(m_lock);
+    int index = typeIndex(type);
+    double c = (index == 0) ? cost.intra : cost.inter;
+    if (!c)
+        return;
+    double alpha = bits * qpToQstep(qp) / c;
+    m_alpha[index] = m_alpha[index] ? m_alpha[index] * 0.7 + alpha * 0.3 : alpha;
+    m_fullness += bits - m_frameBits;
+    //don't let a long static scene build too much credit
+    m_fullness = maxOf(m_fullness, -m_bufferSize);
+}
+
+} //namespace YamiMediaCodec
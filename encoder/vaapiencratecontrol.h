@@ -0,0 +1,103 @@
+/*
+ *  vaapiencratecontrol.h - software rate control for encoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapiencratecontrol_h
+#define vaapiencratecontrol_h
+
+#include <deque>
+#include <vector>
+#include <tr1/memory>
+#include "interface/VideoEncoderDef.h"
+#include "common/lock.h"
+#include "vaapi/vaapipicturetypes.h"
+#include "vaapi/vaapitypes.h"
+
+namespace YamiMediaCodec{
+
+/// estimated cost of a frame, sum of 16x16 block costs on half resolution luma
+struct FrameCost {
+    uint32_t intra;     //cost without reference, block deviation
+    uint32_t inter;     //cost with co-located block of previous frame as prediction
+    bool sceneCut;
+
+    FrameCost(): intra(0), inter(0), sceneCut(false) {}
+};
+
+class VaapiEncRateControl;
+typedef std::tr1::shared_ptr<VaapiEncRateControl> RateControlPtr;
+
+/**
+ * \class VaapiEncRateControl
+ * \brief software rate control on top of driver CQP mode
+ * <pre>
+ * 1. analyze() looks at every input frame in system memory when it arrives.
+ *    frames are held lookAhead frames before encoding, so costs of following frames are known.
+ * 2. getQP() picks qp of a picture in coding order, from a bits = alpha * cost / qstep model,
+ *    the frame budget is scaled by its cost against the look-ahead window and by buffer fullness.
+ * 3. update() is called with the coded size from output thread, it refines alpha of the picture type.
+ * </pre>
+ */
+class VaapiEncRateControl
+{
+public:
+    /// null if software rate control is not asked, it needs RATE_CONTROL_CQP, bitRate and lookAhead
+    static RateControlPtr create(const VideoParamsCommon&);
+
+    /// analyze luma plane of an input frame, detect scene cut
+    void analyze(const uint8_t* luma, uint32_t stride, uint32_t width, uint32_t height, FrameCost& cost);
+    uint32_t getQP(VaapiPictureType, const FrameCost&);
+    void update(VaapiPictureType, uint32_t qp, const FrameCost&, uint32_t bits);
+    uint32_t lookAhead() const { return m_lookAhead; }
+    /// new bitrate or frame rate, the model of each picture type is kept
+    void reconfigure(const VideoParamsCommon&);
+
+private:
+    VaapiEncRateControl(const VideoParamsCommon&);
+    static int typeIndex(VaapiPictureType);
+
+    uint32_t m_lookAhead;
+    uint32_t m_minQP;
+    uint32_t m_initQP;
+    double m_frameBits;         //budget of one frame
+    double m_bufferSize;        //virtual buffer, in bits
+    double m_fullness;          //bits over budget so far
+
+    //model of I/P/B, 0 means no coded frame of this type yet
+    double m_alpha[3];
+    uint32_t m_lastQP[3];
+
+    //half resolution luma of current and previous frame
+    std::vector<uint8_t> m_cur;
+    std::vector<uint8_t> m_prev;
+    uint32_t m_width;
+    uint32_t m_height;
+    //inter costs of recent frames, they are not coded yet
+    std::deque<uint32_t> m_window;
+    double m_avgInter;
+
+    Lock m_lock;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiEncRateControl);
+};
+
+} //namespace YamiMediaCodec
+
+#endif //vaapiencratecontrol_h
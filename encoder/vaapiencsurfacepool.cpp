@@ -0,0 +1,101 @@
+/*
+ *  vaapiencsurfacepool.cpp - surface pool for encoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "vaapiencsurfacepool.h"
+
+#include "common/log.h"
+#include "vaapi/vaapidisplay.h"
+#include "vaapi/vaapisurface.h"
+
+namespace YamiMediaCodec{
+
+EncSurfacePoolPtr VaapiEncSurfacePool::create(const DisplayPtr& display, uint32_t fourcc,
+    uint32_t width, uint32_t height, uint32_t maxSize)
+{
+    EncSurfacePoolPtr pool;
+    if (!display || !width || !height || !maxSize) {
+        ERROR("invalid surface pool parameters %dx%d, size %d", width, height, maxSize);
+        return pool;
+    }
+    pool.reset(new VaapiEncSurfacePool(display, fourcc, width, height, maxSize));
+    return pool;
+}
+
+VaapiEncSurfacePool::VaapiEncSurfacePool(const DisplayPtr& display, uint32_t fourcc,
+    uint32_t width, uint32_t height, uint32_t maxSize):
+    m_display(display),
+    m_fourcc(fourcc),
+    m_width(width),
+    m_height(height),
+    m_maxSize(maxSize)
+{
+    m_surfaces.reserve(maxSize);
+}
+
+struct VaapiEncSurfacePool::SurfaceRecycler
+{
+    SurfaceRecycler(const EncSurfacePoolPtr& pool): m_pool(pool) {}
+    void operator()(VaapiSurface* surface) { m_pool->recycle(surface);}
+private:
+    EncSurfacePoolPtr m_pool;
+};
+
+SurfacePtr VaapiEncSurfacePool::createSurface()
+{
+    VASurfaceAttrib attrib;
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = m_fourcc;
+    return VaapiSurface::create(m_display, VAAPI_CHROMA_TYPE_YUV420,
+                                m_width, m_height, &attrib, 1);
+}
+
+SurfacePtr VaapiEncSurfacePool::acquire()
+{
+    SurfacePtr surface;
+    AutoLock lock(m_lock);
+    if (m_freed.empty()) {
+        if (m_surfaces.size() >= m_maxSize)
+            return surface;
+        SurfacePtr s = createSurface();
+        if (!s)
+            return surface;
+        m_surfaces.push_back(s);
+        m_freed.push_back(s.get());
+        DEBUG("encoder surface pool grows to %d", (int)m_surfaces.size());
+    }
+    VaapiSurface* s = m_freed.front();
+    m_freed.pop_front();
+    surface.reset(s, SurfaceRecycler(shared_from_this()));
+    return surface;
+}
+
+void VaapiEncSurfacePool::recycle(VaapiSurface* surface)
+{
+    AutoLock lock(m_lock);
+    m_freed.push_back(surface);
+}
+
+} //namespace YamiMediaCodec
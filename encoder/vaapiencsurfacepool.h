@@ -0,0 +1,79 @@
+/*
+ *  vaapiencsurfacepool.h - surface pool for encoder
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapiencsurfacepool_h
+#define vaapiencsurfacepool_h
+
+#include "common/common_def.h"
+#include "common/lock.h"
+#include "vaapi/vaapiptrs.h"
+#include "vaapi/vaapitypes.h"
+#include <deque>
+#include <vector>
+#include <va/va.h>
+
+namespace YamiMediaCodec{
+
+/**
+ * \class VaapiEncSurfacePool
+ * \brief bounded surface pool used for encoder input and reconstructed frames
+ * <pre>
+ * 1. surfaces are created on demand, at most maxSize of them.
+ * 2. acquire() returns null surface when all surfaces are in use, the caller should report busy.
+ * 3. a surface goes back to the pool when the last SurfacePtr returned by acquire() is released,
+ *    the surface and its derived image (still mapped, if client mapped it) are kept for next acquire().
+ * 4. the free surface is in a first-in-first-out queue to give gpu more time to finish with it.
+ * </pre>
+ */
+class VaapiEncSurfacePool : public std::tr1::enable_shared_from_this<VaapiEncSurfacePool>
+{
+public:
+    static EncSurfacePoolPtr create(const DisplayPtr&, uint32_t fourcc,
+                                    uint32_t width, uint32_t height, uint32_t maxSize);
+    /// get a free surface, null if all maxSize surfaces are in use.
+    SurfacePtr acquire();
+    uint32_t getMaxSize() const { return m_maxSize; }
+
+private:
+    VaapiEncSurfacePool(const DisplayPtr&, uint32_t fourcc,
+                        uint32_t width, uint32_t height, uint32_t maxSize);
+    SurfacePtr createSurface();
+    void recycle(VaapiSurface*);
+
+    DisplayPtr m_display;
+    uint32_t m_fourcc;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_maxSize;
+
+    //all surfaces we created, and the free ones in them
+    std::vector<SurfacePtr> m_surfaces;
+    std::deque<VaapiSurface*> m_freed;
+    Lock m_lock;
+
+    struct SurfaceRecycler;
+
+    DISALLOW_COPY_AND_ASSIGN(VaapiEncSurfacePool);
+};
+
+} //namespace YamiMediaCodec
+
+#endif //vaapiencsurfacepool_h
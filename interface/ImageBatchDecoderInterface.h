@@ -0,0 +1,76 @@
+/*
+ *  ImageBatchDecoderInterface.h- decode many independent images in one call
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef IMAGE_BATCH_DECODER_INTERFACE_H_
+#define IMAGE_BATCH_DECODER_INTERFACE_H_
+
+#include "VideoDecoderDefs.h"
+#include <X11/Xlib.h>
+
+namespace YamiMediaCodec {
+/// completion of one image of a batch
+struct ImageBatchOutput {
+    /// DECODE_SUCCESS, or the error of this image
+    Decode_Status status;
+    /// decoded frame, NULL if status is an error. return it by IImageBatchDecoder::renderDone
+    VideoRenderBuffer *buffer;
+    /// image size, the surface may be larger since images of similar size share a context
+    int32_t width;
+    int32_t height;
+};
+
+/**
+ * \class IImageBatchDecoder
+ * \brief decodes independent images (thumbnails, image grids) without per image setup
+ * <pre>
+ * images are grouped into size buckets, each bucket keeps its own context and surface pool,
+ * so an image doesn't pay for start/reset, context creation and surface allocation.
+ * completions are returned in the order of input buffers.
+ * </pre>
+ */
+class IImageBatchDecoder {
+public:
+    virtual ~IImageBatchDecoder() {}
+    /**
+     * \brief configure the decoder, no image data is needed
+     * @param[in] buffer buffer->surfaceNumber is the number of frames client may hold in each bucket,
+     * buffer->flag is applied to every bucket. NULL for the defaults.
+     */
+    virtual Decode_Status start(VideoConfigBuffer *buffer) = 0;
+    /// drop all pending completions and destroy all contexts
+    virtual void stop(void) = 0;
+    /**
+     * \brief decode @param count images, each buffer holds a whole image
+     * @return number of buffers consumed. it is less than @param count when a bucket runs out of surfaces
+     * or every bucket holds client frames, client should return frames by #renderDone and submit the rest again.
+     */
+    virtual uint32_t decode(VideoDecodeBuffer *buffers, uint32_t count) = 0;
+    /// get the completion of next image in input order, false if there is none
+    virtual bool getOutput(ImageBatchOutput *output) = 0;
+    /// return a frame got from #getOutput
+    virtual void renderDone(VideoRenderBuffer *buffer) = 0;
+    /// same as IVideoDecoder::exportFrame, for a frame got from #getOutput
+    virtual Decode_Status exportFrame(const VideoRenderBuffer *buffer, VideoFrameDmaBuf *dmaBuf) = 0;
+    /// native display shared by all buckets, set it before #decode
+    virtual void setXDisplay(Display *xDisplay) = 0;
+};
+}
+#endif                          /* IMAGE_BATCH_DECODER_INTERFACE_H_ */
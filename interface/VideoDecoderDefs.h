@@ -48,6 +48,22 @@ struct VideoFrameRawData {
     uint8_t *data;
     // own data or derived from surface. If true, the library will release the memory during clearnup
     bool own;
+    int64_t timeStamp;
+    // set by libyami for a mapped (not copied) frame, client should not touch it
+    intptr_t handle;
+};
+
+// a decoded frame exported as dma-buf, see IVideoDecoder::exportFrame
+struct VideoFrameDmaBuf {
+    // owned by libyami, valid until the frame is returned by renderDone
+    int32_t fd;
+    uint32_t fourcc;
+    int32_t width;
+    int32_t height;
+    uint32_t numPlanes;
+    int32_t pitch[3];
+    int32_t offset[3];
+    int32_t size;
 };
 
 struct PackedFrameData {
@@ -102,6 +118,9 @@ typedef enum {
     // indicate whether video decoder buffer contains secure data
     IS_SECURE_DATA = 0x8000,
 
+    // vp8 decodes first frame multiple times to drain the driver cache, it's always on for psb
+    WANT_DRAIN_FIRST_FRAME = 0x10000,
+
 } VIDEO_BUFFER_FLAG;
 
 struct VideoDecodeBuffer {
@@ -132,10 +151,15 @@ struct VideoConfigBuffer {
     VideoExtensionBuffer *ext;
     void *nativeWindow;
     uint32_t rotationDegrees;
+    // jpeg: split an interleaved scan into up to this many slices on restart markers,
+    // 0 or 1 decodes the scan as one slice, at most JPEG_MAX_SLICES
+    uint32_t jpegMaxSlices;
 
     void *parser_handle;
 };
 
+#define JPEG_MAX_SLICES 64
+
 struct VideoRenderBuffer {
     VASurfaceID surface;
     VADisplay display;
@@ -24,6 +24,7 @@
 #define VIDEO_DECODER_HOST_H_
 
 #include "VideoDecoderInterface.h"
+#include "ImageBatchDecoderInterface.h"
 
 extern "C" { // for dlsym usage
 /** \file VideoDecoderHost.h
@@ -36,6 +37,13 @@ YamiMediaCodec::IVideoDecoder *createVideoDecoder(const char *mimeType);
 /// \brief destroy the decoder
 void releaseVideoDecoder(YamiMediaCodec::IVideoDecoder * p);
 
+/** \fn IImageBatchDecoder *createImageBatchDecoder(const char *mimeType)
+* \brief create a batch decoder for independent images, only "image/jpeg" is supported
+*/
+YamiMediaCodec::IImageBatchDecoder *createImageBatchDecoder(const char *mimeType);
+/// \brief destroy the batch decoder
+void releaseImageBatchDecoder(YamiMediaCodec::IImageBatchDecoder * p);
+
 /** \fn void preSandboxInitEncoder()
  * \brief when yami runs inside sandbox, some necessary work goes here before enter sanbox
  * usually, nothing special is required  except when yami dlopen thirty party libraries.
@@ -46,8 +54,17 @@ void releaseVideoDecoder(YamiMediaCodec::IVideoDecoder * p);
  */
 bool preSandboxInitDecoder();
 
+/** \fn void setMaxContextsPerDisplay(uint32_t maxContexts)
+ * \brief limit the contexts living on one VA display, decoders and encoders sharing
+ * the display count together. a session asking for more fails to start. 0 means no limit.
+ */
+void setMaxContextsPerDisplay(uint32_t maxContexts);
+
 typedef YamiMediaCodec::IVideoDecoder *(*YamiCreateVideoDecoderFuncPtr) (const char *mimeType);
 typedef void (*YamiReleaseVideoDecoderFuncPtr)(YamiMediaCodec::IVideoDecoder * p);
 typedef bool (*YamiPreSandboxInitDecoder)();
+typedef void (*YamiSetMaxContextsPerDisplayFuncPtr)(uint32_t maxContexts);
+typedef YamiMediaCodec::IImageBatchDecoder *(*YamiCreateImageBatchDecoderFuncPtr) (const char *mimeType);
+typedef void (*YamiReleaseImageBatchDecoderFuncPtr)(YamiMediaCodec::IImageBatchDecoder * p);
 }
 #endif                          /* VIDEO_DECODER_HOST_H_ */
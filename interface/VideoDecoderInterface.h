@@ -98,6 +98,34 @@ public:
     * </pre>
     */
     virtual void renderDone(VideoRenderBuffer* buffer) = 0;
+    /**
+     * \brief return one frame in system memory, it requires WANT_RAW_OUTPUT set in #start.
+     * <pre>
+     * if frame->data is set, the frame is copied to it in frame->fourcc layout (NV12, I420 or YV12, 0 means NV12),
+     * frame->pitch/offset are used as given, or filled for a tightly packed layout if frame->pitch[0] is 0.
+     * frame->size is the size of frame->data in bytes, the layout must fit in it.
+     * if frame->data is NULL, the decoded surface is mapped and returned without copy (frame->own is false),
+     * the surface is held until client returns the frame by renderDone(VideoFrameRawData*).
+     * </pre>
+     * @param[in] draining drain out all possible frames or not. it is set to true upon EOS.
+     * @return RENDER_SUCCESS for success
+     * @return RENDER_NO_AVAILABLE_FRAME when no available frame
+     * @return RENDER_INVALID_PARAMETER when raw output is not enabled or the layout is not supported
+     * @return RENDER_FAIL when the surface can't be mapped
+     */
+    virtual Decode_Status getOutput(VideoFrameRawData* frame, bool draining = false) = 0;
+    /// return a frame got by getOutput(VideoFrameRawData*) in mapped mode
+    virtual void renderDone(VideoFrameRawData* frame) = 0;
+    /**
+     * \brief export a frame got from getOutput() as dma-buf, for zero copy sharing with other devices.
+     * the fd and layout in @param dmaBuf stay valid until client returns @param buffer by renderDone(),
+     * which closes the fd; client must not close it, and should dup() it to keep the buffer longer.
+     * exporting the same frame again returns the same fd.
+     * @return RENDER_SUCCESS for success
+     * @return RENDER_INVALID_PARAMETER if the buffer is not an output frame
+     * @return RENDER_FAIL when driver can't export the surface
+     */
+    virtual Decode_Status exportFrame(const VideoRenderBuffer* buffer, VideoFrameDmaBuf* dmaBuf) = 0;
 
     /// todo: move the x_display to VideoConfigBuffer and mark this API as obsolete
     virtual void  setXDisplay(Display * x_display) = 0;
@@ -56,7 +56,7 @@ enum VideoOutputFormat {
     OUTPUT_EVERYTHING = 0,      //Output whatever driver generates
     OUTPUT_CODEC_DATA = 1,      // codec data for mp4, similar to avcc format
     OUTPUT_FRAME_DATA = 2,      //Equal to OUTPUT_EVERYTHING when no header along with the frame data
-    OUTPUT_ONE_NAL = 4,
+    OUTPUT_ONE_NAL = 4,         // one NAL (sps, pps or slice) each call, PARTIALFRAME flag is set until the last one
     OUTPUT_ONE_NAL_WITHOUT_STARTCODE = 8,
     OUTPUT_LENGTH_PREFIXED = 16,
     OUTPUT_STREAM_HEADER = 32,       // sps/pss in bytestream format OUTPUT_EVERYTHING = OUTPUT_STREAM_HEADER (if needed) + OUTPUT_FRAME_DATA;
@@ -139,13 +139,38 @@ struct VideoEncOutputBuffer {
     uint32_t flag;                   //Key frame, Codec Data etc
     VideoOutputFormat format;   //output format
     uint64_t timeStamp;         //reserved
+    uint32_t temporalId;        //temporal layer of the frame, 0 is base layer, see VideoParamsAVC
 
      VideoEncOutputBuffer():data(0), bufferSize(0), dataSize(0)
-    , remainingSize(0), flag(0), format(OUTPUT_BUFFER_LAST), timeStamp(0) {
+    , remainingSize(0), flag(0), format(OUTPUT_BUFFER_LAST), timeStamp(0)
+    , temporalId(0) {
     };
 };
 
+/// one piece of coded data in driver memory, pieces are chained by next
+struct VideoEncCodedSegment {
+    uint8_t *data;
+    uint32_t size;
+    VideoEncCodedSegment *next;
+};
+
+/// coded frame returned by IVideoEncoder::getMappedOutput without copy,
+/// it's valid until client calls IVideoEncoder::releaseMappedOutput
+struct VideoEncMappedBuffer {
+    const VideoEncCodedSegment *segments;
+    uint32_t dataSize;          //total size of all segments
+    uint32_t flag;
+    uint64_t timeStamp;
+    uint32_t temporalId;        //temporal layer of the frame, 0 is base layer
+    intptr_t handle;            //private, used by encoder for release
+
+     VideoEncMappedBuffer():segments(0), dataSize(0), flag(0),
+        timeStamp(0), temporalId(0), handle(0) {
+}};
+
 struct VideoEncRawBuffer {
+    // NV12 frame; in BUFFER_SHARING_KBUFHANDLE mode it carries the dma-buf fd,
+    // in BUFFER_SHARING_USRPTR mode a page aligned pointer (see VideoParamsUpstreamBuffer)
     uint8_t *data;
     uint32_t size;
     bool bufAvailable;          //To indicate whether this buffer can be reused
@@ -225,10 +250,13 @@ struct VideoRateControlParams {
     uint32_t targetPercentage;
     uint32_t disableFrameSkip;
     uint32_t disableBitsStuffing;
+    // software rate control with RATE_CONTROL_CQP: frames analysed before encoding, 0 to disable.
+    // qp is picked per frame to meet bitRate, scene cuts become IDR frames.
+    uint32_t lookAhead;
 
      VideoRateControlParams():bitRate(0), initQP(0), minQP(0)
     , windowSize(0), targetPercentage(0)
-    , disableFrameSkip(0), disableBitsStuffing(0) {
+    , disableFrameSkip(0), disableBitsStuffing(0), lookAhead(0) {
     };
 
     VideoRateControlParams & operator=(const VideoRateControlParams &
@@ -243,6 +271,7 @@ struct VideoRateControlParams {
         this->targetPercentage = other.targetPercentage;
         this->disableFrameSkip = other.disableFrameSkip;
         this->disableBitsStuffing = other.disableBitsStuffing;
+        this->lookAhead = other.lookAhead;
         return *this;
     };
 };
@@ -332,6 +361,9 @@ enum VideoParamConfigType {
     VideoConfigTypeNALSize,
     VideoConfigTypeIDRRequest,
     VideoConfigTypeSliceNum,
+    VideoParamsTypeStatisticsCallback,
+    VideoParamsTypeJPEG,
+    VideoParamsTypeVP8,
 
     VideoParamsConfigExtension
 };
@@ -368,12 +400,19 @@ struct VideoParamsCommon:VideoParamConfigSet {
     int32_t intraPeriod;
     VideoRateControl rcMode;
     VideoRateControlParams rcParams;
+    //VIDEO_ENC_CIR/BOTH is gradual decoder refresh: every macroblock is intra coded
+    //once in cyclicFrameInterval frames, and it replaces periodic key frames.
+    //the first frame of each cycle comes with sps/pps and is flagged ENCODE_BUFFERFLAG_SYNCFRAME
     VideoIntraRefreshType refreshType;
     int32_t cyclicFrameInterval;
     AirParams airParams;
     uint32_t disableDeblocking;
     bool syncEncMode;
     int32_t leastInputCount;
+    // max time getOutput(withWait = true) blocks, in milliseconds.
+    // 0 blocks until a frame is ready, end of stream or flush, so a client which stops
+    // encoding without ending the stream must call flush() to release a blocked getOutput().
+    uint32_t outputTimeout;
 
     VideoParamsCommon()
     :VideoParamConfigSet(VideoParamsTypeCommon, sizeof(VideoParamsCommon))
@@ -389,7 +428,8 @@ struct VideoParamsCommon:VideoParamConfigSet {
     , airParams()
     , disableDeblocking(0)
     , syncEncMode(true)
-    , leastInputCount(3) {
+    , leastInputCount(3)
+    , outputTimeout(0) {
     };
 
     VideoParamsCommon & operator=(const VideoParamsCommon & other) {
@@ -410,6 +450,7 @@ struct VideoParamsCommon:VideoParamConfigSet {
         this->airParams = other.airParams;
         this->disableDeblocking = other.disableDeblocking;
         this->syncEncMode = other.syncEncMode;
+        this->outputTimeout = other.outputTimeout;
         return *this;
     }
 };
@@ -424,6 +465,11 @@ struct VideoParamsAVC:VideoParamConfigSet {
     AVCDelimiterType delimiterType;
     Cropping crop;
     SamplingAspectRatio SAR;
+    uint32_t bFrameNum;         //B frames between two I/P frames, 0 for I/P only gop
+    bool bPyramid;              //use the middle B frame as reference of other B frames
+    //hierarchical P layers, 1 for none and up to 4. frames of top layers can be dropped,
+    //2 layers: 0 1 0 1 ..., 3 layers: 0 2 1 2 0 ..., 4 layers: 0 3 2 3 1 3 2 3 0 ...
+    uint32_t temporalLayers;
 
      VideoParamsAVC()
     :VideoParamConfigSet(VideoParamsTypeAVC, sizeof(VideoParamsAVC))
@@ -434,7 +480,10 @@ struct VideoParamsAVC:VideoParamConfigSet {
     , sliceNum()
     , delimiterType(AVC_DELIMITER_ANNEXB)
     , crop()
-    , SAR() {
+    , SAR()
+    , bFrameNum(0)
+    , bPyramid(false)
+    , temporalLayers(1) {
     };
 
     VideoParamsAVC & operator=(const VideoParamsAVC & other) {
@@ -454,11 +503,21 @@ struct VideoParamsAVC:VideoParamConfigSet {
         this->crop.BottomOffset = other.crop.BottomOffset;
         this->SAR.SarWidth = other.SAR.SarWidth;
         this->SAR.SarHeight = other.SAR.SarHeight;
+        this->bFrameNum = other.bFrameNum;
+        this->bPyramid = other.bPyramid;
+        this->temporalLayers = other.temporalLayers;
 
         return *this;
     }
 };
 
+// share client buffers with encoder instead of copying them.
+// BUFFER_SHARING_KBUFHANDLE: VideoEncRawBuffer::data is a dma-buf fd, the fd must stay valid while the mode is set.
+// BUFFER_SHARING_USRPTR: VideoEncRawBuffer::data is page aligned memory, see VideoParamsUsrptrBuffer.
+// bufAttrib gives the plane layout (lumaStride, chromStride, realHeight is the luma plane height).
+// the buffer is imported once and cached by handle; it's read by gpu until IVideoEncoder::getReleasedInput returns it.
+// a dma-buf fd reused for another buffer is detected and imported again. a user pointer can't be checked that way,
+// set this parameter again after freeing user pointer buffers, it drops the cache.
 struct VideoParamsUpstreamBuffer:VideoParamConfigSet {
 
     VideoParamsUpstreamBuffer()
@@ -478,6 +537,8 @@ struct VideoParamsUpstreamBuffer:VideoParamConfigSet {
     void *display;
 };
 
+// getParameters with this type allocates a page aligned NV12 buffer suitable for zero copy encoding.
+// the memory is owned by encoder and lives until encoder is released.
 struct VideoParamsUsrptrBuffer:VideoParamConfigSet {
 
     VideoParamsUsrptrBuffer()
@@ -607,14 +668,97 @@ struct VideoConfigSliceNum:VideoParamConfigSet {
     SliceNum sliceNum;
 };
 
+// coded frames of one picture type
+typedef struct {
+    uint32_t frames;
+    uint64_t total_size;        // in bytes
+    uint32_t max_size;
+    uint32_t average_qp;        // 0 if qp is chosen by driver rate control
+} VideoFrameTypeStatistics;
+
+// all times are in microseconds, frame numbers are in coding order
 typedef struct {
     uint32_t total_frames;
     uint32_t skipped_frames;
-    uint32_t average_encode_time;
-    uint32_t max_encode_time;
-    uint32_t max_encode_frame;
-    uint32_t min_encode_time;
-    uint32_t min_encode_frame;
+    // from submitting a frame to hardware until its output is synced for client, so it includes
+    // hardware encode time and the time the frame waits for getOutput() in output queue
+    uint32_t average_latency;
+    uint32_t max_latency;
+    uint32_t max_latency_frame;
+    uint32_t min_latency;
+    uint32_t min_latency_frame;
+    // from encode() until the frame is submitted, time held by look-ahead and B frame reordering
+    uint32_t average_wait_time;
+    uint32_t max_wait_time;
+    // frames submitted but not yet returned to client
+    uint32_t queue_depth;
+    uint32_t max_queue_depth;
+    VideoFrameTypeStatistics frame_types[3];    // I, P, B
 } VideoStatistics;
+
+// one coded frame, reported by VideoFrameStatisticsCallback when the frame is returned to client
+typedef struct {
+    uint32_t frame_num;         // coding order
+    int64_t timeStamp;
+    uint32_t type;              // 0: I, 1: P, 2: B
+    uint32_t size;
+    uint32_t qp;
+    uint32_t wait_time;
+    uint32_t latency;
+    uint32_t queue_depth;       // frames in flight when this one was submitted
+} VideoFrameStatistics;
+
+// called in getOutput thread, keep it short
+typedef void (*VideoFrameStatisticsCallback)(void* user, const VideoFrameStatistics*);
+
+struct VideoParamsStatisticsCallback:VideoParamConfigSet {
+
+    VideoParamsStatisticsCallback()
+    :VideoParamConfigSet(VideoParamsTypeStatisticsCallback,
+                         sizeof(VideoParamsStatisticsCallback))
+    , callback(NULL), user(NULL) {
+    }
+    VideoFrameStatisticsCallback callback;    // NULL to disable
+    void* user;
+};
+
+// jpeg encoder, every frame is a baseline jpeg image, mime type "image/jpeg"
+struct VideoParamsJPEG:VideoParamConfigSet {
+
+    VideoParamsJPEG()
+    :VideoParamConfigSet(VideoParamsTypeJPEG, sizeof(VideoParamsJPEG))
+    , quality(50), restartInterval(0), jfifHeader(true) {
+    }
+    uint32_t quality;           // 1 to 100, scales the default quantization tables like libjpeg
+    uint32_t restartInterval;   // MCUs between restart markers, 0 for none
+    bool jfifHeader;            // write APP0 JFIF marker after SOI
+};
+
+typedef enum {
+    VP8_ALTREF_KEY_FRAME_ONLY = 0,  // alt ref frame is refreshed by key frames only
+    VP8_ALTREF_PREVIOUS_GOLDEN,     // alt ref frame takes the old golden frame when golden is refreshed
+} VP8AltRefPolicy;
+
+// vp8 encoder, mime type "video/x-vnd.on2.vp8". key frame interval is VideoParamsCommon::intraPeriod
+struct VideoParamsVP8:VideoParamConfigSet {
+
+    VideoParamsVP8()
+    :VideoParamConfigSet(VideoParamsTypeVP8, sizeof(VideoParamsVP8))
+    , goldenFramePeriod(0), altRefPolicy(VP8_ALTREF_KEY_FRAME_ONLY)
+    , errorResilient(false), temporalLayers(1)
+    , loopFilterLevel(0), sharpnessLevel(0), ivfContainer(false) {
+    }
+    uint32_t goldenFramePeriod;     // refresh golden frame every n frames, 0 for key frames only
+    VP8AltRefPolicy altRefPolicy;
+    bool errorResilient;            // entropy probabilities don't go across frames, a lost frame doesn't corrupt later ones
+    //1 for none and up to 4, same layering as VideoParamsAVC::temporalLayers.
+    //lower layers own last, golden and alt ref frames in turn, it overrides golden/alt ref refresh
+    uint32_t temporalLayers;
+    uint32_t loopFilterLevel;       // 0 to 63
+    uint32_t sharpnessLevel;        // 0 to 7
+    //getOutput() writes ivf file header for OUTPUT_STREAM_HEADER and before the first frame of OUTPUT_EVERYTHING,
+    //and ivf frame header before each frame. getMappedOutput() always gives raw frames.
+    bool ivfContainer;
+};
 }
 #endif                          /*  __VIDEO_ENCODER_DEF_H__ */
@@ -37,6 +37,15 @@ YamiMediaCodec::IVideoEncoder *createVideoEncoder(const char *mimeType);
 */
 void releaseVideoEncoder(YamiMediaCodec::IVideoEncoder * p);
 
+/** \fn IVideoEncodeSession *createVideoEncodeSession()
+ * \brief create a session to encode one input to several outputs
+*/
+YamiMediaCodec::IVideoEncodeSession *createVideoEncodeSession();
+/** \fn void releaseVideoEncodeSession(IVideoEncodeSession *p)
+ * \brief destroy session and its outputs
+*/
+void releaseVideoEncodeSession(YamiMediaCodec::IVideoEncodeSession * p);
+
 /** \fn void preSandboxInitEncoder()
  * \brief when yami runs inside sandbox, some necessary work goes here before enter sanbox
  * usually, nothing special is required  except when yami dlopen thirty party libraries.
@@ -47,8 +56,17 @@ void releaseVideoEncoder(YamiMediaCodec::IVideoEncoder * p);
  */
 bool preSandboxInitEncoder();
 
+/** \fn void setMaxContextsPerDisplay(uint32_t maxContexts)
+ * \brief limit the contexts living on one VA display, decoders and encoders sharing
+ * the display count together. a session asking for more fails to start. 0 means no limit.
+ */
+void setMaxContextsPerDisplay(uint32_t maxContexts);
+
 typedef YamiMediaCodec::IVideoEncoder *(*YamiCreateVideoEncoderFuncPtr) (const char *mimeType);
 typedef void (*YamiReleaseVideoEncoderFuncPtr)(YamiMediaCodec::IVideoEncoder * p);
 typedef bool (*YamiPreSandboxInitEncoder)();
+typedef void (*YamiSetMaxContextsPerDisplayFuncPtr)(uint32_t maxContexts);
+typedef YamiMediaCodec::IVideoEncodeSession *(*YamiCreateVideoEncodeSessionFuncPtr) ();
+typedef void (*YamiReleaseVideoEncodeSessionFuncPtr)(YamiMediaCodec::IVideoEncodeSession * p);
 }
 #endif                          /* VIDEO_ENCODER_HOST_H_ */
@@ -44,12 +44,15 @@ class IVideoEncoder {
     /// stop encoding and destroy encoder context.
     virtual Encode_Status stop(void) = 0;
 
-    /// continue encoding with new data in @param[in] inBuffer
+    /// continue encoding with new data in @param[in] inBuffer.
+    /// an inBuffer without data (data is NULL and size is 0) ends the stream, frames held for B frame reordering are encoded.
     virtual Encode_Status encode(VideoEncRawBuffer * inBuffer) = 0;
     /**
      * \brief return one frame encoded data to client;
      * when withWait is false, ENCODE_BUFFER_NO_MORE will be returned if there is no available frame. \n
-     * when withWait is true, function call is block until there is one frame available. \n
+     * when withWait is true, function call is block until there is one frame available, the stream is ended
+     * by an empty encode() buffer, or flush() is called; VideoParamsCommon::outputTimeout limits the wait,
+     * without it the call blocks until one of them happens. \n
      * typically, getOutput() is called in a separate thread (than encoding thread), this thread sleeps when
      * there is no output available when withWait is true. \n
      *
@@ -57,11 +60,37 @@ class IVideoEncoder {
      * param [in/out] when there is no output data available, wait or not
      */
     virtual Encode_Status getOutput(VideoEncOutputBuffer * outBuffer, bool withWait = false) const = 0;
+    /**
+     * \brief return one encoded frame without copy, the data stays in driver memory as a segment chain.
+     * <pre>
+     * it returns frame data only, get stream header by getOutput() with OUTPUT_STREAM_HEADER or OUTPUT_CODEC_DATA
+     * before this call, if it is needed.
+     * the segments are valid until client calls releaseMappedOutput(), and encoder counts unreleased frames as busy.
+     * </pre>
+     * @return ENCODE_SUCCESS for success
+     * @return ENCODE_BUFFER_NO_MORE if there is no available frame
+     */
+    virtual Encode_Status getMappedOutput(VideoEncMappedBuffer * outBuffer, bool withWait = false) = 0;
+    /// return a frame got by getMappedOutput() to encoder
+    virtual void releaseMappedOutput(VideoEncMappedBuffer * outBuffer) = 0;
+    /**
+     * \brief get an imported input buffer the encoder is done with.
+     * <pre>
+     * in BUFFER_SHARING_KBUFHANDLE and BUFFER_SHARING_USRPTR mode gpu reads client buffer directly,
+     * encode() clears VideoEncRawBuffer::bufAvailable and client must not write the buffer until it comes back here.
+     * a buffer comes back once for each encode() call, when its frame is output (or dropped by flush/stop).
+     * </pre>
+     * @param [out] inBuffer data is the fd or pointer given to encode(), bufAvailable is true.
+     * @return ENCODE_SUCCESS for a released buffer
+     * @return ENCODE_BUFFER_NO_MORE if no buffer is released since last call
+     */
+    virtual Encode_Status getReleasedInput(VideoEncRawBuffer * inBuffer) = 0;
     /// get encoder params, some config parameter are updated basing on sw/hw implement limition.
     /// for example, update pitches basing on hw alignment
     virtual Encode_Status getParameters(VideoParamConfigSet * videoEncParams) = 0;
     /// set encoder params before start. \n
-    /// update rate controls on the fly by VideoParamsTypeRatesControl/VideoParamsRatesControl. SPS updates accordingly.
+    /// update rate controls on the fly by VideoConfigTypeBitRate/VideoConfigTypeFrameRate, they apply from next frame.
+    /// VideoConfigTypeResolution on the fly encodes frames already given, then restarts with an IDR in new resolution.
     virtual Encode_Status setParameters(VideoParamConfigSet * videoEncParams) = 0;
     /// get max coded buffer size.
     virtual Encode_Status getMaxOutSize(uint32_t * maxSize) = 0;
@@ -77,5 +106,38 @@ class IVideoEncoder {
     virtual Encode_Status setConfig(VideoParamConfigSet * videoEncConfig) = 0;
 
 };
+
+/**
+ * \class IVideoEncodeSession
+ * \brief encode one input to several outputs, for example renditions of an ABR ladder
+ * <pre>
+ * the input is uploaded to gpu once, all outputs share one display.
+ * outputs with the input resolution encode the input surface itself, others encode a copy scaled by vpp.
+ * input surfaces are reference counted, a surface is reused after all outputs are done with it.
+ * outputs are IVideoEncoder owned by the session, set their parameters and call getOutput() on them as usual,
+ * but leave encode(), start() and stop() to the session.
+ * </pre>
+ */
+class IVideoEncodeSession {
+  public:
+    virtual ~ IVideoEncodeSession() {}
+    ///set external display
+    virtual void setXDisplay(Display * xdisplay) = 0;
+    ///resolution of NV12 input in system memory, call it before start
+    virtual Encode_Status setInputResolution(uint32_t width, uint32_t height) = 0;
+    ///add an output encoder for @mimeType before start, NULL if it's not supported
+    virtual IVideoEncoder *addOutput(const char *mimeType) = 0;
+    ///start all outputs
+    virtual Encode_Status start(void) = 0;
+    ///stop all outputs
+    virtual Encode_Status stop(void) = 0;
+    /// feed one input frame to all outputs, or end the stream of all outputs with an empty buffer.
+    /// ENCODE_IS_BUSY if an output is busy, nothing is encoded then; client should get output and try again.
+    /// input is scaled for all outputs before any of them encodes, a scaling failure encodes nothing either.
+    /// if an output fails to encode the frame, all outputs are flushed and restart from a key frame on next encode().
+    virtual Encode_Status encode(VideoEncRawBuffer * inBuffer) = 0;
+    ///discard frames in all outputs
+    virtual void flush(void) = 0;
+};
 }
 #endif                          /* VIDEO_ENCODER_INTERFACE_H_ */
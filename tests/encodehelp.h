@@ -35,10 +35,20 @@ static void print_help(const char* app)
     printf("   -o <coded file> optional\n");
     printf("   -b <bitrate> optional\n");
     printf("   -f <frame rate> optional\n");
-    printf("   -c <codec: AVC|VP8|JPEG> Note: not support now\n");
+    printf("   -c <codec: AVC|VP8|JPEG> optional, AVC by default. VP8 is written in ivf, JPEG frames one after another\n");
     printf("   -s <fourcc: NV12|IYUV|YV12> Note: not support now\n");
 }
 
+static bool isJpegCodec()
+{
+    return codec && !strcasecmp(codec, "JPEG");
+}
+
+static bool isVP8Codec()
+{
+    return codec && !strcasecmp(codec, "VP8");
+}
+
 static bool process_cmdline(int argc, char *argv[])
 {
     char opt;
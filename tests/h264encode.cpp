@@ -187,6 +187,14 @@ void setEncoderParameters(VideoParamsCommon * encVideoParams)
     encVideoParams->rawFormat = RAW_FORMAT_YUV420;
 
     encVideoParams->level = 31;
+
+    //jpeg is coded by quality, see VideoParamsJPEG
+    if (isJpegCodec()) {
+        encVideoParams->profile = VAProfileJPEGBaseline;
+        encVideoParams->rcMode = RATE_CONTROL_NONE;
+    }
+    if (isVP8Codec())
+        encVideoParams->profile = VAProfileVP8Version0_3;
 }
 
 int main(int argc, char** argv)
@@ -208,7 +216,16 @@ int main(int argc, char** argv)
     }
 
     x11Display = XOpenDisplay(NULL);
-    encoder = createVideoEncoder("video/h264");
+    if (isJpegCodec())
+        encoder = createVideoEncoder("image/jpeg");
+    else if (isVP8Codec())
+        encoder = createVideoEncoder("video/x-vnd.on2.vp8");
+    else
+        encoder = createVideoEncoder("video/h264");
+    if (!encoder) {
+        fprintf (stderr, "fail to create encoder\n");
+        return -1;
+    }
     encoder->setXDisplay(x11Display);
 
     //configure encoding parameters
@@ -216,6 +233,12 @@ int main(int argc, char** argv)
     encoder->getParameters(&encVideoParams);
     setEncoderParameters(&encVideoParams);
     encoder->setParameters(&encVideoParams);
+    if (isVP8Codec()) {
+        VideoParamsVP8 vp8Params;
+        encoder->getParameters(&vp8Params);
+        vp8Params.ivfContainer = true;
+        encoder->setParameters(&vp8Params);
+    }
     status = encoder->start();
 
     //init output buffer
@@ -240,6 +263,16 @@ int main(int argc, char** argv)
         } while (status != ENCODE_BUFFER_NO_MORE);
     }
 
+    // tell encoder no more input, it encodes frames held for reordering
+    VideoEncRawBuffer eosBuffer;
+    do {
+        status = encoder->encode(&eosBuffer);
+        if (status == ENCODE_IS_BUSY
+            && encoder->getOutput(&output.outputBuffer, false) == ENCODE_SUCCESS
+            && !output.writeOneOutputFrame())
+            assert(0);
+    } while (status == ENCODE_IS_BUSY);
+
     // drain the output buffer
     do {
        status = encoder->getOutput(&output.outputBuffer, true);
@@ -247,6 +280,12 @@ int main(int argc, char** argv)
            assert(0);
     } while (status != ENCODE_BUFFER_NO_MORE);
 
+    VideoStatistics stat;
+    if (encoder->getStatistics(&stat) == ENCODE_SUCCESS)
+        fprintf(stderr, "%d frames, latency avg %d max %d us, wait time avg %d us, max queue depth %d\n",
+                stat.total_frames, stat.average_latency, stat.max_latency,
+                stat.average_wait_time, stat.max_queue_depth);
+
     encoder->stop();
     releaseVideoEncoder(encoder);
 
@@ -76,11 +76,15 @@ ContextPtr VaapiContext::create(const ConfigPtr& config,
     }
     VAStatus vaStatus;
     VAContextID context;
+    if (!config->m_display->acquireContext())
+        return ret;
     vaStatus = vaCreateContext(config->m_display->getID(), config->m_config,
                                width, height, flag,
                                render_targets, num_render_targets, &context);
-    if (!checkVaapiStatus(vaStatus, "vaCreateContext "))
+    if (!checkVaapiStatus(vaStatus, "vaCreateContext ")) {
+        config->m_display->releaseContext();
         return ret;
+    }
     ret.reset(new VaapiContext(config, context));
     return ret;
 }
@@ -93,4 +97,5 @@ VaapiContext::VaapiContext(const ConfigPtr& config, VAContextID context)
 VaapiContext::~VaapiContext()
 {
     vaDestroyContext(m_config->m_display->getID(), m_context);
+    m_config->m_display->releaseContext();
 }
@@ -28,10 +28,16 @@
 #include "common/log.h"
 #include "vaapi/vaapiutils.h"
 #include <list>
+#include <assert.h>
 
 using std::tr1::shared_ptr;
 using std::tr1::weak_ptr;
 using std::list;
+using YamiMediaCodec::AutoLock;
+
+//keep at most this many released surfaces around for the next session
+static const size_t MAX_IDLE_SURFACES = 64;
+static const uint64_t MAX_IDLE_SURFACE_BYTES = 128 << 20;
 
 //helper function
 static bool vaInit(VADisplay vaDisplay)
@@ -111,6 +117,7 @@ VaapiX11Display::VaapiX11Display(const XDisplayPtr& xDisplay, VADisplay vaDispla
 
 VaapiX11Display::~VaapiX11Display()
 {
+    destroyIdleSurfaces();
     vaTerminate(m_display);
 }
 
@@ -138,6 +145,20 @@ bool VaapiX11Display::setRotation(int degree)
 
 
 
+//deleter of a session handle, the real display stays in cache
+struct DisplaySessionRelease
+{
+    DisplaySessionRelease(const DisplayPtr& display) : m_display(display) {}
+    void operator()(VaapiDisplay*) { m_display->releaseSession(); }
+    DisplayPtr m_display;
+
+    static DisplayPtr createSession(const DisplayPtr& display)
+    {
+        display->acquireSession();
+        return DisplayPtr(display.get(), DisplaySessionRelease(display));
+    }
+};
+
 //display cache
 class DisplayCache
 {
@@ -145,21 +166,35 @@ public:
     static shared_ptr<DisplayCache> getInstance();
     template <typename UserData>
     DisplayPtr createDisplay(DisplayPtr (*create)(UserData), const UserData& data);
+    void setMaxContexts(uint32_t maxContexts);
 
     ~DisplayCache() { pthread_mutex_destroy(&m_lock); }
 private:
-    DisplayCache() { pthread_mutex_init(&m_lock, NULL);}
+    DisplayCache() : m_maxContexts(0) { pthread_mutex_init(&m_lock, NULL);}
+    static void init();
 
+    //a display lives as long as one session holds it, sessions created meanwhile
+    //reuse it instead of paying vaInitialize again.
     list<weak_ptr<VaapiDisplay> > m_cache;
+    uint32_t m_maxContexts;
     pthread_mutex_t m_lock;
+
+    static shared_ptr<DisplayCache> s_instance;
+    static pthread_once_t s_once;
 };
 
+shared_ptr<DisplayCache> DisplayCache::s_instance;
+pthread_once_t DisplayCache::s_once = PTHREAD_ONCE_INIT;
+
+void DisplayCache::init()
+{
+    s_instance.reset(new DisplayCache);
+}
+
 shared_ptr<DisplayCache> DisplayCache::getInstance()
 {
-    static shared_ptr<DisplayCache> cache;
-    if (!cache)
-        cache.reset(new DisplayCache);
-    return cache;
+    pthread_once(&s_once, init);
+    return s_instance;
 }
 
 bool expired(const weak_ptr<VaapiDisplay>& weak)
@@ -178,7 +213,8 @@ DisplayPtr DisplayCache::createDisplay(DisplayPtr (*create)(UserData), const Use
     list<weak_ptr<VaapiDisplay> >::iterator it;
     for (it = m_cache.begin(); it != m_cache.end(); ++it) {
         display = (*it).lock();
-        if (display->isCompatible(data)) {
+        if (display && display->isCompatible(data)) {
+            display = DisplaySessionRelease::createSession(display);
             pthread_mutex_unlock(&m_lock);
             return display;
         }
@@ -189,19 +225,171 @@ DisplayPtr DisplayCache::createDisplay(DisplayPtr (*create)(UserData), const Use
     if (display) {
         weak_ptr<VaapiDisplay> weak(display);
         m_cache.push_back(weak);
+        display->setMaxContexts(m_maxContexts);
+        display = DisplaySessionRelease::createSession(display);
     }
     pthread_mutex_unlock(&m_lock);
     return display;
 }
 
+void DisplayCache::setMaxContexts(uint32_t maxContexts)
+{
+    pthread_mutex_lock(&m_lock);
+    m_maxContexts = maxContexts;
+    list<weak_ptr<VaapiDisplay> >::iterator it;
+    for (it = m_cache.begin(); it != m_cache.end(); ++it) {
+        DisplayPtr display = (*it).lock();
+        if (display)
+            display->setMaxContexts(maxContexts);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+VaapiDisplay::VaapiDisplay(VADisplay vaDisplay)
+:m_display(vaDisplay), m_contextCount(0), m_maxContexts(0), m_sessionCount(0), m_idleBytes(0)
+{
+}
+
+void VaapiDisplay::setMaxContexts(uint32_t maxContexts)
+{
+    AutoLock lock(m_lock);
+    m_maxContexts = maxContexts;
+}
 
 bool VaapiDisplay::setRotation(int degree)
 {
     return true;
 }
 
+bool VaapiDisplay::acquireContext()
+{
+    AutoLock lock(m_lock);
+    if (m_maxContexts && m_contextCount >= m_maxContexts) {
+        ERROR("too many contexts on display, limit is %d", m_maxContexts);
+        return false;
+    }
+    m_contextCount++;
+    return true;
+}
+
+void VaapiDisplay::releaseContext()
+{
+    AutoLock lock(m_lock);
+    assert(m_contextCount);
+    m_contextCount--;
+}
+
+void VaapiDisplay::acquireSession()
+{
+    AutoLock lock(m_lock);
+    m_sessionCount++;
+}
+
+void VaapiDisplay::releaseSession()
+{
+    {
+        AutoLock lock(m_lock);
+        assert(m_sessionCount);
+        if (--m_sessionCount)
+            return;
+    }
+    //surfaces hold the session, so all of them are back here
+    destroyIdleSurfaces();
+}
+
+static uint64_t surfaceBytes(uint32_t rtFormat, uint32_t fourcc, uint32_t width, uint32_t height)
+{
+    uint64_t pixels = (uint64_t)width * height;
+
+    if (fourcc == VA_FOURCC('B', 'G', 'R', 'A') || fourcc == VA_FOURCC('B', 'G', 'R', 'X')
+        || fourcc == VA_FOURCC('R', 'G', 'B', 'A') || fourcc == VA_FOURCC('R', 'G', 'B', 'X'))
+        return pixels * 4;
+    if (fourcc == VA_FOURCC('Y', 'U', 'Y', '2') || fourcc == VA_FOURCC('U', 'Y', 'V', 'Y'))
+        return pixels * 2;
+    if (rtFormat == VA_RT_FORMAT_YUV444)
+        return pixels * 3;
+    if (rtFormat == VA_RT_FORMAT_YUV422)
+        return pixels * 2;
+    return pixels * 3 / 2;
+}
+
+bool VaapiDisplay::allocSurface(uint32_t rtFormat, uint32_t fourcc, uint32_t width, uint32_t height, VASurfaceID& id)
+{
+    {
+        AutoLock lock(m_lock);
+        list<IdleSurface>::iterator it;
+        for (it = m_idleSurfaces.begin(); it != m_idleSurfaces.end(); ++it) {
+            if (it->rtFormat == rtFormat && it->fourcc == fourcc
+                && it->width == width && it->height == height) {
+                id = it->id;
+                m_idleBytes -= it->bytes;
+                m_idleSurfaces.erase(it);
+                return true;
+            }
+        }
+    }
+
+    VASurfaceAttrib attrib;
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = fourcc;
+    VAStatus status = vaCreateSurfaces(m_display, rtFormat, width, height,
+                                       &id, 1, fourcc ? &attrib : NULL, fourcc ? 1 : 0);
+    return checkVaapiStatus(status, "vaCreateSurfaces()");
+}
+
+void VaapiDisplay::freeSurface(uint32_t rtFormat, uint32_t fourcc, uint32_t width, uint32_t height, VASurfaceID id)
+{
+    VAStatus status;
+    IdleSurface idle;
+
+    idle.rtFormat = rtFormat;
+    idle.fourcc = fourcc;
+    idle.width = width;
+    idle.height = height;
+    idle.bytes = surfaceBytes(rtFormat, fourcc, width, height);
+    idle.id = id;
+
+    AutoLock lock(m_lock);
+    if (idle.bytes > MAX_IDLE_SURFACE_BYTES) {
+        status = vaDestroySurfaces(m_display, &id, 1);
+        checkVaapiStatus(status, "vaDestroySurfaces()");
+        return;
+    }
+    //make room by dropping the oldest ones
+    while (m_idleSurfaces.size() >= MAX_IDLE_SURFACES
+           || m_idleBytes + idle.bytes > MAX_IDLE_SURFACE_BYTES) {
+        IdleSurface& oldest = m_idleSurfaces.front();
+        status = vaDestroySurfaces(m_display, &oldest.id, 1);
+        checkVaapiStatus(status, "vaDestroySurfaces()");
+        m_idleBytes -= oldest.bytes;
+        m_idleSurfaces.pop_front();
+    }
+    m_idleSurfaces.push_back(idle);
+    m_idleBytes += idle.bytes;
+}
+
+void VaapiDisplay::destroyIdleSurfaces()
+{
+    AutoLock lock(m_lock);
+    list<IdleSurface>::iterator it;
+    for (it = m_idleSurfaces.begin(); it != m_idleSurfaces.end(); ++it)
+        vaDestroySurfaces(m_display, &it->id, 1);
+    m_idleSurfaces.clear();
+    m_idleBytes = 0;
+}
+
 DisplayPtr VaapiDisplay::create(Display* display)
 {
     return DisplayCache::getInstance()->createDisplay(X11DisplayCreate, display);
 }
 
+extern "C" {
+//declared in VideoDecoderHost.h and VideoEncoderHost.h
+void setMaxContextsPerDisplay(uint32_t maxContexts)
+{
+    DisplayCache::getInstance()->setMaxContexts(maxContexts);
+}
+}
+
@@ -25,6 +25,8 @@
 
 #include "vaapi/vaapiptrs.h"
 #include "vaapi/vaapitypes.h"
+#include "common/lock.h"
+#include <list>
 #include <va/va.h>
 #include <va/va_tpi.h>
 #ifdef HAVE_VA_X11
@@ -35,6 +37,7 @@
 class VaapiDisplay
 {
 friend class DisplayCache;
+friend struct DisplaySessionRelease;
 public:
     //FIXME: add more create functions.
     static DisplayPtr create(Display*);
@@ -43,12 +46,52 @@ public:
 
     VADisplay getID() const { return m_display; }
 
+    /// all sessions share one display, so contexts are accounted here.
+    bool acquireContext();
+    void releaseContext();
+
+    /// surfaces released by one session are kept for the next session
+    /// asking for the same format, fourcc and size, instead of vaDestroySurfaces.
+    /// fourcc 0 means driver picks it, or a VASurfaceAttribPixelFormat otherwise.
+    /// idle surfaces are limited by count and bytes, and destroyed once no session
+    /// holds the display.
+    bool allocSurface(uint32_t rtFormat, uint32_t fourcc, uint32_t width, uint32_t height, VASurfaceID& id);
+    void freeSurface(uint32_t rtFormat, uint32_t fourcc, uint32_t width, uint32_t height, VASurfaceID id);
+
+    virtual ~VaapiDisplay() {}
+
 protected:
     /// for display cache management.
     virtual bool isCompatible(const Display*) {return false;}
 
-    VaapiDisplay(VADisplay vaDisplay):m_display(vaDisplay){}
+    /// must be called before the VADisplay is terminated.
+    void destroyIdleSurfaces();
+
+    VaapiDisplay(VADisplay vaDisplay);
     VADisplay   m_display;
+
+private:
+    struct IdleSurface {
+        uint32_t rtFormat;
+        uint32_t fourcc;
+        uint32_t width;
+        uint32_t height;
+        uint64_t bytes;
+        VASurfaceID id;
+    };
+
+    /// every DisplayPtr handed out by create() is a session
+    void acquireSession();
+    void releaseSession();
+    void setMaxContexts(uint32_t maxContexts);
+
+    YamiMediaCodec::Lock m_lock;
+    uint32_t m_contextCount;
+    uint32_t m_maxContexts;
+    uint32_t m_sessionCount;
+    //oldest first
+    std::list<IdleSurface> m_idleSurfaces;
+    uint64_t m_idleBytes;
     DISALLOW_COPY_AND_ASSIGN(VaapiDisplay);
 };
 
@@ -54,7 +54,12 @@ VaapiImage::VaapiImage(VADisplay display,
     m_format = format;
     m_width = width;
     m_height = height;
+    m_ID = VA_INVALID_ID;
+    m_image.image_id = VA_INVALID_ID;
     m_isMapped = false;
+    m_isExported = false;
+    m_exportedMemType = 0;
+    m_exportedHandle = 0;
 
     vaFormat = (VAImageFormat *) getVaFormat(format);
     if (!vaFormat) {
@@ -70,6 +75,7 @@ VaapiImage::VaapiImage(VADisplay display,
         ERROR("Create image failed");
         return;
     }
+    m_ID = m_image.image_id;
 }
 
 VaapiImage::VaapiImage(VADisplay display, VAImage * image)
@@ -77,10 +83,14 @@ VaapiImage::VaapiImage(VADisplay display, VAImage * image)
     VAStatus status;
 
     m_display = display;
+    m_format = (VaapiImageFormat) image->format.fourcc;
     m_width = image->width;
     m_height = image->height;
     m_ID = image->image_id;
     m_isMapped = false;
+    m_isExported = false;
+    m_exportedMemType = 0;
+    m_exportedHandle = 0;
 
     memcpy((void *) &m_image, (void *) image, sizeof(VAImage));
 }
@@ -93,7 +103,10 @@ VaapiImage::~VaapiImage()
         unmap();
         m_isMapped = false;
     }
+    releaseBufferHandle();
 
+    if (m_image.image_id == VA_INVALID_ID)
+        return;
     status = vaDestroyImage(m_display, m_image.image_id);
 
     if (!checkVaapiStatus(status, "vaDestoryImage()"))
@@ -146,6 +159,42 @@ bool VaapiImage::unmap()
     return true;
 }
 
+bool VaapiImage::acquireBufferHandle(uint32_t memType, uintptr_t& handle)
+{
+    VAStatus status;
+    VABufferInfo info;
+
+    if (m_isExported) {
+        if (m_exportedMemType != memType) {
+            ERROR("image buffer is exported as another memory type already");
+            return false;
+        }
+        handle = m_exportedHandle;
+        return true;
+    }
+    memset(&info, 0, sizeof(info));
+    info.mem_type = memType;
+    status = vaAcquireBufferHandle(m_display, m_image.buf, &info);
+    if (!checkVaapiStatus(status, "vaAcquireBufferHandle()"))
+        return false;
+    handle = info.handle;
+    m_isExported = true;
+    m_exportedMemType = memType;
+    m_exportedHandle = info.handle;
+    return true;
+}
+
+void VaapiImage::releaseBufferHandle()
+{
+    VAStatus status;
+
+    if (!m_isExported)
+        return;
+    status = vaReleaseBufferHandle(m_display, m_image.buf);
+    checkVaapiStatus(status, "vaReleaseBufferHandle()");
+    m_isExported = false;
+}
+
 bool VaapiImage::isMapped()
 {
     return m_isMapped;
@@ -121,6 +121,16 @@ class VaapiImage {
     bool isMapped();
     bool unmap();
 
+    /// export the image buffer to other process/device, memType is
+    /// VA_SURFACE_ATTRIB_MEM_TYPE_*, for example DRM_PRIME for dma-buf fd.
+    /// exporting again with the same memType returns the same handle.
+    /// the handle is owned by driver until releaseBufferHandle().
+    bool acquireBufferHandle(uint32_t memType, uintptr_t& handle);
+    /// no-op if the buffer is not exported
+    void releaseBufferHandle();
+    bool isExported() const { return m_isExported; }
+    const VAImage& getVAImage() const { return m_image; }
+
   private:
     const VAImageFormat *getVaFormat(VaapiImageFormat format);
 
@@ -134,6 +144,9 @@ class VaapiImage {
     VAImage m_image;
     uint8_t *m_data;
     bool m_isMapped;
+    bool m_isExported;
+    uint32_t m_exportedMemType;
+    uintptr_t m_exportedHandle;
     VaapiImageRaw m_rawImage;
 };
 
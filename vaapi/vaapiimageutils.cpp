@@ -0,0 +1,200 @@
+/*
+ *  vaapiimageutils.cpp - helpers to copy mapped VA images to system memory
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vaapiimageutils.h"
+#include "common/log.h"
+#include <string.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_STREAM_LOAD 1
+#include <smmintrin.h>
+#include <pthread.h>
+#endif
+
+#if HAVE_STREAM_LOAD
+//built for sse4.1 regardless of compiler flags, only called after a cpu check
+__attribute__ ((target("sse4.1")))
+static void streamCopy(uint8_t * dst, const uint8_t * src, uint32_t size)
+{
+    //movntdqa needs 16 bytes aligned source
+    uint32_t head = (16 - ((uintptr_t) src & 15)) & 15;
+    if (head > size)
+        head = size;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    __m128i* s = (__m128i*)src;
+    __m128i* d = (__m128i*)dst;
+    uint32_t i = 0;
+
+    _mm_mfence();
+    for (; i + 64 <= size; i += 64) {
+        __m128i x0 = _mm_stream_load_si128(s++);
+        __m128i x1 = _mm_stream_load_si128(s++);
+        __m128i x2 = _mm_stream_load_si128(s++);
+        __m128i x3 = _mm_stream_load_si128(s++);
+        _mm_storeu_si128(d++, x0);
+        _mm_storeu_si128(d++, x1);
+        _mm_storeu_si128(d++, x2);
+        _mm_storeu_si128(d++, x3);
+    }
+    for (; i + 16 <= size; i += 16)
+        _mm_storeu_si128(d++, _mm_stream_load_si128(s++));
+    memcpy(dst + i, src + i, size - i);
+}
+
+static bool s_hasStreamLoad = false;
+static pthread_once_t s_streamLoadOnce = PTHREAD_ONCE_INIT;
+
+static void checkStreamLoad()
+{
+    __builtin_cpu_init();
+    s_hasStreamLoad = __builtin_cpu_supports("sse4.1");
+}
+
+static bool hasStreamLoad()
+{
+    pthread_once(&s_streamLoadOnce, checkStreamLoad);
+    return s_hasStreamLoad;
+}
+#endif
+
+void vaapiCopyFromMapped(uint8_t * dst, const uint8_t * src, uint32_t size)
+{
+#if HAVE_STREAM_LOAD
+    if (hasStreamLoad()) {
+        streamCopy(dst, src, size);
+        return;
+    }
+#endif
+    memcpy(dst, src, size);
+}
+
+//plane 0 is always luma, NV12 keeps interleaved UV in plane 1
+static bool getChromaPlanes(uint32_t fourcc, uint32_t & uPlane, uint32_t & vPlane)
+{
+    switch (fourcc) {
+    case VAAPI_IMAGE_NV12:
+        uPlane = vPlane = 1;
+        return true;
+    case VAAPI_IMAGE_I420:
+        uPlane = 1;
+        vPlane = 2;
+        return true;
+    case VAAPI_IMAGE_YV12:
+        uPlane = 2;
+        vPlane = 1;
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+static void copyPlane(uint8_t * dst, uint32_t dstPitch,
+                      const uint8_t * src, uint32_t srcPitch,
+                      uint32_t width, uint32_t height)
+{
+    if (dstPitch == srcPitch && width + 64 > srcPitch) {
+        //padding is small, copy the plane in one go
+        vaapiCopyFromMapped(dst, src, srcPitch * (height - 1) + width);
+        return;
+    }
+    for (uint32_t i = 0; i < height; i++) {
+        vaapiCopyFromMapped(dst, src, width);
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+bool vaapiCopyImageRaw(const VaapiImageRaw * src, uint32_t fourcc,
+                       uint8_t * dst, const uint32_t dstPitches[3],
+                       const uint32_t dstOffsets[3])
+{
+    uint32_t srcU, srcV, dstU, dstV;
+    if (!getChromaPlanes(src->format, srcU, srcV)
+        || !getChromaPlanes(fourcc, dstU, dstV)) {
+        ERROR("unsupported copy from %.4s to %.4s",
+              (const char *) &src->format, (const char *) &fourcc);
+        return false;
+    }
+
+    uint32_t width = src->width;
+    uint32_t height = src->height;
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    bool srcInterleaved = srcU == srcV;
+    bool dstInterleaved = dstU == dstV;
+
+    copyPlane(dst + dstOffsets[0], dstPitches[0],
+              src->pixels[0], src->strides[0], width, height);
+
+    if (srcInterleaved && dstInterleaved) {
+        copyPlane(dst + dstOffsets[1], dstPitches[1],
+                  src->pixels[1], src->strides[1], chromaWidth * 2, chromaHeight);
+    } else if (!srcInterleaved && !dstInterleaved) {
+        copyPlane(dst + dstOffsets[dstU], dstPitches[dstU],
+                  src->pixels[srcU], src->strides[srcU], chromaWidth, chromaHeight);
+        copyPlane(dst + dstOffsets[dstV], dstPitches[dstV],
+                  src->pixels[srcV], src->strides[srcV], chromaWidth, chromaHeight);
+    } else if (srcInterleaved) {
+        //pull each row to cached memory first, then split it
+        std::vector<uint8_t> row(chromaWidth * 2);
+        const uint8_t *uv = src->pixels[1];
+        uint8_t *u = dst + dstOffsets[dstU];
+        uint8_t *v = dst + dstOffsets[dstV];
+        for (uint32_t i = 0; i < chromaHeight; i++) {
+            vaapiCopyFromMapped(&row[0], uv, chromaWidth * 2);
+            for (uint32_t j = 0; j < chromaWidth; j++) {
+                u[j] = row[2 * j];
+                v[j] = row[2 * j + 1];
+            }
+            uv += src->strides[1];
+            u += dstPitches[dstU];
+            v += dstPitches[dstV];
+        }
+    } else {
+        std::vector<uint8_t> rowU(chromaWidth);
+        std::vector<uint8_t> rowV(chromaWidth);
+        const uint8_t *u = src->pixels[srcU];
+        const uint8_t *v = src->pixels[srcV];
+        uint8_t *uv = dst + dstOffsets[1];
+        for (uint32_t i = 0; i < chromaHeight; i++) {
+            vaapiCopyFromMapped(&rowU[0], u, chromaWidth);
+            vaapiCopyFromMapped(&rowV[0], v, chromaWidth);
+            for (uint32_t j = 0; j < chromaWidth; j++) {
+                uv[2 * j] = rowU[j];
+                uv[2 * j + 1] = rowV[j];
+            }
+            u += src->strides[srcU];
+            v += src->strides[srcV];
+            uv += dstPitches[1];
+        }
+    }
+    return true;
+}
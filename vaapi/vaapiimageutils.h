@@ -0,0 +1,40 @@
+/*
+ *  vaapiimageutils.h - helpers to copy mapped VA images to system memory
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef vaapiimageutils_h
+#define vaapiimageutils_h
+
+#include "vaapiimage.h"
+#include <stdint.h>
+
+/// copy @size bytes out of mapped surface memory.
+/// mapped surfaces are usually uncached (USWC), ordinary loads from there
+/// are very slow, so SSE4.1 streaming loads are used when cpu has them.
+void vaapiCopyFromMapped(uint8_t * dst, const uint8_t * src, uint32_t size);
+
+/// copy a mapped NV12/I420/YV12 image to client memory.
+/// @fourcc is the client layout, one of VAAPI_IMAGE_NV12/I420/YV12,
+/// @dstPitches and @dstOffsets describe each plane of @dst.
+bool vaapiCopyImageRaw(const VaapiImageRaw * src, uint32_t fourcc,
+                       uint8_t * dst, const uint32_t dstPitches[3],
+                       const uint32_t dstOffsets[3]);
+
+#endif                          /* vaapiimageutils_h */
@@ -29,6 +29,9 @@ typedef std::tr1::shared_ptr < VaapiSurface > SurfacePtr;
 class VaapiCodedBuffer;
 typedef std::tr1::shared_ptr < VaapiCodedBuffer > CodedBufferPtr;
 
+class VaapiCodedBufferPool;
+typedef std::tr1::shared_ptr < VaapiCodedBufferPool > CodedBufferPoolPtr;
+
 class VaapiBufObject;
 typedef std::tr1::shared_ptr < VaapiBufObject > BufObjectPtr;
 
@@ -41,10 +44,15 @@ typedef std::tr1::shared_ptr < VaapiConfig > ConfigPtr;
 class VaapiContext;
 typedef std::tr1::shared_ptr < VaapiContext > ContextPtr;
 
+class VaapiVpp;
+typedef std::tr1::shared_ptr < VaapiVpp > VppPtr;
+
 //TODO: fix this when we put all Vaapi* classes list above to YamiMediaCodec
 namespace YamiMediaCodec {
 class VaapiDecSurfacePool;
 typedef std::tr1::shared_ptr < VaapiDecSurfacePool > DecSurfacePoolPtr;
+class VaapiEncSurfacePool;
+typedef std::tr1::shared_ptr < VaapiEncSurfacePool > EncSurfacePoolPtr;
 } //namespace YamiMediaCodec
 
 #endif                          /* vaapiptr_h */
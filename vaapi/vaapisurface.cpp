@@ -73,6 +73,19 @@ SurfacePtr VaapiSurface::create(const DisplayPtr& display,
 
     format = vaapiChromaToVaChroma(chromaType);
     uint32_t externalBufHandle = 0;
+    //plain surfaces, and surfaces asking for a pixel format only, come from
+    //the display's shared allocator
+    if (!surfAttribs
+        || (surfAttribNum == 1 && surfAttribs[0].type == VASurfaceAttribPixelFormat)) {
+        uint32_t fourcc = surfAttribs ? surfAttribs[0].value.value.i : 0;
+        if (!display->allocSurface(format, fourcc, width, height, id))
+            return surface;
+        surface.reset(new VaapiSurface(display, id, chromaType,
+                                       width, height, externalBufHandle));
+        surface->m_fourcc = fourcc;
+        surface->m_shared = true;
+        return surface;
+    }
     status = vaCreateSurfaces(display->getID(), format, width, height,
                               &id, 1, surfAttribs, surfAttribNum);
     if (!checkVaapiStatus(status, "vaCreateSurfacesWithAttribute()"))
@@ -100,7 +113,7 @@ VaapiSurface::VaapiSurface(const DisplayPtr& display,
                            uint32_t height, uint32_t externalBufHandle)
 :m_display(display), m_chromaType(chromaType), m_width(width),
 m_height(height),m_externalBufHandle(externalBufHandle), m_ID(id),
-m_derivedImage(NULL)
+m_fourcc(0), m_derivedImage(NULL), m_shared(false)
 {
 
 }
@@ -111,6 +124,11 @@ VaapiSurface::~VaapiSurface()
 
     delete m_derivedImage;
 
+    if (m_shared) {
+        m_display->freeSurface(vaapiChromaToVaChroma(m_chromaType), m_fourcc,
+                               m_width, m_height, m_ID);
+        return;
+    }
     status = vaDestroySurfaces(m_display->getID(), &m_ID, 1);
 
     if (!checkVaapiStatus(status, "vaDestroySurfaces()"))
@@ -217,6 +235,14 @@ VaapiImage *VaapiSurface::getDerivedImage()
     return m_derivedImage;
 }
 
+void VaapiSurface::releaseExportedImage()
+{
+    if (!m_derivedImage || !m_derivedImage->isExported())
+        return;
+    delete m_derivedImage;
+    m_derivedImage = NULL;
+}
+
 bool VaapiSurface::sync()
 {
     VAStatus status;
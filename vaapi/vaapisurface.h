@@ -71,6 +71,8 @@ class VaapiSurface {
     bool getImage(VaapiImage * image);
     bool putImage(VaapiImage * image);
     VaapiImage *getDerivedImage();
+    /// destroy the derived image if its buffer is exported, the exported handle goes with it
+    void releaseExportedImage();
 
   private:
     VaapiSurface(const DisplayPtr&,
@@ -89,6 +91,7 @@ class VaapiSurface {
     uint32_t m_fourcc;
     uint32_t m_externalBufHandle;   //allocate surface from extenal buf
     VaapiImage *m_derivedImage;
+    bool m_shared;              //allocated from display, give it back there
 };
 
 #endif                          /* VAAPI_SURFACE_H */
@@ -0,0 +1,92 @@
+/*
+ *  vaapivpp.cpp - video post processing, scaling for now
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vaapivpp.h"
+#include "common/log.h"
+#include "vaapibuffer.h"
+#include "vaapicontext.h"
+#include "vaapidisplay.h"
+#include "vaapisurface.h"
+#include "vaapiutils.h"
+#include <string.h>
+#include <va/va_vpp.h>
+
+VppPtr VaapiVpp::create(const DisplayPtr& display, uint32_t width, uint32_t height)
+{
+    VppPtr vpp;
+    ConfigPtr config = VaapiConfig::create(display, VAProfileNone, VAEntrypointVideoProc, NULL, 0);
+    if (!config) {
+        ERROR("no video processing entrypoint");
+        return vpp;
+    }
+    ContextPtr context = VaapiContext::create(config, width, height, 0, NULL, 0);
+    if (!context) {
+        ERROR("failed to create video processing context");
+        return vpp;
+    }
+    vpp.reset(new VaapiVpp(display, context));
+    return vpp;
+}
+
+VaapiVpp::VaapiVpp(const DisplayPtr& display, const ContextPtr& context)
+:m_display(display), m_context(context)
+{
+}
+
+bool VaapiVpp::process(const SurfacePtr& src, const SurfacePtr& dest)
+{
+    VAProcPipelineParameterBuffer* param;
+    BufObjectPtr buffer = VaapiBufObject::create(m_context, VAProcPipelineParameterBufferType,
+                                                 sizeof(VAProcPipelineParameterBuffer), NULL, (void**)&param);
+    if (!buffer)
+        return false;
+
+    VARectangle srcRect, destRect;
+    srcRect.x = srcRect.y = 0;
+    srcRect.width = src->getWidth();
+    srcRect.height = src->getHeight();
+    destRect.x = destRect.y = 0;
+    destRect.width = dest->getWidth();
+    destRect.height = dest->getHeight();
+
+    memset(param, 0, sizeof(*param));
+    param->surface = src->getID();
+    param->surface_region = &srcRect;
+    param->output_region = &destRect;
+    param->filter_flags = VA_FILTER_SCALING_DEFAULT;
+    buffer->unmap();
+
+    VADisplay display = m_display->getID();
+    VAContextID context = m_context->getID();
+    VABufferID id = buffer->getID();
+    VAStatus status = vaBeginPicture(display, context, dest->getID());
+    if (!checkVaapiStatus(status, "vaBeginPicture()"))
+        return false;
+    status = vaRenderPicture(display, context, &id, 1);
+    bool ret = checkVaapiStatus(status, "vaRenderPicture()");
+    status = vaEndPicture(display, context);
+    return checkVaapiStatus(status, "vaEndPicture()") && ret;
+}
@@ -0,0 +1,44 @@
+/*
+ *  vaapivpp.h - video post processing, scaling for now
+ *
+ *  Copyright (C) 2014 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef vaapivpp_h
+#define vaapivpp_h
+
+#include "vaapi/vaapiptrs.h"
+#include "vaapi/vaapitypes.h"
+
+/// VAEntrypointVideoProc on a display, used to scale surfaces on gpu
+class VaapiVpp
+{
+public:
+    static VppPtr create(const DisplayPtr&, uint32_t width, uint32_t height);
+    /// scale whole @src to whole @dest, both of them must belong to the display
+    bool process(const SurfacePtr& src, const SurfacePtr& dest);
+
+private:
+    VaapiVpp(const DisplayPtr&, const ContextPtr&);
+    DisplayPtr m_display;
+    ContextPtr m_context;
+    DISALLOW_COPY_AND_ASSIGN(VaapiVpp);
+};
+
+#endif                          /* vaapivpp_h */